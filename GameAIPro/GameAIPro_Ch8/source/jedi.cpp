@@ -8,10 +8,51 @@
 //
 ///////////////////////////////////////////////////////////////////////////////
 
+// give each jedi its own random stream
+static unsigned int takeNextAiRandomSeed() {
+	static unsigned int nextAiRandomSeed = 0;
+	return nextAiRandomSeed++;
+}
+
 CJedi::CJedi() {
+
+	// give each jedi its own random stream
+	aiRandomSeed = takeNextAiRandomSeed();
+
+	// think for myself until a pipeline takes over
+	aiPipelined = false;
+
+	// stay awake until setup
+	aiWakeScheduler = NULL;
+	memset(&aiSleeper, 0, sizeof(aiSleeper));
+	aiSleeper.actor = this;
+	aiSleeper.sleeperIndex = -1;
+	aiSleeper.wheelSlot = -1;
+}
+
+void CJedi::initClone() {
+
+	// my random stream is my own
+	aiRandomSeed = takeNextAiRandomSeed();
+
+	// my AI starts out as if it had just been constructed
+	aiMemory.currentTime = ::getTime();
 }
 
 CJedi::~CJedi() {
+
+	// the wake scheduler can't keep a sleeper that's gone
+	if (aiWakeScheduler != NULL) {
+		aiWakeScheduler->wake(aiSleeper);
+	}
+
+	// let go of the world snapshot my AI was sensing from
+	aiMemory.releaseWorldSnapshot();
+
+	// give back any tokens my AI was holding
+	if (aiMemory.tokenBoard != NULL) {
+		aiMemory.tokenBoard->releaseAll(this);
+	}
 }
 
 
@@ -21,15 +62,156 @@ bool CJedi::setup() {
 
 	// setup my AI behavior tree
 	aiMemory.selfState.jedi = this;
-	aiCombatAction.init(&aiMemory);
+	aiMemory.random.seed(aiRandomSeed);
+	aiMemory.queryBatch = &aiQueryBatch;
+	aiMemory.tokenBoard = &gJediAiTokenBoard;
+	aiMemory.latentFramePool = &aiLatentFramePool;
+	if (aiCombatAction.memory != &aiMemory) {
+
+		// clones of a prototype come with their tree already pointing at their memory
+		aiCombatAction.init(&aiMemory);
+	}
+	aiWakeScheduler = &gJediAiWakeScheduler;
 
 	// success!
 	return true;
 }
 
 void CJedi::process(float dt) {
+
+	// if my AI is pipelined, the pipeline thinks for me and applies my commands
+	if (aiPipelined) {
+		return;
+	}
+
+	// sense and think
+	// if this runs on a worker thread, the game thread calls applyAiCommands() at its sync point instead
+	think(dt);
+
+	// act
+	applyAiCommands();
+}
+
+void CJedi::think(float dt) {
+
+	// if my AI is asleep, nothing it's waiting for has happened yet
+	// keep track of how long it has slept, so its timers catch up when it wakes
+	if (aiWakeScheduler != NULL && aiWakeScheduler->isAsleep(aiSleeper)) {
+		aiSleeper.sleptDt += dt;
+		aiSleeper.skippedThinkCount++;
+		return;
+	}
+
+	// when pipelined, my commands are applied a frame after the world I sense
+	// that's one frame however long I slept, so use the frame's dt before the catch-up is added
+	aiMemory.senseLatency = (aiPipelined ? dt : 0.0f);
+	dt += aiSleeper.sleptDt;
+	aiSleeper.sleptDt = 0.0f;
 	aiMemory.update(dt);
 	aiCombatAction.update(dt);
+
+	// if my AI is only waiting for something to happen, sleep until it does
+	SJediAiWakeCondition wakeCondition;
+	if (aiWakeScheduler != NULL && aiCombatAction.canSleep(wakeCondition)) {
+		aiSleeper.victim = aiMemory.victim;
+		aiSleeper.hitPoints = aiMemory.selfState.hitPoints;
+		aiSleeper.stateBitfield = aiMemory.selfState.currentStateBitfield;
+		aiSleeper.rememberThreats(aiMemory.worldSnapshot);
+		if (aiWakeScheduler->sleep(aiSleeper, wakeCondition, aiMemory.currentTime)) {
+
+			// don't hold on to a world snapshot while asleep, the publisher needs it back
+			aiMemory.releaseWorldSnapshot();
+		}
+	}
+}
+
+void CJedi::applyAiCommands() {
+	SJediAiCommand command;
+	while (aiCommandQueue.pop(command)) {
+		applyAiCommand(command);
+	}
+}
+
+void CJedi::applyAiCommand(const SJediAiCommand &command) {
+	switch (command.type) {
+		case eJediAiCommand_Stop:
+			stop(command.stop.callingFunctionName);
+			break;
+		case eJediAiCommand_PassNearPoint:
+			passNearPoint(CVector(command.passNearPoint.wPoint[0], command.passNearPoint.wPoint[1], command.passNearPoint.wPoint[2]), command.passNearPoint.distanceFromTarget, command.passNearPoint.run, command.passNearPoint.callingFunctionName);
+			break;
+		case eJediAiCommand_SetDesiredMoveSpeed:
+			setDesiredMoveSpeed(command.setDesiredMoveSpeed.speed);
+			break;
+		case eJediAiCommand_StandDefensive:
+			setCommandJediStandDefensive();
+			break;
+		case eJediAiCommand_Strafe:
+			setCommandJediStrafe();
+			break;
+		case eJediAiCommand_SwingSaber:
+			setCommandJediSwingSaber(command.swingSaber.dir);
+			break;
+		case eJediAiCommand_Dodge:
+			setCommandJediDodge(command.dodge.dir, command.dodge.attack);
+			break;
+		case eJediAiCommand_DodgeFlip:
+			setCommandJediDodgeFlip(command.dodge.dir);
+			break;
+		case eJediAiCommand_Dash:
+			setCommandJediDash(command.dash.target, command.dash.distanceToTarget, command.dash.attack);
+			break;
+		case eJediAiCommand_ForcePushCharge:
+			setCommandJediForcePushCharge();
+			break;
+		case eJediAiCommand_ForcePushThrow:
+			setCommandJediForcePushThrow();
+			break;
+		case eJediAiCommand_ForceTkGrip:
+			setCommandJediForceTkGrip(command.forceTkGrip.target, command.forceTkGrip.twoHand, command.forceTkGrip.holdHeight, command.forceTkGrip.skipEnter);
+			break;
+		case eJediAiCommand_ForceTkThrow:
+			setCommandJediForceTkThrow(CVector(command.forceTkThrow.iThrowVelocity[0], command.forceTkThrow.iThrowVelocity[1], command.forceTkThrow.iThrowVelocity[2]));
+			break;
+		case eJediAiCommand_ForceTkThrowAtTarget:
+			setCommandJediForceTkThrowAtTarget(command.actor.target);
+			break;
+		case eJediAiCommand_JumpOver:
+			setCommandJediJumpOver(command.jumpOver.target, command.jumpOver.attack);
+			break;
+		case eJediAiCommand_JumpForward:
+			setCommandJediJumpForward(command.jumpForward.target, command.jumpForward.attack, command.jumpForward.distance);
+			break;
+		case eJediAiCommand_Crouch:
+			setCommandJediCrouch();
+			break;
+		case eJediAiCommand_CrouchAttack:
+			setCommandJediCrouchAttack();
+			break;
+		case eJediAiCommand_Kick:
+			setCommandJediKick(command.kick.allowDisplacement);
+			break;
+		case eJediAiCommand_Deflect:
+			setCommandJediDeflect(command.deflect.deflectAtEnemies);
+			break;
+		case eJediAiCommand_Block:
+			setCommandJediBlock(command.block.dir);
+			break;
+		case eJediAiCommand_Taunt:
+			setCommandJediTaunt();
+			break;
+		case eJediAiCommand_TauntActor:
+			if (command.actor.target != NULL) {
+				command.actor.target->taunt();
+			}
+			break;
+		case eJediAiCommand_SetCurrentTarget:
+			setCurrentTarget(command.actor.target);
+			break;
+		default:
+			error("CJedi::applyAiCommand() - Unknown command type (%d)", command.type);
+			break;
+	}
 }
 
 bool CJedi::isDefensiveModeEnabled() const {
@@ -340,3 +522,192 @@ void CJedi::setCommandJediBlockImpact() {
 void CJedi::setCommandJediTaunt() {
 	setCommand(eCommandTaunt);
 }
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// CJediAiCommandQueue class
+//
+///////////////////////////////////////////////////////////////////////////////
+
+CJediAiCommandQueue::CJediAiCommandQueue() {
+	droppedCommandCount = 0;
+}
+
+void CJediAiCommandQueue::push(const SJediAiCommand &command) {
+
+	// if the game thread has fallen this far behind, the command is stale anyway
+	if (!ring.push(command)) {
+		++droppedCommandCount;
+	}
+}
+
+void CJediAiCommandQueue::pushCommand(EJediAiCommand type) {
+	SJediAiCommand command;
+	command.type = type;
+	push(command);
+}
+
+void CJediAiCommandQueue::stop(const char *callingFunctionName) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_Stop;
+	command.stop.callingFunctionName = callingFunctionName;
+	push(command);
+}
+
+void CJediAiCommandQueue::passNearPoint(const CVector &point, float distanceFromTarget, bool run, const char *callingFunctionName) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_PassNearPoint;
+	command.passNearPoint.wPoint[0] = point.x;
+	command.passNearPoint.wPoint[1] = point.y;
+	command.passNearPoint.wPoint[2] = point.z;
+	command.passNearPoint.distanceFromTarget = distanceFromTarget;
+	command.passNearPoint.run = run;
+	command.passNearPoint.callingFunctionName = callingFunctionName;
+	push(command);
+}
+
+void CJediAiCommandQueue::setDesiredMoveSpeed(float desMoveSpeed) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_SetDesiredMoveSpeed;
+	command.setDesiredMoveSpeed.speed = desMoveSpeed;
+	push(command);
+}
+
+void CJediAiCommandQueue::setCommandJediStandDefensive() {
+	pushCommand(eJediAiCommand_StandDefensive);
+}
+
+void CJediAiCommandQueue::setCommandJediStrafe() {
+	pushCommand(eJediAiCommand_Strafe);
+}
+
+void CJediAiCommandQueue::setCommandJediSwingSaber(EJediSwingSaberDir dir) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_SwingSaber;
+	command.swingSaber.dir = dir;
+	push(command);
+}
+
+void CJediAiCommandQueue::setCommandJediDodge(EJediDodgeDir dir, bool attack) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_Dodge;
+	command.dodge.dir = dir;
+	command.dodge.attack = attack;
+	push(command);
+}
+
+void CJediAiCommandQueue::setCommandJediDodgeFlip(EJediDodgeDir dir) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_DodgeFlip;
+	command.dodge.dir = dir;
+	command.dodge.attack = false;
+	push(command);
+}
+
+void CJediAiCommandQueue::setCommandJediDash(CActor *target, float distanceToTarget, bool attack) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_Dash;
+	command.dash.target = target;
+	command.dash.distanceToTarget = distanceToTarget;
+	command.dash.attack = attack;
+	push(command);
+}
+
+void CJediAiCommandQueue::setCommandJediForcePushCharge() {
+	pushCommand(eJediAiCommand_ForcePushCharge);
+}
+
+void CJediAiCommandQueue::setCommandJediForcePushThrow() {
+	pushCommand(eJediAiCommand_ForcePushThrow);
+}
+
+void CJediAiCommandQueue::setCommandJediForceTkGrip(CActor *target, bool twoHand, float holdHeight, bool skipEnter) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_ForceTkGrip;
+	command.forceTkGrip.target = target;
+	command.forceTkGrip.twoHand = twoHand;
+	command.forceTkGrip.skipEnter = skipEnter;
+	command.forceTkGrip.holdHeight = holdHeight;
+	push(command);
+}
+
+void CJediAiCommandQueue::setCommandJediForceTkThrow(const CVector &iThrowVelocity) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_ForceTkThrow;
+	command.forceTkThrow.iThrowVelocity[0] = iThrowVelocity.x;
+	command.forceTkThrow.iThrowVelocity[1] = iThrowVelocity.y;
+	command.forceTkThrow.iThrowVelocity[2] = iThrowVelocity.z;
+	push(command);
+}
+
+void CJediAiCommandQueue::setCommandJediForceTkThrowAtTarget(CActor *target) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_ForceTkThrowAtTarget;
+	command.actor.target = target;
+	push(command);
+}
+
+void CJediAiCommandQueue::setCommandJediJumpOver(CActor *target, bool attack) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_JumpOver;
+	command.jumpOver.target = target;
+	command.jumpOver.attack = attack;
+	push(command);
+}
+
+void CJediAiCommandQueue::setCommandJediJumpForward(CActor *target, EJediAiJumpForwardAttack attack, float distance) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_JumpForward;
+	command.jumpForward.target = target;
+	command.jumpForward.attack = attack;
+	command.jumpForward.distance = distance;
+	push(command);
+}
+
+void CJediAiCommandQueue::setCommandJediCrouch() {
+	pushCommand(eJediAiCommand_Crouch);
+}
+
+void CJediAiCommandQueue::setCommandJediCrouchAttack() {
+	pushCommand(eJediAiCommand_CrouchAttack);
+}
+
+void CJediAiCommandQueue::setCommandJediKick(bool allowDisplacement) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_Kick;
+	command.kick.allowDisplacement = allowDisplacement;
+	push(command);
+}
+
+void CJediAiCommandQueue::setCommandJediDeflect(bool deflectAtEnemies) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_Deflect;
+	command.deflect.deflectAtEnemies = deflectAtEnemies;
+	push(command);
+}
+
+void CJediAiCommandQueue::setCommandJediBlock(EJediBlockDir dir) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_Block;
+	command.block.dir = dir;
+	push(command);
+}
+
+void CJediAiCommandQueue::setCommandJediTaunt() {
+	pushCommand(eJediAiCommand_Taunt);
+}
+
+void CJediAiCommandQueue::tauntActor(CActor *actor) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_TauntActor;
+	command.actor.target = actor;
+	push(command);
+}
+
+void CJediAiCommandQueue::setCurrentTarget(CActor *target) {
+	SJediAiCommand command;
+	command.type = eJediAiCommand_SetCurrentTarget;
+	command.actor.target = target;
+	push(command);
+}
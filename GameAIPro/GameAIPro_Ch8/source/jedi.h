@@ -9,10 +9,188 @@
 	#include "jedi_ai_actions.h"
 #endif
 
+#ifndef __JEDI_AI_LATENT__
+	#include "jedi_ai_latent.h"
+#endif
+
 #ifndef __JEDI_AI_MEMORY__
 	#include "jedi_ai_memory.h"
 #endif
 
+#ifndef __JEDI_AI_QUERY_BATCH__
+	#include "jedi_ai_query_batch.h"
+#endif
+
+#ifndef __JEDI_AI_TOKENS__
+	#include "jedi_ai_tokens.h"
+#endif
+
+#ifndef __JEDI_AI_WAKE__
+	#include "jedi_ai_wake.h"
+#endif
+
+#ifndef __SPSC_RING__
+	#include "spsc_ring.h"
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// AI commands
+// the AI doesn't call the jedi's commands directly, it queues them up
+// the game thread applies them at a fixed point in the frame, so the AI can think on another thread
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// AI command types
+enum EJediAiCommand {
+	eJediAiCommand_Stop,
+	eJediAiCommand_PassNearPoint,
+	eJediAiCommand_SetDesiredMoveSpeed,
+	eJediAiCommand_StandDefensive,
+	eJediAiCommand_Strafe,
+	eJediAiCommand_SwingSaber,
+	eJediAiCommand_Dodge,
+	eJediAiCommand_DodgeFlip,
+	eJediAiCommand_Dash,
+	eJediAiCommand_ForcePushCharge,
+	eJediAiCommand_ForcePushThrow,
+	eJediAiCommand_ForceTkGrip,
+	eJediAiCommand_ForceTkThrow,
+	eJediAiCommand_ForceTkThrowAtTarget,
+	eJediAiCommand_JumpOver,
+	eJediAiCommand_JumpForward,
+	eJediAiCommand_Crouch,
+	eJediAiCommand_CrouchAttack,
+	eJediAiCommand_Kick,
+	eJediAiCommand_Deflect,
+	eJediAiCommand_Block,
+	eJediAiCommand_Taunt,
+	eJediAiCommand_TauntActor,
+	eJediAiCommand_SetCurrentTarget,
+	eJediAiCommand_Count
+};
+
+// a queued AI command and its params
+// vectors are stored as floats so the params can share a union
+struct SJediAiCommand {
+	EJediAiCommand type;
+	union {
+		struct {
+			const char *callingFunctionName;
+		} stop;
+		struct {
+			float wPoint[3];
+			float distanceFromTarget;
+			bool run;
+			const char *callingFunctionName;
+		} passNearPoint;
+		struct {
+			float speed;
+		} setDesiredMoveSpeed;
+		struct {
+			EJediSwingSaberDir dir;
+		} swingSaber;
+		struct {
+			EJediDodgeDir dir;
+			bool attack;
+		} dodge; // also used for dodge flip
+		struct {
+			CActor *target;
+			float distanceToTarget;
+			bool attack;
+		} dash;
+		struct {
+			CActor *target;
+			bool twoHand;
+			bool skipEnter;
+			float holdHeight;
+		} forceTkGrip;
+		struct {
+			float iThrowVelocity[3];
+		} forceTkThrow;
+		struct {
+			CActor *target;
+			bool attack;
+		} jumpOver;
+		struct {
+			CActor *target;
+			EJediAiJumpForwardAttack attack;
+			float distance;
+		} jumpForward;
+		struct {
+			bool allowDisplacement;
+		} kick;
+		struct {
+			bool deflectAtEnemies;
+		} deflect;
+		struct {
+			EJediBlockDir dir;
+		} block;
+		struct {
+			CActor *target;
+		} actor; // force tk throw at target, taunt actor, set current target
+	};
+};
+
+// a jedi's queue of AI commands
+// the AI pushes and the game thread pops, so each side only ever touches its own end
+// these mirror the jedi's commands, so the AI code reads the same either way
+class CJediAiCommandQueue {
+public:
+
+	// command ring
+	enum { kCommandRingSize = 64 };
+	CSpscRing<SJediAiCommand, kCommandRingSize> ring;
+
+	// how many commands were lost because the ring was full?
+	int droppedCommandCount;
+
+	// construction
+	CJediAiCommandQueue();
+
+	// queue a command
+	void push(const SJediAiCommand &command);
+
+	// queue a command with no params
+	void pushCommand(EJediAiCommand type);
+
+	// get the next command (false if there isn't one)
+	bool pop(SJediAiCommand &command) { return ring.pop(command); }
+
+	// movement
+	void stop(const char *callingFunctionName);
+	void passNearPoint(const CVector &point, float distanceFromTarget, bool run, const char *callingFunctionName);
+	void setDesiredMoveSpeed(float desMoveSpeed);
+
+	// jedi commands
+	void setCommandJediStandDefensive();
+	void setCommandJediStrafe();
+	void setCommandJediSwingSaber(EJediSwingSaberDir dir = eJediSwingSaberDir_Auto);
+	void setCommandJediDodge(EJediDodgeDir dir, bool attack);
+	void setCommandJediDodgeFlip(EJediDodgeDir dir);
+	void setCommandJediDash(CActor *target, float distanceToTarget, bool attack);
+	void setCommandJediForcePushCharge();
+	void setCommandJediForcePushThrow();
+	void setCommandJediForceTkGrip(CActor *target, bool twoHand, float holdHeight = 1.0f, bool skipEnter = false);
+	void setCommandJediForceTkThrow(const CVector &iThrowVelocity);
+	void setCommandJediForceTkThrowAtTarget(CActor *target);
+	void setCommandJediJumpOver(CActor *target, bool attack);
+	void setCommandJediJumpForward(CActor *target, EJediAiJumpForwardAttack attack, float distance = 0.0f);
+	void setCommandJediCrouch();
+	void setCommandJediCrouchAttack();
+	void setCommandJediKick(bool allowDisplacement = true);
+	void setCommandJediDeflect(bool deflectAtEnemies);
+	void setCommandJediBlock(EJediBlockDir dir);
+	void setCommandJediTaunt();
+
+	// tell another actor it has been taunted
+	void tauntActor(CActor *actor);
+
+	// change who I'm targeting
+	void setCurrentTarget(CActor *target);
+};
+
 
 ///////////////////////////////////////////////////////////////////////////////
 //
@@ -27,6 +205,9 @@ public:
 	CJedi();
 	virtual ~CJedi();
 
+	// fill in what a clone of a prototype jedi can't share with it (see CJediPrototype)
+	void initClone();
+
 	// setup this jedi
 	virtual bool setup();
 
@@ -68,10 +249,44 @@ public:
 	// is this jedi under ai control?
 	virtual bool isAiControlled() const { return true; }
 
+	// the coroutine frames of my AI's latent actions
+	// this comes before my AI data, so it outlives the actions using it
+	CJediAiLatentFramePool aiLatentFramePool;
+
 	// AI data
 	CJediAiMemory aiMemory;
 	CJediAiActionCombat aiCombatAction;
 
+	// the engine queries my AI makes while selecting
+	CJediAiEngineQueryBatch aiQueryBatch;
+
+	// commands my AI has queued up for me
+	CJediAiCommandQueue aiCommandQueue;
+
+	// is my AI run by a think pipeline?
+	// if so, process() leaves thinking and applying my commands to the pipeline
+	bool aiPipelined;
+
+	// the wake scheduler my AI sleeps with (NULL if it never sleeps)
+	// when my AI is only waiting for something to happen, it sleeps until it does instead of thinking every frame
+	CJediAiWakeScheduler *aiWakeScheduler;
+	SJediAiSleeper aiSleeper;
+
+	// sense and think, queueing up commands for the game thread to apply
+	// this may run on any thread
+	void think(float dt);
+
+	// apply the commands my AI has queued up
+	// this must be called on the game thread
+	void applyAiCommands();
+
+	// apply a single AI command
+	void applyAiCommand(const SJediAiCommand &command);
+
+	// seed for my AI's random stream (applied in setup())
+	// each jedi gets a different one by default so they don't all make the same choices
+	unsigned int aiRandomSeed;
+
 	// is this jedi a padawan?
 	bool isPadawan() const { return false; }
 
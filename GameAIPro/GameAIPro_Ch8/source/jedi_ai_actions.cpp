@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "jedi_ai_actions.h"
 #include "jedi_ai_memory.h"
+#include "jedi_ai_query_batch.h"
+#include "jedi_ai_tokens.h"
 #include "jedi.h"
 
 
@@ -49,6 +51,7 @@ CJediAiAction::CJediAiAction() {
 	constraint = NULL;
 	lastRunTime = 0.0f;
 	minRunFrequency = 0.0f;
+	requiredTokens = 0;
 	memset(&simSummary, 0, sizeof(simSummary));
 	flags = 0;
 }
@@ -70,6 +73,7 @@ bool CJediAiAction::ensureInitialization() const {
 void CJediAiAction::reset() {
 	lastRunTime = 0.0f;
 	minRunFrequency = 0.0f;
+	requiredTokens = 0;
 	memset(&simSummary, 0, sizeof(simSummary));
 	if (constraint != NULL) {
 		constraint->reset();
@@ -91,6 +95,11 @@ EJediAiActionResult CJediAiAction::checkConstraints(const CJediAiMemory &simMemo
 		return eJediAiActionResult_Failure;
 	}
 
+	// if another jedi holds a token I need, I can't do this
+	if (requiredTokens != 0 && !simMemory.areTokensAvailable(requiredTokens)) {
+		return eJediAiActionResult_Failure;
+	}
+
 	// check our constraints
 	const CJediAiActionConstraint *nextConstraint = constraint;
 	while (nextConstraint != NULL) {
@@ -118,6 +127,12 @@ EJediAiActionResult CJediAiAction::onBegin() {
 		return result;
 	}
 
+	// claim my tokens
+	// if another jedi claimed one since I last sensed, I can't do this
+	if (requiredTokens != 0 && !memory->claimTokens(requiredTokens)) {
+		return eJediAiActionResult_Failure;
+	}
+
 	// we are now in progress
 	flags |= kFlag_InProgress;
 
@@ -130,6 +145,11 @@ void CJediAiAction::onEnd() {
 	// save off the time when we ended
 	lastRunTime = memory->currentTime;
 
+	// give back my tokens
+	if (requiredTokens != 0) {
+		memory->releaseTokens(requiredTokens);
+	}
+
 	// we are no longer in progress
 	flags &= ~kFlag_InProgress;
 }
@@ -157,6 +177,223 @@ void CJediAiAction::setIsNotSelectable(bool notSelectable) {
 	}
 }
 
+bool CJediAiAction::isSimulationEquivalent(const CJediAiAction &) const {
+
+	// we don't know what my params are, so we can't say
+	return false;
+}
+
+bool CJediAiAction::hasEquivalentSimulationSetup(const CJediAiAction &other) const {
+
+	// we must be the same type of action
+	if (getType() != other.getType()) {
+		return false;
+	}
+
+	// neither of us can be running, since we would simulate from where we are
+	if (isInProgress() || other.isInProgress()) {
+		return false;
+	}
+
+	// we can't tell if constraints are equivalent, so neither of us can have any
+	if (constraint != NULL || other.constraint != NULL) {
+		return false;
+	}
+
+	// our run frequencies must match
+	if (minRunFrequency != other.minRunFrequency) {
+		return false;
+	}
+	if (minRunFrequency > 0.0f && lastRunTime != other.lastRunTime) {
+		return false;
+	}
+	return true;
+}
+
+bool CJediAiAction::estimateSimulation(const CJediAiMemory &, SJediAiActionSimSummary &) const {
+
+	// by default, we must be simulated
+	return false;
+}
+
+bool CJediAiAction::canSleep(SJediAiWakeCondition &) const {
+
+	// by default, we must be updated every frame
+	return false;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// latent action
+//
+/////////////////////////////////////////////////////////////////////////////
+
+CJediAiActionLatent::CJediAiActionLatent() {
+	latentData.timer = 0.0f;
+	memset(&latentData.awaiter, 0, sizeof(latentData.awaiter));
+	latentData.result = eJediAiActionResult_Failure;
+}
+
+CJediAiActionLatent::~CJediAiActionLatent() {
+	destroyTask();
+}
+
+void CJediAiActionLatent::reset() {
+
+	// base class version
+	BASECLASS::reset();
+
+	// stop my coroutine
+	destroyTask();
+}
+
+EJediAiActionResult CJediAiActionLatent::onBegin() {
+
+	// stop any coroutine left from last time
+	destroyTask();
+
+	// base class version
+	EJediAiActionResult result = BASECLASS::onBegin();
+	if (result != eJediAiActionResult_InProgress) {
+		return result;
+	}
+
+	// begin my coroutine
+	// it doesn't run until my first update
+	latentData.result = eJediAiActionResult_InProgress;
+	latentData.task = run();
+	if (!latentData.task.handle) {
+		latentData.result = eJediAiActionResult_Failure;
+		return latentData.result;
+	}
+
+	// in progress
+	return eJediAiActionResult_InProgress;
+}
+
+void CJediAiActionLatent::onEnd() {
+
+	// base class version
+	BASECLASS::onEnd();
+
+	// stop my coroutine
+	destroyTask();
+}
+
+void CJediAiActionLatent::updateTimers(float dt) {
+
+	// base class version
+	BASECLASS::updateTimers(dt);
+
+	// update my timer
+	if (latentData.task.handle) {
+		latentData.timer += dt;
+	}
+}
+
+EJediAiActionResult CJediAiActionLatent::update(float dt) {
+
+	// check constraints
+	EJediAiActionResult result = checkConstraints(*memory, false);
+	if (result != eJediAiActionResult_InProgress) {
+		return result;
+	}
+
+	// if what my coroutine is waiting for hasn't happened, there's nothing to do
+	if (!isWaitOver(latentData.awaiter)) {
+		return eJediAiActionResult_InProgress;
+	}
+
+	// otherwise, let it carry on
+	return resume();
+}
+
+SJediAiLatentAwaiter CJediAiActionLatent::nextUpdate() {
+	SJediAiLatentAwaiter awaiter;
+	memset(&awaiter, 0, sizeof(awaiter));
+	awaiter.action = this;
+	awaiter.wait = eJediAiLatentWait_None;
+	return awaiter;
+}
+
+SJediAiLatentAwaiter CJediAiActionLatent::waitForTime(float duration) {
+	SJediAiLatentAwaiter awaiter = nextUpdate();
+	awaiter.wait = eJediAiLatentWait_Time;
+	awaiter.endTime = (latentData.timer + duration);
+	return awaiter;
+}
+
+SJediAiLatentAwaiter CJediAiActionLatent::waitForState(EJediState state) {
+	SJediAiLatentAwaiter awaiter = nextUpdate();
+	awaiter.wait = eJediAiLatentWait_StateEnter;
+	awaiter.state = state;
+	return awaiter;
+}
+
+SJediAiLatentAwaiter CJediAiActionLatent::waitForStateExit(EJediState state) {
+	SJediAiLatentAwaiter awaiter = nextUpdate();
+	awaiter.wait = eJediAiLatentWait_StateExit;
+	awaiter.state = state;
+	return awaiter;
+}
+
+SJediAiLatentAwaiter CJediAiActionLatent::waitUntil(TJediAiLatentCondition condition) {
+	SJediAiLatentAwaiter awaiter = nextUpdate();
+	awaiter.wait = eJediAiLatentWait_Condition;
+	awaiter.condition = condition;
+	return awaiter;
+}
+
+bool CJediAiActionLatent::isWaitOver(const SJediAiLatentAwaiter &awaiter) const {
+	switch (awaiter.wait) {
+		case eJediAiLatentWait_None:
+			return true;
+		case eJediAiLatentWait_Time:
+			return (latentData.timer >= awaiter.endTime);
+		case eJediAiLatentWait_StateEnter:
+			return memory->isSelfInState(awaiter.state);
+		case eJediAiLatentWait_StateExit:
+			return !memory->isSelfInState(awaiter.state);
+		case eJediAiLatentWait_Condition:
+			return (awaiter.condition == NULL || awaiter.condition(*this));
+		default:
+			error("CJediAiActionLatent::isWaitOver() - Unknown wait type %d", awaiter.wait);
+			return true;
+	}
+}
+
+EJediAiActionResult CJediAiActionLatent::resume() {
+
+	// if my coroutine is done, it has already given its result
+	CJediAiLatentTask::THandle handle = latentData.task.handle;
+	if (!handle) {
+		return latentData.result;
+	}
+
+	// run it up to its next wait
+	// it waits for the next update unless it says otherwise
+	latentData.awaiter = nextUpdate();
+	handle.resume();
+	if (!handle.done()) {
+		return eJediAiActionResult_InProgress;
+	}
+
+	// it's done, so give its frame back right away
+	latentData.result = handle.promise().result;
+	destroyTask();
+	return latentData.result;
+}
+
+void CJediAiActionLatent::destroyTask() {
+	if (latentData.task.handle) {
+		latentData.task.handle.destroy();
+		latentData.task.handle = CJediAiLatentTask::THandle();
+	}
+	latentData.timer = 0.0f;
+	latentData.awaiter = nextUpdate();
+}
+
 
 /////////////////////////////////////////////////////////////////////////////
 //
@@ -498,6 +735,119 @@ bool CJediAiActionParallelBase::doesActionLoop(int actionIndex) const {
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+//
+// sequence prefix trie
+//
+/////////////////////////////////////////////////////////////////////////////
+
+CJediAiSequencePrefixTrie::CJediAiSequencePrefixTrie() {
+	nodeCount = 0;
+	memset(nodeList, 0, sizeof(nodeList));
+	memoryPoolIndex = 0;
+	memoryCount = 0;
+}
+
+CJediAiSequencePrefixTrie::~CJediAiSequencePrefixTrie() {
+
+	// give my memories back to the pool
+	if (memoryCount > 0) {
+		SMemoryPool &pool = getMemoryPool();
+		if (pool.usedCount != memoryPoolIndex + memoryCount) {
+			error("CJediAiSequencePrefixTrie::~CJediAiSequencePrefixTrie() - Memory pool released out of order");
+		}
+		pool.usedCount = memoryPoolIndex;
+	}
+}
+
+void CJediAiSequencePrefixTrie::addSequence(const CJediAiActionSequenceBase &sequence) {
+
+	// walk down the trie with each of my actions, adding nodes as we go
+	// a looping sequence comes back around to the start, so stop once we've been through all of them
+	int parentIndex = -1;
+	int nextActionIndex = 0;
+	while (true) {
+		int prevNextActionIndex = nextActionIndex;
+		const CJediAiAction *action = sequence.getNextAction(nextActionIndex);
+		if (action == NULL || nextActionIndex <= prevNextActionIndex) {
+			break;
+		}
+
+		// if another sequence already has this prefix, count us in
+		int nodeIndex = findNode(parentIndex, sequence, *action);
+		if (nodeIndex >= 0) {
+			nodeList[nodeIndex].sequenceCount++;
+
+		// otherwise, start a new prefix if there is room for it
+		} else {
+			if (nodeCount >= kNodeListSize) {
+				return;
+			}
+			nodeIndex = nodeCount++;
+			SNode &node = nodeList[nodeIndex];
+			node.parentIndex = parentIndex;
+			node.sequence = &sequence;
+			node.action = action;
+			node.sequenceCount = 1;
+		}
+		parentIndex = nodeIndex;
+	}
+}
+
+bool CJediAiSequencePrefixTrie::allocateSharedPrefixes() {
+
+	// how many prefixes are shared?
+	int sharedCount = 0;
+	for (int i = 0; i < nodeCount; ++i) {
+		if (nodeList[i].sequenceCount > 1) {
+			++sharedCount;
+		}
+	}
+	if (sharedCount == 0) {
+		return false;
+	}
+
+	// give each of them a memory from the pool, earlier prefixes first since everything after them depends on them
+	// every prefix is copied into its memory before it's read, so they don't need resetting
+	SMemoryPool &pool = getMemoryPool();
+	memoryPoolIndex = pool.usedCount;
+	memoryCount = min(sharedCount, kMemoryPoolSize - pool.usedCount);
+	pool.usedCount += memoryCount;
+	int memoryIndex = 0;
+	for (int i = 0; i < nodeCount && memoryIndex < memoryCount; ++i) {
+		if (nodeList[i].sequenceCount > 1) {
+			nodeList[i].memory = &pool.memoryTable[memoryPoolIndex + memoryIndex++];
+		}
+	}
+	return (memoryCount > 0);
+}
+
+CJediAiSequencePrefixTrie::SMemoryPool &CJediAiSequencePrefixTrie::getMemoryPool() {
+
+	// every thread gets its own pool, so ai threads never contend over it
+	static thread_local SMemoryPool pool;
+	return pool;
+}
+
+int CJediAiSequencePrefixTrie::findNode(int parentIndex, const CJediAiActionSequenceBase &sequence, const CJediAiAction &action) const {
+	for (int i = 0; i < nodeCount; ++i) {
+		const SNode &node = nodeList[i];
+		if (node.parentIndex != parentIndex) {
+			continue;
+		}
+
+		// the sequence itself must run its actions the same way as well
+		if (node.sequence != &sequence && !node.sequence->canSharePrefixWith(sequence)) {
+			continue;
+		}
+		if (node.action == &action || node.action->isSimulationEquivalent(action)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 //
 // sequence
@@ -549,6 +899,10 @@ void CJediAiActionSequenceBase::onEnd() {
 }
 
 void CJediAiActionSequenceBase::simulate(CJediAiMemory &simMemory) {
+	simulateSharingPrefix(simMemory, NULL);
+}
+
+void CJediAiActionSequenceBase::simulateSharingPrefix(CJediAiMemory &simMemory, CJediAiSequencePrefixTrie *prefixTrie) {
 	initSimSummary(simSummary, simMemory);
 
 	// check constraints
@@ -579,12 +933,41 @@ void CJediAiActionSequenceBase::simulate(CJediAiMemory &simMemory) {
 		currentAction = getNextAction(nextActionIndex);
 	}
 
+	// I can only share a prefix if I am starting from the beginning
+	int prefixNodeIndex = -1;
+	bool sharingPrefix = (prefixTrie != NULL && data.currentAction == NULL);
+
 	// simulate the rest of my actions
 	EJediAiActionSimResult bestSimResult = eJediAiActionSimResult_Irrelevant;
-	SJediAiActionSimSummary *lastSimSummary = NULL;
 	float timeBetweenActions = (params.timeBetweenActions - data.timer);
 	while (currentAction != NULL) {
 
+		// if this action continues a prefix shared with other sequences, find it
+		CJediAiSequencePrefixTrie::SNode *prefixNode = NULL;
+		if (sharingPrefix) {
+			prefixNodeIndex = prefixTrie->findNode(prefixNodeIndex, *this, *currentAction);
+			if (prefixNodeIndex >= 0 && prefixTrie->nodeList[prefixNodeIndex].memory != NULL) {
+				prefixNode = &prefixTrie->nodeList[prefixNodeIndex];
+			} else {
+				sharingPrefix = false;
+			}
+		}
+
+		// if another sequence already simulated this prefix and carried on, carry on from where it did
+		// if it didn't carry on, simulate the action here so we stop the same way it did
+		if (prefixNode != NULL && prefixNode->simulated) {
+			if (prefixNode->completed) {
+				simMemory.copy(*prefixNode->memory);
+				currentAction->simSummary = prefixNode->simSummary;
+				bestSimResult = prefixNode->bestSimResult;
+				timeBetweenActions = params.timeBetweenActions;
+				currentAction = getNextAction(nextActionIndex);
+				continue;
+			}
+			sharingPrefix = false;
+			prefixNode = NULL;
+		}
+
 		// if we have any time between actions, simulate that
 		if (nextActionIndex > 1 && timeBetweenActions < params.timeBetweenActions) {
 			simMemory.simulate(timeBetweenActions, CJediAiMemory::SSimulateParams());
@@ -596,6 +979,9 @@ void CJediAiActionSequenceBase::simulate(CJediAiMemory &simMemory) {
 		if (bestSimResult < currentAction->simSummary.result) {
 			bestSimResult = currentAction->simSummary.result;
 		}
+		if (prefixNode != NULL) {
+			prefixNode->simulated = true;
+		}
 
 		// if this action is impossible, I've failed
 		if (!params.allowActionFailure && currentAction->simSummary.result <= params.minFailureResult) {
@@ -613,6 +999,14 @@ void CJediAiActionSequenceBase::simulate(CJediAiMemory &simMemory) {
 			return;
 		}
 
+		// if this prefix is shared, save it off for the other sequences
+		if (prefixNode != NULL) {
+			prefixNode->completed = true;
+			prefixNode->memory->copy(simMemory);
+			prefixNode->simSummary = currentAction->simSummary;
+			prefixNode->bestSimResult = bestSimResult;
+		}
+
 		// move on to the next action
 		currentAction = getNextAction(nextActionIndex);
 	}
@@ -748,6 +1142,21 @@ EJediAiActionResult CJediAiActionSequenceBase::beginNextAction() {
 	return eJediAiActionResult_InProgress;
 }
 
+bool CJediAiActionSequenceBase::canSharePrefixWith(const CJediAiActionSequenceBase &other) const {
+
+	// only plain sequences, since other sequences may simulate differently
+	if (getType() != eJediAiAction_Sequence || other.getType() != eJediAiAction_Sequence) {
+		return false;
+	}
+
+	// we must run our actions the same way
+	return (
+		params.timeBetweenActions == other.params.timeBetweenActions &&
+		params.allowActionFailure == other.params.allowActionFailure &&
+		params.minFailureResult == other.params.minFailureResult
+	);
+}
+
 bool CJediAiActionSequenceBase::isNotSelectable() const {
 
 	// base class version
@@ -771,6 +1180,15 @@ bool CJediAiActionSequenceBase::isNotSelectable() const {
 	return false;
 }
 
+bool CJediAiActionSequenceBase::canSleep(SJediAiWakeCondition &wakeCondition) const {
+
+	// I only move on when my current action is done, so I can sleep as long as it can
+	if (data.currentAction == NULL || !data.currentAction->isInProgress()) {
+		return false;
+	}
+	return data.currentAction->canSleep(wakeCondition);
+}
+
 
 /////////////////////////////////////////////////////////////////////////////
 //
@@ -793,6 +1211,11 @@ void CJediAiActionSelectorBase::reset() {
 	// reset my params and data
 	memset(&selectorParams, 0, sizeof(selectorParams));
 	memset(&selectorData, 0, sizeof(selectorData));
+	memset(&selectorHistory, 0, sizeof(selectorHistory));
+	memset(&selectorRolloutStatsTable, 0, sizeof(selectorRolloutStatsTable));
+	memset(&selectorJob, 0, sizeof(selectorJob));
+	memset(&selectorReuseTable, 0, sizeof(selectorReuseTable));
+	memset(&selectorEstimateStats, 0, sizeof(selectorEstimateStats));
 
 	// apply default values
 	selectorParams.selectFrequency = -1.0f;
@@ -814,6 +1237,7 @@ EJediAiActionResult CJediAiActionSelectorBase::onBegin() {
 	selectorData.debouncedAction = prevSelectorData.debouncedAction;
 	selectorData.bestAction = prevSelectorData.bestAction;
 	selectorData.currentActionResult = eJediAiActionResult_Failure;
+	cancelSelectAction();
 
 	// if we don't already one, choose our best option
 	if (selectorData.bestAction == NULL) {
@@ -832,6 +1256,9 @@ void CJediAiActionSelectorBase::onEnd() {
 
 	// clear my current action
 	setCurrentAction(NULL);
+
+	// stop selecting
+	cancelSelectAction();
 }
 
 void CJediAiActionSelectorBase::simulate(CJediAiMemory &simMemory) {
@@ -895,29 +1322,38 @@ EJediAiActionResult CJediAiActionSelectorBase::update(float dt) {
 		if (selectorData.selectTimer >= selectorParams.selectFrequency) {
 
 			// if I don't have a best action, get one
+			// if I am time slicing, this may take a few frames, during which my current action keeps running
+			bool selectionComplete = true;
 			if (selectorData.bestAction == NULL) {
-				selectorData.bestAction = selectAction(NULL);
+				if (selectorParams.maxSimulationsPerFrame > 0) {
+					selectionComplete = updateSelectAction(&selectorData.bestAction);
+				} else {
+					selectorData.bestAction = selectAction(NULL);
+				}
 			}
 
 			// select the new action
-			CJediAiAction *prevAction = selectorData.currentAction;
-			setCurrentAction(selectorData.bestAction);
+			if (selectionComplete) {
+				CJediAiAction *prevAction = selectorData.currentAction;
+				setCurrentAction(selectorData.bestAction);
 
-			// if we didn't get a new action, we've failed
-			if (selectorData.currentAction == NULL) {
-				return eJediAiActionResult_Failure;
-			}
+				// if we didn't get a new action, we've failed
+				if (selectorData.currentAction == NULL) {
+					return eJediAiActionResult_Failure;
+				}
 
-			// if we selected a new action, don't update it this frame
-			if (prevAction != selectorData.currentAction) {
-				return eJediAiActionResult_InProgress;
+				// if we selected a new action, don't update it this frame
+				if (prevAction != selectorData.currentAction) {
+					return eJediAiActionResult_InProgress;
+				}
 			}
 		}
 	}
 
 	// if I have no current action, I've failed
+	// unless I am still selecting one
 	if (selectorData.currentAction == NULL) {
-		return eJediAiActionResult_Failure;
+		return (selectorJob.inProgress ? eJediAiActionResult_InProgress : eJediAiActionResult_Failure);
 	}
 
 	// update my current action
@@ -925,6 +1361,26 @@ EJediAiActionResult CJediAiActionSelectorBase::update(float dt) {
 	return selectorData.currentActionResult;
 }
 
+bool CJediAiActionSelectorBase::canSleep(SJediAiWakeCondition &wakeCondition) const {
+
+	// I can't sleep in the middle of a selection
+	if (selectorData.currentAction == NULL || selectorData.currentActionResult != eJediAiActionResult_InProgress) {
+		return false;
+	}
+	if (selectorData.bestAction != NULL || selectorJob.inProgress) {
+		return false;
+	}
+
+	// I can sleep as long as my current action can, but I have to wake when it's time to select again
+	if (!selectorData.currentAction->canSleep(wakeCondition)) {
+		return false;
+	}
+	if (selectorParams.selectFrequency >= 0.0f) {
+		wakeCondition.wakeBy(memory->currentTime + max(selectorParams.selectFrequency - selectorData.selectTimer, 0.0f));
+	}
+	return true;
+}
+
 EJediAiActionResult CJediAiActionSelectorBase::setCurrentAction(CJediAiAction *action) {
 
 	// clear our current 'best action'
@@ -978,45 +1434,151 @@ CJediAiAction *CJediAiActionSelectorBase::selectAction(CJediAiMemory *simMemory)
 		}
 	}
 
+	// if we are pruning, figure out which order to simulate our actions in
+	// this fails if we have too many actions to keep a history for, in which case we simulate everything
+	CJediAiActionSelectorBase *me = const_cast<CJediAiActionSelectorBase*>(this);
+	int actionOrder[kSelectorHistorySize];
+	bool simulatedTable[kSelectorHistorySize];
+	bool prune = (selectorParams.pruneActions && computeActionOrder(actionCount, actionTable, actionOrder));
+	if (prune) {
+		memset(simulatedTable, 0, sizeof(simulatedTable));
+	}
+	me->selectorHistory.lastSkippedCount = 0;
+
+	// if some of my sequences begin the same way, they share the simulation of those actions
+	// rollouts give each simulation its own random stream, so they can't share
+	CJediAiSequencePrefixTrie prefixTrie;
+	bool sharePrefixes = (selectorParams.rolloutCount <= 1 && buildSequencePrefixTrie(actionCount, actionTable, prefixTrie));
+
+	// if we are selecting for real, actions whose inputs barely changed can reuse their last simulation
+	SSelectorInputFingerprint fingerprint;
+	bool reuse = (simMemory == NULL && selectorParams.maxReuseCount > 0);
+	if (reuse) {
+		computeInputFingerprint(*memory, fingerprint);
+	}
+
+	// if we are ranking by estimate, only the best estimated actions are simulated
+	SJediAiActionSimSummary estimateTable[kSelectorHistorySize];
+	bool estimatedTable[kSelectorHistorySize];
+	bool skipTable[kSelectorHistorySize];
+	CJediAiMemory &estimateMemory = (simMemory != NULL ? *simMemory : *memory);
+	bool estimate = (selectorParams.estimateTopCount > 0 && rankActionsByEstimate(actionCount, actionTable, estimateMemory, estimateTable, estimatedTable, skipTable));
+
+	// if we are selecting for real, every engine query made while simulating goes through my query batch
+	// if we are batching, record the queries first and answer them all at once, then simulate against the answers
+	CJediAiEngineQueryBatch *queryBatch = (simMemory == NULL ? memory->queryBatch : NULL);
+	if (queryBatch != NULL && queryBatch->beginSelection() && selectorParams.batchEngineQueries) {
+		queryBatch->beginRecord();
+		recordEngineQueries(actionCount, actionTable, (prune ? actionOrder : NULL), 0, 0, (estimate ? skipTable : NULL), (reuse ? &fingerprint : NULL));
+		queryBatch->resolveRecorded();
+		queryBatch->beginReplay();
+	}
+
 	// simulate each action
 	EJediAiActionSimResult bestResult = eJediAiActionSimResult_Impossible;
-	for (int i = 0; i < actionCount; ++i) {
+	for (int orderIndex = 0; orderIndex < actionCount; ++orderIndex) {
+		int i = (prune ? actionOrder[orderIndex] : orderIndex);
 
 		// get the next action
 		CJediAiAction *action = actionTable[i];
 		if (action == NULL) {
+			if (prune) {
+				simulatedTable[i] = true;
+			}
 			continue;
 		}
 
 		// if we can't select this action, skip it
 		if (!canSelectAction(i)) {
+			if (prune) {
+				simulatedTable[i] = true;
+			}
+			continue;
+		}
+
+		// if another jedi holds a token this action needs, skip it without simulating
+		// it gets an impossible result so that it won't be selected
+		if (action->requiredTokens != 0 && !estimateMemory.areTokensAvailable(action->requiredTokens)) {
+			initSimSummary(action->simSummary, *memory);
+			me->selectorHistory.tokenSkippedCount++;
+			if (prune) {
+				simulatedTable[i] = true;
+			}
+			continue;
+		}
+
+		// if this action's estimate didn't make the cut, skip it
+		// it gets an impossible result so that it won't be selected
+		if (estimate && skipTable[i]) {
+			initSimSummary(action->simSummary, *memory);
+			if (prune) {
+				simulatedTable[i] = true;
+			}
 			continue;
 		}
 
+		// if this action can reuse its last simulation, we're done with it
 		// if we have a memory table, simulate the action into it's memory in that table
 		// otherwise, just give it a copy of our memory to simulate into
-		if (memoryTable != NULL && simMemory != NULL) {
-			memoryTable[i].copy(*simMemory);
-			action->simulate(memoryTable[i]);
+		if (reuse && reuseSimulation(i, action, fingerprint)) {
+			me->selectorHistory.reusedCount++;
 		} else {
-			CJediAiMemory actionSimMemory(*memory);
-			action->simulate(actionSimMemory);
+			CJediAiSequencePrefixTrie *actionPrefixTrie = (sharePrefixes ? &prefixTrie : NULL);
+			if (memoryTable != NULL && simMemory != NULL) {
+				memoryTable[i].copy(*simMemory);
+				simulateActionForSelection(i, action, memoryTable[i], actionPrefixTrie);
+			} else {
+				CJediAiMemory actionSimMemory(*memory);
+				simulateActionForSelection(i, action, actionSimMemory, actionPrefixTrie);
+			}
+			me->selectorHistory.simulatedCount++;
+			if (reuse) {
+				saveSimulationForReuse(i, action, fingerprint);
+			}
+			if (estimate && estimatedTable[i]) {
+				recordEstimateError(estimateTable[i], action->simSummary);
+			}
 		}
 
 		// if this action has the best result so far, save it off
 		if (bestResult < action->simSummary.result) {
 			bestResult = action->simSummary.result;
 		}
+
+		// if we are pruning, remember how this action did
+		if (prune) {
+			simulatedTable[i] = true;
+			me->selectorHistory.actionTable[i].lastResult = action->simSummary.result;
+			me->selectorHistory.actionTable[i].simulatedCount++;
+
+			// if nothing left can beat this action, skip the rest
+			// anything we skip gets an impossible result so that it won't be selected
+			if (action->simSummary.result >= eJediAiActionSimResult_Urgent && isSelectionDecided(i, actionCount, actionTable, simulatedTable)) {
+				for (int j = 0; j < actionCount; ++j) {
+					if (!simulatedTable[j] && actionTable[j] != NULL) {
+						initSimSummary(actionTable[j]->simSummary, *memory);
+						me->selectorHistory.lastSkippedCount++;
+					}
+				}
+				me->selectorHistory.skippedCount += me->selectorHistory.lastSkippedCount;
+				break;
+			}
+		}
 	}
 
 	// select the best action
+	// random choices come from the memory we are selecting for, so simulation doesn't disturb the real stream
 	CJediAiAction *bestAction = NULL;
-	int bestActionIndex = compareAndSelectAction(actionCount, actionTable, bestResult);
+	CJediAiMemory &randomMemory = (simMemory != NULL ? *simMemory : *memory);
+	int bestActionIndex = compareAndSelectAction(randomMemory.random, actionCount, actionTable, bestResult);
 	if (bestActionIndex > -1 && bestActionIndex < actionCount) {
 		if (simMemory != NULL && memoryTable != NULL) {
 			simMemory->copy(memoryTable[bestActionIndex]);
 		}
 		bestAction = actionTable[bestActionIndex];
+		if (prune) {
+			me->selectorHistory.actionTable[bestActionIndex].selectedCount++;
+		}
 	}
 
 	// delete our temporary memory table
@@ -1025,11 +1587,467 @@ CJediAiAction *CJediAiActionSelectorBase::selectAction(CJediAiMemory *simMemory)
 		memoryTable = NULL;
 	}
 
+	// we're done asking the engine
+	if (queryBatch != NULL) {
+		queryBatch->endSelection();
+	}
+
 	// return our selected action
 	return bestAction;
 }
 
-int CJediAiActionSelectorBase::compareAndSelectAction(int actionCount, CJediAiAction *const actionTable[], EJediAiActionSimResult bestResult) const {
+void CJediAiActionSelectorBase::simulateActionForSelection(int actionIndex, CJediAiAction *action, CJediAiMemory &simMemory, CJediAiSequencePrefixTrie *prefixTrie) const {
+
+	// if we aren't rolling out, just simulate once
+	int rolloutCount = selectorParams.rolloutCount;
+	if (rolloutCount <= 1 || actionIndex < 0 || actionIndex >= kSelectorHistorySize) {
+		if (prefixTrie != NULL && action->getType() == eJediAiAction_Sequence) {
+			((CJediAiActionSequenceBase*)action)->simulateSharingPrefix(simMemory, prefixTrie);
+		} else {
+			action->simulate(simMemory);
+		}
+		return;
+	}
+
+	// aggregate the results of every rollout
+	float startHitPoints = simMemory.selfState.hitPoints;
+	SSelectorRolloutStats stats;
+	memset(&stats, 0, sizeof(stats));
+	stats.rolloutCount = rolloutCount;
+
+	// every rollout but the first gets its own random stream, so they don't depend on the order they run in
+	// these run first, from a copy of the caller's memory, which is left untouched until the first rollout
+	CJediAiMemory rolloutMemory;
+	for (int k = 1; k < rolloutCount; ++k) {
+		rolloutMemory.copy(simMemory);
+		rolloutMemory.random.fork(simMemory.random, k);
+		action->simulate(rolloutMemory);
+
+		// accumulate the results
+		const SJediAiActionSimSummary &rolloutSimSummary = action->simSummary;
+		stats.worstResult = (k == 1 ? rolloutSimSummary.result : min(stats.worstResult, rolloutSimSummary.result));
+		stats.bestResult = (k == 1 ? rolloutSimSummary.result : max(stats.bestResult, rolloutSimSummary.result));
+		stats.expectedResult += (float)rolloutSimSummary.result;
+		stats.expectedThreatLevel += rolloutSimSummary.threatLevel;
+		stats.expectedHitPointLoss += (startHitPoints - rolloutSimSummary.selfHitPoints);
+	}
+
+	// the first rollout goes into the caller's memory using its own random stream,
+	// so a single rollout gives the same result as not rolling out at all
+	// it runs last, so the action's own simulation state matches the memory and summary we keep
+	action->simulate(simMemory);
+	SJediAiActionSimSummary firstSimSummary = action->simSummary;
+	stats.worstResult = min(stats.worstResult, firstSimSummary.result);
+	stats.bestResult = max(stats.bestResult, firstSimSummary.result);
+	stats.expectedResult += (float)firstSimSummary.result;
+	stats.expectedThreatLevel += firstSimSummary.threatLevel;
+	stats.expectedHitPointLoss += (startHitPoints - firstSimSummary.selfHitPoints);
+	stats.expectedResult /= (float)rolloutCount;
+	stats.expectedThreatLevel /= (float)rolloutCount;
+	stats.expectedHitPointLoss /= (float)rolloutCount;
+
+	// save off our stats
+	CJediAiActionSelectorBase *me = const_cast<CJediAiActionSelectorBase*>(this);
+	me->selectorRolloutStatsTable[actionIndex] = stats;
+
+	// the action is judged by its worst case and expected outcome rather than by a single sample
+	action->simSummary = firstSimSummary;
+	action->simSummary.result = stats.worstResult;
+	action->simSummary.threatLevel = stats.expectedThreatLevel;
+	action->simSummary.selfHitPoints = (startHitPoints - stats.expectedHitPointLoss);
+}
+
+void CJediAiActionSelectorBase::computeInputFingerprint(const CJediAiMemory &simMemory, SSelectorInputFingerprint &fingerprint) const {
+	memset(&fingerprint, 0, sizeof(fingerprint));
+	fingerprint.time = simMemory.currentTime;
+
+	// self
+	fingerprint.wSelfPos = simMemory.selfState.wPos;
+	fingerprint.selfHitPoints = simMemory.selfState.hitPoints;
+	fingerprint.selfStateBitfield = simMemory.selfState.currentStateBitfield;
+
+	// victim
+	const SJediAiActorState *victimState = simMemory.victimState;
+	fingerprint.victim = victimState->actor;
+	fingerprint.wVictimPos = victimState->wPos;
+	fingerprint.victimHitPoints = victimState->hitPoints;
+	fingerprint.victimFlags = victimState->flags;
+
+	// threats
+	// the hash is a sum so it doesn't depend on the order of the threats
+	fingerprint.threatCount = simMemory.threatStateCount;
+	for (int i = 0; i < simMemory.threatStateCount; ++i) {
+		const SJediAiThreatState &threatState = simMemory.threatStates[i];
+		const CActor *creator = (threatState.threat != NULL ? threatState.threat->creator : NULL);
+		unsigned int threatKey = ((unsigned int)threatState.type ^ (unsigned int)((size_t)creator >> 4));
+		fingerprint.threatHash += (threatKey * 2654435761u);
+		if (i == 0 || threatState.duration < fingerprint.nextThreatDuration) {
+			fingerprint.nextThreatDuration = threatState.duration;
+		}
+	}
+}
+
+bool CJediAiActionSelectorBase::reuseSimulation(int actionIndex, CJediAiAction *action, const SSelectorInputFingerprint &fingerprint) const {
+	if (!canReuseSimulation(actionIndex, action, fingerprint)) {
+		return false;
+	}
+
+	// reuse it
+	CJediAiActionSelectorBase *me = const_cast<CJediAiActionSelectorBase*>(this);
+	me->selectorReuseTable[actionIndex].reuseCount++;
+	action->simSummary = selectorReuseTable[actionIndex].simSummary;
+	return true;
+}
+
+bool CJediAiActionSelectorBase::canReuseSimulation(int actionIndex, const CJediAiAction *action, const SSelectorInputFingerprint &fingerprint) const {
+
+	// we need a simulation that hasn't been reused too many times already
+	if (actionIndex < 0 || actionIndex >= kSelectorHistorySize) {
+		return false;
+	}
+	const SSelectorReuse &reuse = selectorReuseTable[actionIndex];
+	if (!reuse.valid || reuse.reuseCount >= selectorParams.maxReuseCount) {
+		return false;
+	}
+
+	// the action must not have started or stopped since, since it would simulate from somewhere else
+	if (reuse.inProgress != action->isInProgress()) {
+		return false;
+	}
+
+	// the same things must be going on
+	const SSelectorInputFingerprint &prevFingerprint = reuse.fingerprint;
+	if (
+		prevFingerprint.selfStateBitfield != fingerprint.selfStateBitfield ||
+		prevFingerprint.victim != fingerprint.victim ||
+		prevFingerprint.victimFlags != fingerprint.victimFlags ||
+		prevFingerprint.threatCount != fingerprint.threatCount ||
+		prevFingerprint.threatHash != fingerprint.threatHash
+	) {
+		return false;
+	}
+
+	// my victim and I must have barely changed
+	float distanceToleranceSq = SQ(selectorParams.reuseDistanceTolerance);
+	if (prevFingerprint.wSelfPos.distanceSqTo(fingerprint.wSelfPos) > distanceToleranceSq) {
+		return false;
+	}
+	if (prevFingerprint.wVictimPos.distanceSqTo(fingerprint.wVictimPos) > distanceToleranceSq) {
+		return false;
+	}
+	if (fabs(prevFingerprint.selfHitPoints - fingerprint.selfHitPoints) > selectorParams.reuseHitPointTolerance) {
+		return false;
+	}
+	if (fabs(prevFingerprint.victimHitPoints - fingerprint.victimHitPoints) > selectorParams.reuseHitPointTolerance) {
+		return false;
+	}
+
+	// the next threat must be about when we expected it to be
+	if (fingerprint.threatCount > 0) {
+		float expectedThreatDuration = prevFingerprint.nextThreatDuration - (fingerprint.time - prevFingerprint.time);
+		if (fabs(expectedThreatDuration - fingerprint.nextThreatDuration) > selectorParams.reuseThreatDurationTolerance) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void CJediAiActionSelectorBase::saveSimulationForReuse(int actionIndex, const CJediAiAction *action, const SSelectorInputFingerprint &fingerprint) const {
+	if (actionIndex < 0 || actionIndex >= kSelectorHistorySize) {
+		return;
+	}
+	CJediAiActionSelectorBase *me = const_cast<CJediAiActionSelectorBase*>(this);
+	SSelectorReuse &reuse = me->selectorReuseTable[actionIndex];
+	reuse.valid = true;
+	reuse.inProgress = action->isInProgress();
+	reuse.reuseCount = 0;
+	reuse.fingerprint = fingerprint;
+	reuse.simSummary = action->simSummary;
+}
+
+bool CJediAiActionSelectorBase::rankActionsByEstimate(int actionCount, CJediAiAction *const actionTable[], const CJediAiMemory &simMemory, SJediAiActionSimSummary estimateTable[], bool estimatedTable[], bool skipTable[]) const {
+
+	// if I have too many actions, I can't rank them
+	if (actionCount > kSelectorHistorySize) {
+		return false;
+	}
+
+	// estimate each action that can
+	// my current action is always simulated, since it wins ties
+	CJediAiActionSelectorBase *me = const_cast<CJediAiActionSelectorBase*>(this);
+	int rankedCount = 0;
+	int rankTable[kSelectorHistorySize];
+	for (int i = 0; i < actionCount; ++i) {
+		estimatedTable[i] = false;
+		skipTable[i] = false;
+		CJediAiAction *action = actionTable[i];
+		if (action == NULL || !canSelectAction(i) || action == selectorData.currentAction) {
+			continue;
+		}
+		if (action->requiredTokens != 0 && !simMemory.areTokensAvailable(action->requiredTokens)) {
+			continue;
+		}
+		if (!action->estimateSimulation(simMemory, estimateTable[i])) {
+			continue;
+		}
+		estimatedTable[i] = true;
+		me->selectorEstimateStats.estimatedCount++;
+
+		// impossible estimates are exact, so there is no need to simulate them
+		if (estimateTable[i].result == eJediAiActionSimResult_Impossible) {
+			skipTable[i] = true;
+			me->selectorEstimateStats.skippedCount++;
+			continue;
+		}
+
+		// insertion sort the action by its estimate
+		// better results go first, then lower threat levels, then more damage to my victim
+		int j = rankedCount++;
+		for (; j > 0; --j) {
+			const SJediAiActionSimSummary &prevEstimate = estimateTable[rankTable[j - 1]];
+			const SJediAiActionSimSummary &estimate = estimateTable[i];
+			if (prevEstimate.result != estimate.result) {
+				if (prevEstimate.result > estimate.result) {
+					break;
+				}
+			} else if (prevEstimate.threatLevel != estimate.threatLevel) {
+				if (prevEstimate.threatLevel < estimate.threatLevel) {
+					break;
+				}
+			} else if (prevEstimate.victimHitPoints <= estimate.victimHitPoints) {
+				break;
+			}
+			rankTable[j] = rankTable[j - 1];
+		}
+		rankTable[j] = i;
+	}
+
+	// skip everything past the top of the ranking
+	for (int r = selectorParams.estimateTopCount; r < rankedCount; ++r) {
+		skipTable[rankTable[r]] = true;
+		me->selectorEstimateStats.skippedCount++;
+	}
+
+	// success
+	return true;
+}
+
+void CJediAiActionSelectorBase::recordEstimateError(const SJediAiActionSimSummary &estimate, const SJediAiActionSimSummary &simSummary) const {
+	CJediAiActionSelectorBase *me = const_cast<CJediAiActionSelectorBase*>(this);
+	SSelectorEstimateStats &stats = me->selectorEstimateStats;
+	stats.comparedCount++;
+	if (estimate.result != simSummary.result) {
+		stats.mismatchCount++;
+	}
+	stats.resultErrorSum += fabs((float)(estimate.result - simSummary.result));
+	stats.hitPointErrorSum += fabs(estimate.selfHitPoints - simSummary.selfHitPoints) + fabs(estimate.victimHitPoints - simSummary.victimHitPoints);
+}
+
+void CJediAiActionSelectorBase::recordEngineQueries(int actionCount, CJediAiAction *const actionTable[], const int actionOrder[], int firstOrderIndex, int maxRecordCount, const bool skipTable[], const SSelectorInputFingerprint *fingerprint) const {
+
+	// simulate each action that is about to be simulated for real
+	// the results don't matter, only the queries they make, so there's no rolling out, sharing or bookkeeping
+	int recordCount = 0;
+	for (int orderIndex = firstOrderIndex; orderIndex < actionCount; ++orderIndex) {
+		if (maxRecordCount > 0 && recordCount >= maxRecordCount) {
+			break;
+		}
+		int i = (actionOrder != NULL ? actionOrder[orderIndex] : orderIndex);
+		CJediAiAction *action = actionTable[i];
+		if (action == NULL || !canSelectAction(i)) {
+			continue;
+		}
+		if (action->requiredTokens != 0 && !memory->areTokensAvailable(action->requiredTokens)) {
+			continue;
+		}
+		if (skipTable != NULL && skipTable[i]) {
+			continue;
+		}
+		if (fingerprint != NULL && canReuseSimulation(i, action, *fingerprint)) {
+			continue;
+		}
+		CJediAiMemory recordMemory(*memory);
+		action->simulate(recordMemory);
+		recordCount++;
+	}
+}
+
+bool CJediAiActionSelectorBase::buildSequencePrefixTrie(int actionCount, CJediAiAction *const actionTable[], CJediAiSequencePrefixTrie &prefixTrie) const {
+
+	// add each plain sequence I could select which hasn't started yet
+	int sequenceCount = 0;
+	for (int i = 0; i < actionCount; ++i) {
+		CJediAiAction *action = actionTable[i];
+		if (action == NULL || action->getType() != eJediAiAction_Sequence || !canSelectAction(i)) {
+			continue;
+		}
+		CJediAiActionSequenceBase *sequence = (CJediAiActionSequenceBase*)action;
+		if (sequence->data.currentAction != NULL) {
+			continue;
+		}
+		prefixTrie.addSequence(*sequence);
+		++sequenceCount;
+	}
+
+	// we need at least two sequences to share anything
+	if (sequenceCount < 2) {
+		return false;
+	}
+	return prefixTrie.allocateSharedPrefixes();
+}
+
+bool CJediAiActionSelectorBase::updateSelectAction(CJediAiAction **selectedAction) {
+	*selectedAction = NULL;
+
+	// get my action table
+	int actionCount = 0;
+	CJediAiAction *const *actionTable = getActionTable(&actionCount);
+	if (actionTable == NULL || actionCount < 0) {
+		cancelSelectAction();
+		return true;
+	}
+
+	// if my action table is too big to track, just select everything now
+	if (actionCount > kSelectorHistorySize) {
+		cancelSelectAction();
+		*selectedAction = selectAction(NULL);
+		return true;
+	}
+
+	// if we aren't already selecting, start a new job
+	if (!selectorJob.inProgress) {
+		memset(&selectorJob, 0, sizeof(selectorJob));
+		selectorJob.inProgress = true;
+		selectorJob.bestResult = eJediAiActionSimResult_Impossible;
+		if (!selectorParams.pruneActions || !computeActionOrder(actionCount, actionTable, selectorJob.actionOrder)) {
+			for (int i = 0; i < actionCount; ++i) {
+				selectorJob.actionOrder[i] = i;
+			}
+		}
+	}
+	selectorJob.frameCount++;
+
+	// actions whose inputs barely changed can reuse their last simulation
+	SSelectorInputFingerprint fingerprint;
+	bool reuse = (selectorParams.maxReuseCount > 0);
+	if (reuse) {
+		computeInputFingerprint(*memory, fingerprint);
+	}
+
+	// every engine query made while simulating goes through my query batch
+	// if we are batching, record this frame's queries first and answer them all at once, then simulate against the answers
+	CJediAiEngineQueryBatch *queryBatch = memory->queryBatch;
+	if (queryBatch != NULL && queryBatch->beginSelection() && selectorParams.batchEngineQueries) {
+		queryBatch->beginRecord();
+		recordEngineQueries(actionCount, actionTable, selectorJob.actionOrder, selectorJob.nextOrderIndex, selectorParams.maxSimulationsPerFrame, NULL, (reuse ? &fingerprint : NULL));
+		queryBatch->resolveRecorded();
+		queryBatch->beginReplay();
+	}
+
+	// simulate the next batch of actions
+	// each one simulates against this frame's memory, and reused ones don't count against the batch
+	bool decided = false;
+	int simulationCount = 0;
+	while (selectorJob.nextOrderIndex < actionCount && simulationCount < selectorParams.maxSimulationsPerFrame && !decided) {
+		int i = selectorJob.actionOrder[selectorJob.nextOrderIndex++];
+		selectorJob.simulatedTable[i] = true;
+
+		// get the next action
+		// if we can't select it, skip it
+		CJediAiAction *action = actionTable[i];
+		if (action == NULL || !canSelectAction(i)) {
+			continue;
+		}
+
+		// if another jedi holds a token it needs, skip it without simulating
+		// it gets an impossible result so that it won't be selected
+		if (action->requiredTokens != 0 && !memory->areTokensAvailable(action->requiredTokens)) {
+			initSimSummary(action->simSummary, *memory);
+			selectorHistory.tokenSkippedCount++;
+			continue;
+		}
+
+		// simulate the action, unless it can reuse its last simulation
+		if (reuse && reuseSimulation(i, action, fingerprint)) {
+			selectorHistory.reusedCount++;
+		} else {
+			CJediAiMemory actionSimMemory(*memory);
+			simulateActionForSelection(i, action, actionSimMemory);
+			selectorHistory.simulatedCount++;
+			simulationCount++;
+			if (reuse) {
+				saveSimulationForReuse(i, action, fingerprint);
+			}
+		}
+
+		// if this action has the best result so far, save it off
+		if (selectorJob.bestResult < action->simSummary.result) {
+			selectorJob.bestResult = action->simSummary.result;
+		}
+
+		// if we are pruning, remember how this action did and see if we can stop
+		if (selectorParams.pruneActions) {
+			selectorHistory.actionTable[i].lastResult = action->simSummary.result;
+			selectorHistory.actionTable[i].simulatedCount++;
+			if (action->simSummary.result >= eJediAiActionSimResult_Urgent && isSelectionDecided(i, actionCount, actionTable, selectorJob.simulatedTable)) {
+				decided = true;
+			}
+		}
+	}
+	if (queryBatch != NULL) {
+		queryBatch->endSelection();
+	}
+
+	// if there is more to simulate, keep going next frame
+	// unless I already have an urgent action or a threat is about to hit me and I have something I can do about it
+	if (!decided && selectorJob.nextOrderIndex < actionCount) {
+		bool mustDecide = (selectorJob.bestResult >= eJediAiActionSimResult_Urgent);
+		if (!mustDecide && isThreatForcingSelection()) {
+			mustDecide = (selectorParams.allowNegativeActions || selectorJob.bestResult > eJediAiActionSimResult_Irrelevant);
+		}
+		if (!mustDecide) {
+			return false;
+		}
+	}
+
+	// anything we didn't simulate gets an impossible result so that it won't be selected
+	selectorHistory.lastSkippedCount = 0;
+	for (int i = 0; i < actionCount; ++i) {
+		if (!selectorJob.simulatedTable[i] && actionTable[i] != NULL) {
+			initSimSummary(actionTable[i]->simSummary, *memory);
+			selectorHistory.lastSkippedCount++;
+		}
+	}
+	selectorHistory.skippedCount += selectorHistory.lastSkippedCount;
+
+	// select the best action
+	int bestActionIndex = compareAndSelectAction(memory->random, actionCount, actionTable, selectorJob.bestResult);
+	if (bestActionIndex > -1 && bestActionIndex < actionCount) {
+		*selectedAction = actionTable[bestActionIndex];
+		if (selectorParams.pruneActions) {
+			selectorHistory.actionTable[bestActionIndex].selectedCount++;
+		}
+	}
+
+	// done!
+	cancelSelectAction();
+	return true;
+}
+
+void CJediAiActionSelectorBase::cancelSelectAction() {
+	memset(&selectorJob, 0, sizeof(selectorJob));
+}
+
+bool CJediAiActionSelectorBase::isThreatForcingSelection() const {
+	for (int i = 0; i < memory->threatStateCount; ++i) {
+		if (memory->threatStates[i].duration <= selectorParams.urgentThreatDuration) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int CJediAiActionSelectorBase::compareAndSelectAction(SJediRandom &, int actionCount, CJediAiAction *const actionTable[], EJediAiActionSimResult bestResult) const {
 
 	// if every action available is negative and we don't allow those, do nothing
 	if (!selectorParams.allowNegativeActions && bestResult <= eJediAiActionSimResult_Irrelevant) {
@@ -1074,11 +2092,85 @@ int CJediAiActionSelectorBase::compareAndSelectAction(int actionCount, CJediAiAc
 		bestAction = bestDebouncedAction;
 	}
 
-	// return the best action
-	return bestAction;
-}
-
-bool CJediAiActionSelectorBase::canSelectAction(int actionIndex) const {
+	// return the best action
+	return bestAction;
+}
+
+bool CJediAiActionSelectorBase::canSelectAction(int actionIndex) const {
+	return true;
+}
+
+bool CJediAiActionSelectorBase::computeActionOrder(int actionCount, CJediAiAction *const actionTable[], int actionOrder[]) const {
+
+	// if I have too many actions, I can't keep a history for them
+	if (actionCount > kSelectorHistorySize) {
+		return false;
+	}
+
+	// compute a sort key for each action
+	// the current action goes first, since it wins ties and can end the search right away
+	// debounced actions go last, since they only win when nothing else can
+	// everything else is sorted by last result, then by how often it has been selected when simulated
+	float sortKeyTable[kSelectorHistorySize];
+	for (int i = 0; i < actionCount; ++i) {
+		const CJediAiAction *action = actionTable[i];
+		if (action != NULL && selectorParams.ifEqualUseCurrentAction && action == selectorData.currentAction) {
+			sortKeyTable[i] = (float)(eJediAiActionSimResult_Count + 1);
+		} else if (action != NULL && selectorParams.debounceActions && action == selectorData.debouncedAction) {
+			sortKeyTable[i] = -1.0f;
+		} else {
+			float winRate = 0.0f;
+			if (selectorHistory.actionTable[i].simulatedCount > 0) {
+				winRate = (float)selectorHistory.actionTable[i].selectedCount / (float)selectorHistory.actionTable[i].simulatedCount;
+			}
+			sortKeyTable[i] = (float)selectorHistory.actionTable[i].lastResult + (winRate * 0.99f);
+		}
+	}
+
+	// insertion sort the actions by their keys
+	// this is stable, so equal keys are simulated in table order
+	for (int i = 0; i < actionCount; ++i) {
+		int j = i;
+		for (; j > 0 && sortKeyTable[actionOrder[j - 1]] < sortKeyTable[i]; --j) {
+			actionOrder[j] = actionOrder[j - 1];
+		}
+		actionOrder[j] = i;
+	}
+
+	// success
+	return true;
+}
+
+bool CJediAiActionSelectorBase::isSelectionDecided(int actionIndex, int actionCount, CJediAiAction *const actionTable[], const bool simulatedTable[]) const {
+
+	// if this is my current action and I favor it, nothing can beat it
+	CJediAiAction *action = actionTable[actionIndex];
+	if (selectorParams.ifEqualUseCurrentAction && action == selectorData.currentAction) {
+		return true;
+	}
+
+	// a debounced action loses to any other action with the same result
+	if (selectorParams.debounceActions && action == selectorData.debouncedAction) {
+		return false;
+	}
+
+	// any earlier action with the same result would win, so they must all be simulated
+	for (int i = 0; i < actionIndex; ++i) {
+		if (!simulatedTable[i]) {
+			return false;
+		}
+	}
+
+	// my current action would win, so it must be simulated
+	if (selectorParams.ifEqualUseCurrentAction && selectorData.currentAction != NULL) {
+		for (int i = actionIndex + 1; i < actionCount; ++i) {
+			if (actionTable[i] == selectorData.currentAction && !simulatedTable[i]) {
+				return false;
+			}
+		}
+	}
+
+	// nothing else can beat this action
 	return true;
 }
 
@@ -1161,7 +2253,16 @@ EJediAiAction CJediAiActionRandomBase::getType() const {
 	return eJediAiAction_Random;
 }
 
-int CJediAiActionRandomBase::compareAndSelectAction(int actionCount, CJediAiAction *const actionTable[], EJediAiActionSimResult bestResult) const {
+void CJediAiActionRandomBase::reset() {
+
+	// base class version
+	BASECLASS::reset();
+
+	// my odds may change, so rebuild my alias table next time
+	invalidateOddsAliasTable();
+}
+
+int CJediAiActionRandomBase::compareAndSelectAction(SJediRandom &random, int actionCount, CJediAiAction *const actionTable[], EJediAiActionSimResult bestResult) const {
 
 	// if every action available is hurtful, do nothing
 	if (!selectorParams.allowNegativeActions && bestResult < eJediAiActionSimResult_Irrelevant) {
@@ -1172,17 +2273,14 @@ int CJediAiActionRandomBase::compareAndSelectAction(int actionCount, CJediAiActi
 	const float *actionOddsTable = getActionOddsTable(NULL);
 	if (actionOddsTable == NULL) {
 		assert(actionOddsTable != NULL);
-		return BASECLASS::compareAndSelectAction(actionCount, actionTable, bestResult);
+		return BASECLASS::compareAndSelectAction(random, actionCount, actionTable, bestResult);
 	}
 
-	// create a local copy of the odds table
-	int sizeofActionOddsTable = sizeof(float) * actionCount;
-	float *localActionOddsTable = (float*)alloca(sizeofActionOddsTable);
-	if (localActionOddsTable == NULL) {
-		error("alloca(%d) failed in CJediAiActionRandomBase::compareAndSelectAction()\n", sizeofActionOddsTable);
-		return -1;
+	// if I have too many actions for my alias table, just use the first best one
+	if (actionCount > kOddsAliasTableSize) {
+		error("CJediAiActionRandomBase::compareAndSelectAction() - %d actions is more than the %d supported", actionCount, kOddsAliasTableSize);
+		return BASECLASS::compareAndSelectAction(random, actionCount, actionTable, bestResult);
 	}
-	memset(localActionOddsTable, 0, sizeofActionOddsTable);
 
 	// if we already have a selected action and it is one of the best and we are supposed to, just return it
 	if (isInProgress()) {
@@ -1197,9 +2295,10 @@ int CJediAiActionRandomBase::compareAndSelectAction(int actionCount, CJediAiActi
 		}
 	}
 
-	// build the odds table for choosing an action
+	// figure out which actions are eligible
+	// only actions which are the most beneficial and have a chance of happening are eligible
 	int debouncedActionIndex = -1;
-	bool allOddsZero = true;
+	unsigned int eligibleMask = 0;
 	for (int i = 0; i < actionCount; ++i) {
 
 		// get the next action
@@ -1208,38 +2307,118 @@ int CJediAiActionRandomBase::compareAndSelectAction(int actionCount, CJediAiActi
 			continue;
 		}
 
-		// only use the odds for actions which are the most beneficial
-		// leave the odds of everything else at zero
+		// skip anything that isn't one of the most beneficial
 		if (action->simSummary.result < bestResult) {
-			localActionOddsTable[i] = 0.0f;
-		} else if (selectorParams.debounceActions && action == selectorData.debouncedAction) {
+			continue;
+		}
+
+		// save off the debounced action for later
+		if (selectorParams.debounceActions && action == selectorData.debouncedAction) {
 			debouncedActionIndex = i;
-		} else {
-			localActionOddsTable[i] = actionOddsTable[i];
-			if (actionOddsTable[i] != 0.0f) {
-				allOddsZero = false;
-			}
+		} else if (actionOddsTable[i] > 0.0f) {
+			eligibleMask |= (1u << i);
 		}
 	}
 
 	// if we couldn't find anything except our debounced action, try it
-	if (allOddsZero && debouncedActionIndex != -1) {
-		localActionOddsTable[debouncedActionIndex] = actionOddsTable[debouncedActionIndex];
-		if (actionOddsTable[debouncedActionIndex] != 0.0f) {
-			allOddsZero = false;
-		}
+	if (eligibleMask == 0 && debouncedActionIndex != -1 && actionOddsTable[debouncedActionIndex] > 0.0f) {
+		eligibleMask = (1u << debouncedActionIndex);
 	}
 
 	// if no action has a chance of happening, do nothing
-	if (allOddsZero) {
+	if (eligibleMask == 0) {
 		return -1;
 	}
 
+	// if only one action is eligible, there is no choice to make
+	if ((eligibleMask & (eligibleMask - 1)) == 0) {
+		for (int i = 0; i < actionCount; ++i) {
+			if (eligibleMask == (1u << i)) {
+				return i;
+			}
+		}
+	}
+
+	// if the eligible set changed, rebuild my alias table
+	if (eligibleMask != oddsAliasTable.eligibleMask || actionCount != oddsAliasTable.actionCount) {
+		CJediAiActionRandomBase *me = const_cast<CJediAiActionRandomBase*>(this);
+		me->buildOddsAliasTable(actionCount, actionOddsTable, eligibleMask);
+	}
+
 	// choose an action
-	int actionIndex = randChoice(actionCount, localActionOddsTable);
+	// the integer part of our random value picks a column, and the fraction picks either it or its alias
+	float value = random.nextFloat() * (float)actionCount;
+	int actionIndex = min((int)value, actionCount - 1);
+	if ((value - (float)actionIndex) >= oddsAliasTable.probabilityTable[actionIndex]) {
+		actionIndex = oddsAliasTable.aliasTable[actionIndex];
+	}
 	return actionIndex;
 }
 
+void CJediAiActionRandomBase::buildOddsAliasTable(int actionCount, const float actionOddsTable[], unsigned int eligibleMask) {
+	oddsAliasTable.eligibleMask = eligibleMask;
+	oddsAliasTable.actionCount = actionCount;
+	oddsAliasTable.buildCount++;
+
+	// calculate the odds total of the eligible actions
+	float oddsTotal = 0.0f;
+	for (int i = 0; i < actionCount; ++i) {
+		if (eligibleMask & (1u << i)) {
+			oddsTotal += actionOddsTable[i];
+		}
+	}
+
+	// scale each action's odds so that the average is one
+	// and sort them into those below average and those above it
+	int smallTable[kOddsAliasTableSize], smallCount = 0;
+	int largeTable[kOddsAliasTableSize], largeCount = 0;
+	for (int i = 0; i < actionCount; ++i) {
+		float odds = ((eligibleMask & (1u << i)) ? actionOddsTable[i] : 0.0f);
+		oddsAliasTable.probabilityTable[i] = (odds * (float)actionCount) / oddsTotal;
+		oddsAliasTable.aliasTable[i] = (unsigned char)i;
+		if (oddsAliasTable.probabilityTable[i] < 1.0f) {
+			smallTable[smallCount++] = i;
+		} else {
+			largeTable[largeCount++] = i;
+		}
+	}
+
+	// fill each below average column with the excess from an above average one
+	while (smallCount > 0 && largeCount > 0) {
+		int small = smallTable[--smallCount];
+		int large = largeTable[largeCount - 1];
+		oddsAliasTable.aliasTable[small] = (unsigned char)large;
+		oddsAliasTable.probabilityTable[large] -= (1.0f - oddsAliasTable.probabilityTable[small]);
+		if (oddsAliasTable.probabilityTable[large] < 1.0f) {
+			--largeCount;
+			smallTable[smallCount++] = large;
+		}
+	}
+
+	// anything left over is only off by rounding error, so it keeps its own column
+	// unless it isn't eligible, in which case it must always use an eligible alias
+	int eligibleIndex = 0;
+	while (!(eligibleMask & (1u << eligibleIndex))) {
+		++eligibleIndex;
+	}
+	while (largeCount > 0) {
+		oddsAliasTable.probabilityTable[largeTable[--largeCount]] = 1.0f;
+	}
+	while (smallCount > 0) {
+		int small = smallTable[--smallCount];
+		if (eligibleMask & (1u << small)) {
+			oddsAliasTable.probabilityTable[small] = 1.0f;
+		} else {
+			oddsAliasTable.probabilityTable[small] = 0.0f;
+			oddsAliasTable.aliasTable[small] = (unsigned char)eligibleIndex;
+		}
+	}
+}
+
+void CJediAiActionRandomBase::invalidateOddsAliasTable() {
+	memset(&oddsAliasTable, 0, sizeof(oddsAliasTable));
+}
+
 bool CJediAiActionRandomBase::canSelectAction(int actionIndex) const {
 
 	// get my odds table
@@ -1264,6 +2443,23 @@ bool CJediAiActionRandomBase::canSelectAction(int actionIndex) const {
 	return true;
 }
 
+bool CJediAiActionRandomBase::isSelectionDecided(int actionIndex, int actionCount, CJediAiAction *const actionTable[], const bool simulatedTable[]) const {
+
+	// if this is my in progress current action and I favor it, nothing can beat it
+	if (isInProgress() && selectorParams.ifEqualUseCurrentAction && actionTable[actionIndex] == selectorData.currentAction) {
+		return true;
+	}
+
+	// otherwise, every action with the same result has a chance of being chosen,
+	// so the odds would be skewed if we skipped any of them
+	for (int i = 0; i < actionCount; ++i) {
+		if (!simulatedTable[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
 const float *CJediAiActionRandomBase::getActionOddsTable(int *actionCount) const {
 	CJediAiActionRandomBase *me = const_cast<CJediAiActionRandomBase*>(this);
 	return me->getActionOddsTable(actionCount);
@@ -1638,7 +2834,7 @@ EJediAiActionResult CJediAiActionWalkRun::checkConstraints(const CJediAiMemory &
 		CVector wTargetPos = wDestActorPos + (destActorState->iToSelfDir * distanceFromTarget);
 
 		// see if we can pathfind to this point
-		if (!determinePathFindValidity(simMemory.selfState.wPos, wTargetPos)) {
+		if (!simMemory.queryPathFindValidity(simMemory.selfState.wPos, wTargetPos)) {
 			return eJediAiActionResult_Failure;
 		}
 	}
@@ -1663,7 +2859,7 @@ void CJediAiActionWalkRun::onEnd() {
 	BASECLASS::onEnd();
 
 	// stop immediately
-	memory->selfState.jedi->stop("CJediAiActionWalkRun::onEnd");
+	memory->selfState.jedi->aiCommandQueue.stop("CJediAiActionWalkRun::onEnd");
 }
 
 void CJediAiActionWalkRun::simulate(CJediAiMemory &simMemory) {
@@ -1746,12 +2942,12 @@ EJediAiActionResult CJediAiActionWalkRun::update(float dt) {
 	CVector wTargetPos = wDestPos + (destActorState->iToSelfDir * distanceFromTarget);
 
 	// if I can't get to the specified position, I can't do this
-	if (!determinePathFindValidity(memory->selfState.wPos, wTargetPos)) {
+	if (!memory->queryPathFindValidity(memory->selfState.wPos, wTargetPos)) {
 		return eJediAiActionResult_Failure;
 	}
 
 	// move toward the specified position
-	memory->selfState.jedi->passNearPoint(destActorState->wPos, distanceFromTarget, false, "CJediAiActionWalkRun::update");
+	memory->selfState.jedi->aiCommandQueue.passNearPoint(destActorState->wPos, distanceFromTarget, false, "CJediAiActionWalkRun::update");
 
 	// adjust move speed based on distance
 	float remainingDistance = (destActorState->distanceToSelf - distanceFromTarget);
@@ -1762,7 +2958,7 @@ EJediAiActionResult CJediAiActionWalkRun::update(float dt) {
 	float runDistance = walkDistance + max(params.minRunDistance, 0.25f);
 	float clampedDistance = limit(walkDistance, remainingDistance, runDistance);
 	float speed = linterp(walkDistance, runDistance, 0.75f, 1.0f, clampedDistance);
-	memory->selfState.jedi->setDesiredMoveSpeed(speed);
+	memory->selfState.jedi->aiCommandQueue.setDesiredMoveSpeed(speed);
 
 	// still running
 	return eJediAiActionResult_InProgress;
@@ -1790,7 +2986,6 @@ void CJediAiActionDash::reset() {
 
 	// reset my data
 	memset(&params, 0, sizeof(params));
-	memset(&data, 0, sizeof(data));
 }
 
 EJediAiActionResult CJediAiActionDash::checkConstraints(const CJediAiMemory &simMemory, bool simulating) const {
@@ -1887,9 +3082,6 @@ EJediAiActionResult CJediAiActionDash::checkConstraints(const CJediAiMemory &sim
 
 EJediAiActionResult CJediAiActionDash::onBegin() {
 
-	// clear my data
-	memset(&data, 0, sizeof(data));
-
 	// base class version
 	EJediAiActionResult result = BASECLASS::onBegin();
 	if (result != eJediAiActionResult_InProgress) {
@@ -1963,83 +3155,93 @@ void CJediAiActionDash::simulate(CJediAiMemory &simMemory) {
 	setSimSummary(simSummary, simMemory);
 }
 
-EJediAiActionResult CJediAiActionDash::update(float dt) {
+CJediAiLatentTask CJediAiActionDash::run() {
 
-	// check constraints
-	EJediAiActionResult result = checkConstraints(*memory, false);
-	if (result != eJediAiActionResult_InProgress) {
-		return result;
-	}
+	// if I'm not already dashing, try to do it
+	if (!memory->isSelfInState(eJediState_Dashing)) {
+		while (true) {
 
-	// get my destination actor
-	float minDistance = 0.5f;
-	float maxDistance = 1e20f;
-	SJediAiActorState *destActorState = lookupJediAiDestinationActorState(params.destination, *memory, &minDistance, &maxDistance);
-	if (destActorState == NULL) {
-		return eJediAiActionResult_Failure;
-	}
+			// get my destination actor
+			float minDistance, activationDistanceFromTarget, distanceFromTarget;
+			SJediAiActorState *destActorState = lookupDestination(minDistance, activationDistanceFromTarget, distanceFromTarget);
+			if (destActorState == NULL) {
+				co_return eJediAiActionResult_Failure;
+			}
 
-	// if I'm ignoring the min distance, set it to my distance parameter
-	if (params.ignoreMinDistance) {
-		minDistance = params.distance;
-	}
+			// first, face my target
+			CVector iSelfToTargetDir = -destActorState->iToSelfDir;
+			float facePct = memory->selfState.iFrontDir.dotProduct(iSelfToTargetDir);
+			const float kMinFacePct = 0.9f;
+			if (facePct < kMinFacePct) {
+				co_await nextUpdate();
+				continue;
+			}
 
-	// if I am not already dashing, try to do it
-	float activationDistanceFromTarget = limit(minDistance, params.activationDistance, maxDistance);
-	float distanceFromTarget = limit(minDistance, params.distance, maxDistance);
-	bool wasDashing = data.wasDashing;
-	bool isDashing = memory->isSelfInState(eJediState_Dashing);
-	data.wasDashing = isDashing;
-	if (!isDashing && !wasDashing) {
-
-		// first, face my target
-		CVector iSelfToTargetDir = -destActorState->iToSelfDir;
-		float facePct = memory->selfState.iFrontDir.dotProduct(iSelfToTargetDir);
-		const float kMinFacePct = 0.9f;
-		if (facePct < kMinFacePct) {
-			return eJediAiActionResult_InProgress;
-		}
+			// if I'm too close, succeed
+			if (destActorState->distanceToSelf <= activationDistanceFromTarget) {
+				co_return eJediAiActionResult_Success;
+			}
 
-		// if I'm too close, succeed
-		if (destActorState->distanceToSelf <= activationDistanceFromTarget) {
-			return eJediAiActionResult_Success;
-		}
+			// if I'm already close enough, succeed
+			if (destActorState->distanceToSelf <= distanceFromTarget) {
+				co_return eJediAiActionResult_Success;
+			}
 
-		// if I'm already close enough, succeed
-		if (destActorState->distanceToSelf <= distanceFromTarget) {
-			return eJediAiActionResult_Success;
-		}
+			// compute our target position
+			CVector wDestActorPos = destActorState->wPos;
+			if (params.destination == eJediAiDestination_Victim) {
+				wDestActorPos.y = memory->victimFloorHeight;
+			}
+			CVector wTargetPos = wDestActorPos + (destActorState->iToSelfDir * distanceFromTarget);
 
-		// compute our target position
-		CVector wDestActorPos = destActorState->wPos;
-		if (params.destination == eJediAiDestination_Victim) {
-			wDestActorPos.y = memory->victimFloorHeight;
-		}
-		CVector wTargetPos = wDestActorPos + (destActorState->iToSelfDir * distanceFromTarget);
+			// if I can't get to the specified position, I can't do this
+			if (!memory->queryPathFindValidity(memory->selfState.wPos, wTargetPos)) {
+				co_return eJediAiActionResult_Failure;
+			}
 
-		// if I can't get to the specified position, I can't do this
-		if (!determinePathFindValidity(memory->selfState.wPos, wTargetPos)) {
-			return eJediAiActionResult_Failure;
+			// send the dash command
+			float distance = (params.attack ? 0.0f : (params.distance > minDistance ? params.distance - minDistance : minDistance));
+			memory->selfState.jedi->aiCommandQueue.setCommandJediDash(destActorState->actor, distance, params.attack);
+			break;
 		}
 
-		// send the dash command
-		float distance = (params.attack ? 0.0f : (params.distance > minDistance ? params.distance - minDistance : minDistance));
-		memory->selfState.jedi->setCommandJediDash(destActorState->actor, distance, params.attack);
-		data.wasDashing = true;
+		// give the command a frame to start my dash
+		co_await nextUpdate();
 	}
 
-	// if I'm dashing or haven't started, I'm still in progress
-	if (isDashing || !wasDashing) {
-		return eJediAiActionResult_InProgress;
-	}
+	// wait for my dash to finish
+	co_await waitForStateExit(eJediState_Dashing);
 
 	// if I didn't arrive at my target, I failed
+	float minDistance, activationDistanceFromTarget, distanceFromTarget;
+	SJediAiActorState *destActorState = lookupDestination(minDistance, activationDistanceFromTarget, distanceFromTarget);
+	if (destActorState == NULL) {
+		co_return eJediAiActionResult_Failure;
+	}
 	if (!params.attack && destActorState->distanceToSelf > distanceFromTarget) {
-		return eJediAiActionResult_Failure;
+		co_return eJediAiActionResult_Failure;
 	}
 
 	// success!
-	return eJediAiActionResult_Success;
+	co_return eJediAiActionResult_Success;
+}
+
+SJediAiActorState *CJediAiActionDash::lookupDestination(float &minDistance, float &activationDistanceFromTarget, float &distanceFromTarget) const {
+
+	// get my destination actor
+	minDistance = 0.5f;
+	float maxDistance = 1e20f;
+	SJediAiActorState *destActorState = lookupJediAiDestinationActorState(params.destination, *memory, &minDistance, &maxDistance);
+
+	// if I'm ignoring the min distance, set it to my distance parameter
+	if (params.ignoreMinDistance) {
+		minDistance = params.distance;
+	}
+
+	// how close do I dash, and how close is too close to bother?
+	activationDistanceFromTarget = limit(minDistance, params.activationDistance, maxDistance);
+	distanceFromTarget = limit(minDistance, params.distance, maxDistance);
+	return destActorState;
 }
 
 
@@ -2155,7 +3357,7 @@ void CJediAiActionStrafe::onEnd() {
 	BASECLASS::onEnd();
 
 	// stop moving
-	memory->selfState.jedi->stop("CJediAiActionStrafe::onEnd");
+	memory->selfState.jedi->aiCommandQueue.stop("CJediAiActionStrafe::onEnd");
 
 	// clear my data
 	memset(&data, 0, sizeof(data));
@@ -2166,7 +3368,7 @@ void CJediAiActionStrafe::simulate(CJediAiMemory &simMemory) {
 
 	// if I am not currently in progress, generate my data
 	if (!isInProgress()) {
-		data.desiredMoveDistance = fRand(params.moveDistanceMin, params.moveDistanceMax);
+		data.desiredMoveDistance = fRand(simMemory.random, params.moveDistanceMin, params.moveDistanceMax);
 		data.wSelfStartPos = simMemory.selfState.wPos;
 		data.wSelfEndPos = computeTargetPos(params.dir, data.desiredMoveDistance, simMemory);
 	}
@@ -2223,9 +3425,9 @@ EJediAiActionResult CJediAiActionStrafe::update(float dt) {
 		// walk in the specified direction
 		CVector iWalkDir = computeStrafeDir(params.dir, *memory);
 		CVector wTargetPos = memory->selfState.wPos + iWalkDir;
-		memory->selfState.jedi->passNearPoint(wTargetPos, 0.5f, false, "CJediAiActionStrafe::update");
-		memory->selfState.jedi->setDesiredMoveSpeed(1.0f);
-		memory->selfState.jedi->setCommandJediStrafe();
+		memory->selfState.jedi->aiCommandQueue.passNearPoint(wTargetPos, 0.5f, false, "CJediAiActionStrafe::update");
+		memory->selfState.jedi->aiCommandQueue.setDesiredMoveSpeed(1.0f);
+		memory->selfState.jedi->aiCommandQueue.setCommandJediStrafe();
 
 		// we are still in progress
 		return eJediAiActionResult_InProgress;
@@ -2394,9 +3596,6 @@ EJediAiActionResult CJediAiActionJumpForward::checkConstraints(const CJediAiMemo
 
 EJediAiActionResult CJediAiActionJumpForward::onBegin() {
 
-	// clear my data
-	memset(&data, 0, sizeof(data));
-
 	// base class version
 	EJediAiActionResult result = BASECLASS::onBegin();
 	if (result != eJediAiActionResult_InProgress) {
@@ -2409,9 +3608,6 @@ EJediAiActionResult CJediAiActionJumpForward::onBegin() {
 
 void CJediAiActionJumpForward::onEnd() {
 
-	// clear my data
-	memset(&data, 0, sizeof(data));
-
 	// base class version
 	BASECLASS::onEnd();
 }
@@ -2522,50 +3718,27 @@ void CJediAiActionJumpForward::simulate(CJediAiMemory &simMemory) {
 	setSimSummary(simSummary, simMemory);
 }
 
-void CJediAiActionJumpForward::updateTimers(float dt) {
+CJediAiLatentTask CJediAiActionJumpForward::run() {
 
-	// base class version
-	BASECLASS::updateTimers(dt);
-
-	// if I'm not already jumping, check if I am now
-	if (!data.isJumping) {
-		data.isJumping = memory->isSelfInState(eJediState_Jumping);
-	}
-}
-
-EJediAiActionResult CJediAiActionJumpForward::update(float dt) {
-
-	// check constraints
-	EJediAiActionResult result = checkConstraints(*memory, false);
-	if (result != eJediAiActionResult_InProgress) {
-		return result;
-	}
-
-	// am I jumping this frame?
-	bool wasJumping = data.isJumping;
-	data.isJumping = memory->isSelfInState(eJediState_Jumping);
-
-	// if I am jumping, I am in progress
-	if (data.isJumping) {
-		return eJediAiActionResult_InProgress;
+	// send the jump command until I am jumping
+	while (!memory->isSelfInState(eJediState_Jumping)) {
+		memory->selfState.jedi->aiCommandQueue.setCommandJediJumpForward(memory->victimState->actor, params.attack, params.distance);
+		co_await nextUpdate();
 	}
 
-	// if I am not already jumping, send the jump command
-	if (!wasJumping) {
-		memory->selfState.jedi->setCommandJediJumpForward(memory->victimState->actor, params.attack, params.distance);
-		return eJediAiActionResult_InProgress;
-	}
+	// wait until I land
+	co_await waitForStateExit(eJediState_Jumping);
 
 	// I am done jumping, make sure I got where I wanted to be
 	CVector wTargetPos = computeTargetPos(*memory, params.distance);
 	float distSq = memory->selfState.wPos.xzDistanceSqTo(wTargetPos);
 	const float kMinDist = 2.0f;
 	if (distSq > SQ(kMinDist)) {
-		return eJediAiActionResult_Failure;
+		co_return eJediAiActionResult_Failure;
 	}
 
 	// success
-	return eJediAiActionResult_Success;
+	co_return eJediAiActionResult_Success;
 }
 
 bool CJediAiActionJumpForward::checkCollision(const CJediAiMemory &memory, float distance) {
@@ -2580,13 +3753,13 @@ bool CJediAiActionJumpForward::checkCollision(const CJediAiMemory &memory, float
 	CVector wTargetPos = computeTargetPos(memory, distance);
 
 	// if I can't get to the specified position, I can't do this
-	if (!determinePathFindValidity(memory.selfState.wPos, wTargetPos)) {
+	if (!memory.queryPathFindValidity(memory.selfState.wPos, wTargetPos)) {
 		return false;
 	}
 
 	// if there is something in my way, I can't do this
 	CVector iHeightDelta = kUnitVectorY * (10.0f + boundsRadius);
-	if (!collideWorldWithMovingSphere(memory.selfState.wPos + iHeightDelta, boundsRadius, wTargetPos - memory.selfState.wPos, NULL)) {
+	if (!memory.queryCollideWorldWithMovingSphere(memory.selfState.wPos + iHeightDelta, boundsRadius, wTargetPos - memory.selfState.wPos, NULL)) {
 		return false;
 	}
 
@@ -2810,7 +3983,7 @@ EJediAiActionResult CJediAiActionJumpOver::update(float dt) {
 
 	// if I am not already jumping, send the jump command
 	if (!wasJumping) {
-		memory->selfState.jedi->setCommandJediJumpOver(memory->victimState->actor, params.attack);
+		memory->selfState.jedi->aiCommandQueue.setCommandJediJumpOver(memory->victimState->actor, params.attack);
 		data.isJumping = true;
 		return eJediAiActionResult_InProgress;
 	}
@@ -2835,13 +4008,13 @@ bool CJediAiActionJumpOver::checkCollision(const CJediAiMemory &memory) {
 	wTargetPos.y += boundsRadius + 0.25f;
 
 	// if I can't get to the specified position, I can't do this
-	if (!determinePathFindValidity(memory.selfState.wPos, wDestPos)) {
+	if (!memory.queryPathFindValidity(memory.selfState.wPos, wDestPos)) {
 		return false;
 	}
 
 	// if there is something in my way, I can't do this
 	CVector iHeightDelta = kUnitVectorY * (10.0f + boundsRadius);
-	if (!collideWorldWithMovingSphere(wTargetPos, boundsRadius, iDelta, NULL)) {
+	if (!memory.queryCollideWorldWithMovingSphere(wTargetPos, boundsRadius, iDelta, NULL)) {
 		return false;
 	}
 
@@ -2963,9 +4136,9 @@ EJediAiActionResult CJediAiActionDodge::onBegin() {
 
 	// send the command
 	if (flip) {
-		memory->selfState.jedi->setCommandJediDodgeFlip(data.dir);
+		memory->selfState.jedi->aiCommandQueue.setCommandJediDodgeFlip(data.dir);
 	} else {
-		memory->selfState.jedi->setCommandJediDodge(data.dir, params.attack);
+		memory->selfState.jedi->aiCommandQueue.setCommandJediDodge(data.dir, params.attack);
 	}
 
 	// in progress
@@ -3070,7 +4243,7 @@ EJediAiActionResult CJediAiActionDodge::update(float dt) {
 	return eJediAiActionResult_Success;
 }
 
-EJediDodgeDir CJediAiActionDodge::chooseBestDir(const CJediAiMemory &simMemory) {
+EJediDodgeDir CJediAiActionDodge::chooseBestDir(CJediAiMemory &simMemory) {
 
 	// compute the dodge distance
 	float distance = (shouldFlipDodge(simMemory) ? kJediDodgeFlipDistance : kJediDodgeDistance);
@@ -3095,20 +4268,20 @@ EJediDodgeDir CJediAiActionDodge::chooseBestDir(const CJediAiMemory &simMemory)
 	}
 
 	// randomly select our direction
-	EJediDodgeDir dir = (EJediDodgeDir)randChoice(TR_COUNTOF(oddsTable), oddsTable);
+	EJediDodgeDir dir = (EJediDodgeDir)randChoice(simMemory.random, TR_COUNTOF(oddsTable), oddsTable);
 	if (dir < 0) {
 		dir = eJediDodgeDir_None;
 	}
 	return dir;
 }
 
-EJediDodgeDir CJediAiActionDodge::chooseRandomDir() {
+EJediDodgeDir CJediAiActionDodge::chooseRandomDir(CJediAiMemory &memory) {
 	EJediDodgeDir table[] = {
 		eJediDodgeDir_Left,
 		eJediDodgeDir_Right,
 		eJediDodgeDir_Back
 	};
-	int index = rand() % TR_COUNTOF(table);
+	int index = (int)(memory.random.next() % TR_COUNTOF(table));
 	return table[index];
 }
 
@@ -3159,13 +4332,13 @@ float CJediAiActionDodge::checkCollision(EJediDodgeDir dir, const CJediAiMemory
 	CVector wTargetPos = wStartPos + iDelta;
 
 	// if I can't get to the specified position, I can't do this
-	if (!determinePathFindValidity(wStartPos, wTargetPos)) {
+	if (!memory.queryPathFindValidity(wStartPos, wTargetPos)) {
 		return kJediDodgeDistance;
 	}
 
 	// if anything is in my way, we can't do this
 	CVector wCollisionPos;
-	if (collideWorldWithMovingSphere(wStartPos, radius, iDelta, &wCollisionPos)) {
+	if (memory.queryCollideWorldWithMovingSphere(wStartPos, radius, iDelta, &wCollisionPos)) {
 		float distance = memory.selfState.wPos.distanceTo(wCollisionPos);
 		return distance;
 	}
@@ -3330,7 +4503,7 @@ EJediAiActionResult CJediAiActionCrouch::onBegin() {
 	}
 
 	// send the crouch command
-	memory->selfState.jedi->setCommandJediCrouch();
+	memory->selfState.jedi->aiCommandQueue.setCommandJediCrouch();
 
 	// in progress
 	return eJediAiActionResult_InProgress;
@@ -3371,10 +4544,10 @@ void CJediAiActionCrouch::simulate(CJediAiMemory &simMemory) {
 	}
 
 	// remove our expired time
-	if (duration < data.timer) {
+	if (duration < latentData.timer) {
 		duration = 0.0f;
 	} else {
-		duration -= data.timer;
+		duration -= latentData.timer;
 	}
 
 	// if we are attacking as well, damage our target
@@ -3399,41 +4572,31 @@ void CJediAiActionCrouch::simulate(CJediAiMemory &simMemory) {
 	setSimSummary(simSummary, simMemory);
 }
 
-void CJediAiActionCrouch::updateTimers(float dt) {
-
-	// update timer
-	incrementTimer(data.timer, dt, data.duration);
-}
-
-EJediAiActionResult CJediAiActionCrouch::update(float dt) {
-
-	// check constraints
-	EJediAiActionResult result = checkConstraints(*memory, false);
-	if (result != eJediAiActionResult_InProgress) {
-		return result;
-	}
+CJediAiLatentTask CJediAiActionCrouch::run() {
 
-	// if we are no longer crouching, bail
-	bool willAttack = (params.attack && !data.attacked);
-	if ((data.duration <= 0.0f && !willAttack) || !memory->isSelfInState(eJediState_Crouching)) {
-		return eJediAiActionResult_Success;
-	}
+	// keep crouching until my timer expires
+	while (true) {
 
-	// if my timer hasn't yet expired, we are still in progress
-	if (data.timer < data.duration) {
-		memory->selfState.jedi->setCommandJediCrouch();
-		return eJediAiActionResult_InProgress;
+		// if we are no longer crouching, bail
+		if ((data.duration <= 0.0f && !params.attack) || !memory->isSelfInState(eJediState_Crouching)) {
+			co_return eJediAiActionResult_Success;
+		}
+		if (latentData.timer >= data.duration) {
+			break;
+		}
+		memory->selfState.jedi->aiCommandQueue.setCommandJediCrouch();
+		co_await nextUpdate();
 	}
 
 	// if I am attacking, send the command now
-	if (willAttack) {
-		memory->selfState.jedi->setCommandJediCrouchAttack();
+	if (params.attack) {
+		memory->selfState.jedi->aiCommandQueue.setCommandJediCrouchAttack();
 		data.attacked = true;
-		return eJediAiActionResult_InProgress;
+		co_await nextUpdate();
 	}
 
 	// success!
-	return eJediAiActionResult_Success;
+	co_return eJediAiActionResult_Success;
 }
 
 
@@ -3500,7 +4663,7 @@ EJediAiActionResult CJediAiActionDeflect::onBegin() {
 
 	// send the deflect command
 	bool deflectAtEnemies = (params.deflectAtEnemies && !memory->selfState.defensiveModeEnabled);
-	memory->selfState.jedi->setCommandJediDeflect(deflectAtEnemies);
+	memory->selfState.jedi->aiCommandQueue.setCommandJediDeflect(deflectAtEnemies);
 
 	// in progress
 	return eJediAiActionResult_InProgress;
@@ -3604,7 +4767,7 @@ EJediAiActionResult CJediAiActionDeflect::update(float dt) {
 
 	// I'm still deflecting
 	bool deflectAtEnemies = (params.deflectAtEnemies && !memory->selfState.defensiveModeEnabled);
-	memory->selfState.jedi->setCommandJediDeflect(deflectAtEnemies);
+	memory->selfState.jedi->aiCommandQueue.setCommandJediDeflect(deflectAtEnemies);
 	return eJediAiActionResult_InProgress;
 }
 
@@ -3668,7 +4831,7 @@ EJediAiActionResult CJediAiActionBlock::onBegin() {
 	}
 
 	// send the block command
-	memory->selfState.jedi->setCommandJediBlock(data.params.dir);
+	memory->selfState.jedi->aiCommandQueue.setCommandJediBlock(data.params.dir);
 
 	// in progress
 	return eJediAiActionResult_InProgress;
@@ -3736,7 +4899,7 @@ EJediAiActionResult CJediAiActionBlock::update(float dt) {
 
 		// if my timer hasn't yet expired, we are still in progress
 		if (data.timer < data.params.duration) {
-			memory->selfState.jedi->setCommandJediBlock(data.params.dir);
+			memory->selfState.jedi->aiCommandQueue.setCommandJediBlock(data.params.dir);
 			return eJediAiActionResult_InProgress;
 		}
 	}
@@ -3792,7 +4955,7 @@ EJediBlockDir CJediAiActionBlock::chooseBestDir(CJediAiMemory &simMemory) const
 	}
 
 	// randomly select our direction
-	EJediBlockDir dir = (EJediBlockDir)randChoice(TR_COUNTOF(oddsTable), oddsTable);
+	EJediBlockDir dir = (EJediBlockDir)randChoice(simMemory.random, TR_COUNTOF(oddsTable), oddsTable);
 	if (dir < 0) {
 		dir = eJediBlockDir_None;
 	}
@@ -4038,7 +5201,7 @@ EJediAiActionResult CJediAiActionSwingSaber::update(float dt) {
 void CJediAiActionSwingSaber::enqueueSaberSwing() {
 
 	// request a swing
-	memory->selfState.jedi->setCommandJediSwingSaber();
+	memory->selfState.jedi->aiCommandQueue.setCommandJediSwingSaber();
 
 	// update our data
 	data.timer = 0.0f;
@@ -4153,7 +5316,7 @@ EJediAiActionResult CJediAiActionKick::onBegin() {
 	}
 
 	// send the kick command
-	memory->selfState.jedi->setCommandJediKick(params.allowDisplacement);
+	memory->selfState.jedi->aiCommandQueue.setCommandJediKick(params.allowDisplacement);
 
 	// in progress
 	return eJediAiActionResult_InProgress;
@@ -4349,14 +5512,14 @@ EJediAiActionResult CJediAiActionForcePush::onBegin() {
 	}
 
 	// stop doing anything else
-	memory->selfState.jedi->stop("CJediAiActionForcePush::onBegin");
+	memory->selfState.jedi->aiCommandQueue.stop("CJediAiActionForcePush::onBegin");
 
 	// prep the force push
 	if (params.skipCharge) {
-		memory->selfState.jedi->setCommandJediForcePushThrow();
+		memory->selfState.jedi->aiCommandQueue.setCommandJediForcePushThrow();
 		data.forcePushed = true;
 	} else {
-		memory->selfState.jedi->setCommandJediForcePushCharge();
+		memory->selfState.jedi->aiCommandQueue.setCommandJediForcePushCharge();
 	}
 
 	// in progress
@@ -4444,7 +5607,7 @@ void CJediAiActionForcePush::simulate(CJediAiMemory &simMemory) {
 	CVector wStartPos = simMemory.selfState.wPos;
 	CVector iDelta = simMemory.selfState.iFrontDir * fpMaxDistance;
 	CVector wCollisionPos;
-	if (collideWorldWithMovingSphere(wStartPos, simMemory.selfState.forcePushDamageRadius, iDelta, &wCollisionPos)) {
+	if (simMemory.queryCollideWorldWithMovingSphere(wStartPos, simMemory.selfState.forcePushDamageRadius, iDelta, &wCollisionPos)) {
 		fpCollisionDistance = wStartPos.distanceTo(wCollisionPos);
 	}
 
@@ -4724,14 +5887,14 @@ EJediAiActionResult CJediAiActionForcePush::update(float dt) {
 
 	// if my timer hasn't yet expired, we are still in progress
 	if (data.chargeTimer < params.chargeDuration) {
-		memory->selfState.jedi->setCommandJediForcePushCharge();
+		memory->selfState.jedi->aiCommandQueue.setCommandJediForcePushCharge();
 		return eJediAiActionResult_InProgress;
 	}
 
 	// if my timer just expired, activate the force push
 	if (memory->isSelfInState(eJediState_ForcePushing)) {
 		data.forcePushed = true;
-		memory->selfState.jedi->setCommandJediForcePushThrow();
+		memory->selfState.jedi->aiCommandQueue.setCommandJediForcePushThrow();
 		return eJediAiActionResult_InProgress;
 	}
 
@@ -4875,10 +6038,10 @@ EJediAiActionResult CJediAiActionForceTk::onBegin() {
 	}
 
 	// stop doing anything else
-	memory->selfState.jedi->stop("CJediAiActionForceTk::onBegin");
+	memory->selfState.jedi->aiCommandQueue.stop("CJediAiActionForceTk::onBegin");
 
 	// send the force tk grip command
-	memory->selfState.jedi->setCommandJediForceTkGrip(gripTarget->actor, data.twoHanded, 1.0f, params.skipEnter);
+	memory->selfState.jedi->aiCommandQueue.setCommandJediForceTkGrip(gripTarget->actor, data.twoHanded, 1.0f, params.skipEnter);
 
 	// in progress
 	return eJediAiActionResult_InProgress;
@@ -4995,7 +6158,7 @@ void CJediAiActionForceTk::simulate(CJediAiMemory &simMemory) {
 
 			// otherwise, compute where we'll throw our target
 			} else {
-				bool throwRight = randBool(0.5f);
+				bool throwRight = randBool(simMemory.random, 0.5f);
 				float throwRange = (throwRight ? kJediThrowRange : -kJediThrowRange);
 				iThrowDelta = simMemory.selfState.iRightDir * throwRange;
 			}
@@ -5100,7 +6263,7 @@ EJediAiActionResult CJediAiActionForceTk::update(float dt) {
 
 	// if we are still in progress, send the tk command
 	if (isInProgress) {
-		memory->selfState.jedi->setCommandJediForceTkGrip(gripTarget->actor, data.twoHanded, 1.0f, params.skipEnter);
+		memory->selfState.jedi->aiCommandQueue.setCommandJediForceTkGrip(gripTarget->actor, data.twoHanded, 1.0f, params.skipEnter);
 		return eJediAiActionResult_InProgress;
 	}
 
@@ -5124,19 +6287,19 @@ EJediAiActionResult CJediAiActionForceTk::update(float dt) {
 			// if we have a throw target, throw at it
 			SJediAiActorState *throwTargetState = lookupJediAiForceTkTargetActorState(true, params.throwTarget, *memory);
 			if (throwTargetState != NULL) {
-				memory->selfState.jedi->setCommandJediForceTkThrowAtTarget(throwTargetState->actor);
+				memory->selfState.jedi->aiCommandQueue.setCommandJediForceTkThrowAtTarget(throwTargetState->actor);
 
 			// otherwise, if I have a throw velocity, use it
 			} else if (!params.iThrowVelocity.isCloseTo(kZeroVector, 0.001f)) {
-				memory->selfState.jedi->setCommandJediForceTkThrow(params.iThrowVelocity);
+				memory->selfState.jedi->aiCommandQueue.setCommandJediForceTkThrow(params.iThrowVelocity);
 
 			// otherwise, throw randomly left or right
 			} else {
-				bool throwRight = randBool(0.5f);
+				bool throwRight = randBool(memory->random, 0.5f);
 				float throwRange = (throwRight ? kJediThrowRange : -kJediThrowRange);
 				CVector iThrowVelocity = memory->selfState.iRightDir * throwRange;
 				iThrowVelocity.y += getGravity() / 2.0f;
-				memory->selfState.jedi->setCommandJediForceTkThrow(iThrowVelocity);
+				memory->selfState.jedi->aiCommandQueue.setCommandJediForceTkThrow(iThrowVelocity);
 			}
 			data.throwing = true;
 			return eJediAiActionResult_InProgress;
@@ -5212,7 +6375,7 @@ EJediAiActionResult CJediAiActionDefensiveStance::onBegin() {
 	}
 
 	// stand defensively
-	memory->selfState.jedi->setCommandJediStandDefensive();
+	memory->selfState.jedi->aiCommandQueue.setCommandJediStandDefensive();
 
 	// in progress
 	return eJediAiActionResult_InProgress;
@@ -5270,7 +6433,7 @@ EJediAiActionResult CJediAiActionDefensiveStance::update(float dt) {
 
 	// if my timer hasn't yet expired, we are still in progress
 	if (params.duration < 0.0f || data.timer < params.duration) {
-		memory->selfState.jedi->setCommandJediStandDefensive();
+		memory->selfState.jedi->aiCommandQueue.setCommandJediStandDefensive();
 		return eJediAiActionResult_InProgress;
 	}
 
@@ -5278,6 +6441,25 @@ EJediAiActionResult CJediAiActionDefensiveStance::update(float dt) {
 	return eJediAiActionResult_Success;
 }
 
+bool CJediAiActionDefensiveStance::canSleep(SJediAiWakeCondition &wakeCondition) const {
+	if (!isInProgress()) {
+		return false;
+	}
+
+	// I just stand there, so I can sleep until my time is up or a threat I exit on appears
+	// my stance holds while I sleep, and I stand again when I wake
+	wakeCondition.clear();
+	if (params.duration >= 0.0f) {
+		wakeCondition.wakeTime = memory->currentTime + max(params.duration - data.timer, 0.0f);
+	}
+	for (int i = 0; i < eJediThreatType_Count; ++i) {
+		if (params.exitOnThreat[i]) {
+			wakeCondition.threatTypeMask |= (1 << i);
+		}
+	}
+	return true;
+}
+
 
 /////////////////////////////////////////////////////////////////////////////
 //
@@ -5336,7 +6518,7 @@ EJediAiActionResult CJediAiActionWaitForThreat::onBegin() {
 	}
 
 	// stand defensively
-	memory->selfState.jedi->setCommandJediStandDefensive();
+	memory->selfState.jedi->aiCommandQueue.setCommandJediStandDefensive();
 
 	// in progress
 	return eJediAiActionResult_InProgress;
@@ -5405,7 +6587,7 @@ EJediAiActionResult CJediAiActionWaitForThreat::update(float dt) {
 
 	// if my timer hasn't yet expired, we are still in progress
 	if (data.timer < params.duration) {
-		memory->selfState.jedi->setCommandJediStandDefensive();
+		memory->selfState.jedi->aiCommandQueue.setCommandJediStandDefensive();
 		return eJediAiActionResult_InProgress;
 	}
 
@@ -5413,6 +6595,26 @@ EJediAiActionResult CJediAiActionWaitForThreat::update(float dt) {
 	return eJediAiActionResult_Failure;
 }
 
+bool CJediAiActionWaitForThreat::canSleep(SJediAiWakeCondition &wakeCondition) const {
+	if (!isInProgress()) {
+		return false;
+	}
+
+	// once a threat I'm waiting for is around, I have to watch it get closer every frame
+	// until then, I can sleep until one appears or my time is up
+	wakeCondition.clear();
+	for (int i = 0; i < eJediThreatType_Count; ++i) {
+		if (params.threatParamTable[i].inUse) {
+			if (memory->threatTypeDataTable[i].count > 0) {
+				return false;
+			}
+			wakeCondition.threatTypeMask |= (1 << i);
+		}
+	}
+	wakeCondition.wakeTime = memory->currentTime + max(params.duration - data.timer, 0.0f);
+	return true;
+}
+
 float CJediAiActionWaitForThreat::computeWaitDurationForThreat(const CJediAiMemory::SJediThreatTypeData &threatTypeData, const SThreatParams &threatParams) const {
 
 	// start with the remaining duration
@@ -5559,7 +6761,7 @@ EJediAiActionResult CJediAiActionTaunt::onBegin() {
 	}
 
 	// send the taunt command
-	memory->selfState.jedi->setCommandJediTaunt();
+	memory->selfState.jedi->aiCommandQueue.setCommandJediTaunt();
 
 	// in progress
 	return eJediAiActionResult_InProgress;
@@ -5610,8 +6812,8 @@ void CJediAiActionTaunt::updateTimers(float dt) {
 	if ((memory->victimState->flags & kJediAiActorStateFlag_InRushAttack) == 0) {
 		float halfDuration = (kJediTauntDuration / 2.0f);
 		if (prevTimer < halfDuration && data.timer >= halfDuration) {
-			if (randBool(params.enrageTargetOdds)) {
-				memory->victimState->actor->taunt();
+			if (randBool(memory->random, params.enrageTargetOdds)) {
+				memory->selfState.jedi->aiCommandQueue.tauntActor(memory->victimState->actor);
 			}
 		}
 	}
@@ -6056,6 +7258,27 @@ bool CJediAiActionMove::doesActionLoop(int actionIndex) const {
 	return (actionIndex == eAction_Deflect);
 }
 
+bool CJediAiActionMove::isSimulationEquivalent(const CJediAiAction &other) const {
+
+	// we must be set up the same
+	if (!hasEquivalentSimulationSetup(other)) {
+		return false;
+	}
+
+	// my children get their params from mine, so we only need to compare mine
+	const CJediAiActionMove &otherMove = (const CJediAiActionMove&)other;
+	return (
+		params.destination == otherMove.params.destination &&
+		params.activationDistance == otherMove.params.activationDistance &&
+		params.dashActivationDistance == otherMove.params.dashActivationDistance &&
+		params.minDashDistance == otherMove.params.minDashDistance &&
+		params.minWalkRunDistance == otherMove.params.minWalkRunDistance &&
+		params.facePct == otherMove.params.facePct &&
+		params.isRelevant == otherMove.params.isRelevant &&
+		params.failIfTooClose == otherMove.params.failIfTooClose
+	);
+}
+
 
 /////////////////////////////////////////////////////////////////////////////
 //
@@ -6177,6 +7400,55 @@ void CJediAiActionBlasterCounterAttack::simulate(CJediAiMemory &simMemory) {
 	}
 }
 
+bool CJediAiActionBlasterCounterAttack::estimateSimulation(const CJediAiMemory &simMemory, SJediAiActionSimSummary &estimate) const {
+	initSimSummary(estimate, simMemory);
+
+	// check constraints
+	EJediAiActionResult result = checkConstraints(simMemory, true);
+	if (result != eJediAiActionResult_InProgress) {
+		if (result == eJediAiActionResult_Success) {
+			setSimSummary(estimate, simMemory);
+		}
+		return true;
+	}
+
+	// I must be able to deflect, see my victim, and be targeted by it
+	if (!simMemory.canSelfDoAction(eJediAction_Deflect) || !simMemory.victimInView) {
+		return true;
+	}
+	if (!(simMemory.victimState->flags & kJediAiActorStateFlag_TargetingSelf)) {
+		return true;
+	}
+
+	// deflecting removes the blaster threats I am facing, and reflects my victim's bolts back at it
+	// anything else that lands while I am deflecting hits me
+	bool reflecting = !simMemory.selfState.defensiveModeEnabled;
+	float removedThreatLevel = 0.0f;
+	for (int i = 0; i < simMemory.threatStateCount; ++i) {
+		const SJediAiThreatState &threatState = simMemory.threatStates[i];
+		if (threatState.type == eJediThreatType_Blaster && threatState.selfFacePct > 0.25f) {
+			removedThreatLevel += simMemory.computeThreatStateLevel(threatState);
+			if (reflecting && threatState.attackerState == simMemory.victimState) {
+				estimate.victimHitPoints -= threatState.strength;
+			}
+		} else if (threatState.duration <= simMemory.recommendedDeflectionDuration) {
+			estimate.selfHitPoints -= threatState.strength;
+		}
+	}
+	estimate.threatLevel = max(0.0f, estimate.threatLevel - (removedThreatLevel / (float)CJediAiMemory::kThreatLevelAverageCount));
+
+	// we are at least beneficial, and better if we took a real bite out of the threats
+	float threatLevelDelta = (simMemory.threatLevel - estimate.threatLevel);
+	if (threatLevelDelta >= 0.05f) {
+		estimate.result = eJediAiActionSimResult_Urgent;
+	} else if (threatLevelDelta > 0.0f && estimate.selfHitPoints >= simMemory.selfState.hitPoints) {
+		estimate.result = eJediAiActionSimResult_Safe;
+	} else {
+		estimate.result = eJediAiActionSimResult_Beneficial;
+	}
+	return true;
+}
+
 CJediAiAction **CJediAiActionBlasterCounterAttack::getActionTable(int *actionCount) {
 	if (actionCount != NULL) {
 		*actionCount = eAction_Count;
@@ -6292,6 +7564,9 @@ void CJediAiActionEngageTrandoshanInfantry::reset() {
 	// debounce my actions
 	selectorParams.debounceActions = true;
 
+	// my counter attack estimates itself, so it is only simulated when it can be done
+	selectorParams.estimateTopCount = 1;
+
 	// setup force tk attack
 	forceTkAttack.name = "Force Tk Victim";
 	forceTkAttack.params.allowActionFailure = true;
@@ -6551,19 +7826,64 @@ void CJediAiActionMeleeCounterAttack::simulate(CJediAiMemory &simMemory) {
 		return;
 	}
 
-	// I can only do this if my victim is targetting me
+	// I can only do this if my victim is targetting me
+	if (!(simMemory.victimState->flags & kJediAiActorStateFlag_TargetingSelf)) {
+		initSimSummary(simSummary, simMemory);
+		return;
+	}
+
+	// base class version
+	BASECLASS::simulate(simMemory);
+
+	// we are at least beneficial
+	if (simSummary.result < eJediAiActionSimResult_Beneficial) {
+		simSummary.result = eJediAiActionSimResult_Beneficial;
+	}
+}
+
+bool CJediAiActionMeleeCounterAttack::estimateSimulation(const CJediAiMemory &simMemory, SJediAiActionSimSummary &estimate) const {
+	initSimSummary(estimate, simMemory);
+
+	// check constraints
+	EJediAiActionResult result = checkConstraints(simMemory, true);
+	if (result != eJediAiActionResult_InProgress) {
+		if (result == eJediAiActionResult_Success) {
+			setSimSummary(estimate, simMemory);
+		}
+		return true;
+	}
+
+	// I must see my victim, be on my feet, and be targeted by my victim
+	if (!simMemory.victimInView || simMemory.isSelfInState(eJediState_KnockedAround)) {
+		return true;
+	}
 	if (!(simMemory.victimState->flags & kJediAiActorStateFlag_TargetingSelf)) {
-		initSimSummary(simSummary, simMemory);
-		return;
+		return true;
 	}
 
-	// base class version
-	BASECLASS::simulate(simMemory);
+	// countering removes my victim's melee and rush threats, and gets in one saber swing
+	float removedThreatLevel = 0.0f;
+	for (int i = 0; i < simMemory.threatStateCount; ++i) {
+		const SJediAiThreatState &threatState = simMemory.threatStates[i];
+		if ((threatState.type == eJediThreatType_Melee || threatState.type == eJediThreatType_Rush) && threatState.attackerState == simMemory.victimState) {
+			removedThreatLevel += simMemory.computeThreatStateLevel(threatState);
+		}
+	}
+	if (removedThreatLevel > 0.0f && !simMemory.selfState.defensiveModeEnabled) {
+		estimate.victimHitPoints -= simMemory.selfState.saberDamage;
+	}
+	estimate.threatLevel = max(0.0f, estimate.threatLevel - (removedThreatLevel / (float)CJediAiMemory::kThreatLevelAverageCount));
 
-	// we are at least beneficial
-	if (simSummary.result < eJediAiActionSimResult_Beneficial) {
-		simSummary.result = eJediAiActionSimResult_Beneficial;
+	// we are at least beneficial, and better if we took a real bite out of the threats
+	float threatLevelDelta = (simMemory.threatLevel - estimate.threatLevel);
+	if (threatLevelDelta >= 0.05f) {
+		estimate.result = eJediAiActionSimResult_Urgent;
+	} else if (threatLevelDelta > 0.0f) {
+		estimate.result = eJediAiActionSimResult_Safe;
+	} else {
+		estimate.result = eJediAiActionSimResult_Beneficial;
 	}
+	return true;
 }
 
 CJediAiAction **CJediAiActionMeleeCounterAttack::getActionTable(int *actionCount) {
@@ -6693,6 +8013,9 @@ void CJediAiActionEngageTrandoshanMelee::reset() {
 	// debounce my actions
 	selectorParams.debounceActions = true;
 
+	// my counter attack estimates itself, so it is only simulated when it can be done
+	selectorParams.estimateTopCount = 1;
+
 	// setup kick fail
 	kickFail.name = "Kick Fail";
 	kickFail.params.allowDisplacement = true;
@@ -7516,6 +8839,9 @@ void CJediAiActionEngageB1BattleDroid::reset() {
 	// debounce my actions
 	selectorParams.debounceActions = true;
 
+	// my counter attack estimates itself, so it is only simulated when it can be done
+	selectorParams.estimateTopCount = 1;
+
 	// setup force tk attack
 	forceTk.name = "Force Tk Victim";
 	forceTk.params.gripDuration = 1.0f;
@@ -7674,6 +9000,9 @@ void CJediAiActionEngageB1MeleeDroid::reset() {
 	// debounce my actions
 	selectorParams.debounceActions = true;
 
+	// my counter attack estimates itself, so it is only simulated when it can be done
+	selectorParams.estimateTopCount = 1;
+
 	// setup special attack
 	specialAttack.name = "Special Attack";
 	specialAttack.selectorParams.debounceActions = true;
@@ -7807,6 +9136,9 @@ void CJediAiActionEngageB1JetpackDroid::reset() {
 	// debounce my actions
 	selectorParams.debounceActions = true;
 
+	// my counter attack estimates itself, so it is only simulated when it can be done
+	selectorParams.estimateTopCount = 1;
+
 	// setup force tk kill
 	forceTkKill.name = "ForceTk Kill";
 	forceTkKill.params.gripDuration = 0.5f;
@@ -8236,6 +9568,9 @@ void CJediAiActionEngageDroideka::reset() {
 	// debounce my actions
 	selectorParams.debounceActions = true;
 
+	// my counter attack estimates itself, so it is only simulated when it can be done
+	selectorParams.estimateTopCount = 1;
+
 	// deflect attack
 	deflectAttack.name = "Deflect Attack";
 
@@ -8369,6 +9704,367 @@ float *CJediAiActionEngageDroideka::getActionOddsTable(int *actionCount) {
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+//
+// planner
+//
+/////////////////////////////////////////////////////////////////////////////
+
+CJediAiActionPlanner::CJediAiActionPlanner() {
+
+	// build my action table
+	// if you hit the compileTimeAssert below, you've likely added an
+	// action and need to set it up here
+	memset(actionTable, 0, sizeof(actionTable));
+	actionTable[eAction_DodgeLeft] = &dodgeLeft;
+	actionTable[eAction_DodgeRight] = &dodgeRight;
+	actionTable[eAction_DodgeBack] = &dodgeBack;
+	actionTable[eAction_SwingSaber] = &swingSaber;
+	actionTable[eAction_ForcePush] = &forcePush;
+	actionTable[eAction_Kick] = &kick;
+	actionTable[eAction_JumpForward] = &jumpForward;
+	compileTimeAssert(eAction_Count == 7);
+
+	// expanded masks are 32 bits, and node indices are shorts
+	compileTimeAssert(eAction_Count <= 32);
+	compileTimeAssert(kPlannerNodePoolSize <= 32767);
+
+	// reset my data
+	reset();
+}
+
+EJediAiAction CJediAiActionPlanner::getType() const {
+	return eJediAiAction_Planner;
+}
+
+void CJediAiActionPlanner::reset() {
+
+	// base class version
+	BASECLASS::reset();
+
+	// reset my params and data
+	memset(&plannerParams, 0, sizeof(plannerParams));
+	memset(&plannerData, 0, sizeof(plannerData));
+
+	// plan every frame, refining the same tree while our action runs
+	selectorParams.selectFrequency = 0.0f;
+
+	// search three actions ahead for half a millisecond
+	plannerParams.budgetMicroseconds = 500.0f;
+	plannerParams.maxDepth = 3;
+	plannerParams.explorationConstant = 1.41f;
+	plannerParams.discount = 0.9f;
+
+	// setup my actions
+	dodgeLeft.name = "Dodge Left";
+	dodgeLeft.params.dir = eJediDodgeDir_Left;
+	dodgeRight.name = "Dodge Right";
+	dodgeRight.params.dir = eJediDodgeDir_Right;
+	dodgeBack.name = "Dodge Back";
+	dodgeBack.params.dir = eJediDodgeDir_Back;
+	swingSaber.name = "Swing Saber";
+	swingSaber.params.numSwings = 1;
+	forcePush.name = "Force Push";
+	kick.name = "Kick";
+	jumpForward.name = "Jump Forward";
+	jumpForward.params.distance = 10.0f;
+	jumpForward.params.activationDistance = 30.0f;
+
+	// start with an empty tree
+	clearTree();
+}
+
+CJediAiAction **CJediAiActionPlanner::getActionTable(int *actionCount) {
+	if (actionCount != NULL) {
+		*actionCount = eAction_Count;
+	}
+	return actionTable;
+}
+
+CJediAiAction *CJediAiActionPlanner::selectAction(CJediAiMemory *simMemory) const {
+
+	// if we are being simulated, just look one action ahead like a regular selector
+	// searching inside someone else's simulation would blow our budget many times over
+	if (simMemory != NULL) {
+		return BASECLASS::selectAction(simMemory);
+	}
+
+	// search for our best action
+	CJediAiActionPlanner *me = const_cast<CJediAiActionPlanner*>(this);
+	return me->plan();
+}
+
+CJediAiAction *CJediAiActionPlanner::plan() {
+
+	// if the action we planned last time is done, what we planned to do after it becomes our new root
+	// if it is still running, keep refining the plan we already have
+	if (plannerData.plannedAction >= 0) {
+		CJediAiAction *plannedAction = actionTable[plannerData.plannedAction];
+		if (selectorData.currentAction != plannedAction || selectorData.currentActionResult != eJediAiActionResult_InProgress) {
+			advanceRoot(plannerData.plannedAction);
+		}
+	}
+	plannerData.plannedAction = -1;
+
+	// if we have no root, we have nothing to search
+	if (plannerData.rootNode < 0) {
+		return NULL;
+	}
+
+	// search until we run out of time or iterations
+	// we always run at least one iteration, and only check the clock between them
+	double startTime = getTimeMicroseconds();
+	double elapsedMicroseconds = 0.0;
+	plannerData.iterationCount = 0;
+	while (plannerParams.maxIterations <= 0 || plannerData.iterationCount < plannerParams.maxIterations) {
+		runSearchIteration();
+		plannerData.iterationCount++;
+		plannerData.totalIterationCount++;
+		elapsedMicroseconds = getTimeMicroseconds() - startTime;
+		if (elapsedMicroseconds >= plannerParams.budgetMicroseconds) {
+			break;
+		}
+	}
+	plannerData.elapsedMicroseconds = (float)elapsedMicroseconds;
+
+	// choose the action we visited the most
+	// break ties with the best average value
+	int bestChild = -1;
+	for (int child = nodePool[plannerData.rootNode].firstChild; child >= 0; child = nodePool[child].nextSibling) {
+		const SPlannerNode &childNode = nodePool[child];
+		if (childNode.visitCount <= 0) {
+			continue;
+		}
+		if (bestChild >= 0) {
+			const SPlannerNode &bestNode = nodePool[bestChild];
+			if (childNode.visitCount < bestNode.visitCount) {
+				continue;
+			}
+			if (childNode.visitCount == bestNode.visitCount && childNode.totalValue <= bestNode.totalValue) {
+				continue;
+			}
+		}
+		bestChild = child;
+	}
+
+	// simulate our chosen action against the world as it is now, so its summary is the one our parent sees
+	CJediAiAction *bestAction = NULL;
+	if (bestChild >= 0) {
+		int actionIndex = nodePool[bestChild].action;
+		CJediAiAction *action = actionTable[actionIndex];
+		searchMemory.copy(*memory);
+		action->simulate(searchMemory);
+
+		// if our best action is negative and we don't allow those, do nothing
+		if (selectorParams.allowNegativeActions || action->simSummary.result > eJediAiActionSimResult_Irrelevant) {
+			bestAction = action;
+			plannerData.plannedAction = actionIndex;
+			plannerData.plannedCountTable[actionIndex]++;
+		}
+	}
+	plannerData.planCount++;
+
+	// return our best action
+	return bestAction;
+}
+
+void CJediAiActionPlanner::runSearchIteration() {
+
+	// start from the world as it is now
+	// each iteration gets its own random stream, so stochastic simulations explore different outcomes
+	searchMemory.copy(*memory);
+	searchMemory.random.fork(memory->random, (unsigned int)plannerData.totalIterationCount);
+
+	// clamp our depth to what our path table can hold
+	int maxDepth = plannerParams.maxDepth;
+	if (maxDepth < 1) {
+		maxDepth = 1;
+	} else if (maxDepth > kPlannerMaxDepth) {
+		maxDepth = kPlannerMaxDepth;
+	}
+
+	// walk down the tree until we add a node
+	// each step simulates one action, and a deadly or impossible action ends the sequence
+	int path[kPlannerMaxDepth + 1];
+	float valueTable[kPlannerMaxDepth];
+	int pathLength = 0;
+	int depth = 0;
+	bool expanded = false;
+	bool terminal = false;
+	int node = plannerData.rootNode;
+	path[pathLength++] = node;
+	while (depth < maxDepth && !expanded && !terminal) {
+
+		// try the first action this node hasn't tried yet
+		// if we are out of nodes, fall back to choosing among the children we have
+		int child = -1;
+		for (int i = 0; i < eAction_Count; ++i) {
+			if (actionTable[i] != NULL && (nodePool[node].expandedMask & (1u << i)) == 0) {
+				child = allocNode(node, i);
+				expanded = (child >= 0);
+				break;
+			}
+		}
+		if (child < 0) {
+			child = selectChild(node);
+			if (child < 0) {
+				break;
+			}
+		}
+
+		// simulate the action
+		CJediAiAction *action = actionTable[nodePool[child].action];
+		action->simulate(searchMemory);
+		valueTable[depth++] = computeActionValue(action->simSummary);
+		terminal = (action->simSummary.result <= eJediAiActionSimResult_Deadly);
+		node = child;
+		path[pathLength++] = node;
+	}
+
+	// finish the sequence with random actions
+	while (depth < maxDepth && !terminal) {
+		CJediAiAction *action = actionTable[searchMemory.random.next() % eAction_Count];
+		if (action == NULL) {
+			break;
+		}
+		action->simulate(searchMemory);
+		valueTable[depth++] = computeActionValue(action->simSummary);
+		terminal = (action->simSummary.result <= eJediAiActionSimResult_Deadly);
+	}
+
+	// back up the value of the sequence
+	// each node gets the discounted value of the actions from the one that reached it onward
+	float value = 0.0f;
+	for (int i = depth - 1; i >= 0; --i) {
+		value = valueTable[i] + plannerParams.discount * value;
+		if (i + 1 < pathLength) {
+			nodePool[path[i + 1]].visitCount++;
+			nodePool[path[i + 1]].totalValue += value;
+		}
+	}
+	nodePool[path[0]].visitCount++;
+	nodePool[path[0]].totalValue += value;
+}
+
+float CJediAiActionPlanner::computeActionValue(const SJediAiActionSimSummary &simSummary) const {
+	return ((float)simSummary.result / (float)eJediAiActionSimResult_Urgent);
+}
+
+int CJediAiActionPlanner::selectChild(int node) const {
+
+	// choose the child with the best upper confidence bound
+	// unvisited children are always tried first
+	float logVisitCount = logf((float)max(nodePool[node].visitCount, 1));
+	int bestChild = -1;
+	float bestScore = 0.0f;
+	for (int child = nodePool[node].firstChild; child >= 0; child = nodePool[child].nextSibling) {
+		const SPlannerNode &childNode = nodePool[child];
+		if (childNode.visitCount <= 0) {
+			return child;
+		}
+		float averageValue = childNode.totalValue / (float)childNode.visitCount;
+		float score = averageValue + plannerParams.explorationConstant * sqrtf(logVisitCount / (float)childNode.visitCount);
+		if (bestChild < 0 || score > bestScore) {
+			bestChild = child;
+			bestScore = score;
+		}
+	}
+	return bestChild;
+}
+
+void CJediAiActionPlanner::clearTree() {
+
+	// put every node on the free list
+	for (int i = 0; i < kPlannerNodePoolSize; ++i) {
+		nodePool[i].nextSibling = (short)(i + 1 < kPlannerNodePoolSize ? i + 1 : -1);
+	}
+	plannerData.freeNode = 0;
+	plannerData.freeNodeCount = kPlannerNodePoolSize;
+	plannerData.plannedAction = -1;
+
+	// start with an empty root
+	plannerData.rootNode = (short)allocNode(-1, eAction_Count);
+}
+
+int CJediAiActionPlanner::allocNode(int parent, int action) {
+
+	// if we are out of nodes, fail
+	int node = plannerData.freeNode;
+	if (node < 0) {
+		return -1;
+	}
+
+	// pop the node off the free list
+	SPlannerNode &newNode = nodePool[node];
+	plannerData.freeNode = newNode.nextSibling;
+	plannerData.freeNodeCount--;
+
+	// setup the node
+	memset(&newNode, 0, sizeof(newNode));
+	newNode.parent = (short)parent;
+	newNode.firstChild = -1;
+	newNode.nextSibling = -1;
+	newNode.action = (short)action;
+
+	// link it to its parent
+	if (parent >= 0) {
+		SPlannerNode &parentNode = nodePool[parent];
+		newNode.nextSibling = parentNode.firstChild;
+		parentNode.firstChild = (short)node;
+		parentNode.expandedMask |= (1u << action);
+	}
+	return node;
+}
+
+void CJediAiActionPlanner::freeSubtree(int node) {
+
+	// free my children
+	int child = nodePool[node].firstChild;
+	while (child >= 0) {
+		int nextChild = nodePool[child].nextSibling;
+		freeSubtree(child);
+		child = nextChild;
+	}
+
+	// push me onto the free list
+	// this doesn't unlink me from my parent, the caller must do that
+	nodePool[node].firstChild = -1;
+	nodePool[node].nextSibling = plannerData.freeNode;
+	plannerData.freeNode = (short)node;
+	plannerData.freeNodeCount++;
+}
+
+void CJediAiActionPlanner::advanceRoot(int action) {
+
+	// keep the child reached by this action and free everything else
+	int oldRoot = plannerData.rootNode;
+	int newRoot = -1;
+	int child = nodePool[oldRoot].firstChild;
+	while (child >= 0) {
+		int nextChild = nodePool[child].nextSibling;
+		if (newRoot < 0 && nodePool[child].action == action) {
+			newRoot = child;
+		} else {
+			freeSubtree(child);
+		}
+		child = nextChild;
+	}
+	nodePool[oldRoot].firstChild = -1;
+	freeSubtree(oldRoot);
+
+	// if we never tried this action, start over with an empty root
+	if (newRoot < 0) {
+		plannerData.rootNode = (short)allocNode(-1, eAction_Count);
+		return;
+	}
+
+	// detach the new root
+	nodePool[newRoot].parent = -1;
+	nodePool[newRoot].nextSibling = -1;
+	plannerData.rootNode = (short)newRoot;
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 //
 // engage
@@ -8406,6 +10102,25 @@ void CJediAiActionEngage::init(CJediAiMemory *newWorldState) {
 	BASECLASS::init(newWorldState);
 }
 
+void CJediAiActionEngage::reset() {
+
+	// base class version
+	BASECLASS::reset();
+
+	// fighting an enemy takes one of its engage slots
+	for (int i = 0; i < eAction_Count; ++i) {
+		actionTable[i]->requiredTokens = kJediAiToken_Engage;
+	}
+
+	// reconsider who to engage every half second, simulating two other enemies each time
+	selectorParams.selectFrequency = 0.5f;
+	memset(&targetSelectionParams, 0, sizeof(targetSelectionParams));
+	targetSelectionParams.maxSimulationsPerSelection = 2;
+	targetSelectionParams.maxResultAge = 1.0f;
+	memset(&targetResultTable, 0, sizeof(targetResultTable));
+	memset(&targetSelectionStats, 0, sizeof(targetSelectionStats));
+}
+
 EJediAiAction CJediAiActionEngage::getType() const {
 	return eJediAiAction_Engage;
 }
@@ -8423,35 +10138,177 @@ CJediAiAction **CJediAiActionEngage::getActionTable(int *actionCount) {
 
 CJediAiAction *CJediAiActionEngage::selectAction(CJediAiMemory *simMemory) const {
 
-	// if I have no victim, I can't engage
+	// if I can engage my victim, simulate the action for it
+	// if other jedi hold every slot to fight my victim in, leave it to them
 	SJediAiActorState *victimState = (simMemory != NULL ? simMemory->victimState : memory->victimState);
-	if (victimState->actor == NULL || victimState->hitPoints <= 0.0f) {
-		return NULL;
+	CJediAiAction *action = NULL;
+	if (canEngageVictim(*victimState) && !(victimState->flags & kJediAiActorStateFlag_EngageSlotsTaken)) {
+		EAction actionType = getActionForVictim(*victimState);
+		action = (actionType == eAction_Count ? NULL : actionTable[actionType]);
+		if (action != NULL) {
+			if (simMemory != NULL) {
+				action->simulate(*simMemory);
+			} else {
+				CJediAiMemory actionSimMemory(*memory);
+				action->simulate(actionSimMemory);
+			}
+		}
 	}
 
-	// if my victim is incapacitated, bail
-	if (victimState->flags & kJediAiActorStateFlag_Incapacitated) {
-		return NULL;
+	// if we are selecting for real, see if someone else would be better to engage
+	if (simMemory == NULL && targetSelectionParams.maxSimulationsPerSelection > 0) {
+		action = selectTarget(action);
 	}
 
-	// get the action for our victim
-	EAction actionType = getActionForVictim(*victimState);
-	CJediAiAction *action = (actionType == eAction_Count ? NULL : actionTable[actionType]);
+	// return our action
+	return action;
+}
 
-	// if we have an action, simulate it
-	if (action != NULL) {
-		if (simMemory != NULL) {
-			action->simulate(*simMemory);
+CJediAiAction *CJediAiActionEngage::selectTarget(CJediAiAction *victimAction) const {
+	CJediAiActionEngage *me = const_cast<CJediAiActionEngage*>(this);
+	me->targetSelectionStats.selectionCount++;
+
+	// remember how my victim did, since simulating someone else with the same action overwrites it
+	// also track who each action was last simulated against, so whichever action I return can be re-simulated if someone else overwrote it
+	const SJediAiActorState *victimState = memory->victimState;
+	SJediAiActionSimSummary victimSimSummary;
+	initSimSummary(victimSimSummary, *memory);
+	const CActor *simulatedActorTable[eAction_Count];
+	memset(simulatedActorTable, 0, sizeof(simulatedActorTable));
+	if (victimAction != NULL) {
+		simulatedActorTable[getActionForVictim(*victimState)] = victimState->actor;
+		victimSimSummary = victimAction->simSummary;
+		STargetResult &victimResult = findTargetResult(victimState->actor);
+		victimResult.actor = victimState->actor;
+		victimResult.time = memory->currentTime;
+		victimResult.simSummary = victimSimSummary;
+	}
+
+	// gather everyone else I could engage, along with how old their last simulations are
+	// enemies that a player or another jedi is fighting, or whose engage slots other jedi hold, are left to them
+	int candidateCount = 0;
+	int candidateTable[CJediAiMemory::kEnemyStateListSize];
+	float candidateAgeTable[CJediAiMemory::kEnemyStateListSize];
+	for (int i = 0; i < memory->enemyStateCount; ++i) {
+		const SJediAiActorState &enemyState = memory->enemyStates[i];
+		if (enemyState.actor == victimState->actor || !canEngageVictim(enemyState) || getActionForVictim(enemyState) == eAction_Count) {
+			continue;
+		}
+		if (enemyState.flags & (kJediAiActorStateFlag_TargetedByPlayer | kJediAiActorStateFlag_EngagedWithOtherJedi | kJediAiActorStateFlag_EngageSlotsTaken)) {
+			continue;
+		}
+		const STargetResult &result = findTargetResult(enemyState.actor);
+		float age = (result.actor == enemyState.actor ? memory->currentTime - result.time : 9999.0f);
+
+		// insertion sort by age, oldest first, so every enemy gets its turn within my budget
+		int j = candidateCount++;
+		for (; j > 0 && candidateAgeTable[j - 1] < age; --j) {
+			candidateTable[j] = candidateTable[j - 1];
+			candidateAgeTable[j] = candidateAgeTable[j - 1];
+		}
+		candidateTable[j] = i;
+		candidateAgeTable[j] = age;
+	}
+
+	// simulate the oldest candidates within my budget, and reuse recent simulations for the rest
+	// each candidate simulates from a copy of my memory with it as my victim
+	int bestEnemyIndex = -1;
+	SJediAiActionSimSummary bestSimSummary = victimSimSummary;
+	for (int c = 0; c < candidateCount; ++c) {
+		int i = candidateTable[c];
+		const SJediAiActorState &enemyState = memory->enemyStates[i];
+		STargetResult &result = findTargetResult(enemyState.actor);
+		if (c < targetSelectionParams.maxSimulationsPerSelection) {
+			EAction actionType = getActionForVictim(enemyState);
+			CJediAiAction *action = actionTable[actionType];
+			CJediAiMemory candidateMemory(*memory);
+			candidateMemory.setVictim(i);
+			action->simulate(candidateMemory);
+			simulatedActorTable[actionType] = enemyState.actor;
+			result.actor = enemyState.actor;
+			result.time = memory->currentTime;
+			result.simSummary = action->simSummary;
+			me->targetSelectionStats.simulatedCount++;
+		} else if (candidateAgeTable[c] <= targetSelectionParams.maxResultAge) {
+			me->targetSelectionStats.reusedCount++;
 		} else {
-			CJediAiMemory actionSimMemory(*memory);
-			action->simulate(actionSimMemory);
+			continue;
+		}
+
+		// switching costs time, so only switch to someone who does better than my victim
+		if ((victimAction == NULL && bestEnemyIndex < 0) || isBetterTarget(result.simSummary, bestSimSummary)) {
+			bestEnemyIndex = i;
+			bestSimSummary = result.simSummary;
 		}
 	}
 
-	// return our action
+	// take a slot to fight my new victim in
+	// if another jedi took the last one since I sensed, stay with my victim
+	if (bestEnemyIndex >= 0 && memory->tokenBoard != NULL) {
+		if (!memory->tokenBoard->claimEngageSlot(memory->selfState.jedi, memory->enemyStates[bestEnemyIndex].actor, memory->currentTime)) {
+			bestEnemyIndex = -1;
+		}
+	}
+
+	// if my victim is still the best, keep it
+	// if a candidate overwrote its action's simulation, simulate my victim again so the action's state is for it
+	if (bestEnemyIndex < 0) {
+		if (victimAction != NULL && simulatedActorTable[getActionForVictim(*victimState)] != victimState->actor) {
+			CJediAiMemory victimMemory(*memory);
+			victimAction->simulate(victimMemory);
+			me->targetSelectionStats.resimulatedCount++;
+		}
+		return victimAction;
+	}
+
+	// switch victims
+	// my memory switches now so the new action runs against it, and the game catches up when it applies my command
+	// if the new victim's result was reused, or a later candidate overwrote its action's simulation, simulate it again
+	me->targetSelectionStats.switchCount++;
+	memory->setVictim(bestEnemyIndex);
+	memory->selfState.jedi->aiCommandQueue.setCurrentTarget(memory->victimState->actor);
+	EAction actionType = getActionForVictim(*memory->victimState);
+	CJediAiAction *action = actionTable[actionType];
+	if (simulatedActorTable[actionType] != memory->victimState->actor) {
+		CJediAiMemory actionSimMemory(*memory);
+		action->simulate(actionSimMemory);
+		me->targetSelectionStats.resimulatedCount++;
+	}
 	return action;
 }
 
+CJediAiActionEngage::STargetResult &CJediAiActionEngage::findTargetResult(const CActor *actor) const {
+	CJediAiActionEngage *me = const_cast<CJediAiActionEngage*>(this);
+
+	// use this actor's entry if it has one
+	// otherwise, take an unused entry or the oldest one
+	STargetResult *oldestResult = &me->targetResultTable[0];
+	for (int i = 0; i < TR_COUNTOF(targetResultTable); ++i) {
+		STargetResult &result = me->targetResultTable[i];
+		if (result.actor == actor) {
+			return result;
+		}
+		if (oldestResult->actor != NULL && (result.actor == NULL || result.time < oldestResult->time)) {
+			oldestResult = &result;
+		}
+	}
+	return *oldestResult;
+}
+
+bool CJediAiActionEngage::isBetterTarget(const SJediAiActionSimSummary &a, const SJediAiActionSimSummary &b) {
+
+	// a better result wins
+	if (a.result != b.result) {
+		return (a.result > b.result);
+	}
+
+	// otherwise, whichever leaves me healthier in a less threatening world
+	if (a.selfHitPoints != b.selfHitPoints) {
+		return (a.selfHitPoints > b.selfHitPoints);
+	}
+	return (a.threatLevel < b.threatLevel);
+}
+
 EJediAiActionResult CJediAiActionEngage::setCurrentAction(CJediAiAction *action) {
 
 	// base class version
@@ -8462,6 +10319,15 @@ EJediAiActionResult CJediAiActionEngage::setCurrentAction(CJediAiAction *action)
 	return result;
 }
 
+bool CJediAiActionEngage::canEngageVictim(const SJediAiActorState &victimState) {
+
+	// I need a living victim that isn't incapacitated
+	if (victimState.actor == NULL || victimState.hitPoints <= 0.0f) {
+		return false;
+	}
+	return !(victimState.flags & kJediAiActorStateFlag_Incapacitated);
+}
+
 CJediAiActionEngage::EAction CJediAiActionEngage::getActionForVictim(const SJediAiActorState &victimState) {
 
 	// select an action specific to my victim's type
@@ -8561,6 +10427,9 @@ CJediAiActionCombat::CJediAiActionCombat() {
 	actionTable[eAction_Idle] = &idle;
 	compileTimeAssert(eAction_Count == 4);
 
+	// start at selector lod
+	lod = eLod_Selector;
+
 	// reset my data
 	reset();
 }
@@ -8568,6 +10437,39 @@ CJediAiActionCombat::CJediAiActionCombat() {
 CJediAiActionCombat::~CJediAiActionCombat() {
 }
 
+void CJediAiActionCombat::setLod(ELod newLod) {
+
+	// if nothing is changing, bail
+	if (newLod == lod) {
+		return;
+	}
+
+	// swap my engage action
+	CJediAiAction *prevEngage = actionTable[eAction_Engage];
+	lod = newLod;
+	actionTable[eAction_Engage] = (lod == eLod_Planner ? (CJediAiAction*)&planner : (CJediAiAction*)&engage);
+
+	// if we were using the old engage action, drop it
+	// any selection in progress has simulated the wrong action, so start over
+	if (selectorData.currentAction == prevEngage) {
+		setCurrentAction(NULL);
+	}
+	if (selectorData.bestAction == prevEngage) {
+		selectorData.bestAction = NULL;
+	}
+	cancelSelectAction();
+}
+
+void CJediAiActionCombat::init(CJediAiMemory *newWorldState) {
+
+	// base class version
+	BASECLASS::init(newWorldState);
+
+	// init both engage actions, since only one of them is in my table
+	engage.init(newWorldState);
+	planner.init(newWorldState);
+}
+
 EJediAiAction CJediAiActionCombat::getType() const {
 	return eJediAiAction_Combat;
 }
@@ -8581,8 +10483,27 @@ void CJediAiActionCombat::reset() {
 	selectorParams.selectFrequency = 0.0f;
 	selectorParams.ifEqualUseCurrentAction = false;
 
+	// when my current action is only waiting, sleep for up to half a second at a time
+	params.maxSleepDuration = 0.5f;
+
+	// once we know we must give another jedi space, don't bother simulating the rest of the tree
+	selectorParams.pruneActions = true;
+
+	// spread selection across frames so deep engage trees don't spike a single frame
+	// if a threat is about to hit, decide right away
+	selectorParams.maxSimulationsPerFrame = 2;
+	selectorParams.urgentThreatDuration = 0.5f;
+
+	// while little is changing, reuse last frame's simulations for a few frames
+	selectorParams.maxReuseCount = 3;
+	selectorParams.reuseDistanceTolerance = 0.25f;
+	selectorParams.reuseHitPointTolerance = 0.5f;
+	selectorParams.reuseThreatDurationTolerance = 0.05f;
+
 	// setup 'give other jedi space'
+	// only one of two crowding jedi needs to move, so whoever starts first holds the space and the other doesn't simulate it
 	giveOtherJediSpace.name = "Give Other Jedi Space";
+	giveOtherJediSpace.requiredTokens = kJediAiToken_Maneuver;
 	tooCloseToOtherJediConstraint.params.desiredValue = true;
 	{
 		// setup melee jump over
@@ -8617,6 +10538,9 @@ void CJediAiActionCombat::reset() {
 	engage.name = "Engage";
 	notTooCloseToOtherJediConstraint.params.desiredValue = false;
 
+	// setup 'planner'
+	planner.name = "Planner";
+
 	// setup 'defend'
 	defend.name = "Defend";
 
@@ -8684,6 +10608,35 @@ EJediAiActionResult CJediAiActionCombat::update(float dt) {
 	return eJediAiActionResult_InProgress;
 }
 
+bool CJediAiActionCombat::canSleep(SJediAiWakeCondition &wakeCondition) const {
+
+	// we need a self to operate
+	if (memory->selfState.jedi == NULL || !memory->selfState.isAiControlled) {
+		return false;
+	}
+
+	// I select every frame only to react to what's going on, so I can sleep with my current action
+	// as long as any threat or a new victim wakes me, and I look around every so often anyway
+	if (selectorData.currentAction == NULL || selectorData.currentActionResult != eJediAiActionResult_InProgress) {
+		return false;
+	}
+	if (selectorData.bestAction != NULL || selectorJob.inProgress) {
+		return false;
+	}
+	if (memory->threatStateCount > 0 || !selectorData.currentAction->canSleep(wakeCondition)) {
+		return false;
+	}
+	wakeCondition.threatTypeMask = kJediAiWakeOnAnyThreat;
+	wakeCondition.wakeOnVictimChange = true;
+	wakeCondition.wakeBy(memory->currentTime + params.maxSleepDuration);
+
+	// my tokens are only renewed when I think, so wake well before their lease runs out
+	if (memory->tokenBoard != NULL) {
+		wakeCondition.wakeBy(memory->currentTime + (memory->tokenBoard->params.leaseDuration * 0.5f));
+	}
+	return true;
+}
+
 CJediAiAction **CJediAiActionCombat::getActionTable(int *actionCount) {
 	if (actionCount != NULL) {
 		*actionCount = eAction_Count;
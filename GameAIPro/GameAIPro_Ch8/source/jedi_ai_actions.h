@@ -13,6 +13,14 @@
 	#include "jedi_ai_memory.h"
 #endif
 
+#ifndef __JEDI_AI_WAKE__
+	#include "jedi_ai_wake.h"
+#endif
+
+#ifndef __JEDI_AI_LATENT__
+	#include "jedi_ai_latent.h"
+#endif
+
 
 /////////////////////////////////////////////////////////////////////////////
 //
@@ -79,6 +87,10 @@ public:
 	// defaults to zero seconds
 	float minRunFrequency;
 
+	// the tokens (kJediAiToken_XXX) I need from my memory's token board
+	// I claim them when I begin, and selectors skip me without simulating while someone else holds one
+	unsigned int requiredTokens;
+
 	// flags
 	enum {
 
@@ -107,6 +119,80 @@ public:
 
 	// set whether or not this action is selectable
 	virtual void setIsNotSelectable(bool notSelectable);
+
+	// would this action simulate exactly like the specified one?
+	// this lets sibling sequences share the simulation of the actions they begin with
+	// only actions that can compare their params say yes
+	virtual bool isSimulationEquivalent(const CJediAiAction &other) const;
+
+	// are this action and the specified one set up the same apart from their params?
+	bool hasEquivalentSimulationSetup(const CJediAiAction &other) const;
+
+	// estimate what simulating this action would do, without stepping the simulation
+	// this lets selectors rank their actions cheaply and only simulate the most promising ones
+	// an impossible estimate must be exact, since the action won't be simulated at all
+	// returns false if this action can't estimate itself, in which case it must be simulated
+	virtual bool estimateSimulation(const CJediAiMemory &simMemory, SJediAiActionSimSummary &estimate) const;
+
+	// can I sleep until something happens, instead of being updated every frame?
+	// if so, this fills in what should wake me
+	// while asleep, neither my timers nor I are updated, and they catch up when I wake
+	// returns false by default, since most actions have something to do every frame
+	virtual bool canSleep(SJediAiWakeCondition &wakeCondition) const;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// base class for latent actions
+// a latent action is written as a coroutine, run(), which co_awaits time, my state or a condition
+// instead of keeping hand-written timers and phase flags that are checked every update
+// its coroutine begins with the action and starts running on its first update
+// while what it's waiting for hasn't happened, updating it only checks the wait
+//
+/////////////////////////////////////////////////////////////////////////////
+
+class CJediAiActionLatent : public CJediAiAction {
+public:
+	typedef CJediAiAction BASECLASS;
+
+	// latent data
+	struct {
+		CJediAiLatentTask task; // my coroutine (NULL if I'm not running)
+		float timer; // how long I've been running
+		SJediAiLatentAwaiter awaiter; // what my coroutine is waiting for
+		EJediAiActionResult result; // what my coroutine co_returned
+	} latentData;
+
+	// construction
+	CJediAiActionLatent();
+	virtual ~CJediAiActionLatent();
+
+	// CJediAiAction methods
+	virtual void reset();
+	virtual EJediAiActionResult onBegin();
+	virtual void onEnd();
+	virtual void updateTimers(float dt);
+	virtual EJediAiActionResult update(float dt);
+
+	// my coroutine
+	virtual CJediAiLatentTask run() = 0;
+
+	// things my coroutine can co_await
+	SJediAiLatentAwaiter nextUpdate();
+	SJediAiLatentAwaiter waitForTime(float duration);
+	SJediAiLatentAwaiter waitForState(EJediState state);
+	SJediAiLatentAwaiter waitForStateExit(EJediState state);
+	SJediAiLatentAwaiter waitUntil(TJediAiLatentCondition condition);
+
+	// is what my coroutine is waiting for over?
+	bool isWaitOver(const SJediAiLatentAwaiter &awaiter) const;
+
+	// resume my coroutine, returning its result once it's done
+	EJediAiActionResult resume();
+
+	// destroy my coroutine, giving its frame back to the pool
+	void destroyTask();
 };
 
 
@@ -220,6 +306,68 @@ public:
 };
 
 
+/////////////////////////////////////////////////////////////////////////////
+//
+// sequence prefix trie
+// sibling sequences often begin with the same actions (usually a move to the victim)
+// a selector fills one of these in for a selection pass, so each shared prefix
+// is simulated once and every sequence starting with it continues from its memory
+//
+/////////////////////////////////////////////////////////////////////////////
+
+class CJediAiActionSequenceBase;
+
+class CJediAiSequencePrefixTrie {
+public:
+
+	// prefix nodes
+	// each node is its parent's prefix followed by one more action
+	enum { kNodeListSize = 16 };
+	struct SNode {
+		int parentIndex; // -1 if this is the first action of a sequence
+		const CJediAiActionSequenceBase *sequence; // the first sequence with this prefix
+		const CJediAiAction *action; // that sequence's action, equivalent to everyone else's
+		int sequenceCount; // how many sequences begin with this prefix
+		CJediAiMemory *memory; // memory after simulating this prefix (only shared prefixes have one)
+		bool simulated; // has a sequence simulated this prefix?
+		bool completed; // did that sequence carry on past it? if not, everyone simulates it themselves
+		EJediAiActionSimResult bestSimResult; // best result of the actions in this prefix
+		SJediAiActionSimSummary simSummary; // the last action's sim summary
+	};
+	int nodeCount;
+	SNode nodeList[kNodeListSize];
+
+	// memory for the shared prefixes comes from a fixed pool each thread keeps, instead of the heap
+	// a trie only lives on the stack while its selector selects, and selectors nested in its simulations
+	// build their tries after it and are done with them before it, so the pool is handed out like a stack
+	// if the pool runs out, the prefixes that miss out just aren't shared
+	enum { kMemoryPoolSize = 8 };
+	struct SMemoryPool {
+		CJediAiMemory memoryTable[kMemoryPoolSize];
+		int usedCount;
+	};
+	int memoryPoolIndex; // where my memories begin in the pool
+	int memoryCount; // how many I took
+
+	// construction
+	CJediAiSequencePrefixTrie();
+	~CJediAiSequencePrefixTrie();
+
+	// add a sequence that hasn't started yet to the trie
+	void addSequence(const CJediAiActionSequenceBase &sequence);
+
+	// set aside memory for every prefix more than one sequence shares, as far as the pool allows
+	// returns false if nothing is shared, in which case the trie isn't worth using
+	bool allocateSharedPrefixes();
+
+	// get this thread's memory pool
+	static SMemoryPool &getMemoryPool();
+
+	// find the node which continues the specified node with the specified action of a sequence (-1 if none)
+	int findNode(int parentIndex, const CJediAiActionSequenceBase &sequence, const CJediAiAction &action) const;
+};
+
+
 /////////////////////////////////////////////////////////////////////////////
 //
 // base class for all actions running sub-action sequences
@@ -254,6 +402,14 @@ public:
 	virtual void updateTimers(float dt);
 	virtual EJediAiActionResult update(float dt);
 	virtual bool isNotSelectable() const;
+	virtual bool canSleep(SJediAiWakeCondition &wakeCondition) const;
+
+	// simulate, sharing the actions I begin with with any sibling sequences that begin the same way
+	// only plain sequences share their prefix, since other sequences may simulate differently
+	void simulateSharingPrefix(CJediAiMemory &simMemory, CJediAiSequencePrefixTrie *prefixTrie);
+
+	// can my prefix be shared with the specified sequence?
+	bool canSharePrefixWith(const CJediAiActionSequenceBase &other) const;
 
 	// get the next available action in the sequence starting with the specified index
 	virtual CJediAiAction *getNextAction(int &nextActionIndex) const;
@@ -308,6 +464,16 @@ public:
 		bool debounceActions;
 		bool allowNegativeActions;
 		bool ifEqualUseCurrentAction; // default is true
+		bool pruneActions; // stop simulating once the selection can no longer change
+		int maxSimulationsPerFrame; // if positive, selection is spread across frames
+		float urgentThreatDuration; // when spreading selection across frames, a threat this close forces a decision
+		int rolloutCount; // if more than one, each action is simulated this many times with different random streams (off by default, see -benchrollouts)
+		int maxReuseCount; // if positive, an action whose inputs barely changed reuses its last simulation up to this many passes in a row
+		float reuseDistanceTolerance; // how far my victim and I can move before actions are re-simulated
+		float reuseHitPointTolerance; // how much my victim's and my hit points can change before actions are re-simulated
+		float reuseThreatDurationTolerance; // how far the next threat can stray from when it was expected before actions are re-simulated
+		int estimateTopCount; // if positive, actions that can estimate their simulation are ranked by it, and only this many of them are simulated
+		bool batchEngineQueries; // record the engine queries my actions will make, answer them in one batch, then simulate against the answers (off by default, since recording simulates everything twice)
 	} selectorParams;
 
 	// update data
@@ -319,6 +485,78 @@ public:
 		EJediAiActionResult currentActionResult;
 	} selectorData;
 
+	// selection history
+	// this survives onBegin() so pruning can order actions by how they did in the past
+	enum { kSelectorHistorySize = 16 };
+	struct SSelectorHistory {
+		struct {
+			EJediAiActionSimResult lastResult;
+			int simulatedCount;
+			int selectedCount;
+		} actionTable[kSelectorHistorySize];
+		int simulatedCount;
+		int skippedCount;
+		int lastSkippedCount;
+		int reusedCount;
+		int tokenSkippedCount; // how many simulations were skipped because another jedi held a token the action needed
+	} selectorHistory;
+
+	// how well my actions' estimates matched their simulations
+	struct SSelectorEstimateStats {
+		int estimatedCount; // how many estimates were made
+		int skippedCount; // how many simulations the estimates saved
+		int comparedCount; // how many estimates were checked against a simulation
+		int mismatchCount; // how many of those got the result wrong
+		float resultErrorSum; // how far off the results were, in result steps
+		float hitPointErrorSum; // how far off my victim's and my hit points were
+	} selectorEstimateStats;
+
+	// the inputs my actions' simulations depend on
+	struct SSelectorInputFingerprint {
+		float time;
+		CVector wSelfPos;
+		float selfHitPoints;
+		int selfStateBitfield;
+		const CActor *victim;
+		CVector wVictimPos;
+		float victimHitPoints;
+		unsigned int victimFlags;
+		int threatCount;
+		unsigned int threatHash; // which threats there are and who they are from
+		float nextThreatDuration; // how long until the soonest threat hits (0 if there are no threats)
+	};
+
+	// each action's last simulation, with the inputs it was simulated from
+	struct SSelectorReuse {
+		bool valid;
+		bool inProgress;
+		int reuseCount;
+		SSelectorInputFingerprint fingerprint;
+		SJediAiActionSimSummary simSummary;
+	} selectorReuseTable[kSelectorHistorySize];
+
+	// monte carlo rollout statistics for each action
+	// when rolling out, an action's sim summary result is its worst case result
+	struct SSelectorRolloutStats {
+		int rolloutCount;
+		EJediAiActionSimResult worstResult;
+		EJediAiActionSimResult bestResult;
+		float expectedResult;
+		float expectedThreatLevel;
+		float expectedHitPointLoss;
+	} selectorRolloutStatsTable[kSelectorHistorySize];
+
+	// time sliced selection job
+	// this lets selection pick up where it left off last frame
+	struct SSelectorJob {
+		bool inProgress;
+		int nextOrderIndex;
+		int actionOrder[kSelectorHistorySize];
+		bool simulatedTable[kSelectorHistorySize];
+		EJediAiActionSimResult bestResult;
+		int frameCount;
+	} selectorJob;
+
 	// construction
 	CJediAiActionSelectorBase();
 
@@ -330,6 +568,7 @@ public:
 	virtual void simulate(CJediAiMemory &simMemory);
 	virtual void updateTimers(float dt);
 	virtual EJediAiActionResult update(float dt);
+	virtual bool canSleep(SJediAiWakeCondition &wakeCondition) const;
 
 	// set my current action
 	EJediAiActionResult setCurrentAction(CJediAiAction *action);
@@ -337,11 +576,62 @@ public:
 	// simulate each action and select which one is best
 	virtual CJediAiAction *selectAction(CJediAiMemory *simMemory) const;
 
+	// simulate one of my actions for selection, rolling it out multiple times if I am supposed to
+	// the first rollout uses the memory's own random stream and is the one left in 'simMemory'
+	// if there is a prefix trie, sequences share their prefixes through it
+	void simulateActionForSelection(int actionIndex, CJediAiAction *action, CJediAiMemory &simMemory, CJediAiSequencePrefixTrie *prefixTrie = NULL) const;
+
+	// compute the fingerprint of the inputs my actions' simulations depend on
+	void computeInputFingerprint(const CJediAiMemory &simMemory, SSelectorInputFingerprint &fingerprint) const;
+
+	// if an action's inputs barely changed since it was last simulated, restore that simulation's summary
+	// returns false if it must be simulated again
+	// 'canReuseSimulation' checks without restoring anything
+	bool reuseSimulation(int actionIndex, CJediAiAction *action, const SSelectorInputFingerprint &fingerprint) const;
+	bool canReuseSimulation(int actionIndex, const CJediAiAction *action, const SSelectorInputFingerprint &fingerprint) const;
+
+	// remember an action's simulation so later passes can reuse it
+	void saveSimulationForReuse(int actionIndex, const CJediAiAction *action, const SSelectorInputFingerprint &fingerprint) const;
+
+	// estimate each of my actions that can, and decide which of those are worth simulating
+	// 'estimatedTable' is set for each estimated action, and 'skipTable' for each one that shouldn't be simulated
+	// returns false if my action table is too big to rank
+	bool rankActionsByEstimate(int actionCount, CJediAiAction *const actionTable[], const CJediAiMemory &simMemory, SJediAiActionSimSummary estimateTable[], bool estimatedTable[], bool skipTable[]) const;
+
+	// compare an action's estimate with its simulation
+	void recordEstimateError(const SJediAiActionSimSummary &estimate, const SJediAiActionSimSummary &simSummary) const;
+
+	// simulate the actions I'm about to simulate into throwaway memory, so my query batch records the engine queries they make
+	// actions are visited in 'actionOrder' (or table order if NULL) starting at 'firstOrderIndex', up to 'maxRecordCount' of them if it's positive
+	// actions in 'skipTable' or that can reuse their last simulation aren't about to be simulated, so they are left out
+	void recordEngineQueries(int actionCount, CJediAiAction *const actionTable[], const int actionOrder[], int firstOrderIndex, int maxRecordCount, const bool skipTable[], const SSelectorInputFingerprint *fingerprint) const;
+
+	// fill in a prefix trie with my sequences that can share their prefixes
+	// returns false if none of them share anything
+	bool buildSequencePrefixTrie(int actionCount, CJediAiAction *const actionTable[], CJediAiSequencePrefixTrie &prefixTrie) const;
+
+	// continue selecting an action over multiple frames
+	// returns true once selection is complete, with the selected action (or NULL) in 'selectedAction'
+	bool updateSelectAction(CJediAiAction **selectedAction);
+
+	// abandon any selection in progress
+	void cancelSelectAction();
+
+	// is a threat close enough that I must stop selecting and decide now?
+	bool isThreatForcingSelection() const;
+
 	// compare action simulation summaries and select one
-	virtual int compareAndSelectAction(int actionCount, CJediAiAction *const actionTable[], EJediAiActionSimResult bestResult) const;
+	virtual int compareAndSelectAction(SJediRandom &random, int actionCount, CJediAiAction *const actionTable[], EJediAiActionSimResult bestResult) const;
 
 	// can I select the specified action
 	virtual bool canSelectAction(int actionIndex) const;
+
+	// build the order in which to simulate my actions when pruning
+	// returns false if my action table is too big to keep a history for
+	bool computeActionOrder(int actionCount, CJediAiAction *const actionTable[], int actionOrder[]) const;
+
+	// now that the specified action has simulated, can anything I have not yet simulated change my selection?
+	virtual bool isSelectionDecided(int actionIndex, int actionCount, CJediAiAction *const actionTable[], const bool simulatedTable[]) const;
 };
 
 
@@ -422,19 +712,38 @@ class CJediAiActionRandomBase : public CJediAiActionSelectorBase {
 public:
 	typedef CJediAiActionSelectorBase BASECLASS;
 
+	// walker alias table for choosing from my odds table in constant time
+	// this is only rebuilt when the set of eligible actions changes
+	enum { kOddsAliasTableSize = 32 };
+	struct SOddsAliasTable {
+		unsigned int eligibleMask; // zero if the table hasn't been built
+		int actionCount;
+		float probabilityTable[kOddsAliasTableSize];
+		unsigned char aliasTable[kOddsAliasTableSize];
+		int buildCount;
+	} oddsAliasTable;
+
 	// construction
 	CJediAiActionRandomBase();
 
 	// CJediAiAction methods
 	virtual EJediAiAction getType() const;
+	virtual void reset();
 
 	// CJediAiActionSelector methods
-	virtual int compareAndSelectAction(int actionCount, CJediAiAction *const actionTable[], EJediAiActionSimResult bestResult) const;
+	virtual int compareAndSelectAction(SJediRandom &random, int actionCount, CJediAiAction *const actionTable[], EJediAiActionSimResult bestResult) const;
 	virtual bool canSelectAction(int actionIndex) const;
+	virtual bool isSelectionDecided(int actionIndex, int actionCount, CJediAiAction *const actionTable[], const bool simulatedTable[]) const;
 
 	// get my action odds table
 	virtual float *getActionOddsTable(int *actionCount) = 0;
 	const float *getActionOddsTable(int *actionCount) const;
+
+	// build my alias table for the specified set of eligible actions
+	void buildOddsAliasTable(int actionCount, const float actionOddsTable[], unsigned int eligibleMask);
+
+	// call this if you change my odds table after I've started selecting actions
+	void invalidateOddsAliasTable();
 };
 
 
@@ -480,6 +789,7 @@ public:
 		if (index >= 0 && index < eAction_Count) {
 			actionTable[index] = action;
 			actionOddsTable[index] = odds;
+			invalidateOddsAliasTable();
 		}
 	}
 };
@@ -597,9 +907,9 @@ public:
 //
 /////////////////////////////////////////////////////////////////////////////
 
-class CJediAiActionDash : public CJediAiAction {
+class CJediAiActionDash : public CJediAiActionLatent {
 public:
-	typedef CJediAiAction BASECLASS;
+	typedef CJediAiActionLatent BASECLASS;
 
 	// parameters
 	struct {
@@ -610,11 +920,6 @@ public:
 		bool ignoreMinDistance;
 	} params;
 
-	// update data
-	struct {
-		bool wasDashing;
-	} data;
-
 	// construction
 	CJediAiActionDash();
 
@@ -625,7 +930,12 @@ public:
 	virtual EJediAiActionResult onBegin();
 	virtual void onEnd();
 	virtual void simulate(CJediAiMemory &simMemory);
-	virtual EJediAiActionResult update(float dt);
+
+	// CJediAiActionLatent methods
+	virtual CJediAiLatentTask run();
+
+	// look up my destination actor and how close to it I dash (NULL if I have no destination)
+	SJediAiActorState *lookupDestination(float &minDistance, float &activationDistanceFromTarget, float &distanceFromTarget) const;
 };
 
 
@@ -696,9 +1006,9 @@ public:
 //
 /////////////////////////////////////////////////////////////////////////////
 
-class CJediAiActionJumpForward : public CJediAiAction {
+class CJediAiActionJumpForward : public CJediAiActionLatent {
 public:
-	typedef CJediAiAction BASECLASS;
+	typedef CJediAiActionLatent BASECLASS;
 
 	// parameters
 	struct {
@@ -707,11 +1017,6 @@ public:
 		EJediAiJumpForwardAttack attack;
 	} params;
 
-	// update data
-	struct {
-		bool isJumping;
-	} data;
-
 	// construction
 	CJediAiActionJumpForward();
 
@@ -722,8 +1027,9 @@ public:
 	virtual EJediAiActionResult onBegin();
 	virtual void onEnd();
 	virtual void simulate(CJediAiMemory &simMemory);
-	virtual void updateTimers(float dt);
-	virtual EJediAiActionResult update(float dt);
+
+	// CJediAiActionLatent methods
+	virtual CJediAiLatentTask run();
 
 	// perform a collision check
 	static bool checkCollision(const CJediAiMemory &memory, float distance);
@@ -805,10 +1111,10 @@ public:
 	virtual EJediAiActionResult update(float dt);
 
 	// choose the best parameters based on the specified memory state
-	static EJediDodgeDir chooseBestDir(const CJediAiMemory &simMemory);
+	static EJediDodgeDir chooseBestDir(CJediAiMemory &simMemory);
 
 	// randomly choose a dodge direction
-	static EJediDodgeDir chooseRandomDir();
+	static EJediDodgeDir chooseRandomDir(CJediAiMemory &memory);
 
 	// should we perform a flip dodge or a normal dodge?
 	static bool shouldFlipDodge(const CJediAiMemory &memory);
@@ -830,9 +1136,9 @@ public:
 //
 /////////////////////////////////////////////////////////////////////////////
 
-class CJediAiActionCrouch : public CJediAiAction {
+class CJediAiActionCrouch : public CJediAiActionLatent {
 public:
-	typedef CJediAiAction BASECLASS;
+	typedef CJediAiActionLatent BASECLASS;
 
 	// parameters
 	struct SCrouchParams {
@@ -842,7 +1148,6 @@ public:
 
 	// update data
 	struct {
-		float timer;
 		float duration;
 		bool attacked;
 	} data;
@@ -857,8 +1162,9 @@ public:
 	virtual EJediAiActionResult onBegin();
 	virtual void onEnd();
 	virtual void simulate(CJediAiMemory &simMemory);
-	virtual void updateTimers(float dt);
-	virtual EJediAiActionResult update(float dt);
+
+	// CJediAiActionLatent methods
+	virtual CJediAiLatentTask run();
 };
 
 
@@ -1128,6 +1434,7 @@ public:
 	virtual void simulate(CJediAiMemory &simMemory);
 	virtual void updateTimers(float dt);
 	virtual EJediAiActionResult update(float dt);
+	virtual bool canSleep(SJediAiWakeCondition &wakeCondition) const;
 };
 
 
@@ -1176,6 +1483,7 @@ public:
 	virtual void simulate(CJediAiMemory &simMemory);
 	virtual void updateTimers(float dt);
 	virtual EJediAiActionResult update(float dt);
+	virtual bool canSleep(SJediAiWakeCondition &wakeCondition) const;
 
 	// compute our wait duration for a given threat
 	float computeWaitDurationForThreat(const CJediAiMemory::SJediThreatTypeData &threatTypeData, const SThreatParams &threatParams) const;
@@ -1383,6 +1691,7 @@ public:
 	virtual void onEnd();
 	virtual void simulate(CJediAiMemory &simMemory);
 	virtual EJediAiActionResult update(float dt);
+	virtual bool isSimulationEquivalent(const CJediAiAction &other) const;
 
 	// CJediAiActionComposite methods
 	virtual CJediAiAction **getActionTable(int *actionCount);
@@ -1443,6 +1752,7 @@ public:
 	virtual void reset();
 	virtual EJediAiActionResult checkConstraints(const CJediAiMemory &simMemory, bool simulating) const;
 	virtual void simulate(CJediAiMemory &simMemory);
+	virtual bool estimateSimulation(const CJediAiMemory &simMemory, SJediAiActionSimSummary &estimate) const;
 
 	// CJediAiActionComposite methods
 	virtual CJediAiAction **getActionTable(int *actionCount);
@@ -1630,6 +1940,7 @@ public:
 	virtual EJediAiAction getType() const;
 	virtual void reset();
 	virtual void simulate(CJediAiMemory &simMemory);
+	virtual bool estimateSimulation(const CJediAiMemory &simMemory, SJediAiActionSimSummary &estimate) const;
 
 	// CJediAiActionComposite methods
 	virtual CJediAiAction **getActionTable(int *actionCount);
@@ -2525,6 +2836,113 @@ public:
 };
 
 
+/////////////////////////////////////////////////////////////////////////////
+//
+// planner
+// search sequences of leaf actions with monte carlo tree search
+// this can stand in for engage on jedi that can afford to look further ahead
+//
+/////////////////////////////////////////////////////////////////////////////
+
+class CJediAiActionPlanner : public CJediAiActionSelectorBase {
+public:
+	typedef CJediAiActionSelectorBase BASECLASS;
+
+	// action table
+	enum EAction {
+		eAction_DodgeLeft,
+		eAction_DodgeRight,
+		eAction_DodgeBack,
+		eAction_SwingSaber,
+		eAction_ForcePush,
+		eAction_Kick,
+		eAction_JumpForward,
+		eAction_Count
+	};
+	CJediAiAction *actionTable[eAction_Count];
+
+	// actions
+	CJediAiActionDodge dodgeLeft;
+	CJediAiActionDodge dodgeRight;
+	CJediAiActionDodge dodgeBack;
+	CJediAiActionSwingSaber swingSaber;
+	CJediAiActionForcePush forcePush;
+	CJediAiActionKick kick;
+	CJediAiActionJumpForward jumpForward;
+
+	// parameters
+	struct SPlannerParams {
+		float budgetMicroseconds; // stop searching once this much time has passed (checked between iterations)
+		int maxIterations; // if positive, stop searching after this many iterations
+		int maxDepth; // how many actions ahead to look
+		float explorationConstant; // how much to favor rarely visited actions (UCB1)
+		float discount; // how much less each action down a sequence is worth
+	} plannerParams;
+
+	// search tree
+	// nodes come from a fixed pool, and the tree is kept across ticks
+	// once an action we planned finishes, the subtree beneath it becomes the new root
+	enum { kPlannerNodePoolSize = 512, kPlannerMaxDepth = 8 };
+	struct SPlannerNode {
+		short parent;
+		short firstChild;
+		short nextSibling;
+		short action; // the action taken to reach this node (eAction_Count for the root)
+		unsigned int expandedMask; // which actions already have a child
+		int visitCount;
+		float totalValue;
+	};
+	SPlannerNode nodePool[kPlannerNodePoolSize];
+	struct SPlannerData {
+		short rootNode;
+		short freeNode; // head of the free list
+		int freeNodeCount;
+		int plannedAction; // the action we chose last time we planned (-1 if none)
+		int iterationCount; // iterations run the last time we planned
+		int totalIterationCount;
+		float elapsedMicroseconds; // time spent the last time we planned
+		int planCount; // how many times we planned
+		int plannedCountTable[eAction_Count]; // how many times we chose each action
+	} plannerData;
+
+	// scratch memory to search in, kept here so planning doesn't allocate
+	CJediAiMemory searchMemory;
+
+	// construction
+	CJediAiActionPlanner();
+
+	// CJediAiAction methods
+	virtual EJediAiAction getType() const;
+	virtual void reset();
+
+	// CJediAiActionComposite methods
+	virtual CJediAiAction **getActionTable(int *actionCount);
+
+	// CJediAiActionSelector methods
+	virtual CJediAiAction *selectAction(CJediAiMemory *simMemory) const;
+
+	// search for the best action to take right now
+	CJediAiAction *plan();
+
+	// run one search iteration from my root in my search memory
+	void runSearchIteration();
+
+	// how much is the result of a single action worth (0 to 1)?
+	float computeActionValue(const SJediAiActionSimSummary &simSummary) const;
+
+	// pick the child of a node with the best upper confidence bound
+	int selectChild(int node) const;
+
+	// node pool management
+	void clearTree();
+	int allocNode(int parent, int action);
+	void freeSubtree(int node);
+
+	// make the child of my root reached by the specified action the new root
+	void advanceRoot(int action);
+};
+
+
 /////////////////////////////////////////////////////////////////////////////
 //
 // choose an appropriate way to engage a particular type of enemy
@@ -2563,12 +2981,36 @@ public:
 	CJediAiActionEngageB2BattleDroid engageB2BattleDroid;
 	CJediAiActionEngageDroideka engageDroideka;
 
+	// target selection parameters
+	// when selecting for real, I simulate engaging my other enemies too, and switch my victim to whoever does best
+	struct STargetSelectionParams {
+		int maxSimulationsPerSelection; // if positive, target selection is on, and this is how many other enemies are simulated per selection
+		float maxResultAge; // how long an enemy's last simulation can stand in for a new one
+	} targetSelectionParams;
+
+	// each enemy's last simulation, so enemies that weren't simulated this selection can still be compared
+	struct STargetResult {
+		const CActor *actor; // NULL if unused
+		float time; // when it was simulated
+		SJediAiActionSimSummary simSummary;
+	} targetResultTable[CJediAiMemory::kEnemyStateListSize];
+
+	// target selection statistics
+	struct STargetSelectionStats {
+		int selectionCount;
+		int simulatedCount; // how many enemies were simulated
+		int reusedCount; // how many enemies were compared using an earlier simulation
+		int switchCount; // how many times my victim was switched
+		int resimulatedCount; // how many times the returned action was simulated again, because a candidate overwrote it or its result was reused
+	} targetSelectionStats;
+
 	// construction
 	CJediAiActionEngage();
 	virtual ~CJediAiActionEngage();
 
 	// CJediAiAction methods
 	virtual void init(CJediAiMemory *memory);
+	virtual void reset();
 	virtual EJediAiAction getType() const;
 	virtual bool isNotSelectable() const;
 
@@ -2581,6 +3023,20 @@ public:
 
 	// get the action for a given victim
 	static EAction getActionForVictim(const SJediAiActorState &victimState);
+
+	// can I engage a given victim?
+	static bool canEngageVictim(const SJediAiActorState &victimState);
+
+	// simulate engaging my other enemies, and switch my victim if one of them does better
+	// 'victimAction' is the action already simulated for my current victim (NULL if I can't engage it)
+	// returns the action to engage my victim with, after any switch
+	CJediAiAction *selectTarget(CJediAiAction *victimAction) const;
+
+	// find an enemy's last simulation, or make room for one (never NULL)
+	STargetResult &findTargetResult(const CActor *actor) const;
+
+	// is one target's simulation better than another's?
+	static bool isBetterTarget(const SJediAiActionSimSummary &a, const SJediAiActionSimSummary &b);
 };
 
 
@@ -2633,17 +3089,37 @@ public:
 	CJediAiActionConstraintSelfIsTooCloseToOtherJedi notTooCloseToOtherJediConstraint;
 	CJediAiActionEngage engage;
 
+	// planner (takes the place of engage at planner lod)
+	CJediAiActionPlanner planner;
+
 	// defend
 	CJediAiActionDefend defend;
 
 	// idle
 	CJediAiActionIdle idle;
 
+	// level of detail
+	enum ELod {
+		eLod_Selector, // engage with the engage tree
+		eLod_Planner, // engage by searching sequences of actions
+		eLod_Count
+	};
+	ELod lod;
+
+	// parameters
+	struct {
+		float maxSleepDuration; // how long I can sleep before looking around again, even if nothing woke me
+	} params;
+
 	// construction
 	CJediAiActionCombat();
 	virtual ~CJediAiActionCombat();
 
+	// set my level of detail
+	void setLod(ELod newLod);
+
 	// CJediAiAction methods
+	virtual void init(CJediAiMemory *memory);
 	virtual EJediAiAction getType() const;
 	virtual void reset();
 	virtual EJediAiActionResult checkConstraints(const CJediAiMemory &simMemory, bool simulating) const;
@@ -2651,6 +3127,7 @@ public:
 	virtual void onEnd();
 	virtual void updateTimers(float dt);
 	virtual EJediAiActionResult update(float dt);
+	virtual bool canSleep(SJediAiWakeCondition &wakeCondition) const;
 
 	// CJediAiActionSelector methods
 	virtual CJediAiAction **getActionTable(int *actionCount);
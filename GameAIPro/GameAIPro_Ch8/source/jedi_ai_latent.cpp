@@ -0,0 +1,111 @@
+#include "pch.h"
+#include "jedi_ai_latent.h"
+#include "jedi_ai_actions.h"
+
+#include <exception>
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// latent frame pool
+//
+/////////////////////////////////////////////////////////////////////////////
+
+CJediAiLatentFramePool::CJediAiLatentFramePool() {
+
+	// every block starts out free
+	freeList = NULL;
+	for (int i = kBlockCount - 1; i >= 0; --i) {
+		blockTable[i].header.pool = this;
+		blockTable[i].header.nextFree = freeList;
+		freeList = &blockTable[i].header;
+	}
+	memset(&stats, 0, sizeof(stats));
+}
+
+void *CJediAiLatentFramePool::allocate(std::size_t size) {
+	if (size > kFrameSize) {
+		error("CJediAiLatentFramePool::allocate() - Frame too big (%d bytes, max %d)", (int)size, kFrameSize);
+		stats.failedCount++;
+		return NULL;
+	}
+	if (freeList == NULL) {
+		error("CJediAiLatentFramePool::allocate() - Too many latent actions running (max %d)", kBlockCount);
+		stats.failedCount++;
+		return NULL;
+	}
+
+	// take a block off the free list
+	SBlockHeader *header = freeList;
+	freeList = header->nextFree;
+	header->nextFree = NULL;
+	stats.allocatedCount++;
+	stats.peakCount = max(stats.peakCount, stats.allocatedCount);
+	return ((SBlock *)header)->frame;
+}
+
+void CJediAiLatentFramePool::release(void *frame) {
+	if (frame == NULL) {
+		return;
+	}
+
+	// the block's header is right before its frame
+	SBlockHeader *header = &((SBlock *)((unsigned char *)frame - offsetof(SBlock, frame)))->header;
+	CJediAiLatentFramePool *pool = header->pool;
+	header->nextFree = pool->freeList;
+	pool->freeList = header;
+	pool->stats.allocatedCount--;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// latent task
+//
+/////////////////////////////////////////////////////////////////////////////
+
+CJediAiLatentTask CJediAiLatentTask::promise_type::get_return_object() {
+	return CJediAiLatentTask(THandle::from_promise(*this));
+}
+
+CJediAiLatentTask CJediAiLatentTask::promise_type::get_return_object_on_allocation_failure() {
+	return CJediAiLatentTask();
+}
+
+void CJediAiLatentTask::promise_type::unhandled_exception() {
+
+	// the AI doesn't use exceptions, so something is very wrong
+	error("CJediAiLatentTask::promise_type::unhandled_exception() - Exception thrown from a latent action");
+	std::terminate();
+}
+
+void *CJediAiLatentTask::promise_type::operator new(std::size_t size, CJediAiActionLatent &action) noexcept {
+	if (action.memory == NULL || action.memory->latentFramePool == NULL) {
+		error("CJediAiLatentTask::promise_type::operator new() - Action '%s' has no latent frame pool", action.getName());
+		return NULL;
+	}
+	return action.memory->latentFramePool->allocate(size);
+}
+
+void CJediAiLatentTask::promise_type::operator delete(void *frame) {
+	CJediAiLatentFramePool::release(frame);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// latent waits
+//
+/////////////////////////////////////////////////////////////////////////////
+
+bool SJediAiLatentAwaiter::await_ready() const {
+
+	// waiting for nothing always waits for the next update
+	return (wait != eJediAiLatentWait_None && action->isWaitOver(*this));
+}
+
+void SJediAiLatentAwaiter::await_suspend(std::coroutine_handle<>) const {
+
+	// my action checks this each update, and only resumes its coroutine once it's over
+	action->latentData.awaiter = *this;
+}
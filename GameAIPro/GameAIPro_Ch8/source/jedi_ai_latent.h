@@ -0,0 +1,132 @@
+#ifndef __JEDI_AI_LATENT__
+#define __JEDI_AI_LATENT__
+
+#ifndef __JEDI_COMMON__
+	#include "jedi_common.h"
+#endif
+
+#include <coroutine>
+#include <cstddef>
+
+class CJediAiActionLatent;
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// latent frame pool
+// hands out the coroutine frames of a jedi's latent actions from a few fixed blocks,
+// so beginning a latent action never touches the heap
+// each jedi has its own, and only that jedi's AI uses it
+//
+/////////////////////////////////////////////////////////////////////////////
+
+class CJediAiLatentFramePool {
+public:
+
+	// blocks
+	// each block starts with a header, so a frame can find its way back to its pool
+	enum { kFrameSize = 1024 }; // the biggest frame a block holds
+	enum { kBlockCount = 4 }; // how many latent actions can be running at once
+	struct alignas(std::max_align_t) SBlockHeader {
+		CJediAiLatentFramePool *pool;
+		SBlockHeader *nextFree;
+	};
+	struct SBlock {
+		SBlockHeader header;
+		alignas(std::max_align_t) unsigned char frame[kFrameSize];
+	};
+	SBlock blockTable[kBlockCount];
+	SBlockHeader *freeList;
+
+	// statistics
+	struct SStats {
+		int allocatedCount; // how many frames are in use
+		int peakCount; // the most frames that were in use at once
+		int failedCount; // how many frames didn't fit or found the pool empty
+	} stats;
+
+	// construction
+	CJediAiLatentFramePool();
+
+	// get a frame (NULL if it's too big or every block is in use)
+	void *allocate(std::size_t size);
+
+	// give back a frame from allocate()
+	static void release(void *frame);
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// latent task
+// the coroutine a latent action runs, which co_returns the action's result
+// it starts suspended, and its frame comes from its action's jedi's frame pool
+//
+/////////////////////////////////////////////////////////////////////////////
+
+class CJediAiLatentTask {
+public:
+
+	// coroutine promise
+	struct promise_type {
+		EJediAiActionResult result;
+
+		// coroutine interface
+		CJediAiLatentTask get_return_object();
+		static CJediAiLatentTask get_return_object_on_allocation_failure();
+		std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+		std::suspend_always final_suspend() noexcept { return std::suspend_always(); }
+		void return_value(EJediAiActionResult value) { result = value; }
+		void unhandled_exception();
+
+		// frames come from the frame pool of the action running the coroutine
+		// only member coroutines of latent actions can be latent tasks
+		static void *operator new(std::size_t size, CJediAiActionLatent &action) noexcept;
+		static void operator delete(void *frame);
+	};
+	typedef std::coroutine_handle<promise_type> THandle;
+
+	// my coroutine (NULL if there wasn't room for it)
+	THandle handle;
+
+	// construction
+	CJediAiLatentTask() {}
+	explicit CJediAiLatentTask(THandle newHandle) : handle(newHandle) {}
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// latent waits
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// what a latent action's coroutine is waiting for
+enum EJediAiLatentWait {
+	eJediAiLatentWait_None, // nothing, so it resumes on the next update
+	eJediAiLatentWait_Time, // some time to pass
+	eJediAiLatentWait_StateEnter, // me to be in a state
+	eJediAiLatentWait_StateExit, // me to no longer be in a state
+	eJediAiLatentWait_Condition, // a condition to be true
+	eJediAiLatentWait_Count
+};
+
+// a condition a latent action can wait for
+typedef bool (*TJediAiLatentCondition)(const CJediAiActionLatent &action);
+
+// what a latent action's coroutine co_awaits
+// if the wait is already over, the coroutine keeps going without suspending
+struct SJediAiLatentAwaiter {
+	CJediAiActionLatent *action;
+	EJediAiLatentWait wait;
+	float endTime; // time waits only
+	EJediState state; // state waits only
+	TJediAiLatentCondition condition; // condition waits only
+
+	// awaiter interface
+	bool await_ready() const;
+	void await_suspend(std::coroutine_handle<> handle) const;
+	void await_resume() const {}
+};
+
+#endif // __JEDI_AI_LATENT__
@@ -1,5 +1,8 @@
 #include "pch.h"
 #include "jedi_ai_memory.h"
+#include "jedi_ai_snapshot.h"
+#include "jedi_ai_query_batch.h"
+#include "jedi_ai_tokens.h"
 #include "jedi.h"
 #include <ctime>
 
@@ -12,12 +15,15 @@
 
 // jedi ai memory constants
 static const float kCollisionCheckDistance = 15.0f;
+static const float kActorAwareDistance = 100.0f;
 static const float kThreatMaxAwareDistance = 50.0f;
 static const float kThreatMaxAwareDuration = 10.0f;
 static const float kThreatRangedAwareDistance = 100.0f;
 static const float kThreatMeleeAwareDistance = 10.0f;
 static const float kThreatRushAwareDistance = 50.0f;
 static const float kThreatRushAwareDuration = 10.0f;
+static const float kOverflowEnemyPressureDistance = 20.0f;
+static const float kOverflowEnemyThreatLevel = 0.25f;
 
 // provide a way to get the time that has elapsed since our application started
 struct SAppTime {
@@ -80,6 +86,14 @@ void CJediAiMemory::reset() {
 	forceTkBestTargetState = gEmptyJediAiActorState;
 	forceTkBestThrowTargetState = gEmptyJediAiActorState;
 
+	// seed our random stream
+	random.seed(0);
+
+	// setup simulation
+	// only split at events by default, since drift sub-stepping costs many times as much per simulation
+	simulationMode = eSimulationMode_EventDriven;
+	simulationMaxError = 0.0f;
+
 	// update our active time
 	currentTime = ::getTime();
 }
@@ -131,15 +145,107 @@ void CJediAiMemory::setup(CJedi *jedi) {
 	update(0.0f);
 }
 
+void CJediAiMemory::releaseWorldSnapshot() {
+	if (worldSnapshot != NULL) {
+		gJediAiWorldSnapshotBuffer.release(worldSnapshot);
+		worldSnapshot = NULL;
+	}
+}
+
+const SJediAiActorSnapshot *CJediAiMemory::findActorSnapshot(const CActor *actor) const {
+	return (worldSnapshot != NULL ? worldSnapshot->findActor(actor) : NULL);
+}
+
+bool CJediAiMemory::queryPathFindValidity(const CVector &a, const CVector &b) const {
+	if (queryBatch != NULL) {
+		return queryBatch->determinePathFindValidity(a, b);
+	}
+	return ::determinePathFindValidity(a, b);
+}
+
+bool CJediAiMemory::queryNavMeshCollideRay(const CVector &wStartPos, const CVector &wTargetPos, CVector *wClosestNavigablePos) const {
+	if (queryBatch != NULL) {
+		return queryBatch->navMeshCollideRay(wStartPos, wTargetPos, wClosestNavigablePos);
+	}
+	return ::navMeshCollideRay(wStartPos, wTargetPos, wClosestNavigablePos);
+}
+
+bool CJediAiMemory::queryCollideWorldWithMovingSphere(const CVector &wPos, float radius, const CVector &iDelta, CVector *wCollisionPos, CActor **collisionActor) const {
+	if (queryBatch != NULL) {
+		return queryBatch->collideWorldWithMovingSphere(wPos, radius, iDelta, wCollisionPos, collisionActor);
+	}
+	return ::collideWorldWithMovingSphere(wPos, radius, iDelta, wCollisionPos, collisionActor);
+}
+
+void CJediAiMemory::resolveEngineQueries(SJediAiEngineQuery queryList[], int queryCount) const {
+	for (int i = 0; i < queryCount; ++i) {
+		queryList[i].resolved = false;
+	}
+	CJediAiEngineQueryBackend &backend = (queryBatch != NULL ? queryBatch->getBackend() : gJediAiEngineQueryBackend);
+	backend.resolve(queryList, queryCount);
+}
+
+bool CJediAiMemory::areTokensAvailable(unsigned int tokens) const {
+
+	// I need a slot to fight my victim in
+	if ((tokens & kJediAiToken_Engage) && (victimState->flags & kJediAiActorStateFlag_EngageSlotsTaken)) {
+		return false;
+	}
+
+	// I need room to move without crowding another jedi
+	if ((tokens & kJediAiToken_Maneuver) && selfState.maneuverSpaceTaken) {
+		return false;
+	}
+	return true;
+}
+
+bool CJediAiMemory::claimTokens(unsigned int tokens) {
+	if (tokenBoard == NULL) {
+		return true;
+	}
+	if ((tokens & kJediAiToken_Engage) && victimState->actor != NULL) {
+		if (!tokenBoard->claimEngageSlot(selfState.jedi, victimState->actor, currentTime)) {
+			return false;
+		}
+	}
+	if (tokens & kJediAiToken_Maneuver) {
+		if (!tokenBoard->claimManeuverSpace(selfState.jedi, selfState.wPos, selfState.collisionRadius * 2.0f, currentTime)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void CJediAiMemory::releaseTokens(unsigned int tokens) {
+	if (tokenBoard == NULL) {
+		return;
+	}
+
+	// my engage slot goes with my victim, so only my maneuver space is given back
+	if (tokens & kJediAiToken_Maneuver) {
+		tokenBoard->releaseManeuverSpace(selfState.jedi);
+	}
+}
+
 void CJediAiMemory::update(float dt) {
 
 	// update our active time
 	currentTime = ::getTime();
 
+	// sense from the latest world snapshot
+	// we hold on to it until our next update, since our threat states point into it
+	const CJediAiWorldSnapshot *prevWorldSnapshot = worldSnapshot;
+	worldSnapshot = gJediAiWorldSnapshotBuffer.acquire();
+	if (prevWorldSnapshot != NULL) {
+		gJediAiWorldSnapshotBuffer.release(prevWorldSnapshot);
+	}
+
 	// we need a self to operate
-	if (selfState.jedi == NULL || (!selfState.jedi->isAiControlled())) {
+	const SJediAiActorSnapshot *selfSnapshot = findActorSnapshot(selfState.jedi);
+	if (selfSnapshot == NULL || !(selfSnapshot->flags & kJediAiActorSnapshotFlag_AiControlled)) {
 		return;
 	}
+	gJediAiWorldSnapshotBuffer.noteSensed(worldSnapshot);
 
 	// update our victim timer
 	victimTimer = (victim != NULL ? victimTimer + dt : 0.0f);
@@ -160,10 +266,160 @@ void CJediAiMemory::update(float dt) {
 
 	// update force tk target states
 	queryForceTkTargetStates();
+
+	// update which tokens I and the other jedi hold
+	queryTokens();
 }
 
 void CJediAiMemory::simulate(float dt, const SSimulateParams &params) {
 
+	// if we aren't splitting, just take one step
+	if (simulationMode == eSimulationMode_SingleStep) {
+		simulateStep(dt, params);
+		return;
+	}
+
+	// step from event to event
+	// my position is moved linearly from where I am now to where the params say I end up
+	CVector wStartSelfPos = selfState.wPos;
+	CVector wStepSelfPos;
+	SSimulateParams stepParams = params;
+	float selfSpeed = (params.wSelfPos != NULL && dt > 0.0f ? wStartSelfPos.distanceTo(*params.wSelfPos) / dt : 0.0f);
+	float elapsed = 0.0f;
+
+	// if I'm holding to an error bound, make room for the steps it takes on top of the event steps
+	int maxStepCount = kMaxSimulationStepCount;
+	if (simulationMaxError > 0.0f && selfSpeed > 0.0f) {
+		float boundStepCount = ceilf((selfSpeed * dt) / simulationMaxError);
+		maxStepCount = (int)min((float)kMaxErrorBoundSimulationStepCount, (float)kMaxSimulationStepCount + boundStepCount);
+	}
+	for (int stepCount = 1; ; ++stepCount) {
+
+		// how long until the next event?
+		// between events, take steps small enough to stay accurate
+		// the steps left are never made smaller than an even split of the time left
+		float remainingDt = dt - elapsed;
+		float stepDt = remainingDt;
+		if (stepCount < maxStepCount) {
+			float minStepDt = remainingDt / (float)(maxStepCount - stepCount + 1);
+			stepDt = computeNextSimulationEventDt(remainingDt);
+			stepDt = computeSimulationStepDt(stepDt, minStepDt, selfSpeed);
+		}
+		bool lastStep = (stepDt >= remainingDt);
+		elapsed += stepDt;
+
+		// where am I at the end of this step?
+		if (params.wSelfPos != NULL) {
+			wStepSelfPos = (lastStep ? *params.wSelfPos : lerp(wStartSelfPos, *params.wSelfPos, elapsed / dt));
+			stepParams.wSelfPos = &wStepSelfPos;
+		}
+
+		// simulate up to the event
+		simulateStep(stepDt, stepParams);
+		if (lastStep) {
+			break;
+		}
+	}
+}
+
+float CJediAiMemory::computeNextSimulationEventDt(float maxDt) const {
+
+	// events this close together are resolved in the same step
+	const float kMinEventDt = 0.001f;
+	float eventDt = maxDt;
+
+	// threats impact when their duration runs out
+	for (int i = 0; i < threatStateCount; ++i) {
+		const SJediAiThreatState &threatState = threatStates[i];
+		if (threatState.duration > kMinEventDt && threatState.duration < eventDt) {
+			eventDt = threatState.duration;
+		}
+
+		// grenades stop when they reach their end pos
+		if (threatState.type == eJediThreatType_Grenade && threatState.objectState != NULL) {
+			float speed = threatState.objectState->iVelocity.length();
+			if (speed > 0.0f) {
+				float arrivalDt = threatState.objectState->wPos.distanceTo(threatState.wEndPos) / speed;
+				if (arrivalDt > kMinEventDt && arrivalDt < eventDt) {
+					eventDt = arrivalDt;
+				}
+			}
+		}
+	}
+
+	// rushing enemies stop when they reach me
+	for (int i = 0; i < enemyStateCount; ++i) {
+		const SJediAiActorState &enemyState = enemyStates[i];
+		if (!(enemyState.flags & kJediAiActorStateFlag_InRushAttack)) {
+			continue;
+		}
+		float speed = enemyState.iVelocity.length();
+		if (speed > 0.0f) {
+			float gapDistance = enemyState.distanceToSelf - enemyState.collisionRadius - selfState.collisionRadius;
+			float arrivalDt = gapDistance / speed;
+			if (arrivalDt > kMinEventDt && arrivalDt < eventDt) {
+				eventDt = arrivalDt;
+			}
+		}
+	}
+	return eventDt;
+}
+
+float CJediAiMemory::computeSimulationStepDt(float maxDt, float minDt, float selfSpeed) const {
+
+	// if I'm not moving or we don't care about error, take the whole step
+	if (simulationMaxError <= 0.0f || selfSpeed <= 0.0f) {
+		return maxDt;
+	}
+
+	// rushing enemies that aren't following a rush threat re-aim at me every step
+	// during a step they head for where I was, so they end up at most (selfSpeed * dt) off their true path
+	float stepDt = maxDt;
+	for (int i = 0; i < enemyStateCount; ++i) {
+		const SJediAiActorState &enemyState = enemyStates[i];
+		if (!(enemyState.flags & kJediAiActorStateFlag_InRushAttack)) {
+			continue;
+		}
+		if (enemyState.threatState != NULL && enemyState.threatState->type == eJediThreatType_Rush) {
+			continue;
+		}
+		float closingSpeed = enemyState.iVelocity.length() + selfSpeed;
+		float gapDistance = enemyState.distanceToSelf - enemyState.collisionRadius - selfState.collisionRadius;
+		if (gapDistance <= 0.0f || closingSpeed <= 0.0f) {
+			continue;
+		}
+
+		// if it reaches me before I drift that far, its arrival event already splits the step
+		float closingDt = gapDistance / closingSpeed;
+		float driftDt = simulationMaxError / selfSpeed;
+		if (closingDt > driftDt) {
+			stepDt = min(stepDt, driftDt);
+		}
+	}
+
+	// whether the nearest threat hits me is judged from where I am at the ends of each step
+	// the closer it is, the more a step's drift changes its aim at me, so the shorter the steps it takes
+	const SJediAiThreatState *nearestThreatState = NULL;
+	for (int i = 0; i < threatStateCount; ++i) {
+		if (nearestThreatState == NULL || nearestThreatState->distanceToSelf > threatStates[i].distanceToSelf) {
+			nearestThreatState = &threatStates[i];
+		}
+	}
+	if (nearestThreatState != NULL) {
+		float driftDt = simulationMaxError / selfSpeed;
+		float hitDistance = max(0.1f, selfState.collisionRadius + nearestThreatState->damageRadius);
+		float proximityFactor = max(1.0f, (nearestThreatState->distanceToSelf / hitDistance));
+
+		// if it lands before I drift that far, its impact event already splits the step
+		if (nearestThreatState->duration > driftDt) {
+			stepDt = min(stepDt, driftDt * proximityFactor);
+		}
+	}
+	return min(maxDt, max(stepDt, minDt));
+}
+
+void CJediAiMemory::simulateStep(float dt, const SSimulateParams &params) {
+
 	// if our victim is still alive, increment our victim kill timer
 	if (victimState->actor != NULL) {
 		victimTimer += dt;
@@ -243,44 +499,50 @@ void CJediAiMemory::simulateDamage(float damage, SJediAiActorState &actorState)
 
 void CJediAiMemory::querySelfState() {
 
+	// get my snapshot
+	const SJediAiActorSnapshot *selfSnapshot = findActorSnapshot(selfState.jedi);
+	if (selfSnapshot == NULL) {
+		return;
+	}
+
 	// query self state
-	selfState.skillLevel = selfState.jedi->getSkillLevel();
-	selfState.hitPoints = selfState.jedi->getHitPoints();
-	selfState.collisionRadius = selfState.jedi->getCollisionRadius();
+	selfState.skillLevel = selfSnapshot->jedi.skillLevel;
+	selfState.hitPoints = selfSnapshot->hitPoints;
+	selfState.collisionRadius = selfSnapshot->collisionRadius;
 	selfState.maxJumpForwardDistance = kJediForwardJumpMaxDistance;
-	selfState.currentStateBitfield = selfState.jedi->currentStateBitfield;
-	selfState.disabledActionBitfield = selfState.jedi->disabledActionAiBitfield;
-	selfState.isAiControlled = selfState.jedi->isAiControlled();
-	selfState.defensiveModeEnabled = selfState.jedi->isDefensiveModeEnabled();
+	selfState.currentStateBitfield = selfSnapshot->jedi.currentStateBitfield;
+	selfState.disabledActionBitfield = selfSnapshot->jedi.disabledActionAiBitfield;
+	selfState.isAiControlled = ((selfSnapshot->flags & kJediAiActorSnapshotFlag_AiControlled) != 0);
+	selfState.defensiveModeEnabled = ((selfSnapshot->flags & kJediAiActorSnapshotFlag_DefensiveMode) != 0);
 	selfState.isTooCloseToAnotherJedi = false;
 
 	// query self damage data
-	selfState.saberDamage = (selfState.jedi->isSaberActive() ? selfState.jedi->getSaberDamage() : 0.0f);
-	selfState.kickDamage = selfState.jedi->getKickDamage();
-	selfState.forcePushMaxDist = selfState.jedi->getForcePushMaxDist();
-	selfState.forcePushDamageRadius = selfState.jedi->getForcePushRadius();
+	selfState.saberDamage = selfSnapshot->jedi.saberDamage;
+	selfState.kickDamage = selfSnapshot->jedi.kickDamage;
+	selfState.forcePushMaxDist = selfSnapshot->jedi.forcePushMaxDist;
+	selfState.forcePushDamageRadius = selfSnapshot->jedi.forcePushRadius;
 
 	// query self positional data
 	selfState.wPrevPos = selfState.wPos;
-	selfState.wPos = selfState.jedi->getPos();
-	selfState.wBoundsCenterPos = selfState.jedi->getBoundsCenter();
-	selfState.iFrontDir = selfState.jedi->getFrontDir();
-	selfState.iRightDir = selfState.jedi->getRightDir();
+	selfState.wPos = selfSnapshot->wPos;
+	selfState.wBoundsCenterPos = selfSnapshot->wBoundsCenterPos;
+	selfState.iFrontDir = selfSnapshot->iFrontDir;
+	selfState.iRightDir = selfSnapshot->iRightDir;
 
 	// get my victim
 	// if it changed, reset the victim timer
 	CActor *prevVictim = victim;
-	victim = selfState.jedi->getCurrentTarget();
+	victim = selfSnapshot->currentTarget;
 	victimChanged = (victim != prevVictim);
 	if (victimChanged) {
 		victimTimer = 0.0f;
 	}
 
 	// can I see my victim?
-	victimInView = selfState.jedi->isCurrentTargetVisible();
+	victimInView = ((selfSnapshot->flags & kJediAiActorSnapshotFlag_CurrentTargetVisible) != 0);
 
 	// can my victim be navigated to?
-	victimCanBeNavigatedTo = determinePathFindValidity(selfState.wPos, victimState->wPos);
+	victimCanBeNavigatedTo = queryPathFindValidity(selfState.wPos, victimState->wPos);
 
 	// query my self collisions
 	querySelfCollisions();
@@ -324,7 +586,7 @@ void CJediAiMemory::querySelfCollisions() {
 	// how far can I navigate in the specified direction?
 	CVector wClosestNavigablePos = kZeroVector;
 	bool collided = false;
-	if (navMeshCollideRay(wStartPos, wTargetPos, &wClosestNavigablePos)) {
+	if (queryNavMeshCollideRay(wStartPos, wTargetPos, &wClosestNavigablePos)) {
 		wTargetPos = wClosestNavigablePos - (iDir * selfState.collisionRadius);
 		iDelta = (wTargetPos - wStartPos);
 		distance = selfState.wPos.distanceTo(wTargetPos);
@@ -338,7 +600,7 @@ void CJediAiMemory::querySelfCollisions() {
 		wTargetPos = wStartPos + iDelta;
 		CVector wCollisionPos;
 		CActor *collisionActor = NULL;
-		if (collideWorldWithMovingSphere(wStartPos, radius, iDelta, &wCollisionPos, &collisionActor)) {
+		if (queryCollideWorldWithMovingSphere(wStartPos, radius, iDelta, &wCollisionPos, &collisionActor)) {
 			wTargetPos = wCollisionPos - (iDir * selfState.collisionRadius);
 			iDelta = (wTargetPos - wStartPos);
 			distance = selfState.wPos.distanceTo(wTargetPos);
@@ -373,91 +635,68 @@ bool CJediAiMemory::canSelfDoAction(EJediAction action) const {
 }
 
 void CJediAiMemory::updateEntityToSelfState(SJediAiEntityState &updateMe) {
+	updateEntityToSelfState(updateMe, selfState.wPos.xzDistanceTo(updateMe.wPos));
+}
+
+void CJediAiMemory::updateEntityToSelfState(SJediAiEntityState &updateMe, float xzDistanceToSelf) {
 
 	// update entity properties that are relative to my self
-	updateMe.iToSelfDir = updateMe.wPos.xzDirectionTo(selfState.wPos);
-	updateMe.distanceToSelf = selfState.wPos.xzDistanceTo(updateMe.wPos);
+	updateMe.iToSelfDir = updateMe.wPos.xzDirectionTo(selfState.wPos, xzDistanceToSelf);
+	updateMe.distanceToSelf = xzDistanceToSelf;
 	updateMe.faceSelfPct = updateMe.iToSelfDir.dotProduct(updateMe.iFrontDir);
 	updateMe.selfFacePct = (-updateMe.iToSelfDir).dotProduct(selfState.iFrontDir);
 }
 
-void CJediAiMemory::queryActorState(CActor *actor, SJediAiActorState &actorState) {
+void CJediAiMemory::queryActorState(const SJediAiActorSnapshot *actorSnapshot, SJediAiActorState &actorState) {
 
 	// we need an actor for this
-	if (actor == NULL) {
+	if (actorSnapshot == NULL) {
 		memset(&actorState, 0, sizeof(actorState));
 		return;
 	}
 
-	// pull the actor state from the actor
+	// pull the actor state from the actor's snapshot and its shared sense
+	SJediAiActorSense senseScratch;
+	const SJediAiActorSense &sense = worldSnapshot->getActorSense(*actorSnapshot, senseScratch);
+	CActor *actor = actorSnapshot->actor;
 	actorState.actor = actor;
 	actorState.victim = NULL;
-	actorState.wPos = actor->getPos();
-	actorState.wBoundsCenterPos = actor->getBoundsCenter();
-	actorState.iVelocity = actor->getInertialVelocity();
-	actorState.iFrontDir = actor->getFrontDir();
-	actorState.iRightDir = actor->getRightDir();
-	actorState.collisionRadius = actor->getCollisionRadius();
+	actorState.wPos = actorSnapshot->wPos;
+	actorState.wBoundsCenterPos = actorSnapshot->wBoundsCenterPos;
+	actorState.iVelocity = sense.iVelocity;
+	actorState.iFrontDir = actorSnapshot->iFrontDir;
+	actorState.iRightDir = actorSnapshot->iRightDir;
+	actorState.collisionRadius = actorSnapshot->collisionRadius;
+	actorState.flags |= sense.stateFlags;
 
 	// update the actor state relative to self
 	updateEntityToSelfState(actorState);
 
 	// get actor data
-	actorState.victim = actor->getCurrentTarget();
-	actorState.hitPoints = actor->getHitPoints();
-	actorState.combatType = actor->getJediCombatType();
-	actorState.enemyType = actor->getJediEnemyType();
-
-	// check shield state
-	if (actor->isShielded()) {
-		actorState.flags |= kJediAiActorStateFlag_Shielded;
-	}
+	actorState.victim = actorSnapshot->currentTarget;
+	actorState.hitPoints = actorSnapshot->hitPoints;
+	actorState.combatType = actorSnapshot->combatType;
+	actorState.enemyType = actorSnapshot->enemyType;
 
 	// is my self this character's victim?
-	CJedi *actorVictimAsJedi = NULL;
 	if (actorState.victim == selfState.jedi) {
 		actorState.flags |= kJediAiActorStateFlag_TargetingSelf;
 
 	// otherwise, is this character engaged with another jedi
 	// this means that both the other jedi and the character are targeting each other
-	} else if (actorState.victim->isJedi() && actorState.victim->getCurrentTarget() == actor) {
+	} else if (sense.engagedWithJedi) {
 		actorState.flags |= kJediAiActorStateFlag_EngagedWithOtherJedi;
 	}
 
-	// is this actor stumbling?
-	if (actor->isStumbling()) {
-		actorState.flags |= kJediAiActorStateFlag_Stumbling;
-		actorState.iVelocity *= 0.25f;
-	}
-
-	// is this victim incapacitated?
-	if (actor->isIncapacitated()) {
-		actorState.flags |= kJediAiActorStateFlag_Incapacitated;
-		actorState.iVelocity.zero();
-	}
-
-	// can this biped be taunted?
-	if (actor->canBeTaunted()) {
-		actorState.flags |= kJediAiActorStateFlag_CanBeTaunted;
-	}
-
-	// if this is a jedi, retrieve jedi-specific info
-	if (actor->isJedi()) {
-		CJedi *jedi = (CJedi*)actor;
-
-		// is this jedi a player?
-		if (!jedi->isAiControlled()) {
-			actorState.flags |= kJediAiActorStateFlag_IsPlayer;
-		}
-
-		// is my self inside this jedi?
+	// is my self inside this jedi?
+	if (actorSnapshot->flags & kJediAiActorSnapshotFlag_IsJedi) {
 		if (actorState.distanceToSelf < ((actorState.collisionRadius + selfState.collisionRadius) * 2.0f)) {
 			selfState.isTooCloseToAnotherJedi = true;
 		}
 	}
 
 	// is this actor force grippable?
-	if (actor->isForceGrippable()) {
+	if (actorSnapshot->flags & kJediAiActorSnapshotFlag_ForceGrippable) {
 		if (actorState.distanceToSelf < kJediForceSelectRange) {
 			if (actorState.hitPoints > 0.0f) {
 				actorState.flags |= kJediAiActorStateFlag_Grippable;
@@ -465,14 +704,8 @@ void CJediAiMemory::queryActorState(CActor *actor, SJediAiActorState &actorState
 		}
 	}
 
-	// is this actor gripped already?
-	if (actor->isForceGripped()) {
-		actorState.flags |= kJediAiActorStateFlag_Grippable;
-		actorState.flags |= kJediAiActorStateFlag_Gripped;
-	}
-
 	// is this actor gripped by my self?
-	if (actor->isBeingForceGrippedByJedi(selfState.jedi)) {
+	if (actorSnapshot->forceGrippingJedi != NULL && actorSnapshot->forceGrippingJedi == selfState.jedi) {
 		actorState.flags |= kJediAiActorStateFlag_Grippable;
 		actorState.flags |= kJediAiActorStateFlag_Gripped;
 		actorState.flags |= kJediAiActorStateFlag_GrippedBySelf;
@@ -480,11 +713,6 @@ void CJediAiMemory::queryActorState(CActor *actor, SJediAiActorState &actorState
 
 	// update our 'throwable' flag
 	updateActorStateThrowableFlag(actorState);
-
-	// is this actor dead?
-	if (actorState.hitPoints <= 0.0f) {
-		actorState.flags |= kJediAiActorStateFlag_Dead;
-	}
 }
 
 void CJediAiMemory::updateActorStateThrowableFlag(SJediAiActorState &actorState) const {
@@ -533,7 +761,9 @@ void CJediAiMemory::queryVictimState() {
 	victimDesiredKillTime = 0.0f;
 
 	// we need a victim to do anything
-	if (victim == NULL) {
+	// if our victim isn't in the snapshot, we know nothing about it
+	const SJediAiActorSnapshot *victimSnapshot = findActorSnapshot(victim);
+	if (victimSnapshot == NULL) {
 		return;
 	}
 
@@ -542,19 +772,50 @@ void CJediAiMemory::queryVictimState() {
 	victimState = findEnemyState(victim);
 
 	// query the victim state
-	queryActorState(victim, *victimState);
+	queryActorState(victimSnapshot, *victimState);
 
 	// get the victim's combat type
-	victimState->combatType = victim->getJediCombatType();
+	victimState->combatType = victimSnapshot->combatType;
 
 	// get the victim's enemy type
-	victimState->enemyType = victim->getJediEnemyType();
+	victimState->enemyType = victimSnapshot->enemyType;
+
+	// compute how long it should take to kill this victim
+	victimDesiredKillTime = computeTimeToKill(selfState.jedi, victimState->enemyType, selfState.skillLevel);
+
+	// get the victim's floor height
+	victimFloorHeight = victimSnapshot->floorHeight;
+}
+
+void CJediAiMemory::setVictim(int enemyStateIndex) {
+	if (enemyStateIndex < 0 || enemyStateIndex >= enemyStateCount) {
+		error("CJediAiMemory::setVictim() - Invalid enemy state index %d", enemyStateIndex);
+		return;
+	}
+
+	// if it changed, reset the victim timer
+	SJediAiActorState &enemyState = enemyStates[enemyStateIndex];
+	victimChanged = (victim != enemyState.actor);
+	if (victimChanged) {
+		victimTimer = 0.0f;
+	}
+	victim = enemyState.actor;
+	victimState = &enemyState;
+
+	// I only sense whether my current target is visible, so assume anyone in front of me is
+	victimInView = (victimState->selfFacePct > 0.0f);
+	victimCanBeNavigatedTo = queryPathFindValidity(selfState.wPos, victimState->wPos);
 
 	// compute how long it should take to kill this victim
 	victimDesiredKillTime = computeTimeToKill(selfState.jedi, victimState->enemyType, selfState.skillLevel);
 
 	// get the victim's floor height
-	victimFloorHeight = victim->getFloorHeight();
+	const SJediAiActorSnapshot *victimSnapshot = findActorSnapshot(victim);
+	victimFloorHeight = (victimSnapshot != NULL ? victimSnapshot->floorHeight : victimState->wPos.y);
+
+	// anything aimed at my victim must be re-aimed
+	updateCanForceTkObjectsHitVictim();
+	queryForceTkTargetStates();
 }
 
 void CJediAiMemory::updateVictimToSelfState() {
@@ -574,12 +835,14 @@ void CJediAiMemory::queryForceTkTargetStates() {
 
 	// compute my force tk target state
 	forceTkTargetState = gEmptyJediAiActorState;
-	if (selfState.jedi->getForceSelectedActor() != NULL) {
-		SJediAiActorState *forceSelectedActorState = findEnemyState(selfState.jedi->getForceSelectedActor());
+	const SJediAiActorSnapshot *selfSnapshot = findActorSnapshot(selfState.jedi);
+	CActor *forceSelectedActor = (selfSnapshot != NULL ? selfSnapshot->jedi.forceSelectedActor : NULL);
+	if (forceSelectedActor != NULL) {
+		SJediAiActorState *forceSelectedActorState = findEnemyState(forceSelectedActor);
 		if (forceSelectedActorState != NULL) {
 			forceTkTargetState = forceSelectedActorState;
 		} else {
-			queryActorState(selfState.jedi->getForceSelectedActor(), *forceTkTargetState);
+			queryActorState(findActorSnapshot(forceSelectedActor), *forceTkTargetState);
 		}
 	}
 
@@ -599,25 +862,29 @@ void CJediAiMemory::queryForceTkBestTargetState() {
 	}
 
 	// if there are any tk-able enemies nearby that I can see, choose one
+	bool enemyMatchTable[kEnemyStateListSize];
+	computeActorStateFlagMatches(enemyStates, enemyStateCount,
+		(kJediAiActorStateFlag_Grippable | kJediAiActorStateFlag_Throwable),
+		(kJediAiActorStateFlag_TargetedByPlayer | kJediAiActorStateFlag_EngagedWithOtherJedi),
+		enemyMatchTable
+	);
 	for (int i = 0; i < enemyStateCount; ++i) {
-		SJediAiActorState &actorState = enemyStates[i];
-		int desiredFlags = (kJediAiActorStateFlag_Grippable | kJediAiActorStateFlag_Throwable);
-		if ((actorState.flags & desiredFlags) == desiredFlags) {
-			if (!(actorState.flags & (kJediAiActorStateFlag_TargetedByPlayer | kJediAiActorStateFlag_EngagedWithOtherJedi))) {
-				if (actorState.selfFacePct > 0.25f) {
-					forceTkBestTargetState = &actorState;
-					return;
-				}
-			}
+		if (enemyMatchTable[i] && enemyStates[i].selfFacePct > 0.25f) {
+			forceTkBestTargetState = &enemyStates[i];
+			return;
 		}
 	}
 
 	// if there are any tk-able objects nearby, choose one
+	bool objectMatchTable[kForceTkObjectStateListSize];
+	computeActorStateFlagMatches(forceTkObjectStates, forceTkObjectStateCount,
+		(kJediAiActorStateFlag_Grippable | kJediAiActorStateFlag_ForceTkObjectCanHitVictim),
+		0,
+		objectMatchTable
+	);
 	for (int i = 0; i < forceTkObjectStateCount; ++i) {
-		SJediAiActorState &actorState = forceTkObjectStates[i];
-		int desiredFlags = (kJediAiActorStateFlag_Grippable | kJediAiActorStateFlag_ForceTkObjectCanHitVictim);
-		if ((actorState.flags & desiredFlags) == desiredFlags) {
-			forceTkBestTargetState = &actorState;
+		if (objectMatchTable[i]) {
+			forceTkBestTargetState = &forceTkObjectStates[i];
 			return;
 		}
 	}
@@ -642,7 +909,7 @@ void CJediAiMemory::queryForceTkBestThrowTargetState() {
 			if (!(victimState->flags & (kJediAiActorStateFlag_TargetedByPlayer | kJediAiActorStateFlag_EngagedWithOtherJedi))) {
 				float distSq = victimState->wBoundsCenterPos.distanceSqTo(forceTkBestTargetState->wBoundsCenterPos);
 				if (distSq < SQ(kJediThrowRange)) {
-					forceTkBestTargetState = victimState;
+					forceTkBestThrowTargetState = victimState;
 					return;
 				}
 			}
@@ -652,43 +919,43 @@ void CJediAiMemory::queryForceTkBestThrowTargetState() {
 	// minimum distance
 	const float kMinDistanceSq = SQ(10.0f);
 
-	// set the actor states
-	forceTkBestThrowTargetState = gEmptyJediAiActorState;
-	float bestEnemyDistanceSq =  SQ(9999.0f);
+	// skip actors that are targeted by a player, engaged with another jedi, or incapacitated
+	bool matchTable[kEnemyStateListSize];
+	computeActorStateFlagMatches(enemyStates, enemyStateCount,
+		0,
+		(kJediAiActorStateFlag_TargetedByPlayer | kJediAiActorStateFlag_EngagedWithOtherJedi | kJediAiActorStateFlag_Incapacitated),
+		matchTable
+	);
+
+	// compute how far every enemy is from my tk target at once
+	float distanceSqTable[kEnemyStateListSize];
+	computeDistancesSq(forceTkBestTargetState->wPos, &enemyStates[0].wPos, distanceSqTable, enemyStateCount, sizeof(enemyStates[0]));
+
+	// use the closest enemy that isn't too close
+	// we can't throw a target at itself, or at an actor gripped by someone other than me
+	float bestEnemyDistanceSq = SQ(9999.0f);
 	for (int i = 0; i < enemyStateCount; ++i) {
-		SJediAiActorState &actorState = enemyStates[i];
-		if (actorState.actor == NULL) {
-			continue;
-		}
-
-		// we can't throw a target at itself
-		if (actorState.actor == forceTkBestTargetState->actor) {
-			continue;
-		}
-
-		// if this actor is targeted by a player, skip it
-		// if this actor is engaged with another jedi, skip it
-		// if this target is incapacitated, skip it
-		unsigned int skipItFlags = (
-			kJediAiActorStateFlag_TargetedByPlayer |
-			kJediAiActorStateFlag_EngagedWithOtherJedi |
-			kJediAiActorStateFlag_Incapacitated
+		const SJediAiActorState &actorState = enemyStates[i];
+		bool grippedByOther = ((actorState.flags & (kJediAiActorStateFlag_Gripped | kJediAiActorStateFlag_GrippedBySelf)) == kJediAiActorStateFlag_Gripped);
+		bool candidate = (
+			matchTable[i] &
+			(actorState.actor != NULL) &
+			(actorState.actor != forceTkBestTargetState->actor) &
+			!grippedByOther &
+			(distanceSqTable[i] >= kMinDistanceSq) &
+			(distanceSqTable[i] < bestEnemyDistanceSq)
 		);
-		if (actorState.flags & skipItFlags) {
-			continue;
-		}
-
-		// if this actor is gripped by someone other than me, skip it
-		if ((actorState.flags & kJediAiActorStateFlag_Gripped) && !(actorState.flags & kJediAiActorStateFlag_GrippedBySelf)) {
-			continue;
+		if (candidate) {
+			bestEnemyDistanceSq = distanceSqTable[i];
+			forceTkBestThrowTargetState = &enemyStates[i];
 		}
+	}
+}
 
-		// if this target is not too close and is closer to my tk target than the last actor, use it instead
-		float distanceSq = forceTkBestTargetState->wPos.distanceSqTo(actorState.wPos);
-		if (distanceSq >= kMinDistanceSq && distanceSq < bestEnemyDistanceSq) {
-			bestEnemyDistanceSq = distanceSq;
-			forceTkBestThrowTargetState = &actorState;
-		}
+void CJediAiMemory::computeActorStateFlagMatches(const SJediAiActorState stateList[], int stateCount, unsigned int requiredFlags, unsigned int excludedFlags, bool matchTable[]) {
+	for (int i = 0; i < stateCount; ++i) {
+		unsigned int flags = stateList[i].flags;
+		matchTable[i] = (((flags & requiredFlags) == requiredFlags) & ((flags & excludedFlags) == 0));
 	}
 }
 
@@ -718,9 +985,6 @@ SJediAiActorState *CJediAiMemory::findEnemyState(CActor *enemy) {
 
 void CJediAiMemory::clearCanForceTkObjectsHitVictim() {
 
-	// reset the index that we check
-	canForceTkObjectHitVictimCheckIndex = 0;
-
 	// clear the 'canHit' flags
 	for (int i = 0; i < forceTkObjectStateCount; ++i) {
 		forceTkObjectStates[i].flags &= ~kJediAiActorStateFlag_ForceTkObjectCanHitVictim;
@@ -735,31 +999,31 @@ void CJediAiMemory::updateCanForceTkObjectsHitVictim() {
 		return;
 	}
 
-	// keep my check index within bounds
-	if (canForceTkObjectHitVictimCheckIndex >= forceTkObjectStateCount || canForceTkObjectHitVictimCheckIndex < 0) {
-		canForceTkObjectHitVictimCheckIndex = 0;
-	}
-
-	// check whether or not the current 'check' object can hit my victim
-	SJediAiActorState &forceTkObjectState = forceTkObjectStates[canForceTkObjectHitVictimCheckIndex];
-	float radius = forceTkObjectState.collisionRadius;
-	CVector wStartPos = forceTkObjectState.wPos + (kUnitVectorY * (radius + 0.1f));
-	CVector wEndPos = victimState->wPos + (kUnitVectorY * (radius + 0.1f));
-	CVector iDir = wStartPos.directionTo(wEndPos);
-	wStartPos += (iDir * radius);
-	wEndPos -= (iDir * radius);
-	CVector iDelta = wEndPos - wStartPos;
-	bool canHitVictim = !collideWorldWithMovingSphere(wStartPos, radius, iDelta, NULL);
-	if (canHitVictim) {
-		forceTkObjectState.flags |= kJediAiActorStateFlag_ForceTkObjectCanHitVictim;
-	} else {
-		forceTkObjectState.flags &= ~kJediAiActorStateFlag_ForceTkObjectCanHitVictim;
-	}
-
-	// move to the next index
-	++canForceTkObjectHitVictimCheckIndex;
-	if (canForceTkObjectHitVictimCheckIndex >= forceTkObjectStateCount) {
-		canForceTkObjectHitVictimCheckIndex = 0;
+	// build a sweep from each object to my victim
+	SJediAiEngineQuery queryList[kForceTkObjectStateListSize];
+	for (int i = 0; i < forceTkObjectStateCount; ++i) {
+		const SJediAiActorState &forceTkObjectState = forceTkObjectStates[i];
+		float radius = forceTkObjectState.collisionRadius;
+		CVector wStartPos = forceTkObjectState.wPos + (kUnitVectorY * (radius + 0.1f));
+		CVector wEndPos = victimState->wPos + (kUnitVectorY * (radius + 0.1f));
+		CVector iDir = wStartPos.directionTo(wEndPos);
+		wStartPos += (iDir * radius);
+		wEndPos -= (iDir * radius);
+		SJediAiEngineQuery &query = queryList[i];
+		query.type = eJediAiEngineQuery_CollideWorldWithMovingSphere;
+		query.wStartPos = wStartPos;
+		query.wEndPos = wEndPos - wStartPos;
+		query.radius = radius;
+	}
+
+	// resolve them all at once, and any object whose sweep is clear can hit my victim
+	resolveEngineQueries(queryList, forceTkObjectStateCount);
+	for (int i = 0; i < forceTkObjectStateCount; ++i) {
+		if (!queryList[i].result) {
+			forceTkObjectStates[i].flags |= kJediAiActorStateFlag_ForceTkObjectCanHitVictim;
+		} else {
+			forceTkObjectStates[i].flags &= ~kJediAiActorStateFlag_ForceTkObjectCanHitVictim;
+		}
 	}
 }
 
@@ -778,30 +1042,30 @@ SJediAiActorState *CJediAiMemory::findForceTkObjectState(CActor *object) {
 	return (objectStateIndex < 0 ? NULL : &forceTkObjectStates[objectStateIndex]);
 }
 
-bool findActorsInVicinityCallback(CActor *actor, void *context) {
-	CJediAiMemory *memory = (CJediAiMemory*)context;
+// is an actor in the world snapshot one that my self cares about?
+static bool isActorOfInterest(const CJediAiMemory &memory, const SJediAiActorSnapshot &actorSnapshot) {
 
 	// skip my self
-	if (actor == memory->selfState.jedi) {
+	if (actorSnapshot.actor == memory.selfState.jedi) {
 		return false;
 	}
 
 	// if this actor is not alive, skip it
-	if (actor->getHitPoints() <= 0.0f) {
+	if (actorSnapshot.hitPoints <= 0.0f) {
 		return false;
 	}
 
 	// force tk objects
-	if (actor->isForceTkObject()) {
+	if (actorSnapshot.flags & kJediAiActorSnapshotFlag_IsForceTkObject) {
 
 		// if this object isn't grippable, skip it
-		if (!actor->isForceGrippable()) {
+		if (!(actorSnapshot.flags & kJediAiActorSnapshotFlag_ForceGrippable)) {
 			return false;
 		}
 
 		// if the object isn't in my view, skip it
-		CVector iSelfToObjectDir = memory->selfState.wPos.xzDirectionTo(actor->getPos());
-		float selfFacePct = memory->selfState.iFrontDir.dotProduct(iSelfToObjectDir);
+		CVector iSelfToObjectDir = memory.selfState.wPos.xzDirectionTo(actorSnapshot.wPos);
+		float selfFacePct = memory.selfState.iFrontDir.dotProduct(iSelfToObjectDir);
 		if (selfFacePct < 0.15f) {
 			return false;
 		}
@@ -811,11 +1075,10 @@ bool findActorsInVicinityCallback(CActor *actor, void *context) {
 	}
 
 	// partner jedi
-	if (actor->isJedi()) {
-		CJedi *jedi = (CJedi*)actor;
+	if (actorSnapshot.flags & kJediAiActorSnapshotFlag_IsJedi) {
 
 		// if this jedi is a padawan, skip it
-		if (jedi->isPadawan()) {
+		if (actorSnapshot.flags & kJediAiActorSnapshotFlag_Padawan) {
 			return false;
 		}
 
@@ -824,7 +1087,7 @@ bool findActorsInVicinityCallback(CActor *actor, void *context) {
 	}
 
 	// always keep enemies
-	if (actor->isJediEnemy()) {
+	if (actorSnapshot.flags & kJediAiActorSnapshotFlag_IsJediEnemy) {
 		return true;
 	}
 
@@ -852,10 +1115,27 @@ void CJediAiMemory::queryActorStates() {
 	memset(enemyStates, 0, sizeof(enemyStates));
 	forceTkObjectStateCount = 0;
 	memset(forceTkObjectStates, 0, sizeof(forceTkObjectStates));
+	overflowEnemyCount = 0;
+	for (int i = 0; i < kOverflowSectorCount; ++i) {
+		overflowSectors[i].enemyCount = 0;
+		overflowSectors[i].wEnemyCenterPos.zero();
+	}
 
-	// find all nearby actors
-	CActor *actorList[256];
-	int actorCount = findActorsInVicinity(selfState.wPos, 100.0f, actorList, TR_COUNTOF(actorList), findActorsInVicinityCallback, this);
+	// find all nearby actors in the world snapshot
+	if (worldSnapshot == NULL) {
+		return;
+	}
+	const SJediAiActorSnapshot *actorList[CJediAiWorldSnapshot::kActorListSize];
+	int actorCount = 0;
+	for (int i = 0; i < worldSnapshot->actorCount; ++i) {
+		const SJediAiActorSnapshot &actorSnapshot = worldSnapshot->actorList[i];
+		if (selfState.wPos.distanceSqTo(actorSnapshot.wPos) > SQ(kActorAwareDistance)) {
+			continue;
+		}
+		if (isActorOfInterest(*this, actorSnapshot)) {
+			actorList[actorCount++] = &actorSnapshot;
+		}
+	}
 	if (actorCount <= 0) {
 		return;
 	}
@@ -864,8 +1144,9 @@ void CJediAiMemory::queryActorStates() {
 	for (int i = 0; i < actorCount; ++i) {
 
 		// calculate the distance to the actor
-		CActor *actor = actorList[i];
-		CVector wActorPos = actor->getPos();
+		const SJediAiActorSnapshot *actorSnapshot = actorList[i];
+		CActor *actor = actorSnapshot->actor;
+		CVector wActorPos = actorSnapshot->wPos;
 
 		// determine which list this actor will go into
 		SJediAiActorState *list;
@@ -873,19 +1154,19 @@ void CJediAiMemory::queryActorStates() {
 		int listSize;
 
 		// this is a force tk object
-		if (actor->isForceTkObject()) {
+		if (actorSnapshot->flags & kJediAiActorSnapshotFlag_IsForceTkObject) {
 			list = forceTkObjectStates;
 			count = &forceTkObjectStateCount;
 			listSize = TR_COUNTOF(forceTkObjectStates);
 
 		// this is a partner jedi
-		} else if (actor->isJedi()) {
+		} else if (actorSnapshot->flags & kJediAiActorSnapshotFlag_IsJedi) {
 			list = partnerJediStates;
 			count = &partnerJediStateCount;
 			listSize = TR_COUNTOF(partnerJediStates);
 
 		// this is an enemy
-		} else if (actor->isJediEnemy()) {
+		} else if (actorSnapshot->flags & kJediAiActorSnapshotFlag_IsJediEnemy) {
 			list = enemyStates;
 			count = &enemyStateCount;
 			listSize = TR_COUNTOF(enemyStates);
@@ -907,17 +1188,25 @@ void CJediAiMemory::queryActorStates() {
 			}
 
 			// move the previous state to make room for the new guy
+			// if there isn't any room for the previous state and it's an enemy, summarize it
 			if (insertIdx < listSize) {
 				list[insertIdx].actor = prevState.actor;
 				list[insertIdx].distanceToSelf = prevState.distanceToSelf;
 			} else {
 				--(*count);
+				if (list == enemyStates) {
+					addOverflowEnemy(findActorSnapshot(prevState.actor)->wPos);
+				}
 			}
 			--insertIdx;
 		}
 
 		// if the list has no room for this actor, skip it
+		// if it's an enemy, summarize it
 		if (insertIdx >= listSize) {
+			if (list == enemyStates) {
+				addOverflowEnemy(wActorPos);
+			}
 			continue;
 		}
 
@@ -932,21 +1221,21 @@ void CJediAiMemory::queryActorStates() {
 	for (int i = 0; i < partnerJediStateCount; ++i) {
 		SJediAiActorState &actorState = partnerJediStates[i];
 		CActor *actor = actorState.actor;
-		queryActorState(actor, actorState);
+		queryActorState(findActorSnapshot(actor), actorState);
 	}
 
 	// query our enemy states
 	for (int i = 0; i < enemyStateCount; ++i) {
 		SJediAiActorState &actorState = enemyStates[i];
 		CActor *actor = actorState.actor;
-		queryActorState(actor, actorState);
+		queryActorState(findActorSnapshot(actor), actorState);
 	}
 
 	// query our forceTkObject states
 	for (int i = 0; i < forceTkObjectStateCount; ++i) {
 		SJediAiActorState &actorState = forceTkObjectStates[i];
 		CActor *actor = actorState.actor;
-		queryActorState(actor, actorState);
+		queryActorState(findActorSnapshot(actor), actorState);
 	}
 
 	// set whether or not we can hit our victim with these objects
@@ -963,6 +1252,26 @@ void CJediAiMemory::queryActorStates() {
 	}
 }
 
+void CJediAiMemory::queryTokens() {
+	selfState.maneuverSpaceTaken = false;
+	if (tokenBoard == NULL) {
+		return;
+	}
+
+	// keep my tokens, and hold a slot to fight my victim in
+	// if other jedi already hold every slot, my victim is flagged below and I'll look for someone else to fight
+	tokenBoard->renew(selfState.jedi, currentTime);
+	if (victim != NULL) {
+		tokenBoard->claimEngageSlot(selfState.jedi, victim, currentTime);
+	} else {
+		tokenBoard->releaseEngageSlot(selfState.jedi);
+	}
+
+	// see who other jedi are fighting and where they are maneuvering
+	tokenBoard->markTakenEngageSlots(selfState.jedi, enemyStates, enemyStateCount, currentTime);
+	selfState.maneuverSpaceTaken = tokenBoard->isManeuverSpaceTaken(selfState.jedi, selfState.wPos, selfState.collisionRadius * 2.0f, currentTime);
+}
+
 void CJediAiMemory::updateActorToSelfStates() {
 
 	// actor state lists
@@ -973,11 +1282,19 @@ void CJediAiMemory::updateActorToSelfStates() {
 	};
 
 	// set the actor states
+	// compute all of the distances for a list at once, then finish each state off with them
+	static const int kEnemyListSize = kEnemyStateListSize;
+	static const int kForceTkObjectListSize = kForceTkObjectStateListSize;
+	static const int kPartnerJediListSize = kPartnerJediStateListSize;
+	static const int kLargerListSize = (kEnemyListSize > kForceTkObjectListSize ? kEnemyListSize : kForceTkObjectListSize);
+	static const int kDistanceTableSize = (kLargerListSize > kPartnerJediListSize ? kLargerListSize : kPartnerJediListSize);
+	float distanceTable[kDistanceTableSize];
 	for (int i = 0; i < TR_COUNTOF(stateLists); ++i) {
 		SJediAiActorState *list = stateLists[i].list;
 		int count = stateLists[i].count;
+		computeXzDistances(selfState.wPos, &list[0].wPos, distanceTable, count, sizeof(list[0]));
 		for (int j = 0; j < count; ++j) {
-			updateEntityToSelfState(list[j]);
+			updateEntityToSelfState(list[j], distanceTable[j]);
 		}
 	}
 }
@@ -1173,27 +1490,34 @@ void CJediAiMemory::queryThreatStates() {
 	memset(blockDirThreatInfoTable, 0, sizeof(blockDirThreatInfoTable));
 	highestDodgeableThreatLevel = 0.0f;
 	memset(dodgeDirThreatLevelTable, 0, sizeof(dodgeDirThreatLevelTable));
+	overflowThreatCount = 0;
+	overflowThreatLevel = 0.0f;
+	for (int i = 0; i < kOverflowSectorCount; ++i) {
+		SOverflowSector &sector = overflowSectors[i];
+		sector.threatCount = 0;
+		sector.wThreatCenterPos.zero();
+		sector.threatCenterDistance = 0.0f;
+		sector.threatLevel = 0.0f;
+		sector.threatStrength = 0.0f;
+		sector.deflectableStrength = 0.0f;
+		sector.threatDuration = 0.0f;
+	}
 
 	// look through the threat list for threats targeting me
 	float threatLevels[TR_COUNTOF(threatStates)] = {};
-	for (int i = 0; i < gThreatCount; ++i) {
-
-		// get the threat
-		SJediThreatInfo *threat = &gThreatList[i];
-		if (threat == NULL) {
-			continue;
-		}
-
-		// if this threat does no damage, ignore it
-		if (threat->strength <= 0.0f) {
+	int worldThreatCount = (worldSnapshot != NULL ? worldSnapshot->threatCount : 0);
+	for (int i = 0; i < worldThreatCount; ++i) {
+
+		// get the threat and its shared sense
+		// if it does no damage or its attacker isn't in the snapshot, ignore it
+		const SJediThreatInfo *threat = &worldSnapshot->threatList[i];
+		SJediAiThreatSense senseScratch;
+		const SJediAiThreatSense &sense = worldSnapshot->getThreatSense(i, senseScratch);
+		const SJediAiActorSnapshot *attackerSnapshot = sense.attackerSnapshot;
+		if (attackerSnapshot == NULL) {
 			continue;
 		}
-
-		// get the attacker
 		CActor *attacker = threat->creator;
-		if (attacker == NULL) {
-			continue;
-		}
 
 		// if this threat is too far from me, ignore it
 		float threatDistSq = threat->wPos.distanceSqTo(selfState.wPos);
@@ -1209,25 +1533,24 @@ void CJediAiMemory::queryThreatStates() {
 		threatState.wPos = threat->wPos;
 		threatState.wEndPos = threat->wEndPos;
 		threatState.wBoundsCenterPos = threatState.wPos;
-		threatState.iFrontDir = threat->iDir;
-		if ((threatState.type == eJediThreatType_Melee) || (threatState.iFrontDir.isCloseTo(kZeroVector, 0.001f))) {
-			threatState.iFrontDir = attacker->getFrontDir();
-			if (threatState.iFrontDir.isCloseTo(kZeroVector, 0.001f)) {
-				threatState.iFrontDir = kUnitVectorZ;
-			}
-		}
-		threatState.iFrontDir.normalize();
-		threatState.iVelocity = threat->iDir * threat->speed;
-		threatState.iRightDir = threatState.iFrontDir.crossProduct(kUnitVectorY);
-		threatState.iRightDir.normalize();
+		threatState.iFrontDir = sense.iFrontDir;
+		threatState.iVelocity = sense.iVelocity;
+		threatState.iRightDir = sense.iRightDir;
 		threatState.attackerState = findEnemyState(attacker);
-		threatState.objectState = (threat->object->isForceTkObject() ? findForceTkObjectState(threat->object) : NULL);
+		const SJediAiActorSnapshot *objectSnapshot = sense.objectSnapshot;
+		threatState.objectState = (objectSnapshot != NULL && (objectSnapshot->flags & kJediAiActorSnapshotFlag_IsForceTkObject) ? findForceTkObjectState(threat->object) : NULL);
 		threatState.duration = threat->delayToAttackTime;
 		threatState.strength = threat->strength;
 		threatState.damageRadius = threat->damageRadius;
 		threatState.attackLevel = threat->attackLevel;
-		if (threatState.threat->isMelee360) {
-			threatState.flags |= kJediAiThreatStateFlag_Melee360;
+		threatState.flags |= sense.stateFlags;
+
+		// if my commands will be applied late, think about this threat as it will be by then
+		// a threat that lands before then can't be avoided, so it lands right away
+		if (senseLatency > 0.0f) {
+			threatState.wPos += threatState.iVelocity * senseLatency;
+			threatState.wBoundsCenterPos = threatState.wPos;
+			threatState.duration = max(threatState.duration - senseLatency, 0.0f);
 		}
 		updateThreatToSelfState(threatState);
 
@@ -1251,7 +1574,7 @@ void CJediAiMemory::queryThreatStates() {
 			case eJediThreatType_Blaster: {
 
 				// if the person who shot this blaster bolt is not my enemy, ignore it
-				if (!attacker->isJediEnemy()) {
+				if (!(attackerSnapshot->flags & kJediAiActorSnapshotFlag_IsJediEnemy)) {
 					continue;
 				}
 
@@ -1271,7 +1594,7 @@ void CJediAiMemory::queryThreatStates() {
 			case eJediThreatType_Melee: {
 
 				// if the attacker is dead or incapacitated, ignore this threat
-				if (attacker->getHitPoints() <= 0 || attacker->isIncapacitated()) {
+				if (attackerSnapshot->hitPoints <= 0 || (attackerSnapshot->flags & kJediAiActorSnapshotFlag_Incapacitated)) {
 					continue;
 				}
 
@@ -1308,8 +1631,8 @@ void CJediAiMemory::queryThreatStates() {
 					if (threatState.attackerState != NULL) {
 						attackerFacePct = threatState.attackerState->faceSelfPct;
 					} else {
-						CVector wAttackerPos = attacker->getPos();
-						CVector iAttackerDir = attacker->getFrontDir();
+						CVector wAttackerPos = attackerSnapshot->wPos;
+						CVector iAttackerDir = attackerSnapshot->iFrontDir;
 						CVector iAttackerToJediDir = wAttackerPos.xzDirectionTo(selfState.wPos);
 						attackerFacePct = iAttackerDir.dotProduct(iAttackerToJediDir);
 					}
@@ -1334,7 +1657,7 @@ void CJediAiMemory::queryThreatStates() {
 			case eJediThreatType_Rush: {
 
 				// if the attacker is dead or incapacitated, ignore this threat
-				if (attacker->getHitPoints() <= 0 || attacker->isIncapacitated()) {
+				if (attackerSnapshot->hitPoints <= 0 || (attackerSnapshot->flags & kJediAiActorSnapshotFlag_Incapacitated)) {
 					continue;
 				}
 
@@ -1369,7 +1692,7 @@ void CJediAiMemory::queryThreatStates() {
 			case eJediThreatType_Rocket: {
 
 				// if the person who threw this rocket is not an enemy, ignore it
-				if (!attacker->isJediEnemy()) {
+				if (!(attackerSnapshot->flags & kJediAiActorSnapshotFlag_IsJediEnemy)) {
 					continue;
 				}
 
@@ -1384,7 +1707,7 @@ void CJediAiMemory::queryThreatStates() {
 			case eJediThreatType_Grenade: {
 
 				// if the person who threw this grenade is not an enemy and it is moving away from me, ignore it
-				if (!attacker->isJediEnemy() && threatState.objectState != NULL) {
+				if (!(attackerSnapshot->flags & kJediAiActorSnapshotFlag_IsJediEnemy) && threatState.objectState != NULL) {
 					CVector iMoveDir = threatState.objectState->iVelocity;
 					iMoveDir.normalize();
 					float movingTowardPct = iMoveDir.dotProduct(threatState.iToSelfDir);
@@ -1414,21 +1737,25 @@ void CJediAiMemory::queryThreatStates() {
 			}
 
 			// move the previous threat to make room for the new guy
-			// if there isn't any room for the previous threat, remove it's type from the type count table
+			// if there isn't any room for the previous threat, summarize it
 			if (insertIdx < TR_COUNTOF(threatStates)) {
 				threatStates[insertIdx] = prevThreatState;
 				threatLevels[insertIdx] = threatLevels[insertIdx - 1];
 			} else {
 				--threatStateCount;
+				addOverflowThreat(prevThreatState, threatLevels[insertIdx - 1]);
 			}
 			--insertIdx;
 		}
 
 		// insert the new threat into it's place in the list
+		// if there isn't any room for it, summarize it
 		if (insertIdx < TR_COUNTOF(threatStates)) {
 			threatStates[insertIdx] = threatState;
 			threatLevels[insertIdx] = threatLevel;
 			++threatStateCount;
+		} else {
+			addOverflowThreat(threatState, threatLevel);
 		}
 	}
 
@@ -1514,10 +1841,9 @@ void CJediAiMemory::queryThreatStates() {
 		}
 	}
 
-	// average our threat level
-	if (threatStateCount > 0) {
-		threatLevel /= (float)TR_COUNTOF(threatStates);
-	}
+	// average our threat level, including whatever overflowed
+	overflowThreatLevel = computeOverflowThreatLevel();
+	threatLevel = ((threatLevel + overflowThreatLevel) / (float)kThreatLevelAverageCount);
 }
 
 void CJediAiMemory::simulateThreats(float dt, const SSimulateParams &params) {
@@ -1716,10 +2042,10 @@ void CJediAiMemory::simulateThreats(float dt, const SSimulateParams &params) {
 							CVector iAttackerToJediDir = threatState.attackerState->wPos.xzDirectionTo(wSelfPosAtImpact);
 							attackerFacePct = threatState.attackerState->iFrontDir.dotProduct(iAttackerToJediDir);
 						} else {
-							CActor *attacker = threatState.threat->creator;
-							if (attacker != NULL) {
-								CVector wAttackerPos = attacker->getPos();
-								CVector iAttackerDir = attacker->getFrontDir();
+							const SJediAiActorSnapshot *attackerSnapshot = findActorSnapshot(threatState.threat->creator);
+							if (attackerSnapshot != NULL) {
+								CVector wAttackerPos = attackerSnapshot->wPos;
+								CVector iAttackerDir = attackerSnapshot->iFrontDir;
 								CVector iAttackerToJediDir = wAttackerPos.xzDirectionTo(wSelfPosAtImpact);
 								attackerFacePct = iAttackerDir.dotProduct(iAttackerToJediDir);
 							}
@@ -1764,10 +2090,10 @@ void CJediAiMemory::simulateThreats(float dt, const SSimulateParams &params) {
 					if (threatState.attackerState != NULL) {
 						attackerFacePct = threatState.attackerState->faceSelfPct;
 					} else {
-						CActor *attacker = threatState.threat->creator;
-						if (attacker != NULL) {
-							CVector wAttackerPos = attacker->getPos();
-							CVector iAttackerDir = attacker->getFrontDir();
+						const SJediAiActorSnapshot *attackerSnapshot = findActorSnapshot(threatState.threat->creator);
+						if (attackerSnapshot != NULL) {
+							CVector wAttackerPos = attackerSnapshot->wPos;
+							CVector iAttackerDir = attackerSnapshot->iFrontDir;
 							CVector iAttackerToJediDir = wAttackerPos.xzDirectionTo(selfState.wPos);
 							attackerFacePct = iAttackerDir.dotProduct(iAttackerToJediDir);
 						}
@@ -1934,9 +2260,110 @@ void CJediAiMemory::simulateThreats(float dt, const SSimulateParams &params) {
 	#endif
 	threatStateCount = survivingThreatCount;
 
+	// overflow threats aren't simulated one by one, each sector's threats land all at once
+	simulateOverflowThreats(dt);
+
 	// update our threat level
-	if (threatStateCount > 0) {
-		threatLevel /= (float)TR_COUNTOF(threatStates);
+	overflowThreatLevel = computeOverflowThreatLevel();
+	threatLevel = ((threatLevel + overflowThreatLevel) / (float)kThreatLevelAverageCount);
+}
+
+int CJediAiMemory::computeOverflowSectorIndex(const CVector &wPos) const {
+	float angle = atan2f(wPos.x - selfState.wPos.x, wPos.z - selfState.wPos.z);
+	if (angle < 0.0f) {
+		angle += TWOPI;
+	}
+	int sectorIndex = (int)(angle * ((float)kOverflowSectorCount / TWOPI));
+	return limit(0, sectorIndex, kOverflowSectorCount - 1);
+}
+
+void CJediAiMemory::addOverflowEnemy(const CVector &wEnemyPos) {
+	SOverflowSector &sector = overflowSectors[computeOverflowSectorIndex(wEnemyPos)];
+	++sector.enemyCount;
+	sector.wEnemyCenterPos += ((wEnemyPos - sector.wEnemyCenterPos) / (float)sector.enemyCount);
+	++overflowEnemyCount;
+}
+
+void CJediAiMemory::addOverflowThreat(const SJediAiThreatState &threatState, float threatStateThreatLevel) {
+	SOverflowSector &sector = overflowSectors[computeOverflowSectorIndex(threatState.wPos)];
+	++sector.threatCount;
+	sector.wThreatCenterPos += ((threatState.wPos - sector.wThreatCenterPos) / (float)sector.threatCount);
+	sector.threatCenterDistance = sector.wThreatCenterPos.xzDistanceTo(selfState.wPos);
+	sector.threatLevel += threatStateThreatLevel;
+	sector.threatStrength += threatState.strength;
+	if (threatState.type == eJediThreatType_Blaster) {
+		sector.deflectableStrength += threatState.strength;
+	}
+	if (sector.threatCount == 1 || sector.threatDuration > threatState.duration) {
+		sector.threatDuration = threatState.duration;
+	}
+	++overflowThreatCount;
+}
+
+float CJediAiMemory::computeOverflowThreatLevel() const {
+
+	// if nothing overflowed, there's nothing to do
+	if (overflowThreatCount <= 0 && overflowEnemyCount <= 0) {
+		return 0.0f;
+	}
+
+	float level = 0.0f;
+	for (int i = 0; i < kOverflowSectorCount; ++i) {
+		const SOverflowSector &sector = overflowSectors[i];
+
+		// each sector presses harder as I close on its threats, and eases off as I back away
+		if (sector.threatCount > 0) {
+			float distance = sector.wThreatCenterPos.xzDistanceTo(selfState.wPos);
+			float closenessFactor = (max(1.0f, sector.threatCenterDistance) / max(1.0f, distance));
+			level += (sector.threatLevel * min(closenessFactor, 2.0f));
+		}
+
+		// enemies I'm not tracking press on me too, more the closer I get to them
+		if (sector.enemyCount > 0) {
+			float distance = sector.wEnemyCenterPos.xzDistanceTo(selfState.wPos);
+			float closenessPct = (1.0f - limit(0.0f, (distance / kOverflowEnemyPressureDistance), 1.0f));
+			level += ((float)sector.enemyCount * kOverflowEnemyThreatLevel * closenessPct);
+		}
+	}
+	return level;
+}
+
+void CJediAiMemory::simulateOverflowThreats(float dt) {
+
+	// if no threats overflowed, there's nothing to do
+	if (overflowThreatCount <= 0) {
+		return;
+	}
+
+	for (int i = 0; i < kOverflowSectorCount; ++i) {
+		SOverflowSector &sector = overflowSectors[i];
+		if (sector.threatCount <= 0) {
+			continue;
+		}
+
+		// if the sector's threats haven't landed yet, apply the timestep
+		if (sector.threatDuration > dt) {
+			sector.threatDuration -= dt;
+			continue;
+		}
+
+		// deflecting stops the blaster bolts
+		float damage = sector.threatStrength;
+		if (isSelfInState(eJediState_Deflecting)) {
+			damage -= sector.deflectableStrength;
+		}
+
+		// the farther I've moved away from where they were aimed, the fewer of them hit me
+		float distance = sector.wThreatCenterPos.xzDistanceTo(selfState.wPos);
+		float closenessFactor = (max(1.0f, sector.threatCenterDistance) / max(1.0f, distance));
+		selfState.hitPoints -= (damage * min(closenessFactor, 1.0f));
+
+		// this sector's threats no longer exist
+		overflowThreatCount -= sector.threatCount;
+		sector.threatCount = 0;
+		sector.threatLevel = 0.0f;
+		sector.threatStrength = 0.0f;
+		sector.deflectableStrength = 0.0f;
 	}
 }
 
@@ -2074,7 +2501,7 @@ void CJediAiMemory::updateThreatToSelfState(SJediAiThreatState &updateMe) {
 	}
 }
 
-float CJediAiMemory::computeThreatStateLevel(SJediAiThreatState &threatState) {
+float CJediAiMemory::computeThreatStateLevel(const SJediAiThreatState &threatState) const {
 
 	// if this is a big attack, get out of the way
 	if (threatState.threat->attackLevel >= eAttackLevel_Heavy) {
@@ -6,6 +6,29 @@
 #endif
 
 
+// get timestamp for this frame
+extern float getTime();
+
+// perception list capacities
+// define these in the build to see more actors and threats in big battles, at the cost of bigger memories
+// whatever doesn't fit is summarized in the overflow sectors
+#ifndef JEDI_AI_PARTNER_JEDI_STATE_LIST_SIZE
+	#define JEDI_AI_PARTNER_JEDI_STATE_LIST_SIZE 2
+#endif
+#ifndef JEDI_AI_ENEMY_STATE_LIST_SIZE
+	#define JEDI_AI_ENEMY_STATE_LIST_SIZE 8
+#endif
+#ifndef JEDI_AI_FORCE_TK_OBJECT_STATE_LIST_SIZE
+	#define JEDI_AI_FORCE_TK_OBJECT_STATE_LIST_SIZE 8
+#endif
+#ifndef JEDI_AI_THREAT_STATE_LIST_SIZE
+	#define JEDI_AI_THREAT_STATE_LIST_SIZE 8
+#endif
+#ifndef JEDI_AI_OVERFLOW_SECTOR_COUNT
+	#define JEDI_AI_OVERFLOW_SECTOR_COUNT 8
+#endif
+
+
 /////////////////////////////////////////////////////////////////////////////
 //
 // jedi world state knowledge container
@@ -40,6 +63,52 @@ public:
 	// the current 'time' (polled each frame from 'getTime()')
 	float currentTime;
 
+	// how long after I sense will my commands be applied? (0 unless my AI is pipelined)
+	// threats are sensed as they will be by then
+	float senseLatency;
+
+	// my random number stream
+	// simulation memory gets a copy, so simulating never disturbs the real stream
+	SJediRandom random;
+
+	// the world snapshot I last sensed from
+	// I hold a reference to it until my next update, copies of me don't
+	const CJediAiWorldSnapshot *worldSnapshot;
+
+	// release my reference to my world snapshot
+	void releaseWorldSnapshot();
+
+	// find an actor in my world snapshot (NULL if it isn't there)
+	const SJediAiActorSnapshot *findActorSnapshot(const CActor *actor) const;
+
+	// the batch my engine queries go through (NULL to ask the engine directly)
+	// copies of me share it, so everything simulated during a selection is answered from the same batch
+	CJediAiEngineQueryBatch *queryBatch;
+
+	// engine queries
+	bool queryPathFindValidity(const CVector &a, const CVector &b) const;
+	bool queryNavMeshCollideRay(const CVector &wStartPos, const CVector &wTargetPos, CVector *wClosestNavigablePos) const;
+	bool queryCollideWorldWithMovingSphere(const CVector &wPos, float radius, const CVector &iDelta, CVector *wCollisionPos, CActor **collisionActor = NULL) const;
+
+	// answer a list of engine queries in one call to the engine
+	void resolveEngineQueries(SJediAiEngineQuery queryList[], int queryCount) const;
+
+	// the board I coordinate with other jedi through (NULL if I don't coordinate)
+	// copies of me share it, but only my real memory claims tokens
+	CJediAiTokenBoard *tokenBoard;
+
+	// are the specified tokens (kJediAiToken_XXX) free for me to take?
+	bool areTokensAvailable(unsigned int tokens) const;
+
+	// claim and release the specified tokens
+	// claiming returns false if someone else got to one of them first
+	bool claimTokens(unsigned int tokens);
+	void releaseTokens(unsigned int tokens);
+
+	// the pool my latent actions take their coroutine frames from (NULL if they can't run)
+	// copies of me share it, but only my real memory's actions begin coroutines
+	CJediAiLatentFramePool *latentFramePool;
+
 
 	//---------------------------------
 	// simulation
@@ -69,9 +138,39 @@ public:
 	// were any actors that a player was targeting disturbed during the simulation?
 	bool playerTargetDisturbedDuringSimulation;
 
+	// simulation modes
+	enum ESimulationMode {
+		eSimulationMode_EventDriven, // split each timestep at the moments threats impact and actors arrive
+		eSimulationMode_SingleStep, // simulate each timestep in one step
+	};
+	ESimulationMode simulationMode;
+
+	// the most steps a single timestep will be split into (anything left is resolved in the last step)
+	// holding to 'simulationMaxError' adds the steps it needs, up to the second limit
+	enum { kMaxSimulationStepCount = 32 };
+	enum { kMaxErrorBoundSimulationStepCount = 256 };
+
+	// how far can an actor drift from its true path in a single step? (0 to only split at events, the default)
+	// rushing enemies chase me, so when I move they curve, and a step only aims them at where I started it
+	// the nearest threat's aim at me drifts the same way, more so the closer it is
+	// set this to sub-step when that matters more than the extra cost (see -benchsim)
+	// past kMaxErrorBoundSimulationStepCount steps the bound is best-effort
+	float simulationMaxError;
+
 	// simulate a set of actions over a given timestep
 	void simulate(float dt, const SSimulateParams &params);
 
+	// simulate a single step with no splitting
+	void simulateStep(float dt, const SSimulateParams &params);
+
+	// how long until the next threat impact or actor arrival? (maxDt if nothing happens sooner)
+	// threats and actors move linearly, so these are computed directly instead of stepped toward
+	float computeNextSimulationEventDt(float maxDt) const;
+
+	// how long a step can I take while staying within 'simulationMaxError'? (maxDt if nothing limits it)
+	// steps are never shorter than minDt, so a timestep doesn't run out of steps
+	float computeSimulationStepDt(float maxDt, float minDt, float selfSpeed) const;
+
 	// simulate damage to an actor
 	void simulateDamage(float damage, SJediAiActorState &actorState);
 
@@ -104,6 +203,7 @@ public:
 		bool isAiControlled;
 		bool defensiveModeEnabled;
 		bool isTooCloseToAnotherJedi;
+		bool maneuverSpaceTaken; // am I inside a space another jedi is maneuvering in?
 
 		// self positional data
 		CVector wPos;
@@ -147,9 +247,10 @@ public:
 
 	// update an entity state relative to the self state
 	void updateEntityToSelfState(SJediAiEntityState &updateMe);
+	void updateEntityToSelfState(SJediAiEntityState &updateMe, float xzDistanceToSelf);
 
-	// fill an actor state with the data from an actor
-	void queryActorState(CActor *actor, SJediAiActorState &state);
+	// fill an actor state with the data from an actor's snapshot
+	void queryActorState(const SJediAiActorSnapshot *actorSnapshot, SJediAiActorState &state);
 
 
 	//---------------------------------
@@ -175,6 +276,10 @@ public:
 	// victim state query
 	void queryVictimState();
 
+	// make one of my enemies my victim, as if it had been my target when I sensed
+	// this is how target selection simulates engaging someone else
+	void setVictim(int enemyStateIndex);
+
 	// update the victim's state relative to the current self state
 	void updateVictimToSelfState();
 
@@ -198,6 +303,9 @@ public:
 	void queryForceTkBestTargetState();
 	void queryForceTkBestThrowTargetState();
 
+	// flag which states in a list have all of the required flags and none of the excluded ones
+	static void computeActorStateFlagMatches(const SJediAiActorState stateList[], int stateCount, unsigned int requiredFlags, unsigned int excludedFlags, bool matchTable[]);
+
 	// update the force tk target's state relative to the current self state
 	void updateForceTkTargetToSelfStates();
 
@@ -207,12 +315,12 @@ public:
 	//---------------------------------
 
 	// partner jedi state list
-	enum { kPartnerJediStateListSize = 2 };
+	enum { kPartnerJediStateListSize = JEDI_AI_PARTNER_JEDI_STATE_LIST_SIZE };
 	int partnerJediStateCount;
 	SJediAiActorState partnerJediStates[kPartnerJediStateListSize];
 
 	// enemy state list
-	enum { kEnemyStateListSize = 8 };
+	enum { kEnemyStateListSize = JEDI_AI_ENEMY_STATE_LIST_SIZE };
 	int enemyStateCount;
 	SJediAiActorState enemyStates[kEnemyStateListSize];
 
@@ -221,18 +329,15 @@ public:
 	SJediAiActorState *findEnemyState(CActor *enemy);
 
 	// force tk object states
-	enum { kForceTkObjectStateListSize = 8 };
+	enum { kForceTkObjectStateListSize = JEDI_AI_FORCE_TK_OBJECT_STATE_LIST_SIZE };
 	int forceTkObjectStateCount;
 	SJediAiActorState forceTkObjectStates[kForceTkObjectStateListSize];
 
-	// each frame, I check whether or not the forceTkObjectState at this
-	// index can hit my victim if thrown
-	int canForceTkObjectHitVictimCheckIndex;
-
 	// clear whether or not forceTkObjects can hit my victim
 	void clearCanForceTkObjectsHitVictim();
 
 	// update whether or not forceTkObjects can hit my victim
+	// every object is swept toward my victim each frame, in a single batch
 	void updateCanForceTkObjectsHitVictim();
 
 	// find a force tk object state
@@ -242,6 +347,9 @@ public:
 	// actor state query
 	void queryActorStates();
 
+	// renew the tokens I hold, claim an engage slot for my victim, and see which tokens other jedi hold
+	void queryTokens();
+
 	// update the 'throwable' flag for a given actor state
 	void updateActorStateThrowableFlag(SJediAiActorState &actorState) const;
 
@@ -261,10 +369,13 @@ public:
 	float threatLevel;
 
 	// threat state list
-	enum { kThreatStateListSize = 8 };
+	enum { kThreatStateListSize = JEDI_AI_THREAT_STATE_LIST_SIZE };
 	int threatStateCount;
 	SJediAiThreatState threatStates[kThreatStateListSize];
 
+	// threat levels are averaged over this many threats, whatever the size of my threat list
+	enum { kThreatLevelAverageCount = 8 };
+
 	// aggregate data for each threat type
 	struct SJediThreatTypeData {
 		int count;
@@ -293,6 +404,48 @@ public:
 	// threat state query
 	void queryThreatStates();
 
+
+	//---------------------------------
+	// overflow
+	//---------------------------------
+
+	// enemies and threats that didn't fit in my lists, clustered by which direction they are in from me
+	// sectors are fixed in world space, starting along +z and going around toward +x
+	enum { kOverflowSectorCount = JEDI_AI_OVERFLOW_SECTOR_COUNT };
+	struct SOverflowSector {
+		int enemyCount;
+		CVector wEnemyCenterPos;
+		int threatCount;
+		CVector wThreatCenterPos;
+		float threatCenterDistance; // how far the threats' center was from me when they were queried
+		float threatLevel; // sum of the threats' levels when they were queried
+		float threatStrength; // how much damage the threats will do
+		float deflectableStrength; // how much of that damage deflecting stops
+		float threatDuration; // how long until the soonest of the threats lands
+	};
+	SOverflowSector overflowSectors[kOverflowSectorCount];
+	int overflowEnemyCount;
+	int overflowThreatCount;
+
+	// aggregate of the overflow sectors' threat levels and enemy pressure, scaled by how close I am to them
+	// this is already included in my threatLevel
+	float overflowThreatLevel;
+
+	// which overflow sector is a position in?
+	int computeOverflowSectorIndex(const CVector &wPos) const;
+
+	// summarize an enemy or threat that didn't fit in my lists
+	void addOverflowEnemy(const CVector &wEnemyPos);
+	void addOverflowThreat(const SJediAiThreatState &threatState, float threatStateThreatLevel);
+
+	// compute my overflow threat level from where I am now
+	// this is O(sectors), however many enemies and threats overflowed
+	float computeOverflowThreatLevel() const;
+
+	// each sector's threats land together when the soonest of them would have
+	// this is O(sectors), however many threats overflowed
+	void simulateOverflowThreats(float dt);
+
 	// simulate threats
 	void simulateThreats(float dt, const SSimulateParams &params);
 
@@ -300,7 +453,7 @@ public:
 	void updateThreatToSelfState(SJediAiThreatState &updateMe);
 
 	// compute a threat state's threat level
-	float computeThreatStateLevel(SJediAiThreatState &state);
+	float computeThreatStateLevel(const SJediAiThreatState &state) const;
 };
 
 #endif // __JEDI_AI_MEMORY__
@@ -0,0 +1,461 @@
+#include "pch.h"
+#include "jedi_ai_navigation.h"
+
+#if defined(VECTOR_SSE)
+	#include <emmintrin.h>
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// globals
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// the game's navigation
+CJediAiNavigation gJediAiNavigation;
+
+// is there a valid path between two points?
+bool determinePathFindValidity(const CVector &a, const CVector &b) {
+	return gJediAiNavigation.determinePathFindValidity(a, b);
+}
+
+// how far can I navigate toward a point?
+bool navMeshCollideRay(const CVector &wStartPos, const CVector &wTargetPos, CVector *wClosestNavigablePos) {
+	return gJediAiNavigation.collideRay(wStartPos, wTargetPos, wClosestNavigablePos);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// navigation grid
+//
+/////////////////////////////////////////////////////////////////////////////
+
+CJediAiNavGrid::CJediAiNavGrid() {
+	blockedTable = NULL;
+	regionTable = NULL;
+	reset();
+}
+
+CJediAiNavGrid::~CJediAiNavGrid() {
+	reset();
+}
+
+void CJediAiNavGrid::reset() {
+	delete [] blockedTable;
+	delete [] regionTable;
+	blockedTable = NULL;
+	regionTable = NULL;
+	width = 0;
+	height = 0;
+	cellSize = 1.0f;
+	originX = 0.0f;
+	originZ = 0.0f;
+	regionCount = 0;
+}
+
+bool CJediAiNavGrid::setup(int newWidth, int newHeight, float newCellSize, float newOriginX, float newOriginZ) {
+
+	// start from scratch
+	reset();
+
+	// make sure the layout makes sense
+	if (newWidth <= 0 || newHeight <= 0 || newCellSize <= 0.0f) {
+		error("CJediAiNavGrid::setup() - Bad grid layout (%d x %d cells of size %f)", newWidth, newHeight, newCellSize);
+		return false;
+	}
+
+	// allocate my cells
+	int cellCount = (newWidth * newHeight);
+	blockedTable = new unsigned char[cellCount];
+	regionTable = new int[cellCount];
+	if (blockedTable == NULL || regionTable == NULL) {
+		error("CJediAiNavGrid::setup() - Out of memory allocating %d cells", cellCount);
+		reset();
+		return false;
+	}
+	memset(blockedTable, 0, sizeof(blockedTable[0]) * cellCount);
+
+	// everything starts out open
+	width = newWidth;
+	height = newHeight;
+	cellSize = newCellSize;
+	originX = newOriginX;
+	originZ = newOriginZ;
+	computeRegions();
+	return true;
+}
+
+bool CJediAiNavGrid::load(const char *fileName) {
+
+	// open the file
+	FILE *file = fopen(fileName, "r");
+	if (file == NULL) {
+		error("CJediAiNavGrid::load() - Can't open '%s'", fileName);
+		return false;
+	}
+
+	// read the layout
+	int newWidth = 0;
+	int newHeight = 0;
+	float newCellSize = 0.0f;
+	float newOriginX = 0.0f;
+	float newOriginZ = 0.0f;
+	if (fscanf(file, " navgrid %d %d %f %f %f", &newWidth, &newHeight, &newCellSize, &newOriginX, &newOriginZ) != 5) {
+		error("CJediAiNavGrid::load() - '%s' doesn't start with a navgrid header", fileName);
+		fclose(file);
+		return false;
+	}
+	if (!setup(newWidth, newHeight, newCellSize, newOriginX, newOriginZ)) {
+		fclose(file);
+		return false;
+	}
+
+	// read the cells, skipping line breaks
+	for (int z = 0; z < height; ++z) {
+		for (int x = 0; x < width; ++x) {
+			int c = fgetc(file);
+			while (c == '\n' || c == '\r') {
+				c = fgetc(file);
+			}
+			if (c == EOF) {
+				error("CJediAiNavGrid::load() - '%s' ends after %d of %d cells", fileName, (z * width) + x, width * height);
+				fclose(file);
+				reset();
+				return false;
+			}
+			blockedTable[(z * width) + x] = (c == '#' ? 1 : 0);
+		}
+	}
+	fclose(file);
+
+	// find out what is connected to what
+	computeRegions();
+	return true;
+}
+
+bool CJediAiNavGrid::isEmpty() const {
+	return (blockedTable == NULL);
+}
+
+void CJediAiNavGrid::setCellBlocked(int x, int z, bool blocked) {
+	if (x < 0 || x >= width || z < 0 || z >= height) {
+		error("CJediAiNavGrid::setCellBlocked() - Cell (%d, %d) is outside the %d x %d grid", x, z, width, height);
+		return;
+	}
+	blockedTable[(z * width) + x] = (blocked ? 1 : 0);
+}
+
+void CJediAiNavGrid::computeRegions() {
+
+	// if I have no cells, there's nothing to do
+	regionCount = 0;
+	if (isEmpty()) {
+		return;
+	}
+
+	// clear the regions
+	int cellCount = (width * height);
+	memset(regionTable, 0, sizeof(regionTable[0]) * cellCount);
+
+	// flood fill each open cell that isn't in a region yet
+	// each cell is only ever pushed once, so the stack never holds more than every cell
+	int *stack = new int[cellCount];
+	if (stack == NULL) {
+		error("CJediAiNavGrid::computeRegions() - Out of memory allocating %d bytes", (int)(sizeof(int) * cellCount));
+		return;
+	}
+	for (int i = 0; i < cellCount; ++i) {
+		if (blockedTable[i] || regionTable[i] != 0) {
+			continue;
+		}
+		int region = ++regionCount;
+		int stackCount = 0;
+		regionTable[i] = region;
+		stack[stackCount++] = i;
+		while (stackCount > 0) {
+			int cellIndex = stack[--stackCount];
+			int x = (cellIndex % width);
+			int z = (cellIndex / width);
+			int neighborTable[4] = {
+				(x > 0 ? cellIndex - 1 : -1),
+				(x < width - 1 ? cellIndex + 1 : -1),
+				(z > 0 ? cellIndex - width : -1),
+				(z < height - 1 ? cellIndex + width : -1),
+			};
+			for (int n = 0; n < TR_COUNTOF(neighborTable); ++n) {
+				int neighbor = neighborTable[n];
+				if (neighbor >= 0 && !blockedTable[neighbor] && regionTable[neighbor] == 0) {
+					regionTable[neighbor] = region;
+					stack[stackCount++] = neighbor;
+				}
+			}
+		}
+	}
+	delete [] stack;
+}
+
+int CJediAiNavGrid::computeCellIndex(const CVector &wPos) const {
+	float fx = ((wPos.x - originX) / cellSize);
+	float fz = ((wPos.z - originZ) / cellSize);
+	if (fx < 0.0f || fz < 0.0f || fx >= (float)width || fz >= (float)height) {
+		return -1;
+	}
+	return (((int)fz * width) + (int)fx);
+}
+
+bool CJediAiNavGrid::isCellBlocked(int cellIndex) const {
+	return (cellIndex < 0 || cellIndex >= (width * height) || blockedTable[cellIndex] != 0);
+}
+
+bool CJediAiNavGrid::collideRay(const CVector &wStartPos, const CVector &wTargetPos, CVector *wClosestNavigablePos) const {
+
+	// march along the ray in cell space, sampling every half cell so no cell is stepped over
+	// the samples are tested in order, so the first blocked one is where we hit
+	float startX = ((wStartPos.x - originX) / cellSize);
+	float startZ = ((wStartPos.z - originZ) / cellSize);
+	float deltaX = ((wTargetPos.x - wStartPos.x) / cellSize);
+	float deltaZ = ((wTargetPos.z - wStartPos.z) / cellSize);
+	float cellLength = sqrtf((deltaX * deltaX) + (deltaZ * deltaZ));
+	int sampleCount = ((int)ceilf(cellLength * 2.0f) + 1);
+	float sampleStep = (sampleCount > 1 ? (1.0f / (float)(sampleCount - 1)) : 0.0f);
+	int hitSample = -1;
+	int i = 0;
+#if defined(VECTOR_SSE)
+
+	// do four samples at a time
+	const __m128 kOne = _mm_set1_ps(1.0f);
+	const __m128 kZero = _mm_setzero_ps();
+	const __m128 kSampleOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	__m128 startXs = _mm_set1_ps(startX);
+	__m128 startZs = _mm_set1_ps(startZ);
+	__m128 deltaXs = _mm_set1_ps(deltaX);
+	__m128 deltaZs = _mm_set1_ps(deltaZ);
+	__m128 widths = _mm_set1_ps((float)width);
+	__m128 heights = _mm_set1_ps((float)height);
+	__m128 sampleSteps = _mm_set1_ps(sampleStep);
+	for (; i < sampleCount && hitSample < 0; i += 4) {
+
+		// compute where the samples are
+		__m128 ts = _mm_min_ps(kOne, _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)i), kSampleOffsets), sampleSteps));
+		__m128 xs = _mm_add_ps(startXs, _mm_mul_ps(deltaXs, ts));
+		__m128 zs = _mm_add_ps(startZs, _mm_mul_ps(deltaZs, ts));
+
+		// anything outside the grid is blocked
+		__m128 insideXs = _mm_and_ps(_mm_cmpge_ps(xs, kZero), _mm_cmplt_ps(xs, widths));
+		__m128 insideZs = _mm_and_ps(_mm_cmpge_ps(zs, kZero), _mm_cmplt_ps(zs, heights));
+		int insideMask = _mm_movemask_ps(_mm_and_ps(insideXs, insideZs));
+
+		// look up the cells
+		int cellXTable[4];
+		int cellZTable[4];
+		_mm_storeu_si128((__m128i*)cellXTable, _mm_cvttps_epi32(xs));
+		_mm_storeu_si128((__m128i*)cellZTable, _mm_cvttps_epi32(zs));
+		for (int j = 0; j < 4 && (i + j) < sampleCount; ++j) {
+			if (!(insideMask & (1 << j)) || blockedTable[(cellZTable[j] * width) + cellXTable[j]]) {
+				hitSample = (i + j);
+				break;
+			}
+		}
+	}
+#else
+	for (; i < sampleCount; ++i) {
+		float t = min(1.0f, (float)i * sampleStep);
+		float x = (startX + (deltaX * t));
+		float z = (startZ + (deltaZ * t));
+		if (x < 0.0f || z < 0.0f || x >= (float)width || z >= (float)height || blockedTable[((int)z * width) + (int)x]) {
+			hitSample = i;
+			break;
+		}
+	}
+#endif
+
+	// if we didn't hit anything, we're done
+	if (hitSample < 0) {
+		if (wClosestNavigablePos != NULL) {
+			*wClosestNavigablePos = wTargetPos;
+		}
+		return false;
+	}
+
+	// the closest navigable position is the last sample before the hit
+	if (wClosestNavigablePos != NULL) {
+		float t = (hitSample > 0 ? min(1.0f, (float)(hitSample - 1) * sampleStep) : 0.0f);
+		*wClosestNavigablePos = lerp(wStartPos, wTargetPos, t);
+	}
+	return true;
+}
+
+bool CJediAiNavGrid::findPath(int startCellIndex, int endCellIndex) const {
+
+	// both ends must be open and in the same region
+	if (isCellBlocked(startCellIndex) || isCellBlocked(endCellIndex)) {
+		return false;
+	}
+	if (regionTable[startCellIndex] != regionTable[endCellIndex]) {
+		return false;
+	}
+	if (startCellIndex == endCellIndex) {
+		return true;
+	}
+
+	// breadth first search out from the start
+	// visited cells go in a small open addressing set, since the search is bounded
+	enum { kVisitedSetSize = (kMaxSearchCellCount * 2) };
+	compileTimeAssert((kVisitedSetSize & (kVisitedSetSize - 1)) == 0);
+	int visitedSet[kVisitedSetSize];
+	memset(visitedSet, 0xff, sizeof(visitedSet));
+	int queue[kMaxSearchCellCount];
+	int queueHead = 0;
+	int queueCount = 0;
+	queue[queueCount++] = startCellIndex;
+	visitedSet[(unsigned int)(startCellIndex * 2654435761u) & (kVisitedSetSize - 1)] = startCellIndex;
+	while (queueHead < queueCount) {
+		int cellIndex = queue[queueHead++];
+		int x = (cellIndex % width);
+		int z = (cellIndex / width);
+		int neighborTable[4] = {
+			(x > 0 ? cellIndex - 1 : -1),
+			(x < width - 1 ? cellIndex + 1 : -1),
+			(z > 0 ? cellIndex - width : -1),
+			(z < height - 1 ? cellIndex + width : -1),
+		};
+		for (int n = 0; n < TR_COUNTOF(neighborTable); ++n) {
+			int neighbor = neighborTable[n];
+			if (neighbor < 0 || blockedTable[neighbor]) {
+				continue;
+			}
+			if (neighbor == endCellIndex) {
+				return true;
+			}
+
+			// skip cells we've already visited
+			int slot = (int)((unsigned int)(neighbor * 2654435761u) & (kVisitedSetSize - 1));
+			while (visitedSet[slot] >= 0 && visitedSet[slot] != neighbor) {
+				slot = ((slot + 1) & (kVisitedSetSize - 1));
+			}
+			if (visitedSet[slot] == neighbor) {
+				continue;
+			}
+
+			// if the search has wandered too far, give up
+			if (queueCount >= kMaxSearchCellCount) {
+				return false;
+			}
+			visitedSet[slot] = neighbor;
+			queue[queueCount++] = neighbor;
+		}
+	}
+
+	// there's no local path
+	return false;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// path validity cache
+//
+/////////////////////////////////////////////////////////////////////////////
+
+CJediAiNavQueryCache::CJediAiNavQueryCache() {
+	memset(entryTable, 0, sizeof(entryTable));
+	hitCount = 0;
+	missCount = 0;
+}
+
+bool CJediAiNavQueryCache::find(unsigned int frameIndex, int startCellIndex, int endCellIndex, bool &valid) {
+	SEntry &entry = getEntry(startCellIndex, endCellIndex);
+	if (entry.frameIndex != frameIndex || entry.startCellIndex != startCellIndex || entry.endCellIndex != endCellIndex) {
+		++missCount;
+		return false;
+	}
+	valid = entry.valid;
+	++hitCount;
+	return true;
+}
+
+void CJediAiNavQueryCache::add(unsigned int frameIndex, int startCellIndex, int endCellIndex, bool valid) {
+	SEntry &entry = getEntry(startCellIndex, endCellIndex);
+	entry.frameIndex = frameIndex;
+	entry.startCellIndex = startCellIndex;
+	entry.endCellIndex = endCellIndex;
+	entry.valid = valid;
+}
+
+CJediAiNavQueryCache::SEntry &CJediAiNavQueryCache::getEntry(int startCellIndex, int endCellIndex) {
+	compileTimeAssert((kEntryCount & (kEntryCount - 1)) == 0);
+	unsigned int hash = (((unsigned int)startCellIndex * 2654435761u) ^ ((unsigned int)endCellIndex * 40503u));
+	return entryTable[(hash >> 8) & (kEntryCount - 1)];
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// navigation
+//
+/////////////////////////////////////////////////////////////////////////////
+
+CJediAiNavigation::CJediAiNavigation() {
+
+	// cache entries start at frame 0, so start at 1 to make them stale
+	frameIndex.store(1);
+}
+
+void CJediAiNavigation::beginFrame() {
+
+	// frame 0 marks unused cache entries, so skip it when we wrap
+	unsigned int nextFrameIndex = (frameIndex.load() + 1);
+	if (nextFrameIndex == 0) {
+		nextFrameIndex = 1;
+	}
+	frameIndex.store(nextFrameIndex);
+}
+
+bool CJediAiNavigation::determinePathFindValidity(const CVector &wStartPos, const CVector &wEndPos) const {
+
+	// without a grid, assume we can get there
+	if (grid.isEmpty()) {
+		return true;
+	}
+
+	// we can't get to or from anywhere off the grid
+	int startCellIndex = grid.computeCellIndex(wStartPos);
+	int endCellIndex = grid.computeCellIndex(wEndPos);
+	if (startCellIndex < 0 || endCellIndex < 0) {
+		return false;
+	}
+
+	// see if we already know the answer this frame
+	CJediAiNavQueryCache &cache = getQueryCache();
+	unsigned int currentFrameIndex = frameIndex.load(std::memory_order_relaxed);
+	bool valid = false;
+	if (cache.find(currentFrameIndex, startCellIndex, endCellIndex, valid)) {
+		return valid;
+	}
+
+	// search the grid, and remember what we found
+	valid = grid.findPath(startCellIndex, endCellIndex);
+	cache.add(currentFrameIndex, startCellIndex, endCellIndex, valid);
+	return valid;
+}
+
+bool CJediAiNavigation::collideRay(const CVector &wStartPos, const CVector &wTargetPos, CVector *wClosestNavigablePos) const {
+
+	// without a grid, assume we hit nothing
+	if (grid.isEmpty()) {
+		if (wClosestNavigablePos != NULL) {
+			wClosestNavigablePos->zero();
+		}
+		return false;
+	}
+	return grid.collideRay(wStartPos, wTargetPos, wClosestNavigablePos);
+}
+
+CJediAiNavQueryCache &CJediAiNavigation::getQueryCache() {
+
+	// every thread gets its own cache, so ai threads never contend over it
+	static thread_local CJediAiNavQueryCache cache;
+	return cache;
+}
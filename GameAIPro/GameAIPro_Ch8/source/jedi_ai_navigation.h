@@ -0,0 +1,156 @@
+#ifndef __JEDI_AI_NAVIGATION__
+#define __JEDI_AI_NAVIGATION__
+
+#ifndef __JEDI_COMMON__
+	#include "jedi_common.h"
+#endif
+
+#include <atomic>
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// navigation grid
+// a self-contained local navmesh: a grid of open and blocked cells on the xz plane
+// anything outside the grid is blocked, but an empty grid leaves everywhere navigable
+//
+/////////////////////////////////////////////////////////////////////////////
+
+class CJediAiNavGrid {
+public:
+
+	// local path searches give up after this many cells
+	enum { kMaxSearchCellCount = 1024 };
+
+	// grid layout
+	int width;
+	int height;
+	float cellSize;
+	float originX; // world position of the corner of cell (0, 0)
+	float originZ;
+
+	// cells
+	unsigned char *blockedTable; // nonzero if a cell is blocked
+	int *regionTable; // which connected region each open cell is in (0 if it's blocked)
+	int regionCount;
+
+	// construction
+	CJediAiNavGrid();
+	~CJediAiNavGrid();
+
+	// free my cells, leaving everywhere navigable
+	void reset();
+
+	// make an open grid of the specified size
+	bool setup(int newWidth, int newHeight, float newCellSize, float newOriginX, float newOriginZ);
+
+	// load a grid from a text file
+	// the first line is "navgrid <width> <height> <cellSize> <originX> <originZ>"
+	// then there is a row of cells for each z, '#' for blocked and anything else for open
+	bool load(const char *fileName);
+
+	// do I have any cells?
+	bool isEmpty() const;
+
+	// block or open a cell
+	// call computeRegions() once you are done editing
+	void setCellBlocked(int x, int z, bool blocked);
+
+	// flood fill my open cells into connected regions
+	void computeRegions();
+
+	// get the cell a position is in
+	// returns -1 if it's outside the grid
+	int computeCellIndex(const CVector &wPos) const;
+
+	// is a cell blocked?
+	bool isCellBlocked(int cellIndex) const;
+
+	// cast a ray across the grid
+	// returns true if it hits a blocked cell, along with the farthest open point before the hit
+	bool collideRay(const CVector &wStartPos, const CVector &wTargetPos, CVector *wClosestNavigablePos) const;
+
+	// is there a local path between two cells?
+	// this is a breadth first search, so paths that wander too far are not found
+	bool findPath(int startCellIndex, int endCellIndex) const;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// path validity cache
+// speculative simulations ask about nearly the same paths over and over
+// answers are keyed by their start and end cells, and only kept for the frame they were found on
+//
+/////////////////////////////////////////////////////////////////////////////
+
+class CJediAiNavQueryCache {
+public:
+
+	// entries
+	enum { kEntryCount = 256 };
+	struct SEntry {
+		unsigned int frameIndex; // 0 if unused
+		int startCellIndex;
+		int endCellIndex;
+		bool valid;
+	};
+	SEntry entryTable[kEntryCount];
+
+	// statistics
+	int hitCount;
+	int missCount;
+
+	// construction
+	CJediAiNavQueryCache();
+
+	// find a cached answer
+	// returns false if there isn't one for this frame
+	bool find(unsigned int frameIndex, int startCellIndex, int endCellIndex, bool &valid);
+
+	// cache an answer
+	void add(unsigned int frameIndex, int startCellIndex, int endCellIndex, bool valid);
+
+	// get the entry a query goes in
+	SEntry &getEntry(int startCellIndex, int endCellIndex);
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// navigation
+// answers the engine's navigation queries from the grid, through a cache on each thread
+//
+/////////////////////////////////////////////////////////////////////////////
+
+class CJediAiNavigation {
+public:
+
+	// my grid
+	CJediAiNavGrid grid;
+
+	// the current frame
+	// cached answers from earlier frames are ignored
+	std::atomic<unsigned int> frameIndex;
+
+	// construction
+	CJediAiNavigation();
+
+	// start a new frame (game thread only)
+	// call this after the world or the grid changes
+	void beginFrame();
+
+	// is there a valid path between two points?
+	bool determinePathFindValidity(const CVector &wStartPos, const CVector &wEndPos) const;
+
+	// how far can I navigate toward a point?
+	bool collideRay(const CVector &wStartPos, const CVector &wTargetPos, CVector *wClosestNavigablePos) const;
+
+	// get the calling thread's cache
+	static CJediAiNavQueryCache &getQueryCache();
+};
+
+// the game's navigation
+extern CJediAiNavigation gJediAiNavigation;
+
+#endif // __JEDI_AI_NAVIGATION__
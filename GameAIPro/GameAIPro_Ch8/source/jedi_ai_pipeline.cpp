@@ -0,0 +1,140 @@
+#include "pch.h"
+#include "jedi_ai_pipeline.h"
+#include "jedi.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// think pipeline
+//
+/////////////////////////////////////////////////////////////////////////////
+
+CJediAiThinkPipeline::CJediAiThinkPipeline() {
+	memset(jediList, 0, sizeof(jediList));
+	jediCount = 0;
+	thinkDt = 0.0f;
+	thinkRequested = false;
+	quitRequested = false;
+	memset(&stats, 0, sizeof(stats));
+
+	// start my worker
+	worker = std::thread(&CJediAiThinkPipeline::runWorker, this);
+}
+
+CJediAiThinkPipeline::~CJediAiThinkPipeline() {
+
+	// finish the current job, so its commands aren't lost
+	endThink();
+
+	// stop my worker
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quitRequested = true;
+	}
+	thinkCondition.notify_one();
+	worker.join();
+
+	// my jedi think for themselves again
+	for (int i = 0; i < jediCount; ++i) {
+		jediList[i]->aiPipelined = false;
+	}
+}
+
+bool CJediAiThinkPipeline::addJedi(CJedi *jedi) {
+	if (jedi == NULL) {
+		return false;
+	}
+
+	// the job's jedi list can't change under it
+	endThink();
+	for (int i = 0; i < jediCount; ++i) {
+		if (jediList[i] == jedi) {
+			return true;
+		}
+	}
+	if (jediCount >= kMaxJediCount) {
+		error("CJediAiThinkPipeline::addJedi() - Too many jedi (max %d)", kMaxJediCount);
+		return false;
+	}
+	jediList[jediCount++] = jedi;
+	jedi->aiPipelined = true;
+	return true;
+}
+
+void CJediAiThinkPipeline::removeJedi(CJedi *jedi) {
+
+	// the job's jedi list can't change under it
+	endThink();
+	for (int i = 0; i < jediCount; ++i) {
+		if (jediList[i] == jedi) {
+			jediList[i] = jediList[--jediCount];
+			jediList[jediCount] = NULL;
+			jedi->aiPipelined = false;
+			return;
+		}
+	}
+}
+
+void CJediAiThinkPipeline::beginThink(float dt) {
+
+	// only one job runs at a time
+	endThink();
+
+	// hand the job to my worker
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		thinkDt = dt;
+		thinkRequested = true;
+	}
+	thinkCondition.notify_one();
+}
+
+void CJediAiThinkPipeline::endThink() {
+
+	// wait for my worker to finish the job
+	double startTime = getTimeMicroseconds();
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (!thinkRequested) {
+			return;
+		}
+		doneCondition.wait(lock, [this] { return !thinkRequested; });
+	}
+	stats.waitMicroseconds += getTimeMicroseconds() - startTime;
+
+	// the worker is idle, so it's safe to apply what it queued up
+	for (int i = 0; i < jediCount; ++i) {
+		jediList[i]->applyAiCommands();
+	}
+}
+
+void CJediAiThinkPipeline::think() {
+	double startTime = getTimeMicroseconds();
+	for (int i = 0; i < jediCount; ++i) {
+		jediList[i]->think(thinkDt);
+	}
+	stats.thinkCount++;
+	stats.thinkMicroseconds += getTimeMicroseconds() - startTime;
+}
+
+void CJediAiThinkPipeline::runWorker() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+
+		// wait for a job
+		thinkCondition.wait(lock, [this] { return thinkRequested || quitRequested; });
+		if (quitRequested) {
+			return;
+		}
+
+		// think without holding the lock, so the game thread can see whether I'm done
+		// the game thread doesn't touch my jedi list or statistics until I am
+		lock.unlock();
+		think();
+		lock.lock();
+
+		// let the game thread know
+		thinkRequested = false;
+		doneCondition.notify_one();
+	}
+}
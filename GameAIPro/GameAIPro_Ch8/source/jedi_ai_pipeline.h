@@ -0,0 +1,77 @@
+#ifndef __JEDI_AI_PIPELINE__
+#define __JEDI_AI_PIPELINE__
+
+#ifndef __JEDI_COMMON__
+	#include "jedi_common.h"
+#endif
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// think pipeline
+// runs jedi AI on a worker thread while the game thread gets on with the rest of the frame
+// each frame, the game thread ends the last think job, which applies the commands it made,
+// then publishes the world and begins the next think job against it
+// commands land a frame after the world they were thought about, so pipelined jedi think
+// about threats as they will be when their commands apply
+//
+/////////////////////////////////////////////////////////////////////////////
+
+class CJediAiThinkPipeline {
+public:
+
+	// the jedi I think for
+	enum { kMaxJediCount = 32 };
+	CJedi *jediList[kMaxJediCount];
+	int jediCount;
+
+	// the think job
+	float thinkDt; // the dt the current job thinks with
+	bool thinkRequested; // the game thread has begun a job the worker hasn't finished
+	bool quitRequested;
+
+	// the worker
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable thinkCondition; // signalled when a job begins or I quit
+	std::condition_variable doneCondition; // signalled when a job is done
+
+	// statistics
+	struct SStats {
+		int thinkCount; // how many jobs were run
+		double thinkMicroseconds; // how long the worker spent thinking
+		double waitMicroseconds; // how long the game thread spent waiting for jobs to finish
+	} stats;
+
+	// construction
+	CJediAiThinkPipeline();
+	~CJediAiThinkPipeline();
+
+	// add a jedi to think for, pipelining its AI
+	// returns false if I'm full
+	bool addJedi(CJedi *jedi);
+
+	// stop thinking for a jedi, and let it think for itself again
+	// this waits for the current job
+	void removeJedi(CJedi *jedi);
+
+	// begin a think job against the latest world snapshot (game thread only)
+	// 'dt' is also how late the job's commands will be applied
+	void beginThink(float dt);
+
+	// wait for the current think job and apply the commands it made (game thread only)
+	// does nothing if there isn't a job
+	void endThink();
+
+	// think for each of my jedi (worker only)
+	void think();
+
+	// the worker's loop
+	void runWorker();
+};
+
+#endif // __JEDI_AI_PIPELINE__
@@ -0,0 +1,282 @@
+#include "pch.h"
+#include "jedi_ai_query_batch.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// globals
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// the default backend, which asks the engine directly
+CJediAiEngineQueryBackend gJediAiEngineQueryBackend;
+
+// hash a query's question
+static unsigned int hashQuestion(const SJediAiEngineQuery &question) {
+	float keyTable[] = {
+		question.wStartPos.x, question.wStartPos.y, question.wStartPos.z,
+		question.wEndPos.x, question.wEndPos.y, question.wEndPos.z,
+		question.radius,
+	};
+	unsigned int hash = (2166136261u ^ (unsigned int)question.type);
+	for (int i = 0; i < TR_COUNTOF(keyTable); ++i) {
+		unsigned int bits;
+		memcpy(&bits, &keyTable[i], sizeof(bits));
+		hash = ((hash ^ bits) * 16777619u);
+	}
+	return hash;
+}
+
+// do two queries ask the same question?
+static bool isSameQuestion(const SJediAiEngineQuery &a, const SJediAiEngineQuery &b) {
+	return (
+		(a.type == b.type) &&
+		(a.wStartPos.x == b.wStartPos.x) && (a.wStartPos.y == b.wStartPos.y) && (a.wStartPos.z == b.wStartPos.z) &&
+		(a.wEndPos.x == b.wEndPos.x) && (a.wEndPos.y == b.wEndPos.y) && (a.wEndPos.z == b.wEndPos.z) &&
+		(a.radius == b.radius)
+	);
+}
+
+// make a query with the answer the engine stubs have always given
+// this is what the record pass sees until the batch is resolved
+static void setPlaceholderAnswer(SJediAiEngineQuery &query) {
+	query.resolved = false;
+	query.result = (query.type == eJediAiEngineQuery_PathFindValidity);
+	query.wResultPos.zero();
+	query.resultActor = NULL;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// engine query backend
+//
+/////////////////////////////////////////////////////////////////////////////
+
+void CJediAiEngineQueryBackend::resolve(SJediAiEngineQuery queryList[], int queryCount) {
+	for (int type = 0; type < eJediAiEngineQuery_Count; ++type) {
+		for (int i = 0; i < queryCount; ++i) {
+			if (queryList[i].type == type && !queryList[i].resolved) {
+				resolveQuery(queryList[i]);
+			}
+		}
+	}
+}
+
+void CJediAiEngineQueryBackend::resolveQuery(SJediAiEngineQuery &query) {
+	query.wResultPos.zero();
+	query.resultActor = NULL;
+	switch (query.type) {
+		case eJediAiEngineQuery_PathFindValidity:
+			query.result = ::determinePathFindValidity(query.wStartPos, query.wEndPos);
+			break;
+		case eJediAiEngineQuery_NavMeshCollideRay:
+			query.result = ::navMeshCollideRay(query.wStartPos, query.wEndPos, &query.wResultPos);
+			break;
+		case eJediAiEngineQuery_CollideWorldWithMovingSphere:
+			query.result = ::collideWorldWithMovingSphere(query.wStartPos, query.radius, query.wEndPos, &query.wResultPos, &query.resultActor);
+			break;
+		default:
+			error("CJediAiEngineQueryBackend::resolveQuery() - Unknown query type %d", query.type);
+			query.result = false;
+			break;
+	}
+	query.resolved = true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// engine query batch
+//
+/////////////////////////////////////////////////////////////////////////////
+
+CJediAiEngineQueryBatch::CJediAiEngineQueryBatch() {
+	queryCount = 0;
+	memset(queryList, 0, sizeof(queryList));
+	memset(queryHashTable, 0xff, sizeof(queryHashTable));
+	memset(&scratchQuery, 0, sizeof(scratchQuery));
+	mode = eMode_Immediate;
+	selectionDepth = 0;
+	backend = NULL;
+	memset(&lastSelectionStats, 0, sizeof(lastSelectionStats));
+	memset(&totalStats, 0, sizeof(totalStats));
+}
+
+bool CJediAiEngineQueryBatch::beginSelection() {
+
+	// if we are already selecting, this is part of that selection
+	if (selectionDepth++ > 0) {
+		return false;
+	}
+
+	// the world may have changed since the last selection, so forget everything
+	compileTimeAssert(kQueryHashTableSize >= kQueryListSize * 2);
+	compileTimeAssert((kQueryHashTableSize & (kQueryHashTableSize - 1)) == 0);
+	queryCount = 0;
+	memset(queryHashTable, 0xff, sizeof(queryHashTable));
+	mode = eMode_Immediate;
+	memset(&lastSelectionStats, 0, sizeof(lastSelectionStats));
+	lastSelectionStats.selectionCount = 1;
+	return true;
+}
+
+void CJediAiEngineQueryBatch::endSelection() {
+
+	// if this isn't the outermost selection, keep going
+	if (selectionDepth <= 0) {
+		error("CJediAiEngineQueryBatch::endSelection() - Not selecting");
+		return;
+	}
+	if (--selectionDepth > 0) {
+		return;
+	}
+
+	// add this selection to the totals
+	mode = eMode_Immediate;
+	totalStats.selectionCount += lastSelectionStats.selectionCount;
+	totalStats.issuedCount += lastSelectionStats.issuedCount;
+	totalStats.duplicateCount += lastSelectionStats.duplicateCount;
+	totalStats.resolvedCount += lastSelectionStats.resolvedCount;
+	totalStats.batchedCount += lastSelectionStats.batchedCount;
+	totalStats.replayMissCount += lastSelectionStats.replayMissCount;
+	totalStats.overflowCount += lastSelectionStats.overflowCount;
+}
+
+void CJediAiEngineQueryBatch::beginRecord() {
+	mode = eMode_Record;
+}
+
+void CJediAiEngineQueryBatch::resolveRecorded() {
+
+	// answer everything that was recorded in one sweep
+	int unresolvedCount = 0;
+	for (int i = 0; i < queryCount; ++i) {
+		if (!queryList[i].resolved) {
+			++unresolvedCount;
+		}
+	}
+	getBackend().resolve(queryList, queryCount);
+	lastSelectionStats.resolvedCount += unresolvedCount;
+	lastSelectionStats.batchedCount += unresolvedCount;
+}
+
+void CJediAiEngineQueryBatch::beginReplay() {
+	mode = eMode_Replay;
+}
+
+bool CJediAiEngineQueryBatch::determinePathFindValidity(const CVector &a, const CVector &b) {
+	SJediAiEngineQuery question;
+	memset(&question, 0, sizeof(question));
+	question.type = eJediAiEngineQuery_PathFindValidity;
+	question.wStartPos = a;
+	question.wEndPos = b;
+	question.radius = 0.0f;
+	return query(question).result;
+}
+
+bool CJediAiEngineQueryBatch::navMeshCollideRay(const CVector &wStartPos, const CVector &wTargetPos, CVector *wClosestNavigablePos) {
+	SJediAiEngineQuery question;
+	memset(&question, 0, sizeof(question));
+	question.type = eJediAiEngineQuery_NavMeshCollideRay;
+	question.wStartPos = wStartPos;
+	question.wEndPos = wTargetPos;
+	question.radius = 0.0f;
+	const SJediAiEngineQuery &answer = query(question);
+	if (wClosestNavigablePos != NULL) {
+		*wClosestNavigablePos = answer.wResultPos;
+	}
+	return answer.result;
+}
+
+bool CJediAiEngineQueryBatch::collideWorldWithMovingSphere(const CVector &wPos, float radius, const CVector &iDelta, CVector *wCollisionPos, CActor **collisionActor) {
+	SJediAiEngineQuery question;
+	memset(&question, 0, sizeof(question));
+	question.type = eJediAiEngineQuery_CollideWorldWithMovingSphere;
+	question.wStartPos = wPos;
+	question.wEndPos = iDelta;
+	question.radius = radius;
+	const SJediAiEngineQuery &answer = query(question);
+	if (wCollisionPos != NULL) {
+		*wCollisionPos = answer.wResultPos;
+	}
+	if (collisionActor != NULL) {
+		*collisionActor = answer.resultActor;
+	}
+	return answer.result;
+}
+
+const SJediAiEngineQuery &CJediAiEngineQueryBatch::query(const SJediAiEngineQuery &question) {
+
+	// outside of a selection, just ask the backend
+	if (selectionDepth <= 0) {
+		scratchQuery = question;
+		getBackend().resolveQuery(scratchQuery);
+		return scratchQuery;
+	}
+	++lastSelectionStats.issuedCount;
+
+	// if this was already asked, answer it from the batch
+	// while recording, the answer may still be a placeholder
+	int queryIndex = findQuery(question);
+	if (queryIndex >= 0) {
+		SJediAiEngineQuery &entry = queryList[queryIndex];
+		if (mode == eMode_Record || entry.resolved) {
+			++lastSelectionStats.duplicateCount;
+			return entry;
+		}
+
+		// this was recorded but never resolved, so answer it now
+		getBackend().resolveQuery(entry);
+		++lastSelectionStats.resolvedCount;
+		return entry;
+	}
+
+	// if the batch is full, answer this now without remembering it
+	if (queryCount >= kQueryListSize) {
+		++lastSelectionStats.overflowCount;
+		scratchQuery = question;
+		getBackend().resolveQuery(scratchQuery);
+		++lastSelectionStats.resolvedCount;
+		return scratchQuery;
+	}
+
+	// add it to the batch
+	queryIndex = queryCount++;
+	SJediAiEngineQuery &entry = queryList[queryIndex];
+	entry = question;
+	int slot = (int)(hashQuestion(question) & (kQueryHashTableSize - 1));
+	while (queryHashTable[slot] >= 0) {
+		slot = ((slot + 1) & (kQueryHashTableSize - 1));
+	}
+	queryHashTable[slot] = (short)queryIndex;
+
+	// while recording, give it a placeholder answer until the batch is resolved
+	// otherwise answer it now, and if we are replaying, note that the record pass missed it
+	if (mode == eMode_Record) {
+		setPlaceholderAnswer(entry);
+	} else {
+		entry.resolved = false;
+		getBackend().resolveQuery(entry);
+		++lastSelectionStats.resolvedCount;
+		if (mode == eMode_Replay) {
+			++lastSelectionStats.replayMissCount;
+		}
+	}
+	return entry;
+}
+
+int CJediAiEngineQueryBatch::findQuery(const SJediAiEngineQuery &question) const {
+	int slot = (int)(hashQuestion(question) & (kQueryHashTableSize - 1));
+	while (queryHashTable[slot] >= 0) {
+		if (isSameQuestion(queryList[queryHashTable[slot]], question)) {
+			return queryHashTable[slot];
+		}
+		slot = ((slot + 1) & (kQueryHashTableSize - 1));
+	}
+	return -1;
+}
+
+CJediAiEngineQueryBackend &CJediAiEngineQueryBatch::getBackend() const {
+	return (backend != NULL ? *backend : gJediAiEngineQueryBackend);
+}
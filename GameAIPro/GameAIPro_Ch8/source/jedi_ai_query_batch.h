@@ -0,0 +1,144 @@
+#ifndef __JEDI_AI_QUERY_BATCH__
+#define __JEDI_AI_QUERY_BATCH__
+
+#ifndef __JEDI_COMMON__
+	#include "jedi_common.h"
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// engine queries
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// engine query types
+enum EJediAiEngineQuery {
+	eJediAiEngineQuery_PathFindValidity,
+	eJediAiEngineQuery_NavMeshCollideRay,
+	eJediAiEngineQuery_CollideWorldWithMovingSphere,
+	eJediAiEngineQuery_Count
+};
+
+// an engine query and its answer
+struct SJediAiEngineQuery {
+
+	// the question
+	EJediAiEngineQuery type;
+	CVector wStartPos;
+	CVector wEndPos; // for sphere collisions, this is the sphere's delta
+	float radius;
+
+	// the answer
+	bool resolved;
+	bool result;
+	CVector wResultPos;
+	CActor *resultActor;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// engine query backend
+// answers engine queries, a batch at a time
+// override this to plug in a collision or navigation system that is faster in bulk
+//
+/////////////////////////////////////////////////////////////////////////////
+
+class CJediAiEngineQueryBackend {
+public:
+
+	// destruction
+	virtual ~CJediAiEngineQueryBackend() {}
+
+	// answer a batch of queries
+	// the default sweeps through them a query type at a time, so each engine system is only visited once
+	virtual void resolve(SJediAiEngineQuery queryList[], int queryCount);
+
+	// answer a single query
+	virtual void resolveQuery(SJediAiEngineQuery &query);
+};
+
+// the default backend, which asks the engine directly
+extern CJediAiEngineQueryBackend gJediAiEngineQueryBackend;
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// engine query batch
+// collects the engine queries a selection makes so each one is only answered once
+// in immediate mode, queries are answered as they are asked and repeats are answered from the batch
+// when batching, a record pass collects the queries with placeholder answers, the batch is
+// resolved in one sweep, and a replay pass reads the answers back
+//
+/////////////////////////////////////////////////////////////////////////////
+
+class CJediAiEngineQueryBatch {
+public:
+
+	// modes
+	enum EMode {
+		eMode_Immediate,
+		eMode_Record,
+		eMode_Replay,
+	};
+
+	// queries
+	// anything past the end of the list is answered immediately and not remembered
+	enum { kQueryListSize = 256 };
+	enum { kQueryHashTableSize = 512 };
+	int queryCount;
+	SJediAiEngineQuery queryList[kQueryListSize];
+	short queryHashTable[kQueryHashTableSize]; // -1 is empty
+	SJediAiEngineQuery scratchQuery; // answers that aren't kept in the list
+
+	// what I'm doing
+	EMode mode;
+	int selectionDepth;
+
+	// who answers my queries (the default backend if NULL)
+	CJediAiEngineQueryBackend *backend;
+
+	// statistics
+	struct SStats {
+		int selectionCount;
+		int issuedCount; // how many queries were asked
+		int duplicateCount; // how many of those had already been asked during the same selection
+		int resolvedCount; // how many the backend answered
+		int batchedCount; // how many of those were answered in a batch
+		int replayMissCount; // how many queries the replay pass asked that the record pass didn't
+		int overflowCount; // how many didn't fit in the batch
+	};
+	SStats lastSelectionStats;
+	SStats totalStats;
+
+	// construction
+	CJediAiEngineQueryBatch();
+
+	// begin and end a selection
+	// selections can nest, only the outermost one clears the batch and counts toward the statistics
+	// returns true if this began the outermost selection
+	bool beginSelection();
+	void endSelection();
+
+	// switch to recording queries, resolve what was recorded, then switch to replaying the answers
+	void beginRecord();
+	void resolveRecorded();
+	void beginReplay();
+
+	// queries
+	bool determinePathFindValidity(const CVector &a, const CVector &b);
+	bool navMeshCollideRay(const CVector &wStartPos, const CVector &wTargetPos, CVector *wClosestNavigablePos);
+	bool collideWorldWithMovingSphere(const CVector &wPos, float radius, const CVector &iDelta, CVector *wCollisionPos, CActor **collisionActor = NULL);
+
+	// ask a query, answering it however my mode calls for
+	const SJediAiEngineQuery &query(const SJediAiEngineQuery &question);
+
+	// find a query that was already asked (-1 if there isn't one)
+	int findQuery(const SJediAiEngineQuery &question) const;
+
+	// get my backend
+	CJediAiEngineQueryBackend &getBackend() const;
+};
+
+#endif // __JEDI_AI_QUERY_BATCH__
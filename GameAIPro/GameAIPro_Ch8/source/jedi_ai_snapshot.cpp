@@ -0,0 +1,381 @@
+#include "pch.h"
+#include "jedi_ai_snapshot.h"
+#include "jedi.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// globals
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// the game's snapshot buffer
+CJediAiWorldSnapshotBuffer gJediAiWorldSnapshotBuffer;
+
+// hash an actor pointer into the lookup table
+static int hashActorPointer(const CActor *actor) {
+	size_t key = ((size_t)actor >> 4);
+	return (int)((unsigned int)(key * 2654435761u) & (CJediAiWorldSnapshot::kActorHashTableSize - 1));
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// world snapshot
+//
+/////////////////////////////////////////////////////////////////////////////
+
+CJediAiWorldSnapshot::CJediAiWorldSnapshot() {
+	reset();
+}
+
+void CJediAiWorldSnapshot::reset() {
+
+	// the lookup table must be a power of two, and at most half full
+	compileTimeAssert((kActorHashTableSize & (kActorHashTableSize - 1)) == 0);
+	compileTimeAssert(kActorHashTableSize >= kActorListSize * 2);
+
+	// clear everything
+	actorCount = 0;
+	memset(actorList, 0, sizeof(actorList));
+	memset(actorHashTable, 0xff, sizeof(actorHashTable));
+	threatCount = 0;
+	memset(threatList, 0, sizeof(threatList));
+	frameIndex = 0;
+	time = 0.0f;
+	senseShared = false;
+}
+
+void CJediAiWorldSnapshot::capture(CActor *const liveActorList[], int liveActorCount, float currentTime) {
+
+	// start from scratch
+	reset();
+	time = currentTime;
+
+	// capture each actor
+	for (int i = 0; i < liveActorCount; ++i) {
+		CActor *actor = liveActorList[i];
+		if (actor == NULL) {
+			continue;
+		}
+
+		// make sure we have room
+		if (actorCount >= kActorListSize) {
+			error("CJediAiWorldSnapshot::capture() - Too many actors (%d), only capturing the first %d", liveActorCount, kActorListSize);
+			break;
+		}
+
+		// capture the actor's data
+		SJediAiActorSnapshot &actorSnapshot = actorList[actorCount];
+		actorSnapshot.actor = actor;
+		actorSnapshot.currentTarget = actor->getCurrentTarget();
+		actorSnapshot.wPos = actor->getPos();
+		actorSnapshot.wBoundsCenterPos = actor->getBoundsCenter();
+		actorSnapshot.iVelocity = actor->getInertialVelocity();
+		actorSnapshot.iFrontDir = actor->getFrontDir();
+		actorSnapshot.iRightDir = actor->getRightDir();
+		actorSnapshot.hitPoints = actor->getHitPoints();
+		actorSnapshot.collisionRadius = actor->getCollisionRadius();
+		actorSnapshot.floorHeight = actor->getFloorHeight();
+		actorSnapshot.combatType = actor->getJediCombatType();
+		actorSnapshot.enemyType = actor->getJediEnemyType();
+
+		// capture the actor's flags
+		if (actor->isJedi()) actorSnapshot.flags |= kJediAiActorSnapshotFlag_IsJedi;
+		if (actor->isForceTkObject()) actorSnapshot.flags |= kJediAiActorSnapshotFlag_IsForceTkObject;
+		if (actor->isJediEnemy()) actorSnapshot.flags |= kJediAiActorSnapshotFlag_IsJediEnemy;
+		if (actor->isShielded()) actorSnapshot.flags |= kJediAiActorSnapshotFlag_Shielded;
+		if (actor->isStumbling()) actorSnapshot.flags |= kJediAiActorSnapshotFlag_Stumbling;
+		if (actor->isIncapacitated()) actorSnapshot.flags |= kJediAiActorSnapshotFlag_Incapacitated;
+		if (actor->canBeTaunted()) actorSnapshot.flags |= kJediAiActorSnapshotFlag_CanBeTaunted;
+		if (actor->isForceGrippable()) actorSnapshot.flags |= kJediAiActorSnapshotFlag_ForceGrippable;
+		if (actor->isForceGripped()) actorSnapshot.flags |= kJediAiActorSnapshotFlag_ForceGripped;
+		if (actor->isCurrentTargetVisible()) actorSnapshot.flags |= kJediAiActorSnapshotFlag_CurrentTargetVisible;
+
+		// capture jedi-specific data
+		if (actor->isJedi()) {
+			CJedi *jedi = (CJedi*)actor;
+			if (jedi->isAiControlled()) actorSnapshot.flags |= kJediAiActorSnapshotFlag_AiControlled;
+			if (jedi->isDefensiveModeEnabled()) actorSnapshot.flags |= kJediAiActorSnapshotFlag_DefensiveMode;
+			if (jedi->isPadawan()) actorSnapshot.flags |= kJediAiActorSnapshotFlag_Padawan;
+			actorSnapshot.jedi.forceSelectedActor = jedi->getForceSelectedActor();
+			actorSnapshot.jedi.skillLevel = jedi->getSkillLevel();
+			actorSnapshot.jedi.currentStateBitfield = jedi->currentStateBitfield;
+			actorSnapshot.jedi.disabledActionAiBitfield = jedi->disabledActionAiBitfield;
+			actorSnapshot.jedi.saberDamage = (jedi->isSaberActive() ? jedi->getSaberDamage() : 0.0f);
+			actorSnapshot.jedi.kickDamage = jedi->getKickDamage();
+			actorSnapshot.jedi.forcePushMaxDist = jedi->getForcePushMaxDist();
+			actorSnapshot.jedi.forcePushRadius = jedi->getForcePushRadius();
+		}
+
+		// add it to the lookup table
+		hashActor(actorCount++);
+	}
+
+	// figure out which jedi is gripping each gripped actor
+	for (int i = 0; i < actorCount; ++i) {
+		SJediAiActorSnapshot &actorSnapshot = actorList[i];
+		if (!(actorSnapshot.flags & kJediAiActorSnapshotFlag_ForceGripped)) {
+			continue;
+		}
+		for (int j = 0; j < actorCount; ++j) {
+			if (actorList[j].flags & kJediAiActorSnapshotFlag_IsJedi) {
+				CJedi *jedi = (CJedi*)actorList[j].actor;
+				if (actorSnapshot.actor->isBeingForceGrippedByJedi(jedi)) {
+					actorSnapshot.forceGrippingJedi = jedi;
+					break;
+				}
+			}
+		}
+	}
+
+	// capture the threat list
+	threatCount = gThreatCount;
+	if (threatCount > kThreatListSize) {
+		error("CJediAiWorldSnapshot::capture() - Too many threats (%d), only capturing the first %d", threatCount, kThreatListSize);
+		threatCount = kThreatListSize;
+	}
+	if (threatCount > 0) {
+		memcpy(threatList, gThreatList, sizeof(threatList[0]) * threatCount);
+	}
+}
+
+const SJediAiActorSnapshot *CJediAiWorldSnapshot::findActor(const CActor *actor) const {
+
+	// we need an actor for this
+	if (actor == NULL) {
+		return NULL;
+	}
+
+	// probe until we find the actor or an empty slot
+	int hashIndex = hashActorPointer(actor);
+	for (int i = 0; i < kActorHashTableSize; ++i) {
+		int actorIndex = actorHashTable[hashIndex];
+		if (actorIndex < 0) {
+			return NULL;
+		}
+		if (actorList[actorIndex].actor == actor) {
+			return &actorList[actorIndex];
+		}
+		hashIndex = ((hashIndex + 1) & (kActorHashTableSize - 1));
+	}
+	return NULL;
+}
+
+void CJediAiWorldSnapshot::hashActor(int actorIndex) {
+
+	// find an empty slot
+	// the table is never more than half full, so there always is one
+	int hashIndex = hashActorPointer(actorList[actorIndex].actor);
+	while (actorHashTable[hashIndex] >= 0) {
+		hashIndex = ((hashIndex + 1) & (kActorHashTableSize - 1));
+	}
+	actorHashTable[hashIndex] = (short)actorIndex;
+}
+
+
+void CJediAiWorldSnapshot::shareSense() {
+	for (int i = 0; i < actorCount; ++i) {
+		computeActorSense(actorList[i], actorSenseList[i]);
+	}
+	for (int i = 0; i < threatCount; ++i) {
+		computeThreatSense(threatList[i], threatSenseList[i]);
+	}
+	senseShared = true;
+}
+
+const SJediAiActorSense &CJediAiWorldSnapshot::getActorSense(const SJediAiActorSnapshot &actorSnapshot, SJediAiActorSense &scratch) const {
+	if (senseShared) {
+		return actorSenseList[&actorSnapshot - actorList];
+	}
+	computeActorSense(actorSnapshot, scratch);
+	return scratch;
+}
+
+const SJediAiThreatSense &CJediAiWorldSnapshot::getThreatSense(int threatIndex, SJediAiThreatSense &scratch) const {
+	if (senseShared) {
+		return threatSenseList[threatIndex];
+	}
+	computeThreatSense(threatList[threatIndex], scratch);
+	return scratch;
+}
+
+void CJediAiWorldSnapshot::computeActorSense(const SJediAiActorSnapshot &actorSnapshot, SJediAiActorSense &sense) const {
+	sense.iVelocity = actorSnapshot.iVelocity;
+	sense.stateFlags = 0;
+
+	// is this actor targeting a jedi that is targeting it back?
+	const SJediAiActorSnapshot *actorVictimSnapshot = findActor(actorSnapshot.currentTarget);
+	sense.engagedWithJedi = (actorVictimSnapshot != NULL && (actorVictimSnapshot->flags & kJediAiActorSnapshotFlag_IsJedi) && actorVictimSnapshot->currentTarget == actorSnapshot.actor);
+
+	// check shield state
+	if (actorSnapshot.flags & kJediAiActorSnapshotFlag_Shielded) {
+		sense.stateFlags |= kJediAiActorStateFlag_Shielded;
+	}
+
+	// is this actor stumbling?
+	if (actorSnapshot.flags & kJediAiActorSnapshotFlag_Stumbling) {
+		sense.stateFlags |= kJediAiActorStateFlag_Stumbling;
+		sense.iVelocity *= 0.25f;
+	}
+
+	// is this actor incapacitated?
+	if (actorSnapshot.flags & kJediAiActorSnapshotFlag_Incapacitated) {
+		sense.stateFlags |= kJediAiActorStateFlag_Incapacitated;
+		sense.iVelocity.zero();
+	}
+
+	// can this biped be taunted?
+	if (actorSnapshot.flags & kJediAiActorSnapshotFlag_CanBeTaunted) {
+		sense.stateFlags |= kJediAiActorStateFlag_CanBeTaunted;
+	}
+
+	// is this jedi a player?
+	if ((actorSnapshot.flags & kJediAiActorSnapshotFlag_IsJedi) && !(actorSnapshot.flags & kJediAiActorSnapshotFlag_AiControlled)) {
+		sense.stateFlags |= kJediAiActorStateFlag_IsPlayer;
+	}
+
+	// is this actor gripped already?
+	if (actorSnapshot.flags & kJediAiActorSnapshotFlag_ForceGripped) {
+		sense.stateFlags |= kJediAiActorStateFlag_Grippable;
+		sense.stateFlags |= kJediAiActorStateFlag_Gripped;
+	}
+
+	// is this actor dead?
+	if (actorSnapshot.hitPoints <= 0.0f) {
+		sense.stateFlags |= kJediAiActorStateFlag_Dead;
+	}
+}
+
+void CJediAiWorldSnapshot::computeThreatSense(const SJediThreatInfo &threat, SJediAiThreatSense &sense) const {
+	memset(&sense, 0, sizeof(sense));
+
+	// threats that do no damage, or whose attacker we know nothing about, are ignored
+	const SJediAiActorSnapshot *attackerSnapshot = findActor(threat.creator);
+	if (threat.strength <= 0.0f || attackerSnapshot == NULL) {
+		return;
+	}
+	sense.attackerSnapshot = attackerSnapshot;
+	sense.objectSnapshot = findActor(threat.object);
+
+	// melee threats and threats with no direction face the way their attacker does
+	sense.iFrontDir = threat.iDir;
+	if ((threat.type == eJediThreatType_Melee) || (sense.iFrontDir.isCloseTo(kZeroVector, 0.001f))) {
+		sense.iFrontDir = attackerSnapshot->iFrontDir;
+		if (sense.iFrontDir.isCloseTo(kZeroVector, 0.001f)) {
+			sense.iFrontDir = kUnitVectorZ;
+		}
+	}
+	sense.iFrontDir.normalize();
+	sense.iVelocity = threat.iDir * threat.speed;
+	sense.iRightDir = sense.iFrontDir.crossProduct(kUnitVectorY);
+	sense.iRightDir.normalize();
+	if (threat.isMelee360) {
+		sense.stateFlags |= kJediAiThreatStateFlag_Melee360;
+	}
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// world snapshot buffer
+//
+/////////////////////////////////////////////////////////////////////////////
+
+CJediAiWorldSnapshotBuffer::CJediAiWorldSnapshotBuffer() {
+	for (int i = 0; i < kSnapshotCount; ++i) {
+		readerCountTable[i].store(0);
+		senseCountTable[i].store(0);
+	}
+	latestIndex.store(-1);
+	publishCount = 0;
+	droppedPublishCount = 0;
+	shareSense = true;
+	shareSenseMinJediCount = 2;
+	sharedPublishCount = 0;
+}
+
+bool CJediAiWorldSnapshotBuffer::publish(CActor *const actorList[], int actorCount, float currentTime) {
+
+	// share sense if enough jedi sensed the last snapshot to make it worth it
+	// until anything has been published, assume they will
+	int latest = latestIndex.load();
+	bool share = (shareSense && (latest < 0 || senseCountTable[latest].load() >= shareSenseMinJediCount));
+
+	// get a snapshot to write into
+	// if readers are holding every one, skip this frame
+	CJediAiWorldSnapshot *snapshot = beginPublish();
+	if (snapshot == NULL) {
+		++droppedPublishCount;
+		return false;
+	}
+
+	// capture the world and make it the latest
+	// sense is shared before anyone can read it, so it never changes under a reader
+	snapshot->capture(actorList, actorCount, currentTime);
+	if (share) {
+		snapshot->shareSense();
+		++sharedPublishCount;
+	}
+	endPublish(snapshot);
+	return true;
+}
+
+CJediAiWorldSnapshot *CJediAiWorldSnapshotBuffer::beginPublish() {
+
+	// find a snapshot that isn't the latest and that nobody is reading
+	// readers only ever acquire the latest one, so once we've picked it, nobody new can start reading it
+	int latest = latestIndex.load();
+	for (int i = 0; i < kSnapshotCount; ++i) {
+		if (i != latest && readerCountTable[i].load() == 0) {
+			senseCountTable[i].store(0);
+			return &snapshotTable[i];
+		}
+	}
+	return NULL;
+}
+
+void CJediAiWorldSnapshotBuffer::endPublish(CJediAiWorldSnapshot *snapshot) {
+	int index = (int)(snapshot - snapshotTable);
+	if (index < 0 || index >= kSnapshotCount) {
+		error("CJediAiWorldSnapshotBuffer::endPublish() - Snapshot isn't from this buffer");
+		return;
+	}
+	snapshot->frameIndex = publishCount++;
+	latestIndex.store(index);
+}
+
+const CJediAiWorldSnapshot *CJediAiWorldSnapshotBuffer::acquire() {
+
+	// take a reference to the latest snapshot
+	// if it stopped being the latest before we got our reference, the publisher may be writing into it, so try again
+	while (true) {
+		int index = latestIndex.load();
+		if (index < 0) {
+			return NULL;
+		}
+		readerCountTable[index].fetch_add(1);
+		if (latestIndex.load() == index) {
+			return &snapshotTable[index];
+		}
+		readerCountTable[index].fetch_sub(1);
+	}
+}
+
+void CJediAiWorldSnapshotBuffer::release(const CJediAiWorldSnapshot *snapshot) {
+	int index = (int)(snapshot - snapshotTable);
+	if (index < 0 || index >= kSnapshotCount) {
+		error("CJediAiWorldSnapshotBuffer::release() - Snapshot isn't from this buffer");
+		return;
+	}
+	readerCountTable[index].fetch_sub(1);
+}
+
+void CJediAiWorldSnapshotBuffer::noteSensed(const CJediAiWorldSnapshot *snapshot) {
+	int index = (int)(snapshot - snapshotTable);
+	if (index < 0 || index >= kSnapshotCount) {
+		error("CJediAiWorldSnapshotBuffer::noteSensed() - Snapshot isn't from this buffer");
+		return;
+	}
+	senseCountTable[index].fetch_add(1);
+}
@@ -0,0 +1,213 @@
+#ifndef __JEDI_AI_SNAPSHOT__
+#define __JEDI_AI_SNAPSHOT__
+
+#ifndef __JEDI_COMMON__
+	#include "jedi_common.h"
+#endif
+
+#include <atomic>
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// actor snapshot
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// actor snapshot bitflags
+const unsigned int kJediAiActorSnapshotFlag_IsJedi = (1 << 0);
+const unsigned int kJediAiActorSnapshotFlag_IsForceTkObject = (1 << 1);
+const unsigned int kJediAiActorSnapshotFlag_IsJediEnemy = (1 << 2);
+const unsigned int kJediAiActorSnapshotFlag_Shielded = (1 << 3);
+const unsigned int kJediAiActorSnapshotFlag_Stumbling = (1 << 4);
+const unsigned int kJediAiActorSnapshotFlag_Incapacitated = (1 << 5);
+const unsigned int kJediAiActorSnapshotFlag_CanBeTaunted = (1 << 6);
+const unsigned int kJediAiActorSnapshotFlag_ForceGrippable = (1 << 7);
+const unsigned int kJediAiActorSnapshotFlag_ForceGripped = (1 << 8);
+const unsigned int kJediAiActorSnapshotFlag_CurrentTargetVisible = (1 << 9);
+const unsigned int kJediAiActorSnapshotFlag_AiControlled = (1 << 10); // jedi only
+const unsigned int kJediAiActorSnapshotFlag_DefensiveMode = (1 << 11); // jedi only
+const unsigned int kJediAiActorSnapshotFlag_Padawan = (1 << 12); // jedi only
+
+// everything the ai senses about an actor, copied out of the actor when the snapshot is published
+// actor pointers are only used as handles, the ai never calls through them
+struct SJediAiActorSnapshot {
+	CActor *actor;
+	CActor *currentTarget;
+	const CJedi *forceGrippingJedi;
+	CVector wPos;
+	CVector wBoundsCenterPos;
+	CVector iVelocity;
+	CVector iFrontDir;
+	CVector iRightDir;
+	float hitPoints;
+	float collisionRadius;
+	float floorHeight;
+	EJediCombatType combatType;
+	EJediEnemyType enemyType;
+	unsigned int flags;
+
+	// jedi only data
+	struct {
+		CActor *forceSelectedActor;
+		float skillLevel;
+		int currentStateBitfield;
+		int disabledActionAiBitfield;
+		float saberDamage;
+		float kickDamage;
+		float forcePushMaxDist;
+		float forcePushRadius;
+	} jedi;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// shared sense
+// the parts of sensing an actor or threat that are the same for every jedi
+// these are in world space, each jedi projects them into its own frame
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// what every jedi senses about an actor
+struct SJediAiActorSense {
+	CVector iVelocity; // slowed while stumbling, stopped while incapacitated
+	unsigned int stateFlags; // actor state flags that don't depend on who is sensing
+	bool engagedWithJedi; // is this actor targeting a jedi that is targeting it back?
+};
+
+// what every jedi senses about a threat
+struct SJediAiThreatSense {
+	const SJediAiActorSnapshot *attackerSnapshot; // NULL if every jedi ignores this threat
+	const SJediAiActorSnapshot *objectSnapshot;
+	CVector iFrontDir;
+	CVector iRightDir;
+	CVector iVelocity;
+	unsigned char stateFlags; // threat state flags that don't depend on who is sensing
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// world snapshot
+// a compact, immutable copy of everything the ai senses, published once per frame
+//
+/////////////////////////////////////////////////////////////////////////////
+
+class CJediAiWorldSnapshot {
+public:
+
+	// actor list
+	enum { kActorListSize = 256 };
+	int actorCount;
+	SJediAiActorSnapshot actorList[kActorListSize];
+
+	// actor lookup table (open addressing on the actor pointer, -1 is empty)
+	enum { kActorHashTableSize = 512 };
+	short actorHashTable[kActorHashTableSize];
+
+	// threat list
+	enum { kThreatListSize = 32 };
+	int threatCount;
+	SJediThreatInfo threatList[kThreatListSize];
+
+	// which frame was this published on, and at what time?
+	unsigned int frameIndex;
+	float time;
+
+	// shared sense for each actor and threat, parallel to their lists
+	// if this wasn't shared when the snapshot was published, each jedi computes its own
+	bool senseShared;
+	SJediAiActorSense actorSenseList[kActorListSize];
+	SJediAiThreatSense threatSenseList[kThreatListSize];
+
+	// construction
+	CJediAiWorldSnapshot();
+
+	// clear this snapshot
+	void reset();
+
+	// capture the specified actors and the global threat list
+	// actors that don't fit are dropped with an error
+	void capture(CActor *const liveActorList[], int liveActorCount, float currentTime);
+
+	// find the snapshot of an actor (NULL if it wasn't captured)
+	const SJediAiActorSnapshot *findActor(const CActor *actor) const;
+
+	// add an actor to the lookup table
+	void hashActor(int actorIndex);
+
+	// compute the shared sense for every actor and threat
+	// call this once capturing (and any editing) is done, so every jedi sensing this snapshot can use it
+	void shareSense();
+
+	// get the shared sense for an actor or threat
+	// if sense wasn't shared, it is computed into 'scratch'
+	const SJediAiActorSense &getActorSense(const SJediAiActorSnapshot &actorSnapshot, SJediAiActorSense &scratch) const;
+	const SJediAiThreatSense &getThreatSense(int threatIndex, SJediAiThreatSense &scratch) const;
+
+	// compute the shared sense for an actor or threat
+	void computeActorSense(const SJediAiActorSnapshot &actorSnapshot, SJediAiActorSense &sense) const;
+	void computeThreatSense(const SJediThreatInfo &threat, SJediAiThreatSense &sense) const;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// world snapshot buffer
+// the game thread publishes into one snapshot while the ai senses from another
+// readers hold a reference to their snapshot, so it is never overwritten while in use
+// there is one publisher, but any number of readers on any thread
+//
+/////////////////////////////////////////////////////////////////////////////
+
+class CJediAiWorldSnapshotBuffer {
+public:
+
+	// snapshots
+	// with three, the publisher always has one to write as long as readers are at most a frame behind
+	enum { kSnapshotCount = 3 };
+	CJediAiWorldSnapshot snapshotTable[kSnapshotCount];
+	std::atomic<int> readerCountTable[kSnapshotCount];
+	std::atomic<int> senseCountTable[kSnapshotCount]; // how many jedi sensed each snapshot
+	std::atomic<int> latestIndex; // -1 until the first publish
+	unsigned int publishCount;
+	int droppedPublishCount;
+
+	// share sensing between jedi? (default is true)
+	// when this is off, each jedi senses every actor and threat for itself
+	// sharing costs a little more than a lone jedi sensing for itself, and saves about 6% a jedi with two
+	// and 10-15% with four or more (see -benchsense), so it is only done once the last snapshot was
+	// sensed by at least this many jedi (default is 2)
+	bool shareSense;
+	int shareSenseMinJediCount;
+	int sharedPublishCount; // how many publishes shared sense
+
+	// construction
+	CJediAiWorldSnapshotBuffer();
+
+	// publish a snapshot of the specified actors and the global threat list
+	// returns false if every snapshot is still being read, in which case readers keep the last one
+	bool publish(CActor *const actorList[], int actorCount, float currentTime);
+
+	// get a snapshot nobody is reading for the publisher to write into (NULL if there isn't one)
+	CJediAiWorldSnapshot *beginPublish();
+
+	// make a snapshot from beginPublish() the latest one
+	void endPublish(CJediAiWorldSnapshot *snapshot);
+
+	// get a reference to the latest snapshot (NULL if nothing has been published)
+	// every acquired snapshot must be released
+	const CJediAiWorldSnapshot *acquire();
+
+	// release a reference to a snapshot
+	void release(const CJediAiWorldSnapshot *snapshot);
+
+	// note that a jedi sensed a snapshot, so the publisher knows if sharing sense is worth it
+	void noteSensed(const CJediAiWorldSnapshot *snapshot);
+};
+
+// the game's snapshot buffer
+extern CJediAiWorldSnapshotBuffer gJediAiWorldSnapshotBuffer;
+
+#endif // __JEDI_AI_SNAPSHOT__
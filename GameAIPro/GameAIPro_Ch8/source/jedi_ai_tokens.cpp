@@ -0,0 +1,259 @@
+#include "pch.h"
+#include "jedi_ai_tokens.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// globals
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// the game's token board
+CJediAiTokenBoard gJediAiTokenBoard;
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// token board
+//
+/////////////////////////////////////////////////////////////////////////////
+
+CJediAiTokenBoard::CJediAiTokenBoard() {
+
+	// one jedi per enemy, and tokens last half a second without being renewed
+	params.engageSlotsPerEnemy = 1;
+	params.leaseDuration = 0.5f;
+	reset();
+}
+
+void CJediAiTokenBoard::reset() {
+	std::lock_guard<std::mutex> lock(mutex);
+	memset(engageEntryTable, 0, sizeof(engageEntryTable));
+	memset(maneuverEntryTable, 0, sizeof(maneuverEntryTable));
+	memset(&stats, 0, sizeof(stats));
+}
+
+bool CJediAiTokenBoard::claimEngageSlot(const CActor *holder, const CActor *enemy, float currentTime) {
+	if (holder == NULL || enemy == NULL) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	expireLeases(currentTime);
+
+	// find this enemy's entry, or make one
+	int entryIndex = findEngageEntry(enemy);
+	if (entryIndex < 0) {
+		for (int i = 0; i < kEngageEntryCount; ++i) {
+			if (engageEntryTable[i].enemy == NULL) {
+				entryIndex = i;
+				break;
+			}
+		}
+
+		// if the board is full, nobody is coordinating over this enemy, so let me fight it
+		if (entryIndex < 0) {
+			return true;
+		}
+	}
+	SEngageEntry &entry = engageEntryTable[entryIndex];
+
+	// if I already hold a slot for this enemy, renew it
+	int freeSlot = -1;
+	int slotCount = min(max(params.engageSlotsPerEnemy, 1), (int)kMaxEngageSlotsPerEnemy);
+	for (int i = 0; i < slotCount; ++i) {
+		if (entry.holderTable[i] == holder) {
+			entry.leaseEndTimeTable[i] = currentTime + params.leaseDuration;
+			return true;
+		}
+		if (entry.holderTable[i] == NULL && freeSlot < 0) {
+			freeSlot = i;
+		}
+	}
+
+	// if every slot is held, I can't fight this enemy
+	if (freeSlot < 0) {
+		stats.deniedCount++;
+		return false;
+	}
+
+	// let go of whoever I was fighting, and take the slot
+	for (int i = 0; i < kEngageEntryCount; ++i) {
+		SEngageEntry &otherEntry = engageEntryTable[i];
+		for (int j = 0; j < kMaxEngageSlotsPerEnemy; ++j) {
+			if (otherEntry.holderTable[j] == holder) {
+				otherEntry.holderTable[j] = NULL;
+			}
+		}
+	}
+	entry.enemy = enemy;
+	entry.holderTable[freeSlot] = holder;
+	entry.leaseEndTimeTable[freeSlot] = currentTime + params.leaseDuration;
+	stats.claimCount++;
+	return true;
+}
+
+void CJediAiTokenBoard::releaseEngageSlot(const CActor *holder) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (int i = 0; i < kEngageEntryCount; ++i) {
+		SEngageEntry &entry = engageEntryTable[i];
+		for (int j = 0; j < kMaxEngageSlotsPerEnemy; ++j) {
+			if (entry.holderTable[j] == holder) {
+				entry.holderTable[j] = NULL;
+			}
+		}
+	}
+}
+
+bool CJediAiTokenBoard::claimManeuverSpace(const CActor *holder, const CVector &wPos, float radius, float currentTime) {
+	if (holder == NULL) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	expireLeases(currentTime);
+
+	// if this overlaps someone else's space, I can't have it
+	// otherwise, find my entry, or a free one
+	int entryIndex = -1;
+	for (int i = 0; i < kManeuverEntryCount; ++i) {
+		const SManeuverEntry &entry = maneuverEntryTable[i];
+		if (entry.holder == holder) {
+			entryIndex = i;
+		} else if (entry.holder != NULL) {
+			if (entry.wPos.xzDistanceTo(wPos) < (entry.radius + radius)) {
+				stats.deniedCount++;
+				return false;
+			}
+		} else if (entryIndex < 0) {
+			entryIndex = i;
+		}
+	}
+
+	// if the board is full, nobody is coordinating over this space, so let me move in it
+	if (entryIndex < 0) {
+		return true;
+	}
+
+	// take the space
+	SManeuverEntry &entry = maneuverEntryTable[entryIndex];
+	if (entry.holder != holder) {
+		stats.claimCount++;
+	}
+	entry.holder = holder;
+	entry.wPos = wPos;
+	entry.radius = radius;
+	entry.leaseEndTime = currentTime + params.leaseDuration;
+	return true;
+}
+
+void CJediAiTokenBoard::releaseManeuverSpace(const CActor *holder) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (int i = 0; i < kManeuverEntryCount; ++i) {
+		if (maneuverEntryTable[i].holder == holder) {
+			maneuverEntryTable[i].holder = NULL;
+		}
+	}
+}
+
+void CJediAiTokenBoard::renew(const CActor *holder, float currentTime) {
+	std::lock_guard<std::mutex> lock(mutex);
+	float leaseEndTime = currentTime + params.leaseDuration;
+	for (int i = 0; i < kEngageEntryCount; ++i) {
+		SEngageEntry &entry = engageEntryTable[i];
+		for (int j = 0; j < kMaxEngageSlotsPerEnemy; ++j) {
+			if (entry.holderTable[j] == holder) {
+				entry.leaseEndTimeTable[j] = leaseEndTime;
+			}
+		}
+	}
+	for (int i = 0; i < kManeuverEntryCount; ++i) {
+		if (maneuverEntryTable[i].holder == holder) {
+			maneuverEntryTable[i].leaseEndTime = leaseEndTime;
+		}
+	}
+}
+
+void CJediAiTokenBoard::releaseAll(const CActor *holder) {
+	releaseEngageSlot(holder);
+	releaseManeuverSpace(holder);
+}
+
+void CJediAiTokenBoard::markTakenEngageSlots(const CActor *holder, SJediAiActorState stateList[], int stateCount, float currentTime) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	int slotCount = min(max(params.engageSlotsPerEnemy, 1), (int)kMaxEngageSlotsPerEnemy);
+	for (int i = 0; i < stateCount; ++i) {
+		SJediAiActorState &actorState = stateList[i];
+		actorState.flags &= ~kJediAiActorStateFlag_EngageSlotsTaken;
+		if (actorState.actor == NULL) {
+			continue;
+		}
+		int entryIndex = findEngageEntry(actorState.actor);
+		if (entryIndex >= 0 && countOtherEngageHolders(engageEntryTable[entryIndex], holder, currentTime) >= slotCount) {
+			actorState.flags |= kJediAiActorStateFlag_EngageSlotsTaken;
+		}
+	}
+}
+
+bool CJediAiTokenBoard::isManeuverSpaceTaken(const CActor *holder, const CVector &wPos, float radius, float currentTime) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (int i = 0; i < kManeuverEntryCount; ++i) {
+		const SManeuverEntry &entry = maneuverEntryTable[i];
+		if (entry.holder == NULL || entry.holder == holder || entry.leaseEndTime < currentTime) {
+			continue;
+		}
+		if (entry.wPos.xzDistanceTo(wPos) < (entry.radius + radius)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int CJediAiTokenBoard::findEngageEntry(const CActor *enemy) const {
+	for (int i = 0; i < kEngageEntryCount; ++i) {
+		if (engageEntryTable[i].enemy == enemy) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int CJediAiTokenBoard::countOtherEngageHolders(const SEngageEntry &entry, const CActor *holder, float currentTime) const {
+	int holderCount = 0;
+	for (int i = 0; i < kMaxEngageSlotsPerEnemy; ++i) {
+		const CActor *slotHolder = entry.holderTable[i];
+		if (slotHolder != NULL && slotHolder != holder && entry.leaseEndTimeTable[i] >= currentTime) {
+			++holderCount;
+		}
+	}
+	return holderCount;
+}
+
+void CJediAiTokenBoard::expireLeases(float currentTime) {
+
+	// free every slot whose lease ran out, and every enemy left without a slot held
+	for (int i = 0; i < kEngageEntryCount; ++i) {
+		SEngageEntry &entry = engageEntryTable[i];
+		if (entry.enemy == NULL) {
+			continue;
+		}
+		bool held = false;
+		for (int j = 0; j < kMaxEngageSlotsPerEnemy; ++j) {
+			if (entry.holderTable[j] != NULL && entry.leaseEndTimeTable[j] < currentTime) {
+				entry.holderTable[j] = NULL;
+				stats.expiredCount++;
+			}
+			held = (held || entry.holderTable[j] != NULL);
+		}
+		if (!held) {
+			entry.enemy = NULL;
+		}
+	}
+
+	// free every maneuver space whose lease ran out
+	for (int i = 0; i < kManeuverEntryCount; ++i) {
+		SManeuverEntry &entry = maneuverEntryTable[i];
+		if (entry.holder != NULL && entry.leaseEndTime < currentTime) {
+			entry.holder = NULL;
+			stats.expiredCount++;
+		}
+	}
+}
@@ -0,0 +1,122 @@
+#ifndef __JEDI_AI_TOKENS__
+#define __JEDI_AI_TOKENS__
+
+#ifndef __JEDI_COMMON__
+	#include "jedi_common.h"
+#endif
+
+#include <mutex>
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// tokens
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// jedi ai token bitflags
+// actions list the tokens they need, and selectors skip them without simulating if someone else holds one
+const unsigned int kJediAiToken_Engage = (1 << 0); // a slot to fight my victim in
+const unsigned int kJediAiToken_Maneuver = (1 << 1); // space to move around in without crowding another jedi
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// token board
+// hands out tokens so jedi stop planning around each other instead of simulating and rejecting each other's plans
+// each enemy has a few engage slots, and each jedi can hold one of them, for the enemy it is fighting
+// each jedi can also hold a maneuver space, a circle nobody else should move within until the jedi is done
+// every token has a lease, so the tokens of a jedi that stops renewing them run out on their own
+// any number of jedi can use the board from any thread
+//
+/////////////////////////////////////////////////////////////////////////////
+
+class CJediAiTokenBoard {
+public:
+
+	// engage slots
+	enum { kEngageEntryCount = 64 };
+	enum { kMaxEngageSlotsPerEnemy = 4 };
+	struct SEngageEntry {
+		const CActor *enemy; // NULL if unused
+		const CActor *holderTable[kMaxEngageSlotsPerEnemy]; // NULL if the slot is free
+		float leaseEndTimeTable[kMaxEngageSlotsPerEnemy];
+	};
+	SEngageEntry engageEntryTable[kEngageEntryCount];
+
+	// maneuver spaces
+	enum { kManeuverEntryCount = 16 };
+	struct SManeuverEntry {
+		const CActor *holder; // NULL if unused
+		CVector wPos;
+		float radius;
+		float leaseEndTime;
+	};
+	SManeuverEntry maneuverEntryTable[kManeuverEntryCount];
+
+	// parameters
+	struct SParams {
+		int engageSlotsPerEnemy; // how many jedi can fight an enemy at once (at most kMaxEngageSlotsPerEnemy)
+		float leaseDuration; // how long a token is held without being renewed
+	} params;
+
+	// statistics
+	struct SStats {
+		int claimCount; // how many tokens were claimed
+		int deniedCount; // how many claims were denied because someone else held the token
+		int expiredCount; // how many tokens ran out without being released
+	} stats;
+
+	// keeps jedi on different threads from claiming the same token
+	mutable std::mutex mutex;
+
+	// construction
+	CJediAiTokenBoard();
+
+	// release every token and clear my statistics
+	void reset();
+
+	// claim an engage slot for an enemy, releasing the one I had for anyone else
+	// if I already hold a slot for this enemy, this renews it
+	// returns false if every slot for this enemy is held by someone else
+	bool claimEngageSlot(const CActor *holder, const CActor *enemy, float currentTime);
+
+	// release my engage slot
+	void releaseEngageSlot(const CActor *holder);
+
+	// claim a maneuver space, replacing the one I had
+	// returns false if it overlaps someone else's space
+	bool claimManeuverSpace(const CActor *holder, const CVector &wPos, float radius, float currentTime);
+
+	// release my maneuver space
+	void releaseManeuverSpace(const CActor *holder);
+
+	// extend the lease on every token I hold
+	void renew(const CActor *holder, float currentTime);
+
+	// release every token I hold
+	void releaseAll(const CActor *holder);
+
+	// flag each actor whose engage slots are all held by someone else
+	void markTakenEngageSlots(const CActor *holder, SJediAiActorState stateList[], int stateCount, float currentTime) const;
+
+	// does a space overlap someone else's maneuver space?
+	bool isManeuverSpaceTaken(const CActor *holder, const CVector &wPos, float radius, float currentTime) const;
+
+	// find an enemy's engage entry (-1 if it doesn't have one)
+	// the caller must hold my mutex
+	int findEngageEntry(const CActor *enemy) const;
+
+	// count the live slots for an enemy held by someone other than me
+	// the caller must hold my mutex
+	int countOtherEngageHolders(const SEngageEntry &entry, const CActor *holder, float currentTime) const;
+
+	// release anything whose lease has run out
+	// the caller must hold my mutex
+	void expireLeases(float currentTime);
+};
+
+// the game's token board
+extern CJediAiTokenBoard gJediAiTokenBoard;
+
+#endif // __JEDI_AI_TOKENS__
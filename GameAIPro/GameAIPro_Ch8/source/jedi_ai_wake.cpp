@@ -0,0 +1,267 @@
+#include "pch.h"
+#include "jedi_ai_wake.h"
+#include "jedi_ai_snapshot.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// globals
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// the game's wake scheduler
+CJediAiWakeScheduler gJediAiWakeScheduler;
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// wake conditions
+//
+/////////////////////////////////////////////////////////////////////////////
+
+void SJediAiWakeCondition::clear() {
+	wakeTime = -1.0f;
+	threatTypeMask = 0;
+	wakeOnVictimChange = false;
+}
+
+void SJediAiWakeCondition::wakeBy(float time) {
+	if (wakeTime < 0.0f || wakeTime > time) {
+		wakeTime = time;
+	}
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// sleepers
+//
+/////////////////////////////////////////////////////////////////////////////
+
+void SJediAiSleeper::rememberThreats(const CJediAiWorldSnapshot *snapshot) {
+	seenThreatCount = 0;
+	if (snapshot == NULL) {
+		return;
+	}
+	for (int i = 0; i < snapshot->threatCount && seenThreatCount < kMaxSeenThreatCount; ++i) {
+		const SJediThreatInfo &threat = snapshot->threatList[i];
+		if (threat.intendedVictim != NULL && threat.intendedVictim != actor) {
+			continue;
+		}
+		SSeenThreat &seenThreat = seenThreatTable[seenThreatCount++];
+		seenThreat.creator = threat.creator;
+		seenThreat.object = threat.object;
+		seenThreat.type = threat.type;
+		seenThreat.wEndPos = threat.wEndPos;
+	}
+}
+
+bool SJediAiSleeper::hasSeenThreat(const SJediThreatInfo &threat) const {
+
+	// a threat's end pos can shift a little from frame to frame as it tracks its victim
+	const float kEndPosTolerance = 1.0f;
+	for (int i = 0; i < seenThreatCount; ++i) {
+		const SSeenThreat &seenThreat = seenThreatTable[i];
+		if (
+			seenThreat.creator == threat.creator && seenThreat.object == threat.object && seenThreat.type == threat.type &&
+			seenThreat.wEndPos.isCloseTo(threat.wEndPos, kEndPosTolerance)
+		) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// wake scheduler
+//
+/////////////////////////////////////////////////////////////////////////////
+
+CJediAiWakeScheduler::CJediAiWakeScheduler() {
+	memset(sleeperList, 0, sizeof(sleeperList));
+	sleeperCount = 0;
+	memset(wheelSlotTable, 0, sizeof(wheelSlotTable));
+	wheelTick = -1;
+
+	// one slot per 30hz frame, so the wheel goes around about every two seconds
+	// jedi memory ignores threats farther than 50m, so those can't change a sleeper's mind
+	params.tickDuration = (1.0f / 30.0f);
+	params.unaimedThreatWakeDistance = 50.0f;
+	memset(&stats, 0, sizeof(stats));
+}
+
+void CJediAiWakeScheduler::reset() {
+	std::lock_guard<std::mutex> lock(mutex);
+	while (sleeperCount > 0) {
+		wakeSleeper(*sleeperList[0]);
+	}
+	wheelTick = -1;
+	memset(&stats, 0, sizeof(stats));
+}
+
+bool CJediAiWakeScheduler::sleep(SJediAiSleeper &sleeper, const SJediAiWakeCondition &condition, float currentTime) {
+
+	// if I'd wake right away, don't bother
+	if (condition.wakeTime >= 0.0f && condition.wakeTime <= currentTime) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	if (sleeper.asleep) {
+		return true;
+	}
+	if (sleeperCount >= kMaxSleeperCount) {
+		error("CJediAiWakeScheduler::sleep() - Too many sleepers (max %d)", kMaxSleeperCount);
+		return false;
+	}
+
+	// add it to my sleeper list
+	sleeper.condition = condition;
+	sleeper.asleep = true;
+	sleeper.sleeperIndex = sleeperCount;
+	sleeperList[sleeperCount++] = &sleeper;
+
+	// if it has a wake time, add it to the wheel
+	sleeper.wheelSlot = -1;
+	sleeper.prevInSlot = NULL;
+	sleeper.nextInSlot = NULL;
+	if (condition.wakeTime >= 0.0f) {
+		sleeper.wheelSlot = (computeTick(condition.wakeTime) & (kWheelSlotCount - 1));
+		sleeper.nextInSlot = wheelSlotTable[sleeper.wheelSlot];
+		if (sleeper.nextInSlot != NULL) {
+			sleeper.nextInSlot->prevInSlot = &sleeper;
+		}
+		wheelSlotTable[sleeper.wheelSlot] = &sleeper;
+	}
+	stats.sleepCount++;
+	return true;
+}
+
+void CJediAiWakeScheduler::wake(SJediAiSleeper &sleeper) {
+	std::lock_guard<std::mutex> lock(mutex);
+	wakeSleeper(sleeper);
+}
+
+bool CJediAiWakeScheduler::isAsleep(const SJediAiSleeper &sleeper) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return sleeper.asleep;
+}
+
+void CJediAiWakeScheduler::update(float currentTime) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// visit every slot from where the wheel was up to now, going around at most once
+	// the slot we were in is visited again, since sleepers may have been added to it since
+	int tick = computeTick(currentTime);
+	int slotCount = (wheelTick < 0 ? 1 : min(tick - wheelTick + 1, (int)kWheelSlotCount));
+	for (int i = 0; i < slotCount; ++i) {
+		wakeDueSleepers(((tick - i) & (kWheelSlotCount - 1)), currentTime);
+	}
+	wheelTick = tick;
+
+	// check the latest snapshot for anything the sleepers are waiting for
+	if (sleeperCount <= 0) {
+		return;
+	}
+	const CJediAiWorldSnapshot *snapshot = gJediAiWorldSnapshotBuffer.acquire();
+	if (snapshot == NULL) {
+		return;
+	}
+	unsigned int threatTypeMask = 0;
+	for (int i = 0; i < snapshot->threatCount; ++i) {
+		threatTypeMask |= (1 << snapshot->threatList[i].type);
+	}
+	for (int i = sleeperCount - 1; i >= 0; --i) {
+		if (hasWakeEventHappened(*sleeperList[i], *snapshot, threatTypeMask)) {
+			wakeSleeper(*sleeperList[i]);
+		}
+	}
+	gJediAiWorldSnapshotBuffer.release(snapshot);
+}
+
+void CJediAiWakeScheduler::wakeDueSleepers(int wheelSlot, float currentTime) {
+	SJediAiSleeper *sleeper = wheelSlotTable[wheelSlot];
+	while (sleeper != NULL) {
+		SJediAiSleeper *nextSleeper = sleeper->nextInSlot;
+		if (sleeper->condition.wakeTime <= currentTime) {
+			wakeSleeper(*sleeper);
+			stats.timerWakeCount++;
+		}
+		sleeper = nextSleeper;
+	}
+}
+
+bool CJediAiWakeScheduler::hasWakeEventHappened(SJediAiSleeper &sleeper, const CJediAiWorldSnapshot &snapshot, unsigned int threatTypeMask) {
+
+	// if I'm gone from the world or something happened to me, wake up and deal with it
+	const SJediAiActorSnapshot *selfSnapshot = snapshot.findActor(sleeper.actor);
+	if (selfSnapshot == NULL || selfSnapshot->hitPoints != sleeper.hitPoints || selfSnapshot->jedi.currentStateBitfield != sleeper.stateBitfield) {
+		stats.selfWakeCount++;
+		return true;
+	}
+
+	// did my victim change?
+	if (sleeper.condition.wakeOnVictimChange && selfSnapshot->currentTarget != sleeper.victim) {
+		stats.victimWakeCount++;
+		return true;
+	}
+
+	// is there a new threat I'm waiting for, meant for me or near enough to hit me?
+	if ((sleeper.condition.threatTypeMask & threatTypeMask) != 0) {
+		for (int i = 0; i < snapshot.threatCount; ++i) {
+			const SJediThreatInfo &threat = snapshot.threatList[i];
+			if ((sleeper.condition.threatTypeMask & (1 << threat.type)) == 0) {
+				continue;
+			}
+			if (threat.intendedVictim != NULL && threat.intendedVictim != sleeper.actor) {
+				continue;
+			}
+			if (threat.intendedVictim == NULL) {
+				float wakeDistanceSq = SQ(params.unaimedThreatWakeDistance);
+				if (threat.wPos.distanceSqTo(selfSnapshot->wPos) > wakeDistanceSq && threat.wEndPos.distanceSqTo(selfSnapshot->wPos) > wakeDistanceSq) {
+					continue;
+				}
+			}
+			if (sleeper.hasSeenThreat(threat)) {
+				continue;
+			}
+			stats.threatWakeCount++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void CJediAiWakeScheduler::wakeSleeper(SJediAiSleeper &sleeper) {
+	if (!sleeper.asleep) {
+		return;
+	}
+
+	// take it out of the wheel
+	if (sleeper.wheelSlot >= 0) {
+		if (sleeper.prevInSlot != NULL) {
+			sleeper.prevInSlot->nextInSlot = sleeper.nextInSlot;
+		} else {
+			wheelSlotTable[sleeper.wheelSlot] = sleeper.nextInSlot;
+		}
+		if (sleeper.nextInSlot != NULL) {
+			sleeper.nextInSlot->prevInSlot = sleeper.prevInSlot;
+		}
+		sleeper.wheelSlot = -1;
+		sleeper.prevInSlot = NULL;
+		sleeper.nextInSlot = NULL;
+	}
+
+	// take it out of my sleeper list
+	SJediAiSleeper *lastSleeper = sleeperList[--sleeperCount];
+	sleeperList[sleeper.sleeperIndex] = lastSleeper;
+	lastSleeper->sleeperIndex = sleeper.sleeperIndex;
+	sleeperList[sleeperCount] = NULL;
+	sleeper.sleeperIndex = -1;
+	sleeper.asleep = false;
+}
+
+int CJediAiWakeScheduler::computeTick(float time) const {
+	return (int)(time / params.tickDuration);
+}
@@ -0,0 +1,162 @@
+#ifndef __JEDI_AI_WAKE__
+#define __JEDI_AI_WAKE__
+
+#ifndef __JEDI_COMMON__
+	#include "jedi_common.h"
+#endif
+
+#include <mutex>
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// wake conditions
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// threat type mask that wakes on any threat
+const unsigned int kJediAiWakeOnAnyThreat = ((1 << eJediThreatType_Count) - 1);
+
+// what wakes a sleeping AI
+// whatever the condition, a sleeper also wakes when something happens to it (its hit points or state change)
+struct SJediAiWakeCondition {
+	float wakeTime; // when to wake no matter what happens (negative if only an event wakes me)
+	unsigned int threatTypeMask; // wake when a threat of one of these types appears (1 << EJediThreatType)
+	bool wakeOnVictimChange; // wake when my victim changes
+
+	// wake on nothing
+	void clear();
+
+	// wake no later than the specified time
+	void wakeBy(float time);
+};
+
+// a jedi whose AI can sleep
+// this lives in the jedi, and the wake scheduler lists it while it is asleep
+struct SJediAiSleeper {
+	const CActor *actor; // the jedi whose AI sleeps
+	SJediAiWakeCondition condition;
+
+	// what I was like when I fell asleep, so the scheduler can tell when it changes
+	const CActor *victim;
+	float hitPoints;
+	int stateBitfield;
+
+	// the threats around when I fell asleep, so only new ones wake me
+	// threats have no id, so each is known by who made it, what it is and where it's headed
+	enum { kMaxSeenThreatCount = 8 };
+	struct SSeenThreat {
+		const CActor *creator;
+		const CActor *object;
+		EJediThreatType type;
+		CVector wEndPos;
+	};
+	SSeenThreat seenThreatTable[kMaxSeenThreatCount];
+	int seenThreatCount;
+
+	// how long I've slept since my AI last thought, so its timers can catch up
+	float sleptDt;
+
+	// how many thinks I've skipped by sleeping
+	int skippedThinkCount;
+
+	// scheduler data
+	bool asleep;
+	int sleeperIndex; // my index in the scheduler's sleeper list
+	int wheelSlot; // the timing wheel slot I'm in (-1 if none)
+	SJediAiSleeper *prevInSlot;
+	SJediAiSleeper *nextInSlot;
+
+	// remember the threats in a snapshot that could wake me (meant for me or anyone)
+	// any past kMaxSeenThreatCount aren't remembered, so they wake me as if they were new
+	void rememberThreats(const CJediAiWorldSnapshot *snapshot);
+
+	// was a threat around when I fell asleep?
+	bool hasSeenThreat(const SJediThreatInfo &threat) const;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// wake scheduler
+// lets jedi whose AI is only waiting for something put it to sleep, so it costs nothing per frame
+// sleepers waiting for a time are kept in a timing wheel, so each frame only visits the slots
+// that came due, and sleepers waiting for an event are checked against each world snapshot
+// the game thread updates this once per frame after publishing, and jedi sleep from any thread
+//
+/////////////////////////////////////////////////////////////////////////////
+
+class CJediAiWakeScheduler {
+public:
+
+	// sleepers
+	enum { kMaxSleeperCount = 256 };
+	SJediAiSleeper *sleeperList[kMaxSleeperCount];
+	int sleeperCount;
+
+	// timing wheel
+	// each slot lists the sleepers whose wake time falls in it, on this lap around the wheel or a later one
+	enum { kWheelSlotCount = 64 };
+	SJediAiSleeper *wheelSlotTable[kWheelSlotCount];
+	int wheelTick; // the tick the wheel was last advanced to (-1 if it hasn't been)
+
+	// parameters
+	struct SParams {
+		float tickDuration; // how much time each wheel slot covers
+		float unaimedThreatWakeDistance; // how close a threat meant for no one in particular must be to wake a sleeper
+	} params;
+
+	// statistics
+	struct SStats {
+		int sleepCount; // how many times a jedi fell asleep
+		int timerWakeCount; // how many sleepers woke because their time was up
+		int threatWakeCount; // how many sleepers woke because a new threat appeared
+		int victimWakeCount; // how many sleepers woke because their victim changed
+		int selfWakeCount; // how many sleepers woke because something happened to them
+	} stats;
+
+	// keeps jedi on other threads from sleeping while I'm waking sleepers
+	mutable std::mutex mutex;
+
+	// construction
+	CJediAiWakeScheduler();
+
+	// wake everyone and clear my statistics
+	void reset();
+
+	// put a sleeper to sleep until its condition is met
+	// its victim, hit points and state bitfield must already be filled in
+	// returns false if its wake time has already passed, in which case it stays awake
+	bool sleep(SJediAiSleeper &sleeper, const SJediAiWakeCondition &condition, float currentTime);
+
+	// wake a sleeper right away
+	void wake(SJediAiSleeper &sleeper);
+
+	// is a sleeper asleep?
+	bool isAsleep(const SJediAiSleeper &sleeper) const;
+
+	// wake every sleeper whose time is up or whose event happened in the latest world snapshot
+	// call this once per frame, after publishing (game thread only)
+	void update(float currentTime);
+
+	// wake every sleeper in a wheel slot whose time is up
+	// the caller must hold my mutex
+	void wakeDueSleepers(int wheelSlot, float currentTime);
+
+	// has an event a sleeper waits for happened in a snapshot?
+	// 'threatTypeMask' is the types of every threat in the snapshot
+	// the caller must hold my mutex
+	bool hasWakeEventHappened(SJediAiSleeper &sleeper, const CJediAiWorldSnapshot &snapshot, unsigned int threatTypeMask);
+
+	// wake a sleeper
+	// the caller must hold my mutex
+	void wakeSleeper(SJediAiSleeper &sleeper);
+
+	// which wheel tick does a time fall in?
+	int computeTick(float time) const;
+};
+
+// the game's wake scheduler
+extern CJediAiWakeScheduler gJediAiWakeScheduler;
+
+#endif // __JEDI_AI_WAKE__
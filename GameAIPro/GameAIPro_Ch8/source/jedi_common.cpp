@@ -1,6 +1,7 @@
 #include "pch.h"
 #include "jedi_common.h"
 #include "jedi_ai_memory.h"
+#include <chrono>
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -69,21 +70,79 @@ const float kThreatMaxAwareDuration = 10.0f; // seconds
 const float kCollisionCheckDistance = 20.0f;
 
 
+/////////////////////////////////////////////////////////////////////////////
+//
+// engine system stubs
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// high resolution timer for budgeting work within a frame
+// the real game would use its own platform timer here
+double getTimeMicroseconds() {
+	static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 //
 // random number utils
 //
 /////////////////////////////////////////////////////////////////////////////
 
-float fRand(float rangeMin, float rangeMax) {
-	return (((float)rand() / (float)RAND_MAX) * (rangeMax + rangeMax));
+// rotate a 32 bit value left
+static inline unsigned int rotateLeft(unsigned int value, int bits) {
+	return ((value << bits) | (value >> (32 - bits)));
 }
 
-bool randBool(float odds) {
-	return (fRand(0.0f, odds) < odds);
+void SJediRandom::seed(unsigned int seedValue) {
+
+	// expand the seed with splitmix32 so that similar seeds give unrelated streams
+	for (int i = 0; i < TR_COUNTOF(state); ++i) {
+		seedValue += 0x9e3779b9;
+		unsigned int z = seedValue;
+		z = (z ^ (z >> 16)) * 0x85ebca6b;
+		z = (z ^ (z >> 13)) * 0xc2b2ae35;
+		state[i] = (z ^ (z >> 16));
+	}
+
+	// an all zero state would only ever generate zeros
+	if ((state[0] | state[1] | state[2] | state[3]) == 0) {
+		state[0] = 1;
+	}
 }
 
-int randChoice(int oddsTableSize, float oddsTable[]) {
+void SJediRandom::fork(const SJediRandom &parent, unsigned int streamIndex) {
+	seed(parent.state[0] ^ rotateLeft(parent.state[1], 13) ^ rotateLeft(parent.state[3], 23) ^ (streamIndex * 0x9e3779b9));
+}
+
+unsigned int SJediRandom::next() {
+	unsigned int result = rotateLeft(state[1] * 5, 7) * 9;
+	unsigned int t = (state[1] << 9);
+	state[2] ^= state[0];
+	state[3] ^= state[1];
+	state[1] ^= state[2];
+	state[0] ^= state[3];
+	state[2] ^= t;
+	state[3] = rotateLeft(state[3], 11);
+	return result;
+}
+
+float SJediRandom::nextFloat() {
+
+	// use the top 24 bits, which is all a float can hold
+	return ((float)(next() >> 8) * (1.0f / 16777216.0f));
+}
+
+float fRand(SJediRandom &random, float rangeMin, float rangeMax) {
+	return (rangeMin + (random.nextFloat() * (rangeMax - rangeMin)));
+}
+
+bool randBool(SJediRandom &random, float odds) {
+	return (random.nextFloat() < odds);
+}
+
+int randChoice(SJediRandom &random, int oddsTableSize, float oddsTable[]) {
 
 	// calculate the odds total
 	float oddsTotal = 0.0f;
@@ -91,19 +150,24 @@ int randChoice(int oddsTableSize, float oddsTable[]) {
 		oddsTotal += oddsTable[i];
 	}
 
-	// compute a random value in the range [0, oddsTotal]
-	float value = fRand(0.0f, oddsTotal);
+	// compute a random value in the range [0, oddsTotal)
+	float value = fRand(random, 0.0f, oddsTotal);
 
 	// determine which odds element the value falls into
+	int lastChoice = 0;
 	for (int i = 0; i < oddsTableSize; ++i) {
+		if (oddsTable[i] <= 0.0f) {
+			continue;
+		}
 		value -= oddsTable[i];
-		if (value <= 0.0f) {
+		if (value < 0.0f) {
 			return i;
 		}
+		lastChoice = i;
 	}
 
-	// we didn't find a value
-	return 0;
+	// rounding left the value just past the total, so it belongs to the last element that has any odds
+	return lastChoice;
 }
 
 
@@ -276,6 +340,9 @@ const char *lookupJediAiActionName(EJediAiAction action) {
 		case eJediAiAction_EngageDroideka: return "eJediAiAction_EngageDroideka";
 		case eJediAiAction_EngageCrabDroid: return "eJediAiAction_EngageCrabDroid";
 
+		// planning
+		case eJediAiAction_Planner: return "eJediAiAction_Planner";
+
 		// idle
 		case eJediAiAction_DefensiveStance: return "eJediAiAction_DefensiveStance";
 		case eJediAiAction_WaitForThreat: return "eJediAiAction_WaitForThreat";
@@ -288,7 +355,7 @@ const char *lookupJediAiActionName(EJediAiAction action) {
 		// unknown
 		default: return "<unknown action>";
 	}
-	compileTimeAssert(eJediAiAction_Count == 43);
+	compileTimeAssert(eJediAiAction_Count == 44);
 }
 
 const char *lookupJediAiActionSimResultName(EJediAiActionSimResult simResult) {
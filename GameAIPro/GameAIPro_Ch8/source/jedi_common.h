@@ -26,6 +26,12 @@ class CJediAiAction;
 struct SJediAiActorState;
 struct SJediAiThreatState;
 struct SJediAiActionSimSummary;
+struct SJediAiActorSnapshot;
+class CJediAiWorldSnapshot;
+class CJediAiEngineQueryBatch;
+struct SJediAiEngineQuery;
+class CJediAiTokenBoard;
+class CJediAiLatentFramePool;
 
 #pragma endregion
 
@@ -114,19 +120,16 @@ extern float kJediTKThrowSpeed;
 #pragma region determinePathFindValidity
 
 // is there a valid path between two points?
-inline bool determinePathFindValidity(const CVector &a, const CVector &b) {
-	return true; // assume we can get there for the example
-}
+// this is answered by the local navigation grid (see jedi_ai_navigation.h)
+extern bool determinePathFindValidity(const CVector &a, const CVector &b);
 
 #pragma endregion
 
 #pragma region navMeshCollideRay
 
-inline bool navMeshCollideRay(const CVector &wStartPos, const CVector &wTargetPos, CVector *wClosestNavigablePos) {
-	if (wClosestNavigablePos != NULL)
-		wClosestNavigablePos->zero();
-	return false; // assume that we hit nothing for the example
-}
+// how far can I navigate toward a point?
+// returns true if something is in the way, along with the farthest navigable position before it
+extern bool navMeshCollideRay(const CVector &wStartPos, const CVector &wTargetPos, CVector *wClosestNavigablePos);
 
 #pragma endregion
 
@@ -165,6 +168,13 @@ enum EAttackLevel {
 
 #pragma endregion
 
+#pragma region getTimeMicroseconds
+
+// high resolution timer for budgeting work within a frame
+extern double getTimeMicroseconds();
+
+#pragma endregion
+
 #pragma region Gravity
 
 // gravity constant
@@ -181,21 +191,47 @@ inline float getGravity() {
 //
 /////////////////////////////////////////////////////////////////////////////
 
+#pragma region SJediRandom
+
+// small, fast random number generator (xoshiro128**)
+// each jedi's memory owns one, and simulation memory copies it along with everything else,
+// so decisions don't depend on evaluation order and replays are deterministic
+// to snapshot a generator, just copy it
+struct SJediRandom {
+	unsigned int state[4];
+
+	// seed this generator
+	void seed(unsigned int seedValue);
+
+	// seed this generator with an independent stream derived from another generator
+	// the parent is left untouched, and the same parent and index always give the same stream
+	void fork(const SJediRandom &parent, unsigned int streamIndex);
+
+	// get the next random value
+	unsigned int next();
+
+	// get a random value in the range [0, 1)
+	float nextFloat();
+};
+
+#pragma endregion
+
 #pragma region fRand
 
-extern float fRand(float rangeMin, float rangeMax);
+// returns a random value in the range [rangeMin, rangeMax)
+extern float fRand(SJediRandom &random, float rangeMin, float rangeMax);
 
 #pragma endregion
 
 #pragma region randBool
 
-extern bool randBool(float odds);
+extern bool randBool(SJediRandom &random, float odds);
 
 #pragma endregion
 
 #pragma region randChoice
 
-extern int randChoice(int oddsTableSize, float oddsTable[]);
+extern int randChoice(SJediRandom &random, int oddsTableSize, float oddsTable[]);
 
 #pragma endregion
 
@@ -503,6 +539,9 @@ enum EJediAiAction {
 	eJediAiAction_EngageDroideka,                // engage a droideka
 	eJediAiAction_EngageCrabDroid,               // engage a crab droid
 
+	// planning
+	eJediAiAction_Planner,                       // search sequences of actions for the best one to take
+
 	// idle
 	eJediAiAction_DefensiveStance,               // hold up my saber defensively
 	eJediAiAction_WaitForThreat,                 // wait defensively for a given threat scenario to occur
@@ -659,6 +698,7 @@ const unsigned int kJediAiActorStateFlag_EngagedWithOtherJedi = (1 << 14); // ot
 const unsigned int kJediAiActorStateFlag_ForceTkObjectCanHitVictim = (1 << 15);
 const unsigned int kJediAiActorStateFlag_IsPlayer = (1 << 16);
 const unsigned int kJediAiActorStateFlag_CanBeTaunted = (1 << 17);
+const unsigned int kJediAiActorStateFlag_EngageSlotsTaken = (1 << 18); // other jedi hold every slot to fight this actor in
 
 // knowledge container for actors
 struct SJediAiActorState : SJediAiEntityState {
@@ -694,7 +734,7 @@ struct SJediAiThreatState : SJediAiEntityState {
 	CVector wEndPos;
 	SJediAiActorState *attackerState;
 	SJediAiActorState *objectState;
-	SJediThreatInfo *threat;
+	const SJediThreatInfo *threat;
 	float duration;
 	float strength;
 	float damageRadius;
@@ -0,0 +1,121 @@
+#include "pch.h"
+#include "jedi_prototype.h"
+
+#include <cstddef>
+
+// jedi storage comes from calloc(), so it must not need more alignment than that gives
+compileTimeAssert(alignof(CJedi) <= alignof(std::max_align_t));
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// jedi prototype
+//
+/////////////////////////////////////////////////////////////////////////////
+
+CJediPrototype::CJediPrototype() {
+	prototype = NULL;
+	relocationTable = NULL;
+	relocationCount = 0;
+	memset(&stats, 0, sizeof(stats));
+}
+
+CJediPrototype::~CJediPrototype() {
+	clear();
+}
+
+bool CJediPrototype::build() {
+	if (prototype != NULL) {
+		return false;
+	}
+
+	// construct the prototype and a twin, both in zeroed storage so their padding matches
+	void *twinStorage = allocateStorage();
+	prototype = new (allocateStorage()) CJedi();
+	CJedi *twin = new (twinStorage) CJedi();
+
+	// point each tree at its own memory, so the relocation takes care of that for clones too
+	prototype->aiCombatAction.init(&prototype->aiMemory);
+	twin->aiCombatAction.init(&twin->aiMemory);
+
+	// every word that points into the prototype points to the same place in the twin
+	const uintptr_t *prototypeWords = (const uintptr_t *)prototype;
+	const uintptr_t *twinWords = (const uintptr_t *)twin;
+	const int wordCount = (int)(sizeof(CJedi) / sizeof(uintptr_t));
+	const uintptr_t delta = ((uintptr_t)twin - (uintptr_t)prototype);
+	const uintptr_t prototypeBegin = (uintptr_t)prototype;
+	const uintptr_t prototypeEnd = prototypeBegin + sizeof(CJedi);
+
+	// count them, then record them
+	// anything else that differs (like the random seed) belongs to each jedi, and CJedi::initClone() fills it in
+	relocationCount = 0;
+	stats.perInstanceWordCount = 0;
+	for (int pass = 0; pass < 2; ++pass) {
+		int count = 0;
+		for (int i = 0; i < wordCount; ++i) {
+			uintptr_t word = prototypeWords[i];
+			if (word == twinWords[i]) {
+				continue;
+			}
+			if (word >= prototypeBegin && word <= prototypeEnd && twinWords[i] - word == delta) {
+				if (relocationTable != NULL) {
+					relocationTable[count] = (int)(i * sizeof(uintptr_t));
+				}
+				count++;
+			} else if (pass == 0) {
+				stats.perInstanceWordCount++;
+			}
+		}
+		if (pass == 0) {
+			relocationCount = count;
+			relocationTable = new int[max(relocationCount, 1)];
+		}
+	}
+
+	// the twin has done its job
+	twin->~CJedi();
+	freeStorage(twinStorage);
+
+	// success
+	return true;
+}
+
+void CJediPrototype::clear() {
+	if (prototype != NULL) {
+		prototype->~CJedi();
+		freeStorage(prototype);
+		prototype = NULL;
+	}
+	delete [] relocationTable;
+	relocationTable = NULL;
+	relocationCount = 0;
+}
+
+CJedi *CJediPrototype::clone(void *storage) {
+	if (prototype == NULL) {
+		error("CJediPrototype::clone() - Prototype hasn't been built");
+		return NULL;
+	}
+
+	// copy the prototype, then move its pointers over to the clone
+	memcpy(storage, (const void *)prototype, sizeof(CJedi));
+	unsigned char *cloneBytes = (unsigned char *)storage;
+	const uintptr_t delta = ((uintptr_t)storage - (uintptr_t)prototype);
+	for (int i = 0; i < relocationCount; ++i) {
+		*(uintptr_t *)(cloneBytes + relocationTable[i]) += delta;
+	}
+
+	// give it what it can't share with the prototype
+	CJedi *jedi = (CJedi *)storage;
+	jedi->initClone();
+	stats.cloneCount++;
+	return jedi;
+}
+
+void *CJediPrototype::allocateStorage() {
+	return calloc(1, sizeof(CJedi));
+}
+
+void CJediPrototype::freeStorage(void *storage) {
+	free(storage);
+}
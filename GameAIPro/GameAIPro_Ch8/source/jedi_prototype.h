@@ -0,0 +1,64 @@
+#ifndef __JEDI_PROTOTYPE__
+#define __JEDI_PROTOTYPE__
+
+#ifndef __JEDI__
+	#include "jedi.h"
+#endif
+
+#include <cstdint>
+#include <new>
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// jedi prototype
+// constructing a jedi builds its whole behavior tree, and init() then walks the tree again,
+// which hitches when a wave of them spawns at once
+// a prototype is constructed once, and spawned jedi are block copies of it, with every pointer
+// into the prototype moved over to the copy in a single pass over a relocation table
+// the table is found by constructing a second prototype somewhere else and comparing the two:
+// a word that differs by exactly how far apart they are is a pointer into the prototype
+// clones come out just like a freshly constructed jedi, so call setup() on them as usual
+//
+/////////////////////////////////////////////////////////////////////////////
+
+class CJediPrototype {
+public:
+
+	// the prototype every clone is copied from (NULL until built)
+	// it is never set up or processed, so its bytes don't change
+	CJedi *prototype;
+
+	// relocation table
+	// the offset of each pointer-sized word in the prototype that points into it
+	int *relocationTable;
+	int relocationCount;
+
+	// statistics
+	struct SStats {
+		int perInstanceWordCount; // how many words differed between the two prototypes but aren't pointers into them
+		int cloneCount; // how many clones were made
+	} stats;
+
+	// construction
+	CJediPrototype();
+	~CJediPrototype();
+
+	// construct the prototype and find its relocation table
+	// returns false if it's already built
+	bool build();
+
+	// throw away the prototype and its relocation table
+	void clear();
+
+	// clone the prototype into the specified storage, which must hold a CJedi and be aligned for one
+	// destroy clones by calling their destructor and freeing their storage yourself
+	// returns NULL if I haven't been built
+	CJedi *clone(void *storage);
+
+	// allocate zeroed storage for a jedi, and free it
+	static void *allocateStorage();
+	static void freeStorage(void *storage);
+};
+
+#endif // __JEDI_PROTOTYPE__
@@ -1,13 +1,847 @@
 #include "pch.h"
 #include "jedi.h"
+#include "jedi_ai_snapshot.h"
+#include "jedi_ai_navigation.h"
+#include "jedi_ai_pipeline.h"
+#include "jedi_ai_wake.h"
+#include "jedi_prototype.h"
 
-int main()
+// build a memory where a group of enemies rush me while I move past them
+static void setupSimulationBenchmark(CJediAiMemory &memory, CActor enemyActors[], int enemyCount) {
+	memory.reset();
+	memory.selfState.wPos = kZeroVector;
+	memory.selfState.wPrevPos = kZeroVector;
+	memory.selfState.iFrontDir = kUnitVectorX;
+	memory.selfState.iRightDir = kUnitVectorX.crossProduct(kUnitVectorY);
+	memory.selfState.collisionRadius = 1.0f;
+	memory.selfState.hitPoints = 100.0f;
+	memory.enemyStateCount = enemyCount;
+	for (int i = 0; i < enemyCount; ++i) {
+		SJediAiActorState &enemyState = memory.enemyStates[i];
+		float angle = (float)i * (2.0f * 3.14159265f / (float)enemyCount);
+		enemyState.actor = &enemyActors[i];
+		enemyState.wPos = CVector(cosf(angle) * 30.0f, 0.0f, sinf(angle) * 30.0f);
+		enemyState.wBoundsCenterPos = enemyState.wPos;
+		enemyState.iFrontDir = enemyState.wPos.xzDirectionTo(kZeroVector, 30.0f);
+		enemyState.iVelocity = enemyState.iFrontDir * 12.0f;
+		enemyState.flags = kJediAiActorStateFlag_InRushAttack;
+		enemyState.hitPoints = 10.0f;
+		enemyState.collisionRadius = 1.0f;
+		memory.updateEntityToSelfState(enemyState);
+	}
+}
+
+// check a math result against what it should be
+static void checkMath(const char *name, float value, float expected, float tolerance, int &failCount) {
+	if (fabsf(value - expected) > tolerance) {
+		printf("FAILED %s: got %f, expected %f\n", name, value, expected);
+		failCount++;
+	}
+}
+
+// check the vector math, and that the batch operations give the same answers as the scalar ones
+// returns how many checks failed
+static int testMath() {
+	int failCount = 0;
+	const float kTolerance = 0.0001f;
+
+	// trig
+	float sinAngle, cosAngle;
+	sinCos(sinAngle, cosAngle, 0.0f);
+	checkMath("sinCos(0) sin", sinAngle, 0.0f, kTolerance, failCount);
+	checkMath("sinCos(0) cos", cosAngle, 1.0f, kTolerance, failCount);
+	sinCos(sinAngle, cosAngle, PI / 2.0f);
+	checkMath("sinCos(pi/2) sin", sinAngle, 1.0f, kTolerance, failCount);
+	checkMath("sinCos(pi/2) cos", cosAngle, 0.0f, kTolerance, failCount);
+	for (float angle = -TWOPI; angle <= TWOPI; angle += 0.1f) {
+		sinCos(sinAngle, cosAngle, angle);
+		checkMath("sinCos sin", sinAngle, sinf(angle), kTolerance, failCount);
+		checkMath("sinCos cos", cosAngle, cosf(angle), kTolerance, failCount);
+	}
+
+	// scalar vector operations
+	CVector a(1.0f, 5.0f, 1.0f);
+	CVector b(4.0f, -2.0f, 5.0f);
+	checkMath("distanceTo", CVector(0.0f, 0.0f, 0.0f).distanceTo(CVector(3.0f, 4.0f, 0.0f)), 5.0f, kTolerance, failCount);
+	checkMath("distanceSqTo", a.distanceSqTo(b), 74.0f, kTolerance, failCount);
+	checkMath("xzDistanceTo", a.xzDistanceTo(b), 5.0f, kTolerance, failCount);
+	checkMath("directionTo x", a.directionTo(b).x, 3.0f / sqrtf(74.0f), kTolerance, failCount);
+	checkMath("xzDirectionTo z", a.xzDirectionTo(b).z, 0.8f, kTolerance, failCount);
+	checkMath("directionTo coincident", a.directionTo(a).length(), 0.0f, kTolerance, failCount);
+	checkMath("isCloseTo", (float)a.isCloseTo(b, 8.7f), 1.0f, 0.0f, failCount);
+	checkMath("isCloseTo far", (float)a.isCloseTo(b, 8.5f), 0.0f, 0.0f, failCount);
+	CVector c;
+	c.set(3.0f, 0.0f, 4.0f);
+	checkMath("set", c.x + c.y + c.z, 7.0f, kTolerance, failCount);
+	c.setLength(10.0f);
+	checkMath("setLength", c.length(), 10.0f, kTolerance, failCount);
+	checkMath("normalizeFast", CVector(b).normalizeFast().length(), 1.0f, kTolerance, failCount);
+	checkMath("fastInvSqrt", fastInvSqrt(16.0f), 0.25f, kTolerance, failCount);
+
+	// batch operations, run over a member of an array of structs
+	// the count isn't a multiple of four, so the scalar tail runs too
+	struct STestEntry {
+		int tag;
+		CVector wPos;
+	};
+	const int kEntryCount = 11;
+	STestEntry entryList[kEntryCount];
+	SJediRandom random;
+	random.seed(1);
+	for (int i = 0; i < kEntryCount; ++i) {
+		entryList[i].tag = i;
+		entryList[i].wPos.set(fRand(random, -50.0f, 50.0f), fRand(random, -50.0f, 50.0f), fRand(random, -50.0f, 50.0f));
+	}
+	float distances[kEntryCount];
+	float distancesSq[kEntryCount];
+	float xzDistances[kEntryCount];
+	float dotProducts[kEntryCount];
+	computeDistances(a, &entryList[0].wPos, distances, kEntryCount, sizeof(entryList[0]));
+	computeDistancesSq(a, &entryList[0].wPos, distancesSq, kEntryCount, sizeof(entryList[0]));
+	computeXzDistances(a, &entryList[0].wPos, xzDistances, kEntryCount, sizeof(entryList[0]));
+	computeDotProducts(b, &entryList[0].wPos, dotProducts, kEntryCount, sizeof(entryList[0]));
+	for (int i = 0; i < kEntryCount; ++i) {
+		const CVector &wPos = entryList[i].wPos;
+		checkMath("computeDistances", distances[i], a.distanceTo(wPos), kTolerance * distances[i], failCount);
+		checkMath("computeDistancesSq", distancesSq[i], a.distanceSqTo(wPos), kTolerance * distancesSq[i], failCount);
+		checkMath("computeXzDistances", xzDistances[i], a.xzDistanceTo(wPos), kTolerance * xzDistances[i], failCount);
+		checkMath("computeDotProducts", dotProducts[i], b.dotProduct(wPos), kTolerance * fabsf(dotProducts[i]) + kTolerance, failCount);
+	}
+
+	// normalizing
+	STestEntry normalizedList[kEntryCount];
+	STestEntry fastNormalizedList[kEntryCount];
+	memcpy(normalizedList, entryList, sizeof(entryList));
+	memcpy(fastNormalizedList, entryList, sizeof(entryList));
+	normalizeVectors(&normalizedList[0].wPos, kEntryCount, sizeof(normalizedList[0]));
+	normalizeVectorsFast(&fastNormalizedList[0].wPos, kEntryCount, sizeof(fastNormalizedList[0]));
+	for (int i = 0; i < kEntryCount; ++i) {
+		CVector expected = CVector(entryList[i].wPos).normalize();
+		checkMath("normalizeVectors x", normalizedList[i].wPos.x, expected.x, kTolerance, failCount);
+		checkMath("normalizeVectors y", normalizedList[i].wPos.y, expected.y, kTolerance, failCount);
+		checkMath("normalizeVectors z", normalizedList[i].wPos.z, expected.z, kTolerance, failCount);
+		checkMath("normalizeVectorsFast x", fastNormalizedList[i].wPos.x, expected.x, kTolerance, failCount);
+		checkMath("normalizeVectorsFast y", fastNormalizedList[i].wPos.y, expected.y, kTolerance, failCount);
+		checkMath("normalizeVectorsFast z", fastNormalizedList[i].wPos.z, expected.z, kTolerance, failCount);
+
+		// the rest of each struct is left alone
+		checkMath("normalizeVectors tag", (float)normalizedList[i].tag, (float)i, 0.0f, failCount);
+		checkMath("normalizeVectorsFast tag", (float)fastNormalizedList[i].tag, (float)i, 0.0f, failCount);
+	}
+
+	printf("math: %s (%d failed)\n", (failCount > 0 ? "FAILED" : "passed"), failCount);
+	return failCount;
+}
+
+// compare the accuracy and cost of simulating with different step settings
+// the reference is simulated with tiny fixed steps
+static void benchmarkSimulation() {
+	const int kEnemyCount = 6;
+	const float kDuration = 2.0f;
+	const int kReferenceStepCount = 2000;
+	const int kRepeatCount = 2000;
+	static CActor enemyActors[kEnemyCount];
+	static CJediAiMemory baseMemory;
+	static CJediAiMemory referenceMemory;
+	static CJediAiMemory simMemory;
+	CVector wSelfEndPos(20.0f, 0.0f, 0.0f);
+
+	// simulate the reference
+	setupSimulationBenchmark(baseMemory, enemyActors, kEnemyCount);
+	referenceMemory.copy(baseMemory);
+	referenceMemory.simulationMode = CJediAiMemory::eSimulationMode_SingleStep;
+	for (int i = 1; i <= kReferenceStepCount; ++i) {
+		CVector wSelfPos = lerp(kZeroVector, wSelfEndPos, (float)i / (float)kReferenceStepCount);
+		CJediAiMemory::SSimulateParams params;
+		params.wSelfPos = &wSelfPos;
+		referenceMemory.simulate(kDuration / (float)kReferenceStepCount, params);
+	}
+
+	// settings to compare
+	struct {
+		const char *name;
+		CJediAiMemory::ESimulationMode mode;
+		float maxError;
+	} settingsTable[] = {
+		{ "single step", CJediAiMemory::eSimulationMode_SingleStep, 0.0f },
+		{ "events only", CJediAiMemory::eSimulationMode_EventDriven, 0.0f },
+		{ "max error 2.0", CJediAiMemory::eSimulationMode_EventDriven, 2.0f },
+		{ "max error 0.5", CJediAiMemory::eSimulationMode_EventDriven, 0.5f },
+		{ "max error 0.25", CJediAiMemory::eSimulationMode_EventDriven, 0.25f },
+		{ "max error 0.1", CJediAiMemory::eSimulationMode_EventDriven, 0.1f },
+	};
+	printf("%-16s %12s %12s\n", "setting", "avg error", "us / sim");
+	for (int i = 0; i < TR_COUNTOF(settingsTable); ++i) {
+		baseMemory.simulationMode = settingsTable[i].mode;
+		baseMemory.simulationMaxError = settingsTable[i].maxError;
+
+		// simulate the whole duration in one call, like an action does
+		double startTime = getTimeMicroseconds();
+		for (int j = 0; j < kRepeatCount; ++j) {
+			simMemory.copy(baseMemory);
+			CJediAiMemory::SSimulateParams params;
+			params.wSelfPos = &wSelfEndPos;
+			simMemory.simulate(kDuration, params);
+		}
+		double elapsedMicroseconds = getTimeMicroseconds() - startTime;
+
+		// how far off the reference did the enemies end up?
+		float totalError = 0.0f;
+		for (int j = 0; j < kEnemyCount; ++j) {
+			totalError += simMemory.enemyStates[j].wPos.distanceTo(referenceMemory.enemyStates[j].wPos);
+		}
+		printf("%-16s %12.3f %12.2f\n", settingsTable[i].name, totalError / (float)kEnemyCount, elapsedMicroseconds / (double)kRepeatCount);
+	}
+}
+
+// publish a world where a ring of enemies shoots at a group of jedi
+// the example's actors are never enemies, so everything after the jedi is marked as one once it's captured
+static double publishSenseBenchmarkWorld(CActor *const actorList[], int actorCount, int jediCount, bool shareSense) {
+	CJediAiWorldSnapshot *snapshot = gJediAiWorldSnapshotBuffer.beginPublish();
+	if (snapshot == NULL) {
+		return 0.0;
+	}
+	snapshot->capture(actorList, actorCount, getTime());
+	for (int i = jediCount; i < snapshot->actorCount; ++i) {
+		snapshot->actorList[i].flags |= kJediAiActorSnapshotFlag_IsJediEnemy;
+		snapshot->actorList[i].enemyType = eJediEnemyType_B1BattleDroid;
+	}
+
+	// sharing is part of the cost of sensing
+	double startTime = getTimeMicroseconds();
+	if (shareSense) {
+		snapshot->shareSense();
+	}
+	double elapsedMicroseconds = getTimeMicroseconds() - startTime;
+	gJediAiWorldSnapshotBuffer.endPublish(snapshot);
+	return elapsedMicroseconds;
+}
+
+// build a battle where a ring of enemies shoots at a group of jedi
+// jedi closer together than their collision radii leave each other no room to engage
+static void setupBattleBenchmark(CJedi jediList[], int jediCount, CActor enemyActors[], int enemyCount, float jediSpacing = 3.0f) {
+
+	// the jedi stand together in the middle, and the enemies surround them
+	for (int i = 0; i < jediCount; ++i) {
+		jediList[i].setup();
+		jediList[i].wPos = CVector((float)i * jediSpacing, 0.0f, 0.0f);
+		jediList[i].wBoundsCenter = jediList[i].wPos;
+	}
+	for (int i = 0; i < enemyCount; ++i) {
+		float angle = (float)i * (2.0f * 3.14159265f / (float)enemyCount);
+		enemyActors[i].wPos = CVector(cosf(angle) * 20.0f, 0.0f, sinf(angle) * 20.0f);
+		enemyActors[i].wBoundsCenter = enemyActors[i].wPos;
+		enemyActors[i].iFrontDir = enemyActors[i].wPos.xzDirectionTo(kZeroVector, 20.0f);
+	}
+
+	// every enemy has a bolt in the air toward one of the jedi
+	gThreatCount = enemyCount;
+	for (int i = 0; i < enemyCount; ++i) {
+		SJediThreatInfo &threat = gThreatList[i];
+		CActor *target = &jediList[i % jediCount];
+		threat.iDir = enemyActors[i].wPos.directionTo(target->wPos);
+		threat.wPos = enemyActors[i].wPos + (threat.iDir * 2.0f);
+		threat.wEndPos = target->wPos;
+		threat.creator = &enemyActors[i];
+		threat.object = NULL;
+		threat.intendedVictim = target;
+		threat.type = eJediThreatType_Blaster;
+		threat.attackLevel = eAttackLevel_Light;
+		threat.strength = 10.0f;
+		threat.speed = 30.0f;
+		threat.delayToAttackTime = threat.wPos.distanceTo(target->wPos) / threat.speed;
+		threat.damageRadius = 0.5f;
+		threat.isMelee360 = false;
+	}
+}
+
+// compare what sensing costs each jedi with and without shared sense, as more jedi fight the same enemies
+// each setting is run several times in turn, and the fastest run is kept, since one run is mostly noise
+static void benchmarkSense() {
+	const int kMaxJediCount = 32;
+	const int kEnemyCount = 24;
+	const int kFrameCount = 500;
+	const int kRunCount = 7;
+	static CJedi jediList[kMaxJediCount];
+	static CActor enemyActors[kEnemyCount];
+	setupBattleBenchmark(jediList, kMaxJediCount, enemyActors, kEnemyCount);
+
+	printf("%-8s %16s %16s\n", "jedi", "us / jedi", "shared us / jedi");
+	for (int jediCount = 1; jediCount <= kMaxJediCount; jediCount *= 2) {
+		CActor *actorList[kMaxJediCount + kEnemyCount];
+		int actorCount = 0;
+		for (int i = 0; i < jediCount; ++i) {
+			actorList[actorCount++] = &jediList[i];
+		}
+		for (int i = 0; i < kEnemyCount; ++i) {
+			actorList[actorCount++] = &enemyActors[i];
+		}
+
+		// sense every frame, once without sharing and once with
+		double elapsedMicrosecondsTable[2] = { 1e30, 1e30 };
+		for (int run = 0; run < kRunCount; ++run) {
+			for (int shared = 0; shared < 2; ++shared) {
+				double elapsedMicroseconds = 0.0;
+				for (int frame = 0; frame < kFrameCount; ++frame) {
+					elapsedMicroseconds += publishSenseBenchmarkWorld(actorList, actorCount, jediCount, (shared != 0));
+					double startTime = getTimeMicroseconds();
+					for (int i = 0; i < jediCount; ++i) {
+						jediList[i].aiMemory.update(0.0f);
+					}
+					elapsedMicroseconds += getTimeMicroseconds() - startTime;
+				}
+				elapsedMicrosecondsTable[shared] = min(elapsedMicrosecondsTable[shared], elapsedMicroseconds / (double)(kFrameCount * jediCount));
+			}
+		}
+		printf("%-8d %16.2f %16.2f\n", jediCount, elapsedMicrosecondsTable[0], elapsedMicrosecondsTable[1]);
+	}
+	gThreatCount = 0;
+}
+
+// compare how long a frame takes when jedi think in it and when they think alongside it
+// the rest of the frame's work is stood in for by a fixed wait
+static void benchmarkPipeline() {
+	const int kJediCount = 4;
+	const int kEnemyCount = 24;
+	const int kFrameCount = 300;
+	const float kDt = (1.0f / 30.0f);
+	const double kGameplayMicroseconds = 500.0;
+	static CJedi jediList[kJediCount];
+	static CActor enemyActors[kEnemyCount];
+	setupBattleBenchmark(jediList, kJediCount, enemyActors, kEnemyCount);
+	CActor *actorList[kJediCount + kEnemyCount];
+	int actorCount = 0;
+	for (int i = 0; i < kJediCount; ++i) {
+		actorList[actorCount++] = &jediList[i];
+	}
+	for (int i = 0; i < kEnemyCount; ++i) {
+		actorList[actorCount++] = &enemyActors[i];
+	}
+
+	printf("%-12s %16s %16s %16s\n", "mode", "us / frame", "think us / frame", "wait us / frame");
+	for (int pipelined = 0; pipelined < 2; ++pipelined) {
+		CJediAiThinkPipeline pipeline;
+		if (pipelined) {
+			for (int i = 0; i < kJediCount; ++i) {
+				pipeline.addJedi(&jediList[i]);
+			}
+		}
+
+		double thinkMicroseconds = 0.0;
+		double startTime = getTimeMicroseconds();
+		for (int frame = 0; frame < kFrameCount; ++frame) {
+
+			// apply what the jedi thought about last frame, then publish this frame's world
+			pipeline.endThink();
+			publishSenseBenchmarkWorld(actorList, actorCount, kJediCount, true);
+			gJediAiWakeScheduler.update(getTime());
+			gJediAiNavigation.beginFrame();
+
+			// think now, or alongside the rest of the frame
+			if (pipelined) {
+				pipeline.beginThink(kDt);
+			} else {
+				double thinkStartTime = getTimeMicroseconds();
+				for (int i = 0; i < kJediCount; ++i) {
+					jediList[i].process(kDt);
+				}
+				thinkMicroseconds += getTimeMicroseconds() - thinkStartTime;
+			}
+
+			// the rest of the frame
+			double gameplayEndTime = getTimeMicroseconds() + kGameplayMicroseconds;
+			while (getTimeMicroseconds() < gameplayEndTime) {
+			}
+		}
+		pipeline.endThink();
+		double elapsedMicroseconds = getTimeMicroseconds() - startTime;
+		if (pipelined) {
+			thinkMicroseconds = pipeline.stats.thinkMicroseconds;
+		}
+		printf(
+			"%-12s %16.2f %16.2f %16.2f\n", (pipelined ? "pipelined" : "immediate"),
+			elapsedMicroseconds / (double)kFrameCount, thinkMicroseconds / (double)kFrameCount, pipeline.stats.waitMicroseconds / (double)kFrameCount
+		);
+	}
+	gThreatCount = 0;
+}
+
+// count the engine queries jedi selections make, and compare what thinking costs with and without batching them
+static void benchmarkQueries() {
+	const int kJediCount = 4;
+	const int kEnemyCount = 24;
+	const int kFrameCount = 300;
+	const float kDt = (1.0f / 30.0f);
+	static CJedi jediList[kJediCount];
+	static CActor enemyActors[kEnemyCount];
+	setupBattleBenchmark(jediList, kJediCount, enemyActors, kEnemyCount);
+	CActor *actorList[kJediCount + kEnemyCount];
+	int actorCount = 0;
+	for (int i = 0; i < kJediCount; ++i) {
+		actorList[actorCount++] = &jediList[i];
+
+		// give each jedi someone to fight, so its actions have somewhere to move
+		jediList[i].setCurrentTarget(&enemyActors[i]);
+	}
+	for (int i = 0; i < kEnemyCount; ++i) {
+		actorList[actorCount++] = &enemyActors[i];
+	}
+
+	printf(
+		"%-10s %16s %12s %12s %12s %12s %12s\n",
+		"mode", "think us / frame", "selections", "issued", "duplicate", "resolved", "batched"
+	);
+	for (int batching = 0; batching < 2; ++batching) {
+		for (int i = 0; i < kJediCount; ++i) {
+			jediList[i].aiCombatAction.selectorParams.batchEngineQueries = (batching != 0);
+			memset(&jediList[i].aiQueryBatch.totalStats, 0, sizeof(jediList[i].aiQueryBatch.totalStats));
+		}
+
+		double thinkMicroseconds = 0.0;
+		for (int frame = 0; frame < kFrameCount; ++frame) {
+			publishSenseBenchmarkWorld(actorList, actorCount, kJediCount, true);
+			gJediAiWakeScheduler.update(getTime());
+			gJediAiNavigation.beginFrame();
+			double startTime = getTimeMicroseconds();
+			for (int i = 0; i < kJediCount; ++i) {
+				jediList[i].process(kDt);
+			}
+			thinkMicroseconds += getTimeMicroseconds() - startTime;
+		}
+
+		// add up everyone's query statistics
+		CJediAiEngineQueryBatch::SStats stats;
+		memset(&stats, 0, sizeof(stats));
+		for (int i = 0; i < kJediCount; ++i) {
+			const CJediAiEngineQueryBatch::SStats &jediStats = jediList[i].aiQueryBatch.totalStats;
+			stats.selectionCount += jediStats.selectionCount;
+			stats.issuedCount += jediStats.issuedCount;
+			stats.duplicateCount += jediStats.duplicateCount;
+			stats.resolvedCount += jediStats.resolvedCount;
+			stats.batchedCount += jediStats.batchedCount;
+		}
+		printf(
+			"%-10s %16.2f %12d %12d %12d %12d %12d\n", (batching ? "batched" : "immediate"),
+			thinkMicroseconds / (double)kFrameCount, stats.selectionCount, stats.issuedCount, stats.duplicateCount, stats.resolvedCount, stats.batchedCount
+		);
+	}
+	gThreatCount = 0;
+}
+
+// compare what thinking costs when jedi engage with the engage tree and when they plan, and show what the planner chooses
+static void benchmarkPlanner() {
+	const int kJediCount = 4;
+	const int kEnemyCount = 24;
+	const int kFrameCount = 300;
+	const float kDt = (1.0f / 30.0f);
+	static CJedi jediList[kJediCount];
+	static CActor enemyActors[kEnemyCount];
+	setupBattleBenchmark(jediList, kJediCount, enemyActors, kEnemyCount, 25.0f);
+	CActor *actorList[kJediCount + kEnemyCount];
+	int actorCount = 0;
+	for (int i = 0; i < kJediCount; ++i) {
+		actorList[actorCount++] = &jediList[i];
+
+		// give each jedi someone to fight within reach, so there is something to plan
+		enemyActors[i].wPos = jediList[i].wPos + CVector(0.0f, 0.0f, 4.0f);
+		enemyActors[i].wBoundsCenter = enemyActors[i].wPos;
+		jediList[i].setCurrentTarget(&enemyActors[i]);
+	}
+	for (int i = 0; i < kEnemyCount; ++i) {
+		actorList[actorCount++] = &enemyActors[i];
+	}
+
+	printf("%-10s %16s %16s %16s %16s\n", "lod", "think us / frame", "engaged frames", "plans", "iterations / plan");
+	for (int planning = 0; planning < 2; ++planning) {
+		for (int i = 0; i < kJediCount; ++i) {
+			jediList[i].aiCombatAction.setLod(planning ? CJediAiActionCombat::eLod_Planner : CJediAiActionCombat::eLod_Selector);
+			memset(&jediList[i].aiCombatAction.planner.plannerData.plannedCountTable, 0, sizeof(jediList[i].aiCombatAction.planner.plannerData.plannedCountTable));
+			jediList[i].aiCombatAction.planner.plannerData.planCount = 0;
+			jediList[i].aiCombatAction.planner.plannerData.totalIterationCount = 0;
+		}
+
+		double thinkMicroseconds = 0.0;
+		int engagedFrameCount = 0;
+		for (int frame = 0; frame < kFrameCount; ++frame) {
+			publishSenseBenchmarkWorld(actorList, actorCount, kJediCount, true);
+			gJediAiWakeScheduler.update(getTime());
+			gJediAiNavigation.beginFrame();
+			double startTime = getTimeMicroseconds();
+			for (int i = 0; i < kJediCount; ++i) {
+				jediList[i].process(kDt);
+			}
+			thinkMicroseconds += getTimeMicroseconds() - startTime;
+
+			// count the frames each jedi spends engaging, whichever way it does it
+			for (int i = 0; i < kJediCount; ++i) {
+				const CJediAiActionCombat &combat = jediList[i].aiCombatAction;
+				if (combat.selectorData.currentAction == combat.actionTable[CJediAiActionCombat::eAction_Engage]) {
+					engagedFrameCount++;
+				}
+			}
+		}
+
+		// add up everyone's plans
+		int planCount = 0;
+		int iterationCount = 0;
+		int plannedCountTable[CJediAiActionPlanner::eAction_Count];
+		memset(plannedCountTable, 0, sizeof(plannedCountTable));
+		for (int i = 0; i < kJediCount; ++i) {
+			const CJediAiActionPlanner &planner = jediList[i].aiCombatAction.planner;
+			planCount += planner.plannerData.planCount;
+			iterationCount += planner.plannerData.totalIterationCount;
+			for (int j = 0; j < CJediAiActionPlanner::eAction_Count; ++j) {
+				plannedCountTable[j] += planner.plannerData.plannedCountTable[j];
+			}
+		}
+		printf(
+			"%-10s %16.2f %16d %16d %16.1f\n", (planning ? "planner" : "selector"),
+			thinkMicroseconds / (double)kFrameCount, engagedFrameCount, planCount, (planCount > 0 ? (double)iterationCount / (double)planCount : 0.0)
+		);
+
+		// show what the planner chose
+		if (planning) {
+			const CJediAiActionPlanner &planner = jediList[0].aiCombatAction.planner;
+			for (int j = 0; j < CJediAiActionPlanner::eAction_Count; ++j) {
+				printf("    %-16s %8d\n", planner.actionTable[j]->getName(), plannedCountTable[j]);
+			}
+		}
+	}
+	for (int i = 0; i < kJediCount; ++i) {
+		jediList[i].aiCombatAction.setLod(CJediAiActionCombat::eLod_Selector);
+	}
+	gThreatCount = 0;
+}
+
+// compare what rolling out each action several times costs, and how much steadier it makes decisions
+// each jedi's decision is made over and over from the same moment with different random streams
+// a choice is steady if it agrees with the one made most often, and a judgement is steady if
+// an action's result agrees with the result it got most often
+static void benchmarkRollouts() {
+	const int kJediCount = 4;
+	const int kEnemyCount = 24;
+	const int kWarmupFrameCount = 30;
+	const int kTrialCount = 64;
+	const float kDt = (1.0f / 30.0f);
+	static CJedi jediList[kJediCount];
+	static CActor enemyActors[kEnemyCount];
+	setupBattleBenchmark(jediList, kJediCount, enemyActors, kEnemyCount, 25.0f);
+	CActor *actorList[kJediCount + kEnemyCount];
+	int actorCount = 0;
+	for (int i = 0; i < kJediCount; ++i) {
+		actorList[actorCount++] = &jediList[i];
+		enemyActors[i].wPos = jediList[i].wPos + CVector(0.0f, 0.0f, 4.0f);
+		enemyActors[i].wBoundsCenter = enemyActors[i].wPos;
+		jediList[i].setCurrentTarget(&enemyActors[i]);
+	}
+	for (int i = 0; i < kEnemyCount; ++i) {
+		actorList[actorCount++] = &enemyActors[i];
+	}
+
+	// let the fight get going, so everyone has something to decide about
+	for (int frame = 0; frame < kWarmupFrameCount; ++frame) {
+		publishSenseBenchmarkWorld(actorList, actorCount, kJediCount, true);
+		gJediAiNavigation.beginFrame();
+		for (int i = 0; i < kJediCount; ++i) {
+			jediList[i].process(kDt);
+		}
+	}
+
+	printf("%-10s %16s %16s %16s\n", "rollouts", "us / decision", "steady choice", "steady judgement");
+	const int rolloutCountTable[] = { 1, 2, 4, 8 };
+	for (int r = 0; r < TR_COUNTOF(rolloutCountTable); ++r) {
+		double elapsedMicroseconds = 0.0;
+		int steadyCount = 0;
+		int judgementCount = 0;
+		int steadyJudgementCount = 0;
+		for (int i = 0; i < kJediCount; ++i) {
+			CJediAiActionCombat &combat = jediList[i].aiCombatAction;
+			combat.selectorParams.rolloutCount = rolloutCountTable[r];
+
+			// decide over and over, counting how often each action is chosen
+			int chosenCountTable[CJediAiActionCombat::eAction_Count + 1];
+			int resultCountTable[CJediAiActionCombat::eAction_Count][eJediAiActionSimResult_Count];
+			memset(chosenCountTable, 0, sizeof(chosenCountTable));
+			memset(resultCountTable, 0, sizeof(resultCountTable));
+			for (int trial = 0; trial < kTrialCount; ++trial) {
+				CJediAiMemory trialMemory(jediList[i].aiMemory);
+				trialMemory.random.fork(jediList[i].aiMemory.random, (unsigned int)trial);
+				double startTime = getTimeMicroseconds();
+				CJediAiAction *action = combat.selectAction(&trialMemory);
+				elapsedMicroseconds += getTimeMicroseconds() - startTime;
+				int chosen = CJediAiActionCombat::eAction_Count;
+				for (int j = 0; j < CJediAiActionCombat::eAction_Count; ++j) {
+					if (combat.actionTable[j] == NULL) {
+						continue;
+					}
+					if (combat.actionTable[j] == action) {
+						chosen = j;
+					}
+					resultCountTable[j][combat.actionTable[j]->simSummary.result]++;
+				}
+				chosenCountTable[chosen]++;
+			}
+			int mostChosenCount = 0;
+			for (int j = 0; j <= CJediAiActionCombat::eAction_Count; ++j) {
+				mostChosenCount = max(mostChosenCount, chosenCountTable[j]);
+			}
+			steadyCount += mostChosenCount;
+			for (int j = 0; j < CJediAiActionCombat::eAction_Count; ++j) {
+				if (combat.actionTable[j] == NULL) {
+					continue;
+				}
+				int mostResultCount = 0;
+				for (int k = 0; k < eJediAiActionSimResult_Count; ++k) {
+					mostResultCount = max(mostResultCount, resultCountTable[j][k]);
+				}
+				steadyJudgementCount += mostResultCount;
+				judgementCount += kTrialCount;
+			}
+			combat.selectorParams.rolloutCount = 0;
+		}
+		printf(
+			"%-10d %16.2f %15.1f%% %15.1f%%\n", rolloutCountTable[r],
+			elapsedMicroseconds / (double)(kJediCount * kTrialCount), 100.0 * (double)steadyCount / (double)(kJediCount * kTrialCount),
+			100.0 * (double)steadyJudgementCount / (double)judgementCount
+		);
+	}
+	gThreatCount = 0;
+}
+
+// compare how long a frame of idle jedi takes when their AI thinks every frame and when it sleeps
+// halfway through, a bolt is fired at one of them, which should only wake that one
+static void benchmarkSleep() {
+	const int kJediCount = 32;
+	const int kFrameCount = 300;
+	const float kDt = (1.0f / 30.0f);
+	static CJedi jediList[kJediCount];
+	CActor *actorList[kJediCount];
+	for (int i = 0; i < kJediCount; ++i) {
+		jediList[i].setup();
+		jediList[i].wPos = CVector((float)i * 3.0f, 0.0f, 0.0f);
+		jediList[i].wBoundsCenter = jediList[i].wPos;
+		actorList[i] = &jediList[i];
+	}
+
+	printf("%-10s %16s %16s %16s\n", "mode", "us / frame", "thinks skipped", "woken by threat");
+	for (int sleeping = 0; sleeping < 2; ++sleeping) {
+		gJediAiWakeScheduler.reset();
+		for (int i = 0; i < kJediCount; ++i) {
+			jediList[i].aiWakeScheduler = (sleeping ? &gJediAiWakeScheduler : NULL);
+			jediList[i].aiSleeper.skippedThinkCount = 0;
+		}
+
+		double elapsedMicroseconds = 0.0;
+		gThreatCount = 0;
+		for (int frame = 0; frame < kFrameCount; ++frame) {
+
+			// fire a bolt at the first jedi
+			if (frame == kFrameCount / 2) {
+				SJediThreatInfo &threat = gThreatList[0];
+				memset(&threat, 0, sizeof(threat));
+				threat.wPos = CVector(0.0f, 0.0f, 20.0f);
+				threat.wEndPos = jediList[0].wPos;
+				threat.iDir = threat.wPos.directionTo(threat.wEndPos);
+				threat.intendedVictim = &jediList[0];
+				threat.type = eJediThreatType_Blaster;
+				threat.attackLevel = eAttackLevel_Light;
+				threat.strength = 10.0f;
+				threat.speed = 30.0f;
+				threat.delayToAttackTime = threat.wPos.distanceTo(threat.wEndPos) / threat.speed;
+				threat.damageRadius = 0.5f;
+				gThreatCount = 1;
+			}
+
+			// publish, wake whoever needs it, then think
+			double startTime = getTimeMicroseconds();
+			gJediAiWorldSnapshotBuffer.publish(actorList, kJediCount, getTime());
+			gJediAiWakeScheduler.update(getTime());
+			gJediAiNavigation.beginFrame();
+			for (int i = 0; i < kJediCount; ++i) {
+				jediList[i].process(kDt);
+			}
+			elapsedMicroseconds += getTimeMicroseconds() - startTime;
+		}
+
+		int skippedThinkCount = 0;
+		for (int i = 0; i < kJediCount; ++i) {
+			skippedThinkCount += jediList[i].aiSleeper.skippedThinkCount;
+		}
+		printf(
+			"%-10s %16.2f %15.1f%% %16d\n", (sleeping ? "sleeping" : "awake"),
+			elapsedMicroseconds / (double)kFrameCount, 100.0 * (double)skippedThinkCount / (double)(kJediCount * kFrameCount), gJediAiWakeScheduler.stats.threatWakeCount
+		);
+	}
+	gThreatCount = 0;
+	gJediAiWakeScheduler.reset();
+}
+
+// compare how long spawning a wave of jedi takes when each is constructed and when each is cloned from a prototype
+// each wave then runs a few frames, so the clones have to think like the real thing
+// every wave reuses the same storage, the way a game would spawn into a pool
+static void benchmarkSpawn() {
+	const int kJediCount = 32;
+	const int kWaveCount = 20;
+	const int kFrameCount = 10;
+	const float kDt = (1.0f / 30.0f);
+	void *storageList[kJediCount];
+	CActor *actorList[kJediCount];
+	for (int i = 0; i < kJediCount; ++i) {
+		storageList[i] = CJediPrototype::allocateStorage();
+	}
+
+	// build the prototype
+	CJediPrototype prototype;
+	double startTime = getTimeMicroseconds();
+	prototype.build();
+	double buildMicroseconds = getTimeMicroseconds() - startTime;
+	printf(
+		"prototype: %d bytes, %d relocations, %d per-instance words, built in %.2f us\n\n",
+		(int)sizeof(CJedi), prototype.relocationCount, prototype.stats.perInstanceWordCount, buildMicroseconds
+	);
+
+	printf("%-12s %16s %16s\n", "mode", "spawn us / jedi", "think us / frame");
+	for (int cloning = 0; cloning < 2; ++cloning) {
+		double spawnMicroseconds = 0.0;
+		double thinkMicroseconds = 0.0;
+		for (int wave = 0; wave < kWaveCount; ++wave) {
+
+			// spawn the wave
+			startTime = getTimeMicroseconds();
+			for (int i = 0; i < kJediCount; ++i) {
+				CJedi *jedi = (cloning ? prototype.clone(storageList[i]) : new (storageList[i]) CJedi());
+				jedi->setup();
+				jedi->wPos = CVector((float)i * 3.0f, 0.0f, 0.0f);
+				jedi->wBoundsCenter = jedi->wPos;
+				actorList[i] = jedi;
+			}
+			spawnMicroseconds += getTimeMicroseconds() - startTime;
+
+			// let it think for a bit
+			startTime = getTimeMicroseconds();
+			for (int frame = 0; frame < kFrameCount; ++frame) {
+				gJediAiWorldSnapshotBuffer.publish(actorList, kJediCount, getTime());
+				gJediAiWakeScheduler.update(getTime());
+				gJediAiNavigation.beginFrame();
+				for (int i = 0; i < kJediCount; ++i) {
+					((CJedi *)actorList[i])->process(kDt);
+				}
+			}
+			thinkMicroseconds += getTimeMicroseconds() - startTime;
+
+			// and get rid of it
+			for (int i = 0; i < kJediCount; ++i) {
+				((CJedi *)actorList[i])->~CJedi();
+			}
+		}
+		printf(
+			"%-12s %16.2f %16.2f\n", (cloning ? "cloned" : "constructed"),
+			spawnMicroseconds / (double)(kWaveCount * kJediCount), thinkMicroseconds / (double)(kWaveCount * kFrameCount)
+		);
+	}
+	for (int i = 0; i < kJediCount; ++i) {
+		CJediPrototype::freeStorage(storageList[i]);
+	}
+}
+
+int main(int argc, char *argv[])
 {
+	// test the math if asked to
+	if (argc > 1 && strcmp(argv[1], "-testmath") == 0) {
+		return (testMath() > 0 ? 1 : 0);
+	}
+
+	// benchmark the simulation if asked to
+	if (argc > 1 && strcmp(argv[1], "-benchsim") == 0) {
+		benchmarkSimulation();
+		return 0;
+	}
+
+	// benchmark sensing if asked to
+	if (argc > 1 && strcmp(argv[1], "-benchsense") == 0) {
+		benchmarkSense();
+		return 0;
+	}
+
+	// benchmark the think pipeline if asked to
+	if (argc > 1 && strcmp(argv[1], "-benchpipeline") == 0) {
+		benchmarkPipeline();
+		return 0;
+	}
+
+	// benchmark engine query batching if asked to
+	if (argc > 1 && strcmp(argv[1], "-benchqueries") == 0) {
+		benchmarkQueries();
+		return 0;
+	}
+
+	// benchmark the planner if asked to
+	if (argc > 1 && strcmp(argv[1], "-benchplanner") == 0) {
+		benchmarkPlanner();
+		return 0;
+	}
+
+	// benchmark monte carlo rollouts if asked to
+	if (argc > 1 && strcmp(argv[1], "-benchrollouts") == 0) {
+		benchmarkRollouts();
+		return 0;
+	}
+
+	// benchmark sleeping AI if asked to
+	if (argc > 1 && strcmp(argv[1], "-benchsleep") == 0) {
+		benchmarkSleep();
+		return 0;
+	}
+
+	// benchmark spawning jedi from a prototype if asked to
+	if (argc > 1 && strcmp(argv[1], "-benchspawn") == 0) {
+		benchmarkSpawn();
+		return 0;
+	}
+
+	// load a navigation grid if we were given one
+	// without one, everywhere is navigable
+	// with -pipeline, the AI thinks on a worker while the rest of the frame runs
+	// with -planner, the jedi engages by planning instead of with its engage tree
+	bool pipelined = false;
+	bool planning = false;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-navgrid") == 0 && i + 1 < argc) {
+			gJediAiNavigation.grid.load(argv[i + 1]);
+		} else if (strcmp(argv[i], "-pipeline") == 0) {
+			pipelined = true;
+		} else if (strcmp(argv[i], "-planner") == 0) {
+			planning = true;
+		}
+	}
+
 	// test the Jedi
 	CJedi jedi;
 	jedi.setup();
-	while (true)
+	if (planning) {
+		jedi.aiCombatAction.setLod(CJediAiActionCombat::eLod_Planner);
+	}
+	CJediAiThinkPipeline pipeline;
+	if (pipelined) {
+		pipeline.addJedi(&jedi);
+	}
+	CActor *actorList[] = { &jedi };
+	while (true) {
+
+		// apply what a pipelined AI thought about last frame
+		pipeline.endThink();
+
+		// publish the world for the AI to sense, then let the AI run
+		// navigation answers from last frame may be out of date, so start a new frame there too
+		// sleeping AI is woken by what was published
+		gJediAiWorldSnapshotBuffer.publish(actorList, TR_COUNTOF(actorList), getTime());
+		gJediAiWakeScheduler.update(getTime());
+		gJediAiNavigation.beginFrame();
 		jedi.process(0.333f);
+		if (pipelined) {
+			pipeline.beginThink(0.333f);
+		}
+	}
 
 	// done
 	return 0;
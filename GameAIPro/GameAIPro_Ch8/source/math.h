@@ -31,8 +31,8 @@ template <typename T> T linterp(T srcMin, T srcMax, T dstMin, T dstMax, T value)
 
 // trig
 inline void sinCos(float &sinAngle, float &cosAngle, float angleInRadians) {
+	sinAngle = sinf(angleInRadians);
 	cosAngle = cosf(angleInRadians);
-	sinAngle = (1.0f - cosAngle);
 }
 
 #endif // __MATH__
@@ -0,0 +1,68 @@
+#ifndef __SPSC_RING__
+#define __SPSC_RING__
+
+#include <atomic>
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// single producer, single consumer ring buffer
+// one thread pushes and one thread pops, without locks
+// entries are copied in and out, so keep them small and plain
+//
+/////////////////////////////////////////////////////////////////////////////
+
+template <class T, int kCapacity>
+class CSpscRing {
+public:
+	enum { eCapacity = kCapacity };
+
+	// entries
+	T entryTable[kCapacity];
+
+	// the indices only ever increase, and wrap through the table with a mask
+	// the producer owns writeIndex and the consumer owns readIndex
+	std::atomic<unsigned int> writeIndex;
+	std::atomic<unsigned int> readIndex;
+
+	// construction
+	CSpscRing() {
+		compileTimeAssert(kCapacity > 0 && (kCapacity & (kCapacity - 1)) == 0);
+		writeIndex.store(0);
+		readIndex.store(0);
+	}
+
+	// push an entry (producer only)
+	// returns false if the ring is full
+	bool push(const T &entry) {
+		unsigned int write = writeIndex.load(std::memory_order_relaxed);
+		unsigned int read = readIndex.load(std::memory_order_acquire);
+		if (write - read >= (unsigned int)kCapacity) {
+			return false;
+		}
+		entryTable[write & (kCapacity - 1)] = entry;
+		writeIndex.store(write + 1, std::memory_order_release);
+		return true;
+	}
+
+	// pop an entry (consumer only)
+	// returns false if the ring is empty
+	bool pop(T &entry) {
+		unsigned int read = readIndex.load(std::memory_order_relaxed);
+		unsigned int write = writeIndex.load(std::memory_order_acquire);
+		if (read == write) {
+			return false;
+		}
+		entry = entryTable[read & (kCapacity - 1)];
+		readIndex.store(read + 1, std::memory_order_release);
+		return true;
+	}
+
+	// how many entries are waiting?
+	// this is only a hint if the other thread is running
+	int getCount() const {
+		return (int)(writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_acquire));
+	}
+};
+
+#endif // __SPSC_RING__
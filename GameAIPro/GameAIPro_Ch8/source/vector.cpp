@@ -6,3 +6,163 @@ CVector kZeroVector(0.0f, 0.0f, 0.0f);
 CVector kUnitVectorX(1.0f, 0.0f, 0.0f);
 CVector kUnitVectorY(0.0f, 1.0f, 0.0f);
 CVector kUnitVectorZ(0.0f, 0.0f, 1.0f);
+
+// simd code loads vectors whole, so make sure they are padded out
+compileTimeAssert(sizeof(CVector) == 16);
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// batch operations
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// get the vector at the given index of a strided list
+static inline CVector &getVectorAt(CVector *vectors, int index, int stride) {
+	return *(CVector*)((char*)vectors + (index * stride));
+}
+static inline const CVector &getVectorAt(const CVector *vectors, int index, int stride) {
+	return *(const CVector*)((const char*)vectors + (index * stride));
+}
+
+#if defined(VECTOR_SSE)
+
+// load four vectors from a strided list and transpose them so that we have
+// all of their x components in one register, all of their y components in another, etc.
+static inline void loadVectors4(const CVector *vectors, int index, int stride, __m128 &xs, __m128 &ys, __m128 &zs) {
+	__m128 a = _mm_loadu_ps(&getVectorAt(vectors, index + 0, stride).x);
+	__m128 b = _mm_loadu_ps(&getVectorAt(vectors, index + 1, stride).x);
+	__m128 c = _mm_loadu_ps(&getVectorAt(vectors, index + 2, stride).x);
+	__m128 d = _mm_loadu_ps(&getVectorAt(vectors, index + 3, stride).x);
+	_MM_TRANSPOSE4_PS(a, b, c, d);
+	xs = a;
+	ys = b;
+	zs = c;
+}
+
+// scale four vectors in a strided list
+// this only touches x, y and z, since the padding may belong to whoever owns the list
+static inline void scaleVectors4(CVector *vectors, int index, int stride, __m128 scales) {
+	float scaleTable[4];
+	_mm_storeu_ps(scaleTable, scales);
+	for (int i = 0; i < 4; ++i) {
+		getVectorAt(vectors, index + i, stride) *= scaleTable[i];
+	}
+}
+
+#endif
+
+void normalizeVectors(CVector *vectors, int count, int stride) {
+	int i = 0;
+#if defined(VECTOR_SSE)
+	for (; i + 4 <= count; i += 4) {
+		__m128 xs, ys, zs;
+		loadVectors4(vectors, i, stride, xs, ys, zs);
+		__m128 lengthSqs = _mm_add_ps(_mm_add_ps(_mm_mul_ps(xs, xs), _mm_mul_ps(ys, ys)), _mm_mul_ps(zs, zs));
+		scaleVectors4(vectors, i, stride, _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSqs)));
+	}
+#endif
+	for (; i < count; ++i) {
+		getVectorAt(vectors, i, stride).normalize();
+	}
+}
+
+void normalizeVectorsFast(CVector *vectors, int count, int stride) {
+	int i = 0;
+#if defined(VECTOR_SSE)
+	const __m128 kHalf = _mm_set1_ps(0.5f);
+	const __m128 kThreeHalves = _mm_set1_ps(1.5f);
+	for (; i + 4 <= count; i += 4) {
+		__m128 xs, ys, zs;
+		loadVectors4(vectors, i, stride, xs, ys, zs);
+		__m128 lengthSqs = _mm_add_ps(_mm_add_ps(_mm_mul_ps(xs, xs), _mm_mul_ps(ys, ys)), _mm_mul_ps(zs, zs));
+
+		// estimate, then refine with one newton-raphson step
+		__m128 r = _mm_rsqrt_ps(lengthSqs);
+		__m128 halfVRR = _mm_mul_ps(_mm_mul_ps(kHalf, lengthSqs), _mm_mul_ps(r, r));
+		r = _mm_mul_ps(r, _mm_sub_ps(kThreeHalves, halfVRR));
+		scaleVectors4(vectors, i, stride, r);
+	}
+#endif
+	for (; i < count; ++i) {
+		getVectorAt(vectors, i, stride).normalizeFast();
+	}
+}
+
+void computeDistances(const CVector &from, const CVector *to, float *distances, int count, int stride) {
+	int i = 0;
+#if defined(VECTOR_SSE)
+	__m128 fromXs = _mm_set1_ps(from.x);
+	__m128 fromYs = _mm_set1_ps(from.y);
+	__m128 fromZs = _mm_set1_ps(from.z);
+	for (; i + 4 <= count; i += 4) {
+		__m128 xs, ys, zs;
+		loadVectors4(to, i, stride, xs, ys, zs);
+		xs = _mm_sub_ps(xs, fromXs);
+		ys = _mm_sub_ps(ys, fromYs);
+		zs = _mm_sub_ps(zs, fromZs);
+		__m128 distanceSqs = _mm_add_ps(_mm_add_ps(_mm_mul_ps(xs, xs), _mm_mul_ps(ys, ys)), _mm_mul_ps(zs, zs));
+		_mm_storeu_ps(&distances[i], _mm_sqrt_ps(distanceSqs));
+	}
+#endif
+	for (; i < count; ++i) {
+		distances[i] = from.distanceTo(getVectorAt(to, i, stride));
+	}
+}
+
+void computeDistancesSq(const CVector &from, const CVector *to, float *distancesSq, int count, int stride) {
+	int i = 0;
+#if defined(VECTOR_SSE)
+	__m128 fromXs = _mm_set1_ps(from.x);
+	__m128 fromYs = _mm_set1_ps(from.y);
+	__m128 fromZs = _mm_set1_ps(from.z);
+	for (; i + 4 <= count; i += 4) {
+		__m128 xs, ys, zs;
+		loadVectors4(to, i, stride, xs, ys, zs);
+		xs = _mm_sub_ps(xs, fromXs);
+		ys = _mm_sub_ps(ys, fromYs);
+		zs = _mm_sub_ps(zs, fromZs);
+		_mm_storeu_ps(&distancesSq[i], _mm_add_ps(_mm_add_ps(_mm_mul_ps(xs, xs), _mm_mul_ps(ys, ys)), _mm_mul_ps(zs, zs)));
+	}
+#endif
+	for (; i < count; ++i) {
+		distancesSq[i] = from.distanceSqTo(getVectorAt(to, i, stride));
+	}
+}
+
+void computeXzDistances(const CVector &from, const CVector *to, float *distances, int count, int stride) {
+	int i = 0;
+#if defined(VECTOR_SSE)
+	__m128 fromXs = _mm_set1_ps(from.x);
+	__m128 fromZs = _mm_set1_ps(from.z);
+	for (; i + 4 <= count; i += 4) {
+		__m128 xs, ys, zs;
+		loadVectors4(to, i, stride, xs, ys, zs);
+		xs = _mm_sub_ps(xs, fromXs);
+		zs = _mm_sub_ps(zs, fromZs);
+		__m128 distanceSqs = _mm_add_ps(_mm_mul_ps(xs, xs), _mm_mul_ps(zs, zs));
+		_mm_storeu_ps(&distances[i], _mm_sqrt_ps(distanceSqs));
+	}
+#endif
+	for (; i < count; ++i) {
+		distances[i] = from.xzDistanceTo(getVectorAt(to, i, stride));
+	}
+}
+
+void computeDotProducts(const CVector &v, const CVector *others, float *dotProducts, int count, int stride) {
+	int i = 0;
+#if defined(VECTOR_SSE)
+	__m128 vXs = _mm_set1_ps(v.x);
+	__m128 vYs = _mm_set1_ps(v.y);
+	__m128 vZs = _mm_set1_ps(v.z);
+	for (; i + 4 <= count; i += 4) {
+		__m128 xs, ys, zs;
+		loadVectors4(others, i, stride, xs, ys, zs);
+		__m128 dots = _mm_add_ps(_mm_add_ps(_mm_mul_ps(xs, vXs), _mm_mul_ps(ys, vYs)), _mm_mul_ps(zs, vZs));
+		_mm_storeu_ps(&dotProducts[i], dots);
+	}
+#endif
+	for (; i < count; ++i) {
+		dotProducts[i] = v.dotProduct(getVectorAt(others, i, stride));
+	}
+}
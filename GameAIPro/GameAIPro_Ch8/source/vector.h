@@ -5,6 +5,51 @@
 	#include "math.h"
 #endif
 
+// figure out which simd instruction set we can use
+// anything else falls back to scalar code
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+	#define VECTOR_SSE
+	#include <xmmintrin.h>
+#elif defined(_M_ARM) || defined(_M_ARM64) || defined(__ARM_NEON)
+	#define VECTOR_NEON
+	#include <arm_neon.h>
+#endif
+
+// vectors are padded out to 16 bytes and aligned so that simd code can load them whole
+#if defined(_MSC_VER)
+	#define VECTOR_ALIGN __declspec(align(16))
+#else
+	#define VECTOR_ALIGN __attribute__((aligned(16)))
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// fast reciprocal square root
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// approximately 1/sqrt(value), accurate to about 22 bits
+// use this where speed matters more than the last bit of precision
+inline float fastInvSqrt(float value) {
+#if defined(VECTOR_SSE)
+	__m128 v = _mm_set_ss(value);
+	__m128 r = _mm_rsqrt_ss(v);
+
+	// one newton-raphson step: r * (1.5 - 0.5 * v * r * r)
+	__m128 halfVRR = _mm_mul_ss(_mm_mul_ss(_mm_set_ss(0.5f), v), _mm_mul_ss(r, r));
+	r = _mm_mul_ss(r, _mm_sub_ss(_mm_set_ss(1.5f), halfVRR));
+	return _mm_cvtss_f32(r);
+#elif defined(VECTOR_NEON)
+	float32x2_t v = vdup_n_f32(value);
+	float32x2_t r = vrsqrte_f32(v);
+	r = vmul_f32(r, vrsqrts_f32(vmul_f32(v, r), r));
+	return vget_lane_f32(r, 0);
+#else
+	return 1.0f / sqrtf(value);
+#endif
+}
+
 
 /////////////////////////////////////////////////////////////////////////////
 //
@@ -12,7 +57,7 @@
 //
 /////////////////////////////////////////////////////////////////////////////
 
-class CVector {
+class VECTOR_ALIGN CVector {
 public:
 
 	// vector components
@@ -39,7 +84,7 @@ public:
 		x = y = z = 0.0f;
 	}
 	void set(float x, float y, float z) {
-		x = x; y = y; z = z;
+		this->x = x; this->y = y; this->z = z;
 	}
 	float dotProduct(const CVector &v) const {
 		return (x*v.x) + (y*v.y) + (z*v.z);
@@ -48,16 +93,16 @@ public:
 		return CVector((y*v.z) - (z*v.y), (z*v.x) - (x*v.z), (x*v.y) - (y*v.x));
 	}
 	float distanceSqTo(const CVector &v) const {
-		return (x*v.x) + (y*v.y) + (z*v.z);
+		return SQ(v.x - x) + SQ(v.y - y) + SQ(v.z - z);
 	}
 	float distanceTo(const CVector &v) const {
-		return sqrtf((x*v.x) + (y*v.y) + (z*v.z));
+		return sqrtf(distanceSqTo(v));
 	}
 	float xzDistanceSqTo(const CVector &v) const {
-		return (x*v.x) + (z*v.z);
+		return SQ(v.x - x) + SQ(v.z - z);
 	}
 	float xzDistanceTo(const CVector &v) const {
-		return sqrtf((x*v.x) + (z*v.z));
+		return sqrtf(xzDistanceSqTo(v));
 	}
 	float lengthSq() const {
 		return (x*x) + (y*y) + (z*z);
@@ -66,10 +111,13 @@ public:
 		return sqrtf((x*x) + (y*y) + (z*z));
 	}
 	void setLength(float length) {
-		length *= sqrtf((x*x) + (y*y) + (z*z));
-		x /= length;
-		y /= length;
-		z /= length;
+		float currentLength = sqrtf((x*x) + (y*y) + (z*z));
+		if (currentLength > 0.0f) {
+			float scale = length / currentLength;
+			x *= scale;
+			y *= scale;
+			z *= scale;
+		}
 	}
 	CVector &normalize() {
 		float length = sqrtf((x*x) + (y*y) + (z*z));
@@ -78,25 +126,41 @@ public:
 		z /= length;
 		return *this;
 	}
+	CVector &normalizeFast() {
+		float invLength = fastInvSqrt((x*x) + (y*y) + (z*z));
+		x *= invLength;
+		y *= invLength;
+		z *= invLength;
+		return *this;
+	}
 	CVector directionTo(const CVector &v) const {
-		float dist = sqrtf((x*v.x) + (y*v.y) + (z*v.z));
+		return directionTo(v, distanceTo(v));
+	}
+	CVector directionTo(const CVector &v, float distance) const {
+		if (distance <= 0.0f) {
+			return CVector(0.0f, 0.0f, 0.0f);
+		}
 		return CVector(
-			(v.x - x) / dist,
-			(v.y - y) / dist,
-			(v.z - z) / dist
+			(v.x - x) / distance,
+			(v.y - y) / distance,
+			(v.z - z) / distance
 		);
 	}
 	CVector xzDirectionTo(const CVector &v) const {
-		float dist = sqrtf((x*v.x) + (z*v.z));
+		return xzDirectionTo(v, xzDistanceTo(v));
+	}
+	CVector xzDirectionTo(const CVector &v, float xzDistance) const {
+		if (xzDistance <= 0.0f) {
+			return CVector(0.0f, 0.0f, 0.0f);
+		}
 		return CVector(
-			(v.x - x) / dist,
+			(v.x - x) / xzDistance,
 			0.0f,
-			(v.z - z) / dist
+			(v.z - z) / xzDistance
 		);
 	}
 	bool isCloseTo(const CVector &v, float maxOffset) const {
-		float distSq = (x*v.x) + (y*v.y) + (z*v.z);
-		return (distSq <= SQ(maxOffset));
+		return (distanceSqTo(v) <= SQ(maxOffset));
 	}
 };
 
@@ -111,6 +175,16 @@ inline CVector operator/ (const CVector &a, float s) { return CVector(a.x/s, a.y
 inline CVector operator/ (float s, const CVector &a) { return CVector(s/a.x, s/a.y, s/a.z); }
 inline CVector operator- (const CVector &a) { return CVector(-a.x, -a.y, -a.z); }
 
+// batch operations
+// 'stride' is the number of bytes from one vector to the next, so these can run
+// straight over a member of an array of structs (e.g. &stateList[0].wPos, sizeof(stateList[0]))
+void normalizeVectors(CVector *vectors, int count, int stride = sizeof(CVector));
+void normalizeVectorsFast(CVector *vectors, int count, int stride = sizeof(CVector));
+void computeDistances(const CVector &from, const CVector *to, float *distances, int count, int stride = sizeof(CVector));
+void computeDistancesSq(const CVector &from, const CVector *to, float *distancesSq, int count, int stride = sizeof(CVector));
+void computeXzDistances(const CVector &from, const CVector *to, float *distances, int count, int stride = sizeof(CVector));
+void computeDotProducts(const CVector &v, const CVector *others, float *dotProducts, int count, int stride = sizeof(CVector));
+
 // constants
 extern CVector kZeroVector;
 extern CVector kUnitVectorX;